@@ -31,6 +31,7 @@
 #include <donut/engine/DescriptorTableManager.h>
 #include <donut/engine/BindingCache.h>
 #include <donut/app/DeviceManager.h>
+#include <donut/app/imgui_renderer.h>
 #include <donut/core/log.h>
 #include <donut/core/vfs/VFS.h>
 #include <donut/core/math/math.h>
@@ -40,6 +41,28 @@
 #include "ffx_a.h"
 #include "ffx_fsr1.h"
 
+#include "camera_trail.h"
+#include "culling.h"
+#include "AsyncFrameCapture.h"
+#include "CpuTssResolve.h"
+#include "RenderTargetPool.h"
+#include "UploadRing.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <limits>
+#include <map>
+#include <sstream>
+#include <thread>
+
+#ifdef DONUT_WITH_TASKFLOW
+#include <taskflow/taskflow.hpp>
+#endif
+
 using namespace donut;
 using namespace donut::math;
 
@@ -55,16 +78,142 @@ struct FSRConstants
     uint32_t4 Const1;
     uint32_t4 Const2;
     uint32_t4 Const3;
-    uint32_t4 Sample;
+    uint32_t4 Sample;    // x: square the output, y: sharpen with RCAS
+    uint32_t4 RcasConst;
+};
+
+// Render target traffic that the fused FSR dispatch avoids, in bytes per frame. The separate passes copied the
+// jittered color into their input, and wrote and read back the EASU output and, with RCAS, the RCAS output
+// before copying it into the color buffer. All of them are RGBA16_FLOAT.
+static uint64_t GetFusedFsrBandwidthSaving(uint32_t displayWidth, uint32_t displayHeight, uint32_t renderWidth, uint32_t renderHeight, bool rcas)
+{
+    const uint64_t bytesPerPixel = 8;
+    uint64_t inputCopy = 2 * uint64_t(renderWidth) * renderHeight * bytesPerPixel;
+    uint64_t displayPass = uint64_t(displayWidth) * displayHeight * bytesPerPixel;
+    return inputCopy + (rcas ? 4 : 2) * displayPass;
+}
+
+static const char* GetAAModeName(int mode)
+{
+    switch (mode)
+    {
+    case NATIVE_RESOLUTION: return "NATIVE";
+    case NATIVE_WITH_TAA: return "NATIVE TAA";
+    case RAW_UPSCALED: return "UPSCALED";
+    case TEMPORAL_SUPERSAMPLING: return "TSS";
+    case TEMPORAL_ANTIALIASING: return "TAA";
+    case FSR_WITHOUT_RCAS: return "FSR (Unsharpened)";
+    case FSR_WITH_RCAS: return "FSR (Sharpened)";
+    default: return "";
+    }
+}
+
+struct BindlessRenderingOptions
+{
+    std::string trailFileName = "camera_trail.bin";
+    bool quantizeTrail = true;
+
+    // Batch replay: the trail is replayed once per AA mode, and every mode is compared against the first one
+    std::string replayFileName;
+    std::vector<int> replayModes;
+    std::string replayStatsFileName = "replay_stats.csv";
+    int diffInterval = 30;
+
+    // Extension of the frames written by the C key and by interactive replay: png, bmp, exr or raw
+    std::string captureFormat = "png";
+
+    // Main pass draw recording; 0 threads means one per hardware thread.
+    // Indirect draws take precedence, multithreaded recording applies to the per-geometry draw loop.
+    bool indirectDraws = true;
+    bool multithreadedRecording = true;
+    int recordingThreads = 0;
+
+    // GPU culling of the indirect draw list; occlusion uses the HZB built from the previous frame's depth
+    bool frustumCulling = true;
+    bool occlusionCulling = true;
+
+    // Resolve TSS with the groupshared-tiled compute shader instead of the full-screen pixel shader
+    bool computeTSS = false;
+
+    // Graphics pipelines survive a resize when the framebuffer formats are unchanged. The NVRHI validation
+    // layer also requires the framebuffer size to match the pipeline, so they are recreated when it is enabled.
+    bool pipelinesMatchFramebufferSize = false;
+};
+
+struct CullingStats
+{
+    bool valid = false;
+    uint32_t drawCount = 0;
+    uint32_t counts[CULL_STAT_COUNT] = {};
+};
+
+struct RecordingChunkStats
+{
+    uint32_t threadIndex = 0;
+    uint32_t instanceCount = 0;
+    uint32_t drawCount = 0;
+    double recordTimeMs = 0.0;
+};
+
+struct MainPassRecordingStats
+{
+    bool indirect = false;
+    uint32_t updatedDraws = 0; // indirect records rewritten this frame
+    CullingStats culling;      // read back a few frames late
+    bool multithreaded = false;
+    uint32_t threadCount = 1;
+    double totalTimeMs = 0.0; // from the start of recording until every chunk is closed
+    std::vector<RecordingChunkStats> chunks;
+};
+
+// Stages of a frame, timed on the CPU while recording and on the GPU with timer queries
+enum FrameStage { FRAME_STAGE_MAIN_PASS, FRAME_STAGE_RESOLVE, FRAME_STAGE_OUTPUT, FRAME_STAGE_COUNT };
+
+static const char* GetFrameStageName(int stage)
+{
+    switch (stage)
+    {
+    case FRAME_STAGE_MAIN_PASS: return "Main pass";
+    case FRAME_STAGE_RESOLVE: return "TSS / FSR";
+    case FRAME_STAGE_OUTPUT: return "Output";
+    default: return "";
+    }
+}
+
+// Timer queries around the stages of one frame, resolved a few frames later
+struct FrameStageTimers
+{
+    nvrhi::TimerQueryHandle queries[FRAME_STAGE_COUNT];
+    bool pending = false;
+};
+
+struct FrameStageStats
+{
+    double cpuTimeMs[FRAME_STAGE_COUNT] = {}; // recording, this frame
+    double gpuTimeMs[FRAME_STAGE_COUNT] = {}; // from the most recent frame whose timers are resolved
+    double submitTimeMs = 0.0;                // CPU time spent in executeCommandLists
+    uint32_t submissions = 0;                 // executeCommandLists calls per frame
+    uint32_t commandLists = 0;                // command lists in those calls
+    uint64_t trafficBytes[FRAME_STAGE_COUNT] = {}; // written by clears, copies, blits and resolves, plus copy and blit reads
 };
 
-struct CameraRolling
+static uint64_t GetTextureBytes(nvrhi::ITexture* texture)
+{
+    const nvrhi::TextureDesc& desc = texture->getDesc();
+    return uint64_t(desc.width) * desc.height * nvrhi::getFormatInfo(desc.format).bytesPerBlock;
+}
+
+struct ReplayModeStats
 {
-    dm::float3 pos;
-    dm::float3 dir;
-    dm::float3 up;
-    CameraRolling() {}
-    CameraRolling(const dm::float3& pos, const dm::float3& dir, const dm::float3& up) : pos(pos), dir(dir), up(up) {}
+    int mode = 0;
+    uint32_t frames = 0;
+    double cpuTimeSum = 0.0;
+    double cpuTimeMax = 0.0;
+    double frameIntervalSum = 0.0;
+    uint32_t frameIntervals = 0;
+    double squaredErrorSum = 0.0;
+    uint64_t comparedSamples = 0;
+    uint32_t comparedFrames = 0;
 };
 
 class BindlessRendering : public app::ApplicationBase
@@ -73,6 +222,9 @@ private:
 	std::shared_ptr<vfs::RootFileSystem> m_RootFS;
 
     nvrhi::CommandListHandle m_CommandList;
+    // With multithreaded recording, the frame is recorded into the two lists around the chunks;
+    // they trade places every frame
+    nvrhi::CommandListHandle m_PrologueCommandList;
     
     nvrhi::BindingLayoutHandle m_BindlessLayout;
 
@@ -80,17 +232,18 @@ private:
     nvrhi::BindingLayoutHandle m_MotionBindingLayout;
     nvrhi::BindingLayoutHandle m_UpsampleBindingLayout;
     nvrhi::BindingLayoutHandle m_TSSBindingLayout;
-    nvrhi::BindingLayoutHandle m_EASUBindingLayout;
-    nvrhi::BindingLayoutHandle m_RCASBindingLayout;
+    nvrhi::BindingLayoutHandle m_TSSComputeBindingLayout;
+    nvrhi::BindingLayoutHandle m_FSRBindingLayout;
     
     nvrhi::BindingSetHandle m_RenderBindingSet;
     nvrhi::BindingSetHandle m_MotionBindingSet;
     nvrhi::BindingSetHandle m_UpsampleBindingSet;
-    nvrhi::BindingSetHandle m_TSSBindingSet;
-    nvrhi::BindingSetHandle m_EASUBindingSet;
-    nvrhi::BindingSetHandle m_RCASBindingSet;
+    nvrhi::BindingSetHandle m_TSSBindingSets[2];        // indexed by m_HistoryIndex
+    nvrhi::BindingSetHandle m_TSSComputeBindingSets[2];
+    nvrhi::BindingSetHandle m_FSRBindingSet;
 
     nvrhi::ShaderHandle m_RenderVertexShader;
+    nvrhi::ShaderHandle m_RenderIndirectVertexShader;
     nvrhi::ShaderHandle m_RenderPixelShader;
     nvrhi::ShaderHandle m_MotionVertexShader;
     nvrhi::ShaderHandle m_MotionPixelShader;
@@ -98,40 +251,44 @@ private:
     nvrhi::ShaderHandle m_UpsamplePixelShader;
     nvrhi::ShaderHandle m_TSSVertexShader;
     nvrhi::ShaderHandle m_TSSPixelShaderPost;
-    nvrhi::ShaderHandle m_EASUComputePassShader;
-    nvrhi::ShaderHandle m_RCASComputePassShader;
+    nvrhi::ShaderHandle m_TSSComputeShader;
+    nvrhi::ShaderHandle m_FSRComputeShader;
 
     nvrhi::GraphicsPipelineHandle m_RenderPipeline;
+    nvrhi::GraphicsPipelineHandle m_RenderIndirectPipeline;
+    nvrhi::InputLayoutHandle m_DrawIdInputLayout;
     nvrhi::GraphicsPipelineHandle m_TSSPipeline;
 
-    nvrhi::ComputePipelineHandle m_EASUPipeline;
-    nvrhi::ComputePipelineHandle m_RCASPipeline;
+    nvrhi::ComputePipelineHandle m_TSSComputePipeline;
+    nvrhi::ComputePipelineHandle m_FSRPipeline;
 
     nvrhi::BufferHandle m_SamplingRate;
     nvrhi::BufferHandle m_FrameIndex;
     nvrhi::BufferHandle m_ThisFrameViewConstants;
     nvrhi::BufferHandle m_LastFrameViewConstants;
     nvrhi::BufferHandle m_FSRConstants;
+
+    //Per-frame data is copied through a persistently mapped ring into static buffers, once per frame
+    //instead of once per recording command list. The main pass has its own copies of the view constants
+    //and sampling rate because the TSS pass rewrites the volatile ones at the upsampled resolution.
+    std::unique_ptr<UploadRing> m_UploadRing;
+    UploadRing::Context m_UploadContext;
+    nvrhi::BufferHandle m_MainPassViewConstants;
+    nvrhi::BufferHandle m_MainPassSamplingRate;
     
     //High-res
     nvrhi::TextureHandle m_ColorBuffer;
-    nvrhi::TextureHandle m_ColorBufferBackup;
-    nvrhi::TextureHandle m_FSROutputBuffer;//rcas output
-    nvrhi::TextureHandle m_HistoryColor;
+    //TSS history, ping-ponged: the resolve reads m_HistoryColors[m_HistoryIndex ^ 1] and writes
+    //m_HistoryColors[m_HistoryIndex], which becomes the history of the next frame without a copy
+    nvrhi::TextureHandle m_HistoryColors[2];
+    uint32_t m_HistoryIndex = 0;
     //High-res, but UAV
     nvrhi::TextureHandle m_ValidSampleCount;
     nvrhi::TextureHandle m_FirstOrderMomentum;
     nvrhi::TextureHandle m_SecondOrderMomentum;
     
-    nvrhi::TextureHandle m_FSRIntermediateBuffer;//easu output, rcas input
-    nvrhi::TextureHandle m_SSColorBuffer;
-    nvrhi::TextureHandle m_SSNormalBuffer;
-    nvrhi::TextureHandle m_SSHistoryNormal;
-    nvrhi::TextureHandle m_SSMotionVector;
-    
     //Low-res
     nvrhi::TextureHandle m_JitteredColor;
-    nvrhi::TextureHandle m_FSRInputBuffer;//Use this one as easu input
     nvrhi::TextureHandle m_NormalBuffer;
     nvrhi::TextureHandle m_HistoryNormal;
     nvrhi::TextureHandle m_RenderMotionVector;
@@ -140,12 +297,13 @@ private:
     nvrhi::TextureHandle m_DepthBuffer;
     
     nvrhi::FramebufferHandle m_RenderFramebuffer;
-    nvrhi::FramebufferHandle m_TSSFramebuffer;
+    nvrhi::FramebufferHandle m_TSSFramebuffers[2];      // indexed by m_HistoryIndex
    
     std::shared_ptr<engine::ShaderFactory> m_ShaderFactory;
     std::unique_ptr<engine::Scene> m_Scene;
     std::shared_ptr<engine::DescriptorTableManager> m_DescriptorTableManager;
     std::unique_ptr<engine::BindingCache> m_BindingCache;
+    std::unique_ptr<RenderTargetPool> m_RenderTargetPool;
 
     app::FirstPersonCamera m_Camera;
     engine::PlanarView m_View;
@@ -156,19 +314,105 @@ private:
     float m_slidingSamplingRate = 1.0f / 4.0f;
     float m_WallclockTime = 0.f;
 
-    //Side by side records
-    std::vector<CameraRolling> camTrails;
+    //Side by side records, streamed to and mapped from m_Options.trailFileName
+    BindlessRenderingOptions m_Options;
+    CameraTrailWriter m_TrailWriter;
+    CameraTrailReader m_TrailReader;
     size_t currentFrameIndex;
-    size_t recordedFrameIndex;
-    static const size_t maximalFrameIndex = 5 * 60 * 120;
     bool bRecordCurrentTrajectory;
     bool bReplayCapturedFrame;
 
-    void setCamera()
+    //Batch replay over m_Options.replayModes
+    bool m_BatchReplay = false;
+    size_t m_BatchModeIndex = 0;
+    std::vector<ReplayModeStats> m_BatchStats;
+    std::chrono::high_resolution_clock::time_point m_LastFrameStart;
+
+    // Compared frames are copied into a ring of staging textures and read back once the GPU is done
+    // with them. The reference mode streams its frames as 8-bit RGB to m_ReferenceFile.
+    struct DiffReadback
     {
-        m_Camera.SetPosition(camTrails[currentFrameIndex].pos);
-        m_Camera.SetDir(camTrails[currentFrameIndex].dir);
-        m_Camera.SetUp(camTrails[currentFrameIndex].up);
+        nvrhi::StagingTextureHandle stagingTexture;
+        nvrhi::EventQueryHandle query;
+        size_t frameIndex = 0;
+        size_t modeIndex = 0;
+        bool pending = false;
+    };
+    std::vector<DiffReadback> m_DiffReadbacks;
+    size_t m_DiffReadbackIndex = 0;
+    std::filesystem::path m_ReferenceFileName;
+    std::fstream m_ReferenceFile;
+    std::map<size_t, uint64_t> m_ReferenceOffsets;
+
+    std::unique_ptr<AsyncFrameCapture> m_FrameCapture;
+    bool m_CaptureRequested = false;
+    bool m_TssCaptureRequested = false;
+
+    //Main pass recording: instances are split into chunks that are recorded into separate command lists
+    struct MainPassConstants
+    {
+        PlanarViewConstants thisView;
+        PlanarViewConstants lastView;
+        float samplingRate;
+        int2 frameStatus;
+    };
+    MainPassConstants m_MainPassConstants = {};
+    std::vector<nvrhi::CommandListHandle> m_ChunkCommandLists;
+    std::vector<std::thread::id> m_RecordingThreadIds;
+    MainPassRecordingStats m_RecordingStats;
+
+    //Indirect main pass: one DrawIndirectArguments and one DrawRecord per geometry, kept across frames
+    //and only rebuilt when the scene structure changes
+    nvrhi::BufferHandle m_DrawArgumentsBuffer;
+    nvrhi::BufferHandle m_DrawRecordBuffer;
+    nvrhi::BufferHandle m_DrawIdBuffer;
+    size_t m_DrawCapacity = 0;
+    std::vector<DrawRecord> m_DrawRecords;
+    std::vector<nvrhi::DrawIndirectArguments> m_DrawArguments;
+    std::vector<DrawRecord> m_NewDrawRecords;
+    std::vector<nvrhi::DrawIndirectArguments> m_NewDrawArguments;
+    size_t m_DrawListInstanceCount = 0;
+    bool m_DrawListDirty = true;
+
+    //Culling: cull.hlsl compacts the visible draws of the list into m_CulledDrawArgumentsBuffer,
+    //hzb.hlsl reduces the depth buffer for the occlusion test of the next frame
+    nvrhi::ShaderHandle m_CullComputeShader;
+    nvrhi::ShaderHandle m_HzbComputeShader;
+    nvrhi::BindingLayoutHandle m_CullBindingLayout;
+    nvrhi::BindingLayoutHandle m_HzbBindingLayout;
+    nvrhi::BindingSetHandle m_CullBindingSet;
+    std::vector<nvrhi::BindingSetHandle> m_HzbBindingSets; // one per HZB level
+    nvrhi::ComputePipelineHandle m_CullPipeline;
+    nvrhi::ComputePipelineHandle m_HzbPipeline;
+    nvrhi::BufferHandle m_CullingConstants;
+    nvrhi::BufferHandle m_CulledDrawArgumentsBuffer;
+    nvrhi::BufferHandle m_CullStatsBuffer;
+    nvrhi::TextureHandle m_Hzb;
+    float4x4 m_HzbWorldToClip;
+    bool m_HzbValid = false;
+
+    struct CullStatsReadback
+    {
+        nvrhi::BufferHandle buffer;
+        nvrhi::EventQueryHandle query;
+        uint32_t drawCount = 0;
+        bool pending = false;
+    };
+    std::vector<CullStatsReadback> m_CullStatsReadbacks;
+    size_t m_CullStatsReadbackIndex = 0;
+
+    std::vector<FrameStageTimers> m_FrameStageTimers;
+    size_t m_FrameStageTimerIndex = 0;
+    FrameStageStats m_FrameStageStats;
+#ifdef DONUT_WITH_TASKFLOW
+    std::unique_ptr<tf::Executor> m_Executor;
+#endif
+
+    void setCamera(const CameraRolling& roll)
+    {
+        m_Camera.SetPosition(roll.pos);
+        m_Camera.SetDir(roll.dir);
+        m_Camera.SetUp(roll.up);
         m_Camera.UpdateWorldToView();
     }
 
@@ -180,11 +424,10 @@ private:
 public:
     using ApplicationBase::ApplicationBase;
 
-    bool Init()
+    bool Init(const BindlessRenderingOptions& options)
     {
+        m_Options = options;
         currentFrameIndex = 0;
-        recordedFrameIndex = 0;
-        camTrails.resize(maximalFrameIndex);
         bRecordCurrentTrajectory = false;
         bReplayCapturedFrame = false;
 
@@ -199,8 +442,18 @@ public:
 		m_ShaderFactory = std::make_shared<engine::ShaderFactory>(GetDevice(), m_RootFS, "/shaders");
 		m_CommonPasses = std::make_shared<engine::CommonRenderPasses>(GetDevice(), m_ShaderFactory);
         m_BindingCache = std::make_unique<engine::BindingCache>(GetDevice());
+        m_RenderTargetPool = std::make_unique<RenderTargetPool>(GetDevice());
 
         m_RenderVertexShader = m_ShaderFactory->CreateShader("/shaders/app/bindless_rendering.hlsl", "vs_main", nullptr, nvrhi::ShaderType::Vertex);
+        m_RenderIndirectVertexShader = m_ShaderFactory->CreateShader("/shaders/app/bindless_rendering.hlsl", "vs_main_indirect", nullptr, nvrhi::ShaderType::Vertex);
+
+        nvrhi::VertexAttributeDesc drawIdAttribute;
+        drawIdAttribute.name = "DRAW_ID";
+        drawIdAttribute.format = nvrhi::Format::R32_UINT;
+        drawIdAttribute.bufferIndex = 0;
+        drawIdAttribute.elementStride = sizeof(uint32_t);
+        drawIdAttribute.isInstanced = true;
+        m_DrawIdInputLayout = GetDevice()->createInputLayout(&drawIdAttribute, 1, m_RenderIndirectVertexShader);
         m_RenderPixelShader = m_ShaderFactory->CreateShader("/shaders/app/bindless_rendering.hlsl", "ps_main", nullptr, nvrhi::ShaderType::Pixel);
         m_MotionVertexShader = m_ShaderFactory->CreateShader("/shaders/app/motion_vector.hlsl", "vs_main", nullptr, nvrhi::ShaderType::Vertex);
         m_MotionPixelShader = m_ShaderFactory->CreateShader("/shaders/app/motion_vector.hlsl", "ps_main", nullptr, nvrhi::ShaderType::Pixel);
@@ -209,10 +462,11 @@ public:
         m_TSSVertexShader = m_ShaderFactory->CreateShader("/shaders/app/tss.hlsl", "vs_main", nullptr, nvrhi::ShaderType::Vertex);
         m_TSSPixelShaderPost = m_ShaderFactory->CreateShader("/shaders/app/tss.hlsl", "ps_main", nullptr, nvrhi::ShaderType::Pixel);
 
-        std::vector<engine::ShaderMacro> defines = { { "SAMPLE_EASU", "1" }, { "SAMPLE_RCAS", "0" } };
-        m_EASUComputePassShader = m_ShaderFactory->CreateShader("/shaders/app/fsr_easu.hlsl", "mainCS", &defines, nvrhi::ShaderType::Compute);
-        defines = { { "SAMPLE_EASU", "0" }, { "SAMPLE_RCAS", "1" } };
-        m_RCASComputePassShader = m_ShaderFactory->CreateShader("/shaders/app/fsr_rcas.hlsl", "mainCS", &defines, nvrhi::ShaderType::Compute);
+        std::vector<engine::ShaderMacro> defines = { { "TSS_COMPUTE", "1" } };
+        m_TSSComputeShader = m_ShaderFactory->CreateShader("/shaders/app/tss.hlsl", "cs_main", &defines, nvrhi::ShaderType::Compute);
+        m_FSRComputeShader = m_ShaderFactory->CreateShader("/shaders/app/fsr.hlsl", "mainCS", nullptr, nvrhi::ShaderType::Compute);
+        m_CullComputeShader = m_ShaderFactory->CreateShader("/shaders/app/cull.hlsl", "main", nullptr, nvrhi::ShaderType::Compute);
+        m_HzbComputeShader = m_ShaderFactory->CreateShader("/shaders/app/hzb.hlsl", "main", nullptr, nvrhi::ShaderType::Compute);
 
         nvrhi::BindlessLayoutDesc bindlessLayoutDesc;
         bindlessLayoutDesc.visibility = nvrhi::ShaderType::All;
@@ -231,26 +485,198 @@ public:
         m_TextureCache = std::make_shared<engine::TextureCache>(GetDevice(), nativeFS, m_DescriptorTableManager);
 
         m_CommandList = GetDevice()->createCommandList();
+        m_PrologueCommandList = GetDevice()->createCommandList();
+
+        m_FrameStageTimers.resize(4);
+        for (FrameStageTimers& timers : m_FrameStageTimers)
+        {
+            for (auto& query : timers.queries)
+                query = GetDevice()->createTimerQuery();
+        }
+
+        // Room for the seven textures of a TSS capture and a frame capture in the same frame
+        m_FrameCapture = std::make_unique<AsyncFrameCapture>(GetDevice(), 8);
+
+#ifdef DONUT_WITH_TASKFLOW
+        if (m_Options.recordingThreads > 0)
+            m_Executor = std::make_unique<tf::Executor>(size_t(m_Options.recordingThreads));
+        else
+            m_Executor = std::make_unique<tf::Executor>();
+
+        m_ChunkCommandLists.resize(m_Executor->num_workers());
+        for (auto& commandList : m_ChunkCommandLists)
+        {
+            commandList = GetDevice()->createCommandList(nvrhi::CommandListParameters()
+                .setEnableImmediateExecution(false));
+        }
+#else
+        m_Options.multithreadedRecording = false;
+#endif
         
         SetAsynchronousLoadingEnabled(false);
         BeginLoadingScene(nativeFS, sceneFileName);
 
         m_Scene->FinishedLoading(GetFrameIndex());
 
+        // The draw list is uploaded on the first frame; create the buffers now so that the binding set can reference them
+        size_t drawCount = 0;
+        for (const auto& instance : m_Scene->GetSceneGraph()->GetMeshInstances())
+            drawCount += instance->GetMesh()->geometries.size();
+        m_CommandList->open();
+        createIndirectDrawBuffers(m_CommandList, drawCount);
+        m_CommandList->close();
+        GetDevice()->executeCommandList(m_CommandList);
+
         m_Camera.LookAt(float3(0.f, 1.8f, 0.f), float3(1.f, 1.8f, 0.f));
         m_Camera.SetMoveSpeed(3.f);
 
         m_SamplingRate = GetDevice()->createBuffer(nvrhi::utils::CreateVolatileConstantBufferDesc(sizeof(float), "SamplingRate", engine::c_MaxRenderPassConstantBufferVersions));
-        m_FrameIndex = GetDevice()->createBuffer(nvrhi::utils::CreateVolatileConstantBufferDesc(sizeof(int), "FrameIndex", engine::c_MaxRenderPassConstantBufferVersions));
+        m_FrameIndex = GetDevice()->createBuffer(nvrhi::utils::CreateStaticConstantBufferDesc(sizeof(int2), "FrameIndex"));
         m_ThisFrameViewConstants = GetDevice()->createBuffer(nvrhi::utils::CreateVolatileConstantBufferDesc(sizeof(PlanarViewConstants), "ViewConstants", engine::c_MaxRenderPassConstantBufferVersions));
-        m_LastFrameViewConstants = GetDevice()->createBuffer(nvrhi::utils::CreateVolatileConstantBufferDesc(sizeof(PlanarViewConstants), "ViewConstantsLastFrame", engine::c_MaxRenderPassConstantBufferVersions));
+        m_LastFrameViewConstants = GetDevice()->createBuffer(nvrhi::utils::CreateStaticConstantBufferDesc(sizeof(PlanarViewConstants), "ViewConstantsLastFrame"));
+        m_MainPassViewConstants = GetDevice()->createBuffer(nvrhi::utils::CreateStaticConstantBufferDesc(sizeof(PlanarViewConstants), "MainPassViewConstants"));
+        m_MainPassSamplingRate = GetDevice()->createBuffer(nvrhi::utils::CreateStaticConstantBufferDesc(sizeof(float), "MainPassSamplingRate"));
+        m_UploadRing = std::make_unique<UploadRing>(GetDevice());
         m_FSRConstants = GetDevice()->createBuffer(nvrhi::utils::CreateVolatileConstantBufferDesc(sizeof(FSRConstants), "FSRConstants", engine::c_MaxRenderPassConstantBufferVersions));
+        m_CullingConstants = GetDevice()->createBuffer(nvrhi::utils::CreateVolatileConstantBufferDesc(sizeof(CullingConstants), "CullingConstants", engine::c_MaxRenderPassConstantBufferVersions));
+
+        nvrhi::BufferDesc cullStatsDesc;
+        cullStatsDesc.byteSize = CULL_STAT_COUNT * sizeof(uint32_t);
+        cullStatsDesc.canHaveUAVs = true;
+        cullStatsDesc.canHaveRawViews = true;
+        cullStatsDesc.initialState = nvrhi::ResourceStates::UnorderedAccess;
+        cullStatsDesc.keepInitialState = true;
+        cullStatsDesc.debugName = "CullStats";
+        m_CullStatsBuffer = GetDevice()->createBuffer(cullStatsDesc);
+
+        // The statistics are copied out every frame and read once the GPU is done with them
+        m_CullStatsReadbacks.resize(3);
+        for (auto& readback : m_CullStatsReadbacks)
+        {
+            nvrhi::BufferDesc readbackDesc;
+            readbackDesc.byteSize = cullStatsDesc.byteSize;
+            readbackDesc.cpuAccess = nvrhi::CpuAccessMode::Read;
+            readbackDesc.debugName = "CullStatsReadback";
+            readback.buffer = GetDevice()->createBuffer(readbackDesc);
+            readback.query = GetDevice()->createEventQuery();
+        }
 
         GetDevice()->waitForIdle();
 
+        if (!m_Options.replayFileName.empty())
+        {
+            if (!m_TrailReader.Open(m_Options.replayFileName) || m_TrailReader.GetFrameCount() == 0 || m_Options.replayModes.empty())
+            {
+                log::error("Nothing to replay from '%s'", m_Options.replayFileName.c_str());
+                return false;
+            }
+
+            m_ReferenceFileName = std::filesystem::path(m_Options.replayStatsFileName).replace_extension(".reference.bin");
+            m_ReferenceFile.open(m_ReferenceFileName, std::ios::in | std::ios::out | std::ios::binary | std::ios::trunc);
+            if (!m_ReferenceFile)
+            {
+                log::error("Cannot create the reference frame file '%s'", m_ReferenceFileName.generic_string().c_str());
+                return false;
+            }
+
+            m_DiffReadbacks.resize(4);
+            for (auto& readback : m_DiffReadbacks)
+                readback.query = GetDevice()->createEventQuery();
+
+            m_BatchReplay = true;
+            m_BatchModeIndex = 0;
+            beginReplay(m_Options.replayModes[0]);
+        }
+
         return true;
     }
 
+    std::shared_ptr<engine::ShaderFactory> GetShaderFactory() const
+    {
+        return m_ShaderFactory;
+    }
+
+    const MainPassRecordingStats& GetRecordingStats() const
+    {
+        return m_RecordingStats;
+    }
+
+    const FrameStageStats& GetFrameStageStats() const
+    {
+        return m_FrameStageStats;
+    }
+
+    bool IsMultithreadedRecordingSupported() const
+    {
+        return !m_ChunkCommandLists.empty();
+    }
+
+    bool IsIndirectDrawingEnabled() const
+    {
+        return m_Options.indirectDraws;
+    }
+
+    void SetIndirectDrawing(bool enabled)
+    {
+        m_Options.indirectDraws = enabled;
+    }
+
+    bool IsFrustumCullingEnabled() const
+    {
+        return m_Options.frustumCulling;
+    }
+
+    void SetFrustumCulling(bool enabled)
+    {
+        m_Options.frustumCulling = enabled;
+    }
+
+    bool IsOcclusionCullingEnabled() const
+    {
+        return m_Options.occlusionCulling;
+    }
+
+    void SetOcclusionCulling(bool enabled)
+    {
+        m_Options.occlusionCulling = enabled;
+    }
+
+    bool IsMultithreadedRecordingEnabled() const
+    {
+        return m_Options.multithreadedRecording;
+    }
+
+    void SetMultithreadedRecording(bool enabled)
+    {
+        m_Options.multithreadedRecording = enabled && IsMultithreadedRecordingSupported();
+    }
+
+    bool IsComputeTSSEnabled() const
+    {
+        return m_Options.computeTSS;
+    }
+
+    void SetComputeTSS(bool enabled)
+    {
+        m_Options.computeTSS = enabled;
+    }
+
+    void beginReplay(int aaMode)
+    {
+        m_currentAAMode = aaMode;
+        BackBufferResizing();
+        currentFrameIndex = 0;
+        m_WallclockTime = 0.f;
+        bReplayCapturedFrame = true;
+
+        if (m_BatchReplay)
+        {
+            ReplayModeStats stats;
+            stats.mode = aaMode;
+            m_BatchStats.push_back(stats);
+        }
+    }
+
     bool LoadScene(std::shared_ptr<vfs::IFileSystem> fs, const std::filesystem::path& sceneFileName) override 
     {
         engine::Scene* scene = new engine::Scene(GetDevice(), *m_ShaderFactory, fs, m_TextureCache, m_DescriptorTableManager, nullptr);
@@ -284,29 +710,66 @@ public:
             BackBufferResizing();
             return true;
         }
-        if (key == GLFW_KEY_C)
+        if (key == GLFW_KEY_I && action == GLFW_PRESS)
+        {
+            SetIndirectDrawing(!m_Options.indirectDraws);
+            return true;
+        }
+        if (key == GLFW_KEY_F && action == GLFW_PRESS)
+        {
+            SetFrustumCulling(!m_Options.frustumCulling);
+            return true;
+        }
+        if (key == GLFW_KEY_O && action == GLFW_PRESS)
         {
-            captureCurrentFrame();
+            SetOcclusionCulling(!m_Options.occlusionCulling);
+            return true;
+        }
+        if (key == GLFW_KEY_M && action == GLFW_PRESS)
+        {
+            SetMultithreadedRecording(!m_Options.multithreadedRecording);
+            return true;
+        }
+        if (key == GLFW_KEY_X && action == GLFW_PRESS)
+        {
+            SetComputeTSS(!m_Options.computeTSS);
+            log::info("TSS resolve: %s shader", m_Options.computeTSS ? "compute" : "pixel");
+            return true;
+        }
+        if (key == GLFW_KEY_C && action == GLFW_PRESS)
+        {
+            m_CaptureRequested = true;
+        }
+        if (key == GLFW_KEY_V && action == GLFW_PRESS)
+        {
+            m_TssCaptureRequested = true;
         }
-        if (key == GLFW_KEY_R && action == GLFW_PRESS)
+        if (key == GLFW_KEY_R && action == GLFW_PRESS && !m_BatchReplay)
         {
             if (bRecordCurrentTrajectory)
             {
-                recordedFrameIndex = currentFrameIndex;
-                currentFrameIndex = 0;
+                m_TrailWriter.Close();
+                log::info("Recorded %d frames into '%s'", int(currentFrameIndex), m_Options.trailFileName.c_str());
+                bRecordCurrentTrajectory = false;
             }
             else
             {
-                currentFrameIndex = 0;
-                recordedFrameIndex = 0;
+                // Release the mapping in case we are about to overwrite the file that is being replayed
+                m_TrailReader.Close();
+                bReplayCapturedFrame = false;
+                bRecordCurrentTrajectory = m_TrailWriter.Open(m_Options.trailFileName, m_Options.quantizeTrail);
             }
-            bRecordCurrentTrajectory = !bRecordCurrentTrajectory;
+            currentFrameIndex = 0;
         }
-        if (key == GLFW_KEY_P && action == GLFW_PRESS)
+        if (key == GLFW_KEY_P && action == GLFW_PRESS && !m_BatchReplay && !bRecordCurrentTrajectory)
         {
             BackBufferResizing();
             currentFrameIndex = 0;
             bReplayCapturedFrame = !bReplayCapturedFrame;
+            if (bReplayCapturedFrame && !m_TrailReader.Open(m_Options.trailFileName))
+            {
+                bReplayCapturedFrame = false;
+            }
         }
 
         return true;
@@ -330,7 +793,8 @@ public:
 
         if (IsSceneLoaded() && m_EnableAnimations)
         {
-            m_WallclockTime += fElapsedTimeSeconds;
+            // Batch replays advance animations at a fixed rate so that every AA mode sees the same frames
+            m_WallclockTime += m_BatchReplay ? (1.f / 60.f) : fElapsedTimeSeconds;
             float offset = 0;
 
             for (const auto& anim : m_Scene->GetSceneGraph()->GetAnimations())
@@ -344,76 +808,46 @@ public:
         }
 
         std::string extraInfoOnAAMode = "Current AA Mode: ";
-        switch (m_currentAAMode)
-        {
-        case NATIVE_RESOLUTION:
-            currentAAModeToStr = "NATIVE";
-            break;
-        case NATIVE_WITH_TAA:
-            currentAAModeToStr = "NATIVE TAA";
-            break;
-        case RAW_UPSCALED:
-            currentAAModeToStr = "UPSCALED";
-            break;
-        case TEMPORAL_SUPERSAMPLING:
-            currentAAModeToStr = "TSS";
-            break;
-        case TEMPORAL_ANTIALIASING:
-            currentAAModeToStr = "TAA";
-            break;
-        case FSR_WITHOUT_RCAS:
-            currentAAModeToStr = "FSR (Unsharpened)";
-            break;
-        case FSR_WITH_RCAS:
-            currentAAModeToStr = "FSR (Sharpened)";
-            break;
-        default:
-            break;
-        }
+        currentAAModeToStr = GetAAModeName(m_currentAAMode);
         extraInfoOnAAMode += currentAAModeToStr;
         GetDeviceManager()->SetInformativeWindowTitle(g_WindowTitle, extraInfoOnAAMode.c_str());
     }
 
+    // Returns the render targets to the pool and drops everything that references them. Binding layouts
+    // and pipelines do not depend on the targets and are kept; see isPipelineOutdated.
     void BackBufferResizing() override
     { 
+        m_RenderTargetPool->ReleaseAll();
+
         m_DepthBuffer = nullptr;
         m_ColorBuffer = nullptr;
-        m_FSRInputBuffer = nullptr;
-        m_FSROutputBuffer = nullptr;
-        m_FSRIntermediateBuffer = nullptr;
         m_FirstOrderMomentum = nullptr;
         m_SecondOrderMomentum = nullptr;
         m_ValidSampleCount = nullptr;
-        m_SSColorBuffer = nullptr;
-        m_HistoryColor = nullptr;
+        m_HistoryColors[0] = nullptr;
+        m_HistoryColors[1] = nullptr;
         m_HistoryNormal = nullptr;
         m_JitteredColor = nullptr;
         m_RenderMotionVector = nullptr;
-        m_SSMotionVector = nullptr;
-        m_SSNormalBuffer = nullptr;
-        m_SSHistoryNormal = nullptr;
         m_NormalBuffer = nullptr;
+        m_Hzb = nullptr;
+        m_HzbValid = false;
 
-        m_TSSFramebuffer = nullptr;
+        m_TSSFramebuffers[0] = nullptr;
+        m_TSSFramebuffers[1] = nullptr;
         m_RenderFramebuffer = nullptr;
 
-        m_RenderBindingLayout = nullptr;
-        m_MotionBindingLayout = nullptr;
-        m_UpsampleBindingLayout = nullptr;
-        m_TSSBindingLayout = nullptr;
-
         //Never forget to clear the binding set!
         m_RenderBindingSet = nullptr;
         m_MotionBindingSet = nullptr;
         m_UpsampleBindingSet = nullptr;
-        m_TSSBindingSet = nullptr;
-        m_EASUBindingSet = nullptr;
-        m_RCASBindingSet = nullptr;
-
-        m_RenderPipeline = nullptr;
-        m_TSSPipeline = nullptr;
-        m_EASUPipeline = nullptr;
-        m_RCASPipeline = nullptr;
+        m_TSSBindingSets[0] = nullptr;
+        m_TSSBindingSets[1] = nullptr;
+        m_TSSComputeBindingSets[0] = nullptr;
+        m_TSSComputeBindingSets[1] = nullptr;
+        m_FSRBindingSet = nullptr;
+        m_CullBindingSet = nullptr;
+        m_HzbBindingSets.clear();
 
         m_BindingCache->Clear();
     }
@@ -499,49 +933,32 @@ public:
         textureDescHighRes.keepInitialState = true;
         textureDescHighRes.clearValue = nvrhi::Color(0.f);
         textureDescHighRes.useClearValue = true;
+        textureDescHighRes.isUAV = true; // written by the compute TSS resolve and by FSR
         textureDescHighRes.debugName = "ScreenContent";
         textureDescHighRes.width = width;
         textureDescHighRes.height = height;
         textureDescHighRes.dimension = nvrhi::TextureDimension::Texture2D;
-        m_ColorBuffer = GetDevice()->createTexture(textureDescHighRes);
-
-        textureDescHighRes.debugName = "BackupContent";
-        m_ColorBufferBackup = GetDevice()->createTexture(textureDescHighRes);
+        m_ColorBuffer = m_RenderTargetPool->AcquireTexture(textureDescHighRes);
 
         textureDescHighRes.isTypeless = false;
         textureDescHighRes.format = nvrhi::Format::RGBA16_FLOAT;
         textureDescHighRes.isUAV = true;
-        textureDescHighRes.debugName = "SupersampledColor";
-        m_SSColorBuffer = GetDevice()->createTexture(textureDescHighRes);
-
-        textureDescHighRes.debugName = "OutputFSR";
-        m_FSROutputBuffer = GetDevice()->createTexture(textureDescHighRes);
-
-        textureDescHighRes.debugName = "IntermediateFSR";
-        m_FSRIntermediateBuffer = GetDevice()->createTexture(textureDescHighRes);
-
-        textureDescHighRes.debugName = "HistoryColor";
-        m_HistoryColor = GetDevice()->createTexture(textureDescHighRes);
-
-        textureDescHighRes.debugName = "SupersampledNormalBuffer";
-        m_SSNormalBuffer = GetDevice()->createTexture(textureDescHighRes);
-
-        textureDescHighRes.debugName = "SupersampledHistoryNormal";
-        m_SSHistoryNormal = GetDevice()->createTexture(textureDescHighRes);
+        textureDescHighRes.debugName = "HistoryColor0";
+        m_HistoryColors[0] = m_RenderTargetPool->AcquireTexture(textureDescHighRes);
 
-        textureDescHighRes.debugName = "SupersampledMotionVector";
-        m_SSMotionVector = GetDevice()->createTexture(textureDescHighRes);
+        textureDescHighRes.debugName = "HistoryColor1";
+        m_HistoryColors[1] = m_RenderTargetPool->AcquireTexture(textureDescHighRes);
 
         textureDescHighRes.format = nvrhi::Format::R32_FLOAT;
         textureDescHighRes.debugName = "SampleCount";
-        m_ValidSampleCount = GetDevice()->createTexture(textureDescHighRes);
+        m_ValidSampleCount = m_RenderTargetPool->AcquireTexture(textureDescHighRes);
 
         textureDescHighRes.format = nvrhi::Format::RGBA32_FLOAT;
         textureDescHighRes.debugName = "FirstOrderMoment";
-        m_FirstOrderMomentum = GetDevice()->createTexture(textureDescHighRes);
+        m_FirstOrderMomentum = m_RenderTargetPool->AcquireTexture(textureDescHighRes);
 
         textureDescHighRes.debugName = "SecondOrderMoment";
-        m_SecondOrderMomentum = GetDevice()->createTexture(textureDescHighRes);
+        m_SecondOrderMomentum = m_RenderTargetPool->AcquireTexture(textureDescHighRes);
     }
 
     void createLowResolutionTextures(uint32_t width, uint32_t height)
@@ -556,41 +973,49 @@ public:
         textureDescLowRes.debugName = "JitteredCurrentBuffer";
         textureDescLowRes.width = width;
         textureDescLowRes.height = height;
-        m_JitteredColor = GetDevice()->createTexture(textureDescLowRes);
+        m_JitteredColor = m_RenderTargetPool->AcquireTexture(textureDescLowRes);
 
         textureDescLowRes.format = nvrhi::Format::D24S8;
+        textureDescLowRes.isTypeless = true; // read by the HZB pass
         textureDescLowRes.debugName = "DepthBuffer";
         textureDescLowRes.initialState = nvrhi::ResourceStates::DepthWrite;
-        m_DepthBuffer = GetDevice()->createTexture(textureDescLowRes);
+        m_DepthBuffer = m_RenderTargetPool->AcquireTexture(textureDescLowRes);
 
         textureDescLowRes.isTypeless = false;
         textureDescLowRes.format = nvrhi::Format::RGBA16_FLOAT;
         textureDescLowRes.isUAV = true;
         textureDescLowRes.initialState = nvrhi::ResourceStates::RenderTarget;
         textureDescLowRes.debugName = "NormalBuffer";
-        m_NormalBuffer = GetDevice()->createTexture(textureDescLowRes);
+        m_NormalBuffer = m_RenderTargetPool->AcquireTexture(textureDescLowRes);
 
         textureDescLowRes.debugName = "HistoryNormal";
-        m_HistoryNormal = GetDevice()->createTexture(textureDescLowRes);
-
-        textureDescLowRes.debugName = "InputBuffer";
-        m_FSRInputBuffer = GetDevice()->createTexture(textureDescLowRes);
+        m_HistoryNormal = m_RenderTargetPool->AcquireTexture(textureDescLowRes);
 
         textureDescLowRes.format = nvrhi::Format::RGBA16_FLOAT;
         textureDescLowRes.debugName = "MotionVector";
-        m_RenderMotionVector = GetDevice()->createTexture(textureDescLowRes);
+        m_RenderMotionVector = m_RenderTargetPool->AcquireTexture(textureDescLowRes);
+
+        nvrhi::TextureDesc hzbDesc;
+        hzbDesc.format = nvrhi::Format::R32_FLOAT;
+        hzbDesc.isUAV = true;
+        hzbDesc.width = std::max((width + 1) / 2, 1u);
+        hzbDesc.height = std::max((height + 1) / 2, 1u);
+        hzbDesc.mipLevels = GetHzbMipCount(width, height);
+        hzbDesc.initialState = nvrhi::ResourceStates::ShaderResource;
+        hzbDesc.keepInitialState = true;
+        hzbDesc.debugName = "HZB";
+        m_Hzb = m_RenderTargetPool->AcquireTexture(hzbDesc);
     }
 
     void createHighResolutionFramebuffer()
     {
-        nvrhi::FramebufferDesc framebufferDescHigher;
-        framebufferDescHigher.addColorAttachment(m_ColorBuffer, nvrhi::AllSubresources);
-        framebufferDescHigher.addColorAttachment(m_SSColorBuffer, nvrhi::AllSubresources);
-        framebufferDescHigher.addColorAttachment(m_SSMotionVector, nvrhi::AllSubresources);
-        framebufferDescHigher.addColorAttachment(m_SSNormalBuffer, nvrhi::AllSubresources);
-        framebufferDescHigher.addColorAttachment(m_SSHistoryNormal, nvrhi::AllSubresources);
-        framebufferDescHigher.addColorAttachment(m_HistoryColor, nvrhi::AllSubresources);
-        m_TSSFramebuffer = GetDevice()->createFramebuffer(framebufferDescHigher);
+        for (uint32_t historyIndex = 0; historyIndex < 2; historyIndex++)
+        {
+            nvrhi::FramebufferDesc framebufferDescHigher;
+            framebufferDescHigher.addColorAttachment(m_ColorBuffer, nvrhi::AllSubresources);
+            framebufferDescHigher.addColorAttachment(m_HistoryColors[historyIndex], nvrhi::AllSubresources);
+            m_TSSFramebuffers[historyIndex] = m_RenderTargetPool->AcquireFramebuffer(framebufferDescHigher);
+        }
     }
 
     void createLowResolutionFramebuffer()
@@ -601,7 +1026,13 @@ public:
         framebufferDescLower.addColorAttachment(m_HistoryNormal, nvrhi::AllSubresources);
         framebufferDescLower.addColorAttachment(m_RenderMotionVector, nvrhi::AllSubresources);
         framebufferDescLower.setDepthAttachment(m_DepthBuffer);
-        m_RenderFramebuffer = GetDevice()->createFramebuffer(framebufferDescLower);
+        m_RenderFramebuffer = m_RenderTargetPool->AcquireFramebuffer(framebufferDescLower);
+    }
+
+    // A graphics pipeline must be recreated when the framebuffer it renders into has other formats
+    bool isPipelineOutdated(nvrhi::IGraphicsPipeline* pipeline, nvrhi::IFramebuffer* framebuffer) const
+    {
+        return !pipeline || !IsFramebufferCompatible(pipeline->getFramebufferInfo(), framebuffer->getFramebufferInfo(), m_Options.pipelinesMatchFramebufferSize);
     }
 
     void createRenderingPipeline()
@@ -609,18 +1040,22 @@ public:
         nvrhi::BindingSetDesc bindingSetDesc;
         bindingSetDesc.bindings =
         {
-            nvrhi::BindingSetItem::ConstantBuffer(0, m_ThisFrameViewConstants),
+            nvrhi::BindingSetItem::ConstantBuffer(0, m_MainPassViewConstants),
             nvrhi::BindingSetItem::ConstantBuffer(1, m_LastFrameViewConstants),
-            nvrhi::BindingSetItem::ConstantBuffer(2, m_SamplingRate),
+            nvrhi::BindingSetItem::ConstantBuffer(2, m_MainPassSamplingRate),
             nvrhi::BindingSetItem::ConstantBuffer(3, m_FrameIndex),
             nvrhi::BindingSetItem::PushConstants(4, sizeof(int2)),
             nvrhi::BindingSetItem::StructuredBuffer_SRV(0, m_Scene->GetInstanceBuffer()),
             nvrhi::BindingSetItem::StructuredBuffer_SRV(1, m_Scene->GetGeometryBuffer()),
             nvrhi::BindingSetItem::StructuredBuffer_SRV(2, m_Scene->GetMaterialBuffer()),
+            nvrhi::BindingSetItem::StructuredBuffer_SRV(3, m_DrawRecordBuffer),
             nvrhi::BindingSetItem::Sampler(0, m_CommonPasses->m_AnisotropicWrapSampler)
         };
         nvrhi::utils::CreateBindingSetAndLayout(GetDevice(), nvrhi::ShaderType::All, 0, bindingSetDesc, m_RenderBindingLayout, m_RenderBindingSet);
 
+        if (!isPipelineOutdated(m_RenderPipeline, m_RenderFramebuffer))
+            return;
+
         nvrhi::GraphicsPipelineDesc pipelineDesc;
         pipelineDesc.VS = m_RenderVertexShader;
         pipelineDesc.PS = m_RenderPixelShader;
@@ -632,29 +1067,98 @@ public:
         pipelineDesc.renderState.rasterState.setCullBack();
 
         m_RenderPipeline = GetDevice()->createGraphicsPipeline(pipelineDesc, m_RenderFramebuffer);
+
+        pipelineDesc.VS = m_RenderIndirectVertexShader;
+        pipelineDesc.inputLayout = m_DrawIdInputLayout;
+        m_RenderIndirectPipeline = GetDevice()->createGraphicsPipeline(pipelineDesc, m_RenderFramebuffer);
     }
 
-    void createTSSPipeline()
+    void createCullingPipeline()
     {
-        nvrhi::BindingSetDesc bindingSetDescPost;
-        bindingSetDescPost.bindings =
-        {
-            nvrhi::BindingSetItem::ConstantBuffer(0, m_ThisFrameViewConstants),
-            nvrhi::BindingSetItem::ConstantBuffer(1, m_SamplingRate),
-            nvrhi::BindingSetItem::PushConstants(2, sizeof(int2)),
-            nvrhi::BindingSetItem::Texture_SRV(0, m_RenderMotionVector, nvrhi::Format::RGBA16_FLOAT),
-            nvrhi::BindingSetItem::Texture_SRV(1, m_HistoryColor, nvrhi::Format::RGBA16_FLOAT),
-            nvrhi::BindingSetItem::Texture_SRV(2, m_JitteredColor, nvrhi::Format::RGBA16_FLOAT),
-            nvrhi::BindingSetItem::Texture_SRV(3, m_NormalBuffer, nvrhi::Format::RGBA16_FLOAT),
-            nvrhi::BindingSetItem::Texture_SRV(4, m_HistoryNormal, nvrhi::Format::RGBA16_FLOAT),
-            nvrhi::BindingSetItem::Texture_UAV(0, m_ValidSampleCount, nvrhi::Format::R32_FLOAT),
-            nvrhi::BindingSetItem::Texture_UAV(1, m_FirstOrderMomentum, nvrhi::Format::RGBA32_FLOAT),
-            nvrhi::BindingSetItem::Texture_UAV(2, m_SecondOrderMomentum, nvrhi::Format::RGBA32_FLOAT),
-            nvrhi::BindingSetItem::Sampler(0, m_CommonPasses->m_AnisotropicClampSampler),
-            nvrhi::BindingSetItem::Sampler(1, m_CommonPasses->m_LinearClampSampler),
-            nvrhi::BindingSetItem::Sampler(2, m_CommonPasses->m_PointClampSampler)
+        nvrhi::BindingSetDesc bindingSetDescCull;
+        bindingSetDescCull.bindings =
+        {
+            nvrhi::BindingSetItem::ConstantBuffer(0, m_CullingConstants),
+            nvrhi::BindingSetItem::StructuredBuffer_SRV(0, m_Scene->GetInstanceBuffer()),
+            nvrhi::BindingSetItem::StructuredBuffer_SRV(1, m_DrawRecordBuffer),
+            nvrhi::BindingSetItem::Texture_SRV(2, m_Hzb, nvrhi::Format::R32_FLOAT),
+            nvrhi::BindingSetItem::RawBuffer_UAV(0, m_CulledDrawArgumentsBuffer),
+            nvrhi::BindingSetItem::RawBuffer_UAV(1, m_CullStatsBuffer)
         };
-        nvrhi::utils::CreateBindingSetAndLayout(GetDevice(), nvrhi::ShaderType::All, 0, bindingSetDescPost, m_TSSBindingLayout, m_TSSBindingSet);
+        nvrhi::utils::CreateBindingSetAndLayout(GetDevice(), nvrhi::ShaderType::All, 0, bindingSetDescCull, m_CullBindingLayout, m_CullBindingSet);
+
+        if (!m_CullPipeline)
+        {
+            nvrhi::ComputePipelineDesc pipelineDescCull = nvrhi::ComputePipelineDesc().setComputeShader(m_CullComputeShader).addBindingLayout(m_CullBindingLayout);
+            m_CullPipeline = GetDevice()->createComputePipeline(pipelineDescCull);
+        }
+
+        // Level 0 reads the depth buffer, every other level reads the one above it
+        m_HzbBindingSets.clear();
+        for (uint32_t level = 0; level < m_Hzb->getDesc().mipLevels; level++)
+        {
+            nvrhi::BindingSetDesc bindingSetDescHzb;
+            bindingSetDescHzb.bindings =
+            {
+                nvrhi::BindingSetItem::PushConstants(0, sizeof(HzbConstants)),
+                level == 0
+                    ? nvrhi::BindingSetItem::Texture_SRV(0, m_DepthBuffer, nvrhi::Format::D24S8)
+                    : nvrhi::BindingSetItem::Texture_SRV(0, m_Hzb, nvrhi::Format::R32_FLOAT, nvrhi::TextureSubresourceSet(level - 1, 1, 0, 1)),
+                nvrhi::BindingSetItem::Texture_UAV(0, m_Hzb, nvrhi::Format::R32_FLOAT, nvrhi::TextureSubresourceSet(level, 1, 0, 1))
+            };
+
+            nvrhi::BindingSetHandle bindingSet;
+            nvrhi::utils::CreateBindingSetAndLayout(GetDevice(), nvrhi::ShaderType::All, 0, bindingSetDescHzb, m_HzbBindingLayout, bindingSet);
+            m_HzbBindingSets.push_back(bindingSet);
+        }
+
+        if (!m_HzbPipeline)
+        {
+            nvrhi::ComputePipelineDesc pipelineDescHzb = nvrhi::ComputePipelineDesc().setComputeShader(m_HzbComputeShader).addBindingLayout(m_HzbBindingLayout);
+            m_HzbPipeline = GetDevice()->createComputePipeline(pipelineDescHzb);
+        }
+    }
+
+    void createTSSPipeline()
+    {
+        // One binding set per history order; the compute resolve reads the same resources and writes the
+        // two color targets as UAVs
+        for (uint32_t historyIndex = 0; historyIndex < 2; historyIndex++)
+        {
+            nvrhi::BindingSetDesc bindingSetDescPost;
+            bindingSetDescPost.bindings =
+            {
+                nvrhi::BindingSetItem::ConstantBuffer(0, m_ThisFrameViewConstants),
+                nvrhi::BindingSetItem::ConstantBuffer(1, m_SamplingRate),
+                nvrhi::BindingSetItem::PushConstants(2, sizeof(int2)),
+                nvrhi::BindingSetItem::Texture_SRV(0, m_RenderMotionVector, nvrhi::Format::RGBA16_FLOAT),
+                nvrhi::BindingSetItem::Texture_SRV(1, m_HistoryColors[historyIndex ^ 1], nvrhi::Format::RGBA16_FLOAT),
+                nvrhi::BindingSetItem::Texture_SRV(2, m_JitteredColor, nvrhi::Format::RGBA16_FLOAT),
+                nvrhi::BindingSetItem::Texture_SRV(3, m_NormalBuffer, nvrhi::Format::RGBA16_FLOAT),
+                nvrhi::BindingSetItem::Texture_SRV(4, m_HistoryNormal, nvrhi::Format::RGBA16_FLOAT),
+                nvrhi::BindingSetItem::Texture_UAV(0, m_ValidSampleCount, nvrhi::Format::R32_FLOAT),
+                nvrhi::BindingSetItem::Texture_UAV(1, m_FirstOrderMomentum, nvrhi::Format::RGBA32_FLOAT),
+                nvrhi::BindingSetItem::Texture_UAV(2, m_SecondOrderMomentum, nvrhi::Format::RGBA32_FLOAT),
+                nvrhi::BindingSetItem::Sampler(0, m_CommonPasses->m_AnisotropicClampSampler),
+                nvrhi::BindingSetItem::Sampler(1, m_CommonPasses->m_LinearClampSampler),
+                nvrhi::BindingSetItem::Sampler(2, m_CommonPasses->m_PointClampSampler)
+            };
+            nvrhi::utils::CreateBindingSetAndLayout(GetDevice(), nvrhi::ShaderType::All, 0, bindingSetDescPost, m_TSSBindingLayout, m_TSSBindingSets[historyIndex]);
+
+            nvrhi::BindingSetDesc bindingSetDescCompute = bindingSetDescPost;
+            bindingSetDescCompute.bindings.push_back(nvrhi::BindingSetItem::Texture_UAV(3, m_ColorBuffer, nvrhi::Format::RGBA16_FLOAT));
+            bindingSetDescCompute.bindings.push_back(nvrhi::BindingSetItem::Texture_UAV(4, m_HistoryColors[historyIndex], nvrhi::Format::RGBA16_FLOAT));
+            nvrhi::utils::CreateBindingSetAndLayout(GetDevice(), nvrhi::ShaderType::All, 0, bindingSetDescCompute, m_TSSComputeBindingLayout, m_TSSComputeBindingSets[historyIndex]);
+        }
+
+        if (!m_TSSComputePipeline)
+        {
+            nvrhi::ComputePipelineDesc pipelineDescCompute = nvrhi::ComputePipelineDesc().setComputeShader(m_TSSComputeShader).addBindingLayout(m_TSSComputeBindingLayout);
+            m_TSSComputePipeline = GetDevice()->createComputePipeline(pipelineDescCompute);
+        }
+
+        if (!isPipelineOutdated(m_TSSPipeline, m_TSSFramebuffers[0]))
+            return;
 
         nvrhi::GraphicsPipelineDesc pipelineDescPost;
         pipelineDescPost.VS = m_TSSVertexShader;
@@ -665,39 +1169,26 @@ public:
         pipelineDescPost.renderState.depthStencilState.stencilEnable = false;
         pipelineDescPost.renderState.rasterState.setCullNone();
 
-        m_TSSPipeline = GetDevice()->createGraphicsPipeline(pipelineDescPost, m_TSSFramebuffer);
+        m_TSSPipeline = GetDevice()->createGraphicsPipeline(pipelineDescPost, m_TSSFramebuffers[0]);
     }
 
-    void createEASUPipeline()
+    void createFSRPipeline()
     {
-        nvrhi::BindingSetDesc bindingSetDescEASU;
-        bindingSetDescEASU.bindings =
+        nvrhi::BindingSetDesc bindingSetDescFSR;
+        bindingSetDescFSR.bindings =
         {
             nvrhi::BindingSetItem::ConstantBuffer(0, m_FSRConstants),
-            nvrhi::BindingSetItem::Texture_SRV(0, m_FSRInputBuffer, nvrhi::Format::RGBA16_FLOAT),
-            nvrhi::BindingSetItem::Texture_UAV(0, m_FSRIntermediateBuffer, nvrhi::Format::RGBA16_FLOAT),
+            nvrhi::BindingSetItem::Texture_SRV(0, m_JitteredColor, nvrhi::Format::RGBA16_FLOAT),
+            nvrhi::BindingSetItem::Texture_UAV(0, m_ColorBuffer, nvrhi::Format::RGBA16_FLOAT),
             nvrhi::BindingSetItem::Sampler(0, m_CommonPasses->m_LinearClampSampler)
         };
-        nvrhi::utils::CreateBindingSetAndLayout(GetDevice(), nvrhi::ShaderType::All, 0, bindingSetDescEASU, m_EASUBindingLayout, m_EASUBindingSet);
+        nvrhi::utils::CreateBindingSetAndLayout(GetDevice(), nvrhi::ShaderType::All, 0, bindingSetDescFSR, m_FSRBindingLayout, m_FSRBindingSet);
 
-        nvrhi::ComputePipelineDesc pipelineDescEASU = nvrhi::ComputePipelineDesc().setComputeShader(m_EASUComputePassShader).addBindingLayout(m_EASUBindingLayout);
-        m_EASUPipeline = GetDevice()->createComputePipeline(pipelineDescEASU);
-    }
-
-    void createRCASPipeline()
-    {
-        nvrhi::BindingSetDesc bindingSetDescRCAS;
-        bindingSetDescRCAS.bindings =
+        if (!m_FSRPipeline)
         {
-            nvrhi::BindingSetItem::ConstantBuffer(0, m_FSRConstants),
-            nvrhi::BindingSetItem::Texture_SRV(0, m_FSRIntermediateBuffer, nvrhi::Format::RGBA16_FLOAT),
-            nvrhi::BindingSetItem::Texture_UAV(0, m_FSROutputBuffer, nvrhi::Format::RGBA16_FLOAT),
-            nvrhi::BindingSetItem::Sampler(0, m_CommonPasses->m_LinearClampSampler)
-        };
-        nvrhi::utils::CreateBindingSetAndLayout(GetDevice(), nvrhi::ShaderType::All, 0, bindingSetDescRCAS, m_RCASBindingLayout, m_RCASBindingSet);
-
-        nvrhi::ComputePipelineDesc pipelineDescRCAS = nvrhi::ComputePipelineDesc().setComputeShader(m_RCASComputePassShader).addBindingLayout(m_RCASBindingLayout);
-        m_RCASPipeline = GetDevice()->createComputePipeline(pipelineDescRCAS);
+            nvrhi::ComputePipelineDesc pipelineDescFSR = nvrhi::ComputePipelineDesc().setComputeShader(m_FSRComputeShader).addBindingLayout(m_FSRBindingLayout);
+            m_FSRPipeline = GetDevice()->createComputePipeline(pipelineDescFSR);
+        }
     }
 
     void fillRenderViewConstants(PlanarViewConstants &viewConstants, int renderWidth, int renderHeight)
@@ -705,7 +1196,7 @@ public:
         if (GetFrameIndex() != 0)
         {
             m_View.FillPlanarViewConstants(viewConstants);
-            m_CommandList->writeBuffer(m_LastFrameViewConstants, &viewConstants, sizeof(viewConstants));
+            m_MainPassConstants.lastView = viewConstants;
         }
 
         m_View.SetPixelOffset(GetCurrentFramePixelOffset(GetFrameIndex()));
@@ -721,12 +1212,12 @@ public:
         if (GetFrameIndex() == 0)
         {
             m_View.FillPlanarViewConstants(viewConstants);
-            m_CommandList->writeBuffer(m_LastFrameViewConstants, &viewConstants, sizeof(viewConstants));
+            m_MainPassConstants.lastView = viewConstants;
         }
         m_View.FillPlanarViewConstants(viewConstants);
 
-        m_CommandList->writeBuffer(m_ThisFrameViewConstants, &viewConstants, sizeof(viewConstants));
-        m_CommandList->writeBuffer(m_SamplingRate, &m_slidingSamplingRate, sizeof(m_slidingSamplingRate));
+        m_MainPassConstants.thisView = viewConstants;
+        m_MainPassConstants.samplingRate = m_slidingSamplingRate;
     }
 
     void fillTSSViewConstants(PlanarViewConstants& viewConstants, int upsampledWidth, int upsampledHeight)
@@ -742,7 +1233,34 @@ public:
         m_CommandList->writeBuffer(m_SamplingRate, &m_slidingSamplingRate, sizeof(m_slidingSamplingRate));
     }
 
-    void fillEASUConstants(const uint32_t displayWidth, const uint32_t displayHeight, const uint32_t renderWidth, const uint32_t renderHeight)
+    // Captures what the TSS pass reads, before it runs, for RunTssReference. The moments are captured
+    // before the pass updates them in place. On a reset frame the history is captured before it is
+    // cleared, which does not matter because the resolve does not blend it in then.
+    void captureTSSInputs(const std::string& prefix, const PlanarViewConstants& viewConstants, int2 frameStatus)
+    {
+        TssConstants constants;
+        constants.outputSize = uint2(uint32_t(viewConstants.viewportSize.x), uint32_t(viewConstants.viewportSize.y));
+        constants.pixelOffset = viewConstants.pixelOffset;
+        constants.samplingRate = m_slidingSamplingRate;
+        constants.frameHasReset = frameStatus.x != 0;
+        constants.aaMode = frameStatus.y;
+        if (!SaveTssConstants(constants, prefix + "_constants.txt"))
+        {
+            log::warning("Cannot write the TSS constants for '%s'", prefix.c_str());
+            return;
+        }
+
+        m_FrameCapture->Capture(m_CommandList, m_JitteredColor, GetTssCaptureFileName(prefix, "jittered"));
+        m_FrameCapture->Capture(m_CommandList, m_RenderMotionVector, GetTssCaptureFileName(prefix, "motion"));
+        m_FrameCapture->Capture(m_CommandList, m_HistoryColors[m_HistoryIndex ^ 1], GetTssCaptureFileName(prefix, "history"));
+        m_FrameCapture->Capture(m_CommandList, m_FirstOrderMomentum, GetTssCaptureFileName(prefix, "moment1"));
+        m_FrameCapture->Capture(m_CommandList, m_SecondOrderMomentum, GetTssCaptureFileName(prefix, "moment2"));
+        m_FrameCapture->Capture(m_CommandList, m_ValidSampleCount, GetTssCaptureFileName(prefix, "sequence"));
+
+        log::info("Capturing the TSS inputs to '%s_*'", prefix.c_str());
+    }
+
+    void fillFSRConstants(const uint32_t displayWidth, const uint32_t displayHeight, const uint32_t renderWidth, const uint32_t renderHeight, bool rcas)
     {
         FSRConstants fsrConsts = {};
         FsrEasuCon(
@@ -751,41 +1269,41 @@ public:
             static_cast<AF1>(renderWidth), static_cast<AF1>(renderHeight), 
             static_cast<AF1>(renderWidth), static_cast<AF1>(renderHeight), 
             (AF1)displayWidth, (AF1)displayHeight);
+        float rcasAttenuation = 0.0f;
+        FsrRcasCon(reinterpret_cast<AU1*>(&fsrConsts.RcasConst), rcasAttenuation);
         fsrConsts.Sample.x = 0;//(hdr && m_currentAAMode == FSR_WITH_RCAS) ? 0 : 1;
+        fsrConsts.Sample.y = rcas ? 1 : 0;
 
         m_CommandList->writeBuffer(m_FSRConstants, &fsrConsts, sizeof(fsrConsts));
     }
 
-    void fillRCASConstants()
+    void clearTexture(FrameStage stage, nvrhi::ITexture* texture)
     {
-        FSRConstants fsrConsts = {};
-        float rcasAttenuation = 0.0f;
-        FsrRcasCon(reinterpret_cast<AU1*>(&fsrConsts.Const0), rcasAttenuation);
-        fsrConsts.Sample.x = 0;
-
-        m_CommandList->writeBuffer(m_FSRConstants, &fsrConsts, sizeof(fsrConsts));
+        m_CommandList->clearTextureFloat(texture, nvrhi::AllSubresources, nvrhi::Color(0.0f));
+        m_FrameStageStats.trafficBytes[stage] += GetTextureBytes(texture);
     }
 
     void clearStatsSignals()
     {
-        m_CommandList->clearTextureFloat(m_ValidSampleCount, nvrhi::AllSubresources, 0.0f);
-        m_CommandList->clearTextureFloat(m_FirstOrderMomentum, nvrhi::AllSubresources, 0.0f);
-        m_CommandList->clearTextureFloat(m_SecondOrderMomentum, nvrhi::AllSubresources, 0.0f);
+        clearTexture(FRAME_STAGE_MAIN_PASS, m_ValidSampleCount);
+        clearTexture(FRAME_STAGE_MAIN_PASS, m_FirstOrderMomentum);
+        clearTexture(FRAME_STAGE_MAIN_PASS, m_SecondOrderMomentum);
     }
 
-    void clearUptheSignals()
+    // Only the targets of the main pass need clearing, since it leaves the pixels without geometry alone.
+    // The resolves write every pixel of the color buffer and of the history they output.
+    void clearMainPassTargets()
     {
-        m_CommandList->clearTextureFloat(m_RenderMotionVector, nvrhi::AllSubresources, nvrhi::Color(0.0f));
-        m_CommandList->clearTextureFloat(m_SSMotionVector, nvrhi::AllSubresources, nvrhi::Color(0.0f));
-        m_CommandList->clearTextureFloat(m_ColorBuffer, nvrhi::AllSubresources, nvrhi::Color(0.0f));
-        m_CommandList->clearTextureFloat(m_JitteredColor, nvrhi::AllSubresources, nvrhi::Color(0.0f));
-        m_CommandList->clearTextureFloat(m_SSColorBuffer, nvrhi::AllSubresources, nvrhi::Color(0.0f));
-        m_CommandList->clearTextureFloat(m_NormalBuffer, nvrhi::AllSubresources, nvrhi::Color(0.0f));
-        m_CommandList->clearTextureFloat(m_HistoryNormal, nvrhi::AllSubresources, nvrhi::Color(0.0f));
+        clearTexture(FRAME_STAGE_MAIN_PASS, m_JitteredColor);
+        clearTexture(FRAME_STAGE_MAIN_PASS, m_NormalBuffer);
+        clearTexture(FRAME_STAGE_MAIN_PASS, m_HistoryNormal);
+        clearTexture(FRAME_STAGE_MAIN_PASS, m_RenderMotionVector);
     }
 
     void Render(nvrhi::IFramebuffer* framebuffer) override
     {
+        auto frameStart = std::chrono::high_resolution_clock::now();
+
         const auto& fbinfo = framebuffer->getFramebufferInfo();
         uint32_t upsampledWidth = fbinfo.width;
         uint32_t upsampledHeight = fbinfo.height;
@@ -798,8 +1316,9 @@ public:
         }
 
         int frameHasBeenReset = 0;
-        if (!m_RenderPipeline || !m_TSSPipeline || !m_EASUPipeline || !m_RCASPipeline)
+        if (!m_RenderFramebuffer || !m_TSSFramebuffers[0])
         {
+            auto setupStart = std::chrono::high_resolution_clock::now();
             frameHasBeenReset = 1;
             //High-res texture
             createHighResolutionTextures(upsampledWidth, upsampledHeight);
@@ -811,157 +1330,1008 @@ public:
             createLowResolutionFramebuffer();
             //Pipelines
             createRenderingPipeline();
+            createCullingPipeline();
             createTSSPipeline();
-            createEASUPipeline();
-            createRCASPipeline();
+            createFSRPipeline();
+
+            if (m_currentAAMode == FSR_WITHOUT_RCAS || m_currentAAMode == FSR_WITH_RCAS)
+            {
+                const bool rcas = m_currentAAMode == FSR_WITH_RCAS;
+                const uint32_t renderWidthAt4K = uint32_t(3840.0 * renderWidth / upsampledWidth);
+                const uint32_t renderHeightAt4K = uint32_t(2160.0 * renderHeight / upsampledHeight);
+                log::info("Fused FSR saves %.1f MB of render target traffic per frame (%.1f MB at 4K)",
+                    double(GetFusedFsrBandwidthSaving(upsampledWidth, upsampledHeight, renderWidth, renderHeight, rcas)) / (1024.0 * 1024.0),
+                    double(GetFusedFsrBandwidthSaving(3840, 2160, renderWidthAt4K, renderHeightAt4K, rcas)) / (1024.0 * 1024.0));
+            }
+
+            const RenderTargetPool::Stats& poolStats = m_RenderTargetPool->GetStats();
+            log::info("Render targets recreated in %.2f ms; pool: %llu textures reused, %llu created, %llu framebuffers reused, %.1f MB",
+                std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - setupStart).count(),
+                (unsigned long long)poolStats.texturesReused, (unsigned long long)poolStats.texturesCreated,
+                (unsigned long long)poolStats.framebuffersReused, double(poolStats.pooledBytes) / (1024.0 * 1024.0));
         }
 
         if (bRecordCurrentTrajectory)
         {
-            if (currentFrameIndex < maximalFrameIndex)
-            {
-                CameraRolling roll = getCamera();
-                camTrails[currentFrameIndex] = roll;
-                ++currentFrameIndex;
-            }
+            m_TrailWriter.Append(getCamera());
+            ++currentFrameIndex;
         }
+        bool replayedThisFrame = false;
         if (bReplayCapturedFrame)
         {
-            if (currentFrameIndex < recordedFrameIndex)
+            if (currentFrameIndex < m_TrailReader.GetFrameCount())
             {
-                setCamera();
+                setCamera(m_TrailReader.GetFrame(uint32_t(currentFrameIndex)));
                 ++currentFrameIndex;
+                replayedThisFrame = true;
             }
         }
+        const size_t replayedFrameIndex = currentFrameIndex - 1;
+        const bool compareThisFrame = m_BatchReplay && (replayedFrameIndex % size_t(m_Options.diffInterval)) == 0;
+
+        // The whole frame goes out in one executeCommandLists call at the end: a single list, or the
+        // prologue, the recording chunks and the rest of the frame with multithreaded recording
+        resolveFrameStageTimers();
+        FrameStageTimers* stageTimers = &m_FrameStageTimers[m_FrameStageTimerIndex];
+        if (stageTimers->pending)
+            stageTimers = nullptr;
+
+        std::vector<nvrhi::ICommandList*> frameCommandLists;
+        bool cullStatsQueued = false;
+
+        auto stageStart = std::chrono::high_resolution_clock::now();
+        auto endStage = [&](FrameStage stage)
+        {
+            if (stageTimers)
+                m_CommandList->endTimerQuery(stageTimers->queries[stage]);
+
+            auto now = std::chrono::high_resolution_clock::now();
+            m_FrameStageStats.cpuTimeMs[stage] = std::chrono::duration<double, std::milli>(now - stageStart).count();
+            stageStart = now;
+        };
+        auto beginStage = [&](FrameStage stage)
+        {
+            if (stageTimers)
+                m_CommandList->beginTimerQuery(stageTimers->queries[stage]);
+        };
+
+        for (uint64_t& bytes : m_FrameStageStats.trafficBytes)
+            bytes = 0;
 
         m_CommandList->open();
+        beginStage(FRAME_STAGE_MAIN_PASS);
         
         if (frameHasBeenReset)
         {
             clearStatsSignals();
         }
+        clearMainPassTargets();
         PlanarViewConstants viewConstants;
         fillRenderViewConstants(viewConstants, renderWidth, renderHeight);
 
         int2 frameStatus = int2(frameHasBeenReset, m_currentAAMode);
-        m_CommandList->writeBuffer(m_FrameIndex, &frameStatus, sizeof(frameStatus));
-
-        nvrhi::GraphicsState state;
-        state.pipeline = m_RenderPipeline;
-        state.framebuffer = m_RenderFramebuffer;
-        state.bindings = { m_RenderBindingSet, m_DescriptorTableManager->GetDescriptorTable() };
-        state.viewport = m_View.GetViewportState();
-        m_CommandList->setGraphicsState(state);
+        m_MainPassConstants.frameStatus = frameStatus;
+        uploadMainPassConstants(m_CommandList);
 
-        for (const auto& instance : m_Scene->GetSceneGraph()->GetMeshInstances())
+        if (m_Options.indirectDraws)
         {
-            const auto& mesh = instance->GetMesh();
+            auto recordStart = std::chrono::high_resolution_clock::now();
 
-            for (size_t i = 0; i < mesh->geometries.size(); i++)
-            {
-                int2 constants = int2(instance->GetInstanceIndex(), int(i));
-                m_CommandList->setPushConstants(&constants, sizeof(constants));
+            pollCullStats();
 
-                nvrhi::DrawArguments args;
-                args.instanceCount = 1;
-                args.vertexCount = mesh->geometries[i]->numIndices;
-                m_CommandList->draw(args);
+            const bool culling = m_Options.frustumCulling || m_Options.occlusionCulling;
+            uint32_t updatedDraws = updateIndirectDrawBuffers(m_CommandList);
+            if (culling)
+            {
+                cullIndirectDraws(m_CommandList);
+                recordMainPassIndirect(m_CommandList, m_CulledDrawArgumentsBuffer);
+                buildHzb(m_CommandList);
+            }
+            else
+            {
+                recordMainPassIndirect(m_CommandList, m_DrawArgumentsBuffer);
+                m_HzbValid = false;
             }
+
+            RecordingChunkStats chunkStats;
+            chunkStats.instanceCount = uint32_t(m_Scene->GetSceneGraph()->GetMeshInstances().size());
+            chunkStats.drawCount = uint32_t(m_DrawRecords.size());
+            chunkStats.recordTimeMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - recordStart).count();
+
+            m_RecordingStats.indirect = true;
+            m_RecordingStats.updatedDraws = updatedDraws;
+            m_RecordingStats.multithreaded = false;
+            m_RecordingStats.threadCount = 1;
+            m_RecordingStats.totalTimeMs = chunkStats.recordTimeMs;
+            m_RecordingStats.chunks = { chunkStats };
+
+            cullStatsQueued = culling && !m_DrawRecords.empty();
         }
+        else if (m_Options.multithreadedRecording)
+        {
+            m_HzbValid = false;
+            m_CommandList->close();
+            recordMainPassMultithreaded();
 
-        m_CommandList->close();
-        GetDevice()->executeCommandList(m_CommandList);
-        
-        m_CommandList->open();
+            frameCommandLists.push_back(m_CommandList);
+            for (size_t chunk = 0; chunk < m_RecordingStats.chunks.size(); chunk++)
+                frameCommandLists.push_back(m_ChunkCommandLists[chunk]);
+
+            // The rest of the frame is recorded into the other list, which is submitted after the chunks
+            std::swap(m_CommandList, m_PrologueCommandList);
+            m_CommandList->open();
+        }
+        else
+        {
+            m_HzbValid = false;
+            auto recordStart = std::chrono::high_resolution_clock::now();
+
+            const auto& instances = m_Scene->GetSceneGraph()->GetMeshInstances();
+            uint32_t drawCount = recordMainPassDraws(m_CommandList, 0, instances.size());
+
+            RecordingChunkStats chunkStats;
+            chunkStats.instanceCount = uint32_t(instances.size());
+            chunkStats.drawCount = drawCount;
+            chunkStats.recordTimeMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - recordStart).count();
+
+            m_RecordingStats.indirect = false;
+            m_RecordingStats.multithreaded = false;
+            m_RecordingStats.threadCount = 1;
+            m_RecordingStats.totalTimeMs = chunkStats.recordTimeMs;
+            m_RecordingStats.chunks = { chunkStats };
+        }
+
+        // One batch of transitions stands in for the submission that used to separate the main pass from the resolve
+        m_CommandList->setTextureState(m_JitteredColor, nvrhi::AllSubresources, nvrhi::ResourceStates::ShaderResource);
+        m_CommandList->setTextureState(m_RenderMotionVector, nvrhi::AllSubresources, nvrhi::ResourceStates::ShaderResource);
+        m_CommandList->setTextureState(m_NormalBuffer, nvrhi::AllSubresources, nvrhi::ResourceStates::ShaderResource);
+        m_CommandList->setTextureState(m_HistoryNormal, nvrhi::AllSubresources, nvrhi::ResourceStates::ShaderResource);
+        m_CommandList->commitBarriers();
+        endStage(FRAME_STAGE_MAIN_PASS);
+
+        beginStage(FRAME_STAGE_RESOLVE);
         if (m_currentAAMode != FSR_WITHOUT_RCAS && m_currentAAMode != FSR_WITH_RCAS)
         {
             fillTSSViewConstants(viewConstants, upsampledWidth, upsampledHeight);
 
-            nvrhi::GraphicsState statePost;
-            statePost.pipeline = m_TSSPipeline;
-            statePost.framebuffer = m_TSSFramebuffer;
-            statePost.bindings = { m_TSSBindingSet };
-            statePost.viewport = m_View.GetViewportState();
-            m_CommandList->setGraphicsState(statePost);
-
-            m_CommandList->setPushConstants(&frameStatus, sizeof(frameStatus));
+            std::string tssCapturePrefix;
+            if (m_TssCaptureRequested)
+            {
+                tssCapturePrefix = "./tss_" + std::to_string(GetFrameIndex());
+                captureTSSInputs(tssCapturePrefix, viewConstants, frameStatus);
+                m_TssCaptureRequested = false;
+            }
 
             if (frameHasBeenReset == 1)
             {
-                m_CommandList->clearTextureFloat(m_HistoryColor, nvrhi::AllSubresources, nvrhi::Color(0.f));
+                clearTexture(FRAME_STAGE_RESOLVE, m_HistoryColors[m_HistoryIndex ^ 1]);
             }
 
-            nvrhi::DrawArguments argsPost;
-            argsPost.vertexCount = 3;
-            m_CommandList->draw(argsPost);
+            if (m_Options.computeTSS)
+            {
+                static const int threadGroupDim = 16;
+                int dispatchX = (upsampledWidth + threadGroupDim - 1) / threadGroupDim;
+                int dispatchY = (upsampledHeight + threadGroupDim - 1) / threadGroupDim;
+
+                nvrhi::ComputeState tssState;
+                tssState.pipeline = m_TSSComputePipeline;
+                tssState.bindings = { m_TSSComputeBindingSets[m_HistoryIndex] };
+                m_CommandList->setComputeState(tssState);
+                m_CommandList->setPushConstants(&frameStatus, sizeof(frameStatus));
+                m_CommandList->dispatch(dispatchX, dispatchY);
+            }
+            else
+            {
+                nvrhi::GraphicsState statePost;
+                statePost.pipeline = m_TSSPipeline;
+                statePost.framebuffer = m_TSSFramebuffers[m_HistoryIndex];
+                statePost.bindings = { m_TSSBindingSets[m_HistoryIndex] };
+                statePost.viewport = m_View.GetViewportState();
+                m_CommandList->setGraphicsState(statePost);
+
+                m_CommandList->setPushConstants(&frameStatus, sizeof(frameStatus));
+
+                nvrhi::DrawArguments argsPost;
+                argsPost.vertexCount = 3;
+                m_CommandList->draw(argsPost);
+            }
+
+            m_FrameStageStats.trafficBytes[FRAME_STAGE_RESOLVE] += GetTextureBytes(m_ColorBuffer) + GetTextureBytes(m_HistoryColors[m_HistoryIndex]) +
+                GetTextureBytes(m_ValidSampleCount) + GetTextureBytes(m_FirstOrderMomentum) + GetTextureBytes(m_SecondOrderMomentum);
+
+            if (!tssCapturePrefix.empty())
+                m_FrameCapture->Capture(m_CommandList, m_HistoryColors[m_HistoryIndex], GetTssCaptureFileName(tssCapturePrefix, "output"));
         }
         else
         {
-            m_CommandList->copyTexture(m_FSRInputBuffer, nvrhi::TextureSlice(), m_JitteredColor, nvrhi::TextureSlice());
-            fillEASUConstants(upsampledWidth, upsampledHeight, renderWidth, renderHeight);
+            if (m_TssCaptureRequested)
+            {
+                log::warning("The TSS inputs cannot be captured in the FSR modes");
+                m_TssCaptureRequested = false;
+            }
+
+            // EASU and RCAS run in one dispatch that writes the color buffer directly
+            fillFSRConstants(upsampledWidth, upsampledHeight, renderWidth, renderHeight, m_currentAAMode == FSR_WITH_RCAS);
             static const int threadGroupDim = 16;
             int dispatchX = (upsampledWidth + threadGroupDim - 1) / threadGroupDim;
             int dispatchY = (upsampledHeight + threadGroupDim - 1) / threadGroupDim;
 
-            nvrhi::ComputeState easuState;
-            easuState.pipeline = m_EASUPipeline;
-            easuState.bindings = { m_EASUBindingSet };
-            m_CommandList->setComputeState(easuState);
+            nvrhi::ComputeState fsrState;
+            fsrState.pipeline = m_FSRPipeline;
+            fsrState.bindings = { m_FSRBindingSet };
+            m_CommandList->setComputeState(fsrState);
             m_CommandList->dispatch(dispatchX, dispatchY);
+
+            m_FrameStageStats.trafficBytes[FRAME_STAGE_RESOLVE] += GetTextureBytes(m_ColorBuffer);
         }
-        m_CommandList->close();
-        GetDevice()->executeCommandList(m_CommandList);
+        endStage(FRAME_STAGE_RESOLVE);
 
-        m_CommandList->open();
-        if (m_currentAAMode == FSR_WITH_RCAS)
+        // The output of the temporal modes becomes the history of the next frame
+        if (m_currentAAMode == TEMPORAL_ANTIALIASING || m_currentAAMode == TEMPORAL_SUPERSAMPLING || m_currentAAMode == NATIVE_WITH_TAA)
         {
-            fillRCASConstants();
-            static const int threadGroupDim = 16;
-            int dispatchX = (upsampledWidth + threadGroupDim - 1) / threadGroupDim;
-            int dispatchY = (upsampledHeight + threadGroupDim - 1) / threadGroupDim;
+            m_HistoryIndex ^= 1;
+        }
+
+        beginStage(FRAME_STAGE_OUTPUT);
+        m_CommonPasses->BlitTexture(m_CommandList, framebuffer, m_ColorBuffer, m_BindingCache.get());
+        m_FrameStageStats.trafficBytes[FRAME_STAGE_OUTPUT] += GetTextureBytes(m_ColorBuffer) + GetTextureBytes(framebuffer->getDesc().colorAttachments[0].texture);
 
-            nvrhi::ComputeState rcasState;
-            rcasState.pipeline = m_RCASPipeline;
-            rcasState.bindings = { m_RCASBindingSet };
-            m_CommandList->setComputeState(rcasState);
-            m_CommandList->dispatch(dispatchX, dispatchY);   
+        // Interactive replay dumps every replayed frame; the copy is read back and encoded in the background
+        if (m_CaptureRequested || (replayedThisFrame && !m_BatchReplay))
+        {
+            m_FrameCapture->Capture(m_CommandList, m_ColorBuffer, getCaptureFileName(replayedThisFrame ? replayedFrameIndex : currentFrameIndex));
+            m_FrameStageStats.trafficBytes[FRAME_STAGE_OUTPUT] += 2 * GetTextureBytes(m_ColorBuffer);
+            m_CaptureRequested = false;
         }
+
+        bool diffQueued = false;
+        if (compareThisFrame)
+        {
+            diffQueued = queueDiffReadback(m_CommandList, replayedFrameIndex);
+            if (diffQueued)
+                m_FrameStageStats.trafficBytes[FRAME_STAGE_OUTPUT] += 2 * GetTextureBytes(m_ColorBuffer);
+        }
+
+        endStage(FRAME_STAGE_OUTPUT);
+
         m_CommandList->close();
-        GetDevice()->executeCommandList(m_CommandList);
+        frameCommandLists.push_back(m_CommandList);
 
-        m_CommandList->open();
-        if (m_currentAAMode == FSR_WITH_RCAS)
+        auto submitStart = std::chrono::high_resolution_clock::now();
+        GetDevice()->executeCommandLists(frameCommandLists.data(), frameCommandLists.size());
+        m_FrameStageStats.submitTimeMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - submitStart).count();
+        m_FrameStageStats.submissions = 1;
+        m_FrameStageStats.commandLists = uint32_t(frameCommandLists.size());
+
+        if (stageTimers)
         {
-            m_CommandList->copyTexture(m_ColorBuffer, nvrhi::TextureSlice(), m_FSROutputBuffer, nvrhi::TextureSlice());
+            stageTimers->pending = true;
+            m_FrameStageTimerIndex = (m_FrameStageTimerIndex + 1) % m_FrameStageTimers.size();
         }
-        else if (m_currentAAMode == FSR_WITHOUT_RCAS)
+
+        if (cullStatsQueued)
         {
-            m_CommandList->copyTexture(m_ColorBuffer, nvrhi::TextureSlice(), m_FSRIntermediateBuffer, nvrhi::TextureSlice());
+            CullStatsReadback& readback = m_CullStatsReadbacks[m_CullStatsReadbackIndex];
+            GetDevice()->resetEventQuery(readback.query);
+            GetDevice()->setEventQuery(readback.query, nvrhi::CommandQueue::Graphics);
+            readback.pending = true;
+            m_CullStatsReadbackIndex = (m_CullStatsReadbackIndex + 1) % m_CullStatsReadbacks.size();
         }
-        else if (m_currentAAMode == TEMPORAL_ANTIALIASING || m_currentAAMode == TEMPORAL_SUPERSAMPLING || m_currentAAMode == NATIVE_WITH_TAA)
+
+        if (diffQueued)
         {
-            m_CommandList->copyTexture(m_HistoryColor, nvrhi::TextureSlice(), m_SSColorBuffer, nvrhi::TextureSlice());
+            DiffReadback& readback = m_DiffReadbacks[m_DiffReadbackIndex];
+            GetDevice()->resetEventQuery(readback.query);
+            GetDevice()->setEventQuery(readback.query, nvrhi::CommandQueue::Graphics);
+            readback.pending = true;
+            m_DiffReadbackIndex = (m_DiffReadbackIndex + 1) % m_DiffReadbacks.size();
         }
-        m_CommonPasses->BlitTexture(m_CommandList, framebuffer, m_ColorBuffer, m_BindingCache.get());
-        m_CommandList->copyTexture(m_ColorBufferBackup, nvrhi::TextureSlice(), m_ColorBuffer, nvrhi::TextureSlice());
-        clearUptheSignals();
 
-        m_CommandList->close();
-        GetDevice()->executeCommandList(m_CommandList);
+        m_FrameCapture->EndFrame();
+        m_RenderTargetPool->EndFrame();
+        m_UploadRing->EndFrame();
 
-        if (bReplayCapturedFrame)
+        if (m_BatchReplay)
+        {
+            updateBatchReplay(frameStart);
+        }
+    }
+
+    // Records the draws of instances [firstInstance, lastInstance) with the main pass state
+    uint32_t recordMainPassDraws(nvrhi::ICommandList* commandList, size_t firstInstance, size_t lastInstance)
+    {
+        nvrhi::GraphicsState state;
+        state.pipeline = m_RenderPipeline;
+        state.framebuffer = m_RenderFramebuffer;
+        state.bindings = { m_RenderBindingSet, m_DescriptorTableManager->GetDescriptorTable() };
+        state.viewport = m_View.GetViewportState();
+        commandList->setGraphicsState(state);
+
+        const auto& instances = m_Scene->GetSceneGraph()->GetMeshInstances();
+        uint32_t drawCount = 0;
+
+        for (size_t instanceIndex = firstInstance; instanceIndex < lastInstance; instanceIndex++)
+        {
+            const auto& instance = instances[instanceIndex];
+            const auto& mesh = instance->GetMesh();
+
+            for (size_t i = 0; i < mesh->geometries.size(); i++)
+            {
+                int2 constants = int2(instance->GetInstanceIndex(), int(i));
+                commandList->setPushConstants(&constants, sizeof(constants));
+
+                nvrhi::DrawArguments args;
+                args.instanceCount = 1;
+                args.vertexCount = mesh->geometries[i]->numIndices;
+                commandList->draw(args);
+                ++drawCount;
+            }
+        }
+
+        return drawCount;
+    }
+
+    void createIndirectDrawBuffers(nvrhi::ICommandList* commandList, size_t capacity)
+    {
+        m_DrawCapacity = std::max<size_t>(capacity, 1);
+
+        nvrhi::BufferDesc argumentsDesc;
+        argumentsDesc.byteSize = m_DrawCapacity * sizeof(nvrhi::DrawIndirectArguments);
+        argumentsDesc.isDrawIndirectArgs = true;
+        argumentsDesc.initialState = nvrhi::ResourceStates::IndirectArgument;
+        argumentsDesc.keepInitialState = true;
+        argumentsDesc.debugName = "DrawArguments";
+        m_DrawArgumentsBuffer = GetDevice()->createBuffer(argumentsDesc);
+
+        argumentsDesc.canHaveUAVs = true;
+        argumentsDesc.canHaveRawViews = true;
+        argumentsDesc.debugName = "CulledDrawArguments";
+        m_CulledDrawArgumentsBuffer = GetDevice()->createBuffer(argumentsDesc);
+
+        nvrhi::BufferDesc recordsDesc;
+        recordsDesc.byteSize = m_DrawCapacity * sizeof(DrawRecord);
+        recordsDesc.structStride = sizeof(DrawRecord);
+        recordsDesc.initialState = nvrhi::ResourceStates::ShaderResource;
+        recordsDesc.keepInitialState = true;
+        recordsDesc.debugName = "DrawRecords";
+        m_DrawRecordBuffer = GetDevice()->createBuffer(recordsDesc);
+
+        nvrhi::BufferDesc drawIdDesc;
+        drawIdDesc.byteSize = m_DrawCapacity * sizeof(uint32_t);
+        drawIdDesc.isVertexBuffer = true;
+        drawIdDesc.initialState = nvrhi::ResourceStates::VertexBuffer;
+        drawIdDesc.keepInitialState = true;
+        drawIdDesc.debugName = "DrawIds";
+        m_DrawIdBuffer = GetDevice()->createBuffer(drawIdDesc);
+
+        std::vector<uint32_t> drawIds(m_DrawCapacity);
+        for (size_t i = 0; i < m_DrawCapacity; i++)
+            drawIds[i] = uint32_t(i);
+        commandList->writeBuffer(m_DrawIdBuffer, drawIds.data(), drawIds.size() * sizeof(uint32_t));
+
+        // New buffers start empty, the next update uploads the whole draw list
+        m_DrawRecords.clear();
+        m_DrawArguments.clear();
+        m_DrawListDirty = true;
+    }
+
+    // Rebuilds the draw list on the CPU when the instances changed and uploads only the ranges that
+    // differ from the previous list. Returns the number of draws that were written.
+    uint32_t updateIndirectDrawBuffers(nvrhi::ICommandList* commandList)
+    {
+        // Instances, geometries and their object space bounds are fixed once the scene is loaded
+        const size_t instanceCount = m_Scene->GetSceneGraph()->GetMeshInstances().size();
+        if (!m_DrawListDirty && instanceCount == m_DrawListInstanceCount)
+            return 0;
+
+        m_DrawListInstanceCount = instanceCount;
+
+        m_NewDrawRecords.clear();
+        m_NewDrawArguments.clear();
+
+        for (const auto& instance : m_Scene->GetSceneGraph()->GetMeshInstances())
+        {
+            const auto& mesh = instance->GetMesh();
+
+            for (size_t i = 0; i < mesh->geometries.size(); i++)
+            {
+                const auto& geometry = mesh->geometries[i];
+
+                DrawRecord record = {};
+                record.instance = uint32_t(instance->GetInstanceIndex());
+                record.geometryInMesh = uint32_t(i);
+                record.vertexCount = geometry->numIndices;
+                record.boundsMin = float4(geometry->objectSpaceBounds.m_mins, 0.f);
+                record.boundsMax = float4(geometry->objectSpaceBounds.m_maxs, 0.f);
+
+                nvrhi::DrawIndirectArguments args;
+                args.vertexCount = geometry->numIndices;
+                args.instanceCount = 1;
+                args.startVertexLocation = 0;
+                args.startInstanceLocation = uint32_t(m_NewDrawRecords.size()); // selects DRAW_ID
+
+                m_NewDrawRecords.push_back(record);
+                m_NewDrawArguments.push_back(args);
+            }
+        }
+
+        if (m_NewDrawRecords.size() > m_DrawCapacity)
+        {
+            createIndirectDrawBuffers(commandList, m_NewDrawRecords.size() + m_NewDrawRecords.size() / 2);
+
+            // The binding sets reference the old buffers
+            m_RenderBindingSet = nullptr;
+            m_CullBindingSet = nullptr;
+            createRenderingPipeline();
+            createCullingPipeline();
+        }
+        m_DrawListDirty = false;
+
+        // Find the dirty range; records past the end of the old list are always written
+        size_t firstDirty = m_NewDrawRecords.size();
+        size_t lastDirty = 0;
+        for (size_t i = 0; i < m_NewDrawRecords.size(); i++)
+        {
+            // The record includes the vertex count, so it also covers the arguments
+            bool same = i < m_DrawRecords.size()
+                && memcmp(&m_DrawRecords[i], &m_NewDrawRecords[i], sizeof(DrawRecord)) == 0;
+
+            if (!same)
+            {
+                firstDirty = std::min(firstDirty, i);
+                lastDirty = i + 1;
+            }
+        }
+
+        std::swap(m_DrawRecords, m_NewDrawRecords);
+        std::swap(m_DrawArguments, m_NewDrawArguments);
+
+        if (firstDirty >= lastDirty)
+            return 0;
+
+        const size_t count = lastDirty - firstDirty;
+        m_UploadRing->Write(m_UploadContext, commandList, m_DrawRecordBuffer, &m_DrawRecords[firstDirty], count * sizeof(DrawRecord), firstDirty * sizeof(DrawRecord));
+        m_UploadRing->Write(m_UploadContext, commandList, m_DrawArgumentsBuffer, &m_DrawArguments[firstDirty], count * sizeof(nvrhi::DrawIndirectArguments), firstDirty * sizeof(nvrhi::DrawIndirectArguments));
+
+        return uint32_t(count);
+    }
+
+    void recordMainPassIndirect(nvrhi::ICommandList* commandList, nvrhi::IBuffer* drawArguments)
+    {
+        if (m_DrawRecords.empty())
+            return;
+
+        nvrhi::GraphicsState state;
+        state.pipeline = m_RenderIndirectPipeline;
+        state.framebuffer = m_RenderFramebuffer;
+        state.bindings = { m_RenderBindingSet, m_DescriptorTableManager->GetDescriptorTable() };
+        state.vertexBuffers = { { m_DrawIdBuffer, 0, 0 } };
+        state.indirectParams = drawArguments;
+        state.viewport = m_View.GetViewportState();
+        commandList->setGraphicsState(state);
+
+        commandList->drawIndirect(0, uint32_t(m_DrawRecords.size()));
+    }
+
+    // Compacts the visible draws to the front of m_CulledDrawArgumentsBuffer. There is no count buffer
+    // for drawIndirect, so the rest of the buffer is cleared and the main pass still draws the whole list.
+    void cullIndirectDraws(nvrhi::ICommandList* commandList)
+    {
+        const uint32_t drawCount = uint32_t(m_DrawRecords.size());
+        const nvrhi::TextureDesc& depthDesc = m_DepthBuffer->getDesc();
+
+        CullingConstants constants = {};
+        ComputeFrustumPlanes(m_View.GetViewProjectionMatrix(), constants.frustumPlanes);
+        constants.matWorldToClipHzb = m_HzbWorldToClip;
+        constants.depthSize = uint2(depthDesc.width, depthDesc.height);
+        constants.hzbMipCount = m_Hzb->getDesc().mipLevels;
+        constants.drawCount = drawCount;
+        constants.flags = (m_Options.frustumCulling ? CULL_FRUSTUM : 0) | (m_Options.occlusionCulling && m_HzbValid ? CULL_OCCLUSION : 0);
+        commandList->writeBuffer(m_CullingConstants, &constants, sizeof(constants));
+
+        commandList->clearBufferUInt(m_CulledDrawArgumentsBuffer, 0);
+        commandList->clearBufferUInt(m_CullStatsBuffer, 0);
+
+        if (drawCount == 0)
+            return;
+
+        nvrhi::ComputeState state;
+        state.pipeline = m_CullPipeline;
+        state.bindings = { m_CullBindingSet };
+        commandList->setComputeState(state);
+        commandList->dispatch((drawCount + 63) / 64);
+
+        CullStatsReadback& readback = m_CullStatsReadbacks[m_CullStatsReadbackIndex];
+        if (readback.pending)
+        {
+            GetDevice()->waitEventQuery(readback.query);
+            readCullStats(readback);
+        }
+        commandList->copyBuffer(readback.buffer, 0, m_CullStatsBuffer, 0, CULL_STAT_COUNT * sizeof(uint32_t));
+        readback.drawCount = drawCount;
+    }
+
+    // Reduces this frame's depth buffer for the occlusion test of the next frame
+    void buildHzb(nvrhi::ICommandList* commandList)
+    {
+        const nvrhi::TextureDesc& depthDesc = m_DepthBuffer->getDesc();
+        const nvrhi::TextureDesc& hzbDesc = m_Hzb->getDesc();
+
+        HzbConstants constants;
+        constants.srcSize = uint2(depthDesc.width, depthDesc.height);
+
+        nvrhi::ComputeState state;
+        state.pipeline = m_HzbPipeline;
+
+        for (uint32_t level = 0; level < hzbDesc.mipLevels; level++)
+        {
+            constants.dstSize = uint2(std::max(hzbDesc.width >> level, 1u), std::max(hzbDesc.height >> level, 1u));
+
+            state.bindings = { m_HzbBindingSets[level] };
+            commandList->setComputeState(state);
+            commandList->setPushConstants(&constants, sizeof(constants));
+            commandList->dispatch((constants.dstSize.x + 7) / 8, (constants.dstSize.y + 7) / 8);
+
+            constants.srcSize = constants.dstSize;
+        }
+
+        m_HzbWorldToClip = m_View.GetViewProjectionMatrix();
+        m_HzbValid = true;
+    }
+
+    void readCullStats(CullStatsReadback& readback)
+    {
+        const uint32_t* counts = static_cast<const uint32_t*>(GetDevice()->mapBuffer(readback.buffer, nvrhi::CpuAccessMode::Read));
+        if (counts)
+        {
+            CullingStats& stats = m_RecordingStats.culling;
+            memcpy(stats.counts, counts, sizeof(stats.counts));
+            stats.drawCount = readback.drawCount;
+            stats.valid = true;
+            GetDevice()->unmapBuffer(readback.buffer);
+        }
+        readback.pending = false;
+    }
+
+    // Reads the stage timers of every frame that the GPU has finished
+    void resolveFrameStageTimers()
+    {
+        for (size_t i = 0; i < m_FrameStageTimers.size(); i++)
+        {
+            FrameStageTimers& timers = m_FrameStageTimers[(m_FrameStageTimerIndex + i) % m_FrameStageTimers.size()];
+            if (!timers.pending || !GetDevice()->pollTimerQuery(timers.queries[FRAME_STAGE_OUTPUT]))
+                continue;
+
+            for (int stage = 0; stage < FRAME_STAGE_COUNT; stage++)
+            {
+                m_FrameStageStats.gpuTimeMs[stage] = double(GetDevice()->getTimerQueryTime(timers.queries[stage])) * 1000.0;
+                GetDevice()->resetTimerQuery(timers.queries[stage]);
+            }
+            timers.pending = false;
+        }
+    }
+
+    // Picks up every statistics copy that the GPU has finished, oldest first
+    void pollCullStats()
+    {
+        for (size_t i = 0; i < m_CullStatsReadbacks.size(); i++)
+        {
+            CullStatsReadback& readback = m_CullStatsReadbacks[(m_CullStatsReadbackIndex + i) % m_CullStatsReadbacks.size()];
+            if (readback.pending && GetDevice()->pollEventQuery(readback.query))
+                readCullStats(readback);
+        }
+    }
+
+    // The main pass reads static constant buffers, so they are written once on the frame's first
+    // command list and every recording chunk sees the same data
+    void uploadMainPassConstants(nvrhi::ICommandList* commandList)
+    {
+        m_UploadRing->Write(m_UploadContext, commandList, m_MainPassViewConstants, &m_MainPassConstants.thisView, sizeof(m_MainPassConstants.thisView));
+        m_UploadRing->Write(m_UploadContext, commandList, m_LastFrameViewConstants, &m_MainPassConstants.lastView, sizeof(m_MainPassConstants.lastView));
+        m_UploadRing->Write(m_UploadContext, commandList, m_MainPassSamplingRate, &m_MainPassConstants.samplingRate, sizeof(m_MainPassConstants.samplingRate));
+        m_UploadRing->Write(m_UploadContext, commandList, m_FrameIndex, &m_MainPassConstants.frameStatus, sizeof(m_MainPassConstants.frameStatus));
+    }
+
+    uint32_t getRecordingThreadIndex(std::thread::id id)
+    {
+        auto it = std::find(m_RecordingThreadIds.begin(), m_RecordingThreadIds.end(), id);
+        if (it != m_RecordingThreadIds.end())
+            return uint32_t(it - m_RecordingThreadIds.begin());
+
+        m_RecordingThreadIds.push_back(id);
+        return uint32_t(m_RecordingThreadIds.size() - 1);
+    }
+
+    // Splits the mesh instances into one chunk per worker with roughly equal draw counts and records
+    // each chunk into its own deferred command list. The lists are closed when this returns.
+    void recordMainPassMultithreaded()
+    {
+#ifdef DONUT_WITH_TASKFLOW
+        using namespace std::chrono;
+
+        auto recordStart = high_resolution_clock::now();
+
+        const auto& instances = m_Scene->GetSceneGraph()->GetMeshInstances();
+
+        size_t totalDraws = 0;
+        for (const auto& instance : instances)
+            totalDraws += instance->GetMesh()->geometries.size();
+
+        const size_t chunkCount = std::max<size_t>(1, std::min(m_ChunkCommandLists.size(), instances.size()));
+        const size_t drawsPerChunk = (totalDraws + chunkCount - 1) / chunkCount;
+
+        std::vector<std::pair<size_t, size_t>> ranges;
+        size_t rangeStart = 0;
+        size_t rangeDraws = 0;
+        for (size_t instanceIndex = 0; instanceIndex < instances.size(); instanceIndex++)
+        {
+            rangeDraws += instances[instanceIndex]->GetMesh()->geometries.size();
+            if (rangeDraws >= drawsPerChunk && ranges.size() + 1 < chunkCount)
+            {
+                ranges.push_back({ rangeStart, instanceIndex + 1 });
+                rangeStart = instanceIndex + 1;
+                rangeDraws = 0;
+            }
+        }
+        ranges.push_back({ rangeStart, instances.size() });
+
+        std::vector<RecordingChunkStats> chunkStats(ranges.size());
+        std::vector<std::thread::id> chunkThreads(ranges.size());
+
+        tf::Taskflow taskFlow;
+        for (size_t chunk = 0; chunk < ranges.size(); chunk++)
+        {
+            taskFlow.emplace([this, chunk, &ranges, &chunkStats, &chunkThreads]()
+            {
+                auto chunkStart = high_resolution_clock::now();
+
+                nvrhi::ICommandList* commandList = m_ChunkCommandLists[chunk];
+                commandList->open();
+                chunkStats[chunk].drawCount = recordMainPassDraws(commandList, ranges[chunk].first, ranges[chunk].second);
+                commandList->close();
+
+                chunkStats[chunk].instanceCount = uint32_t(ranges[chunk].second - ranges[chunk].first);
+                chunkStats[chunk].recordTimeMs = duration<double, std::milli>(high_resolution_clock::now() - chunkStart).count();
+                chunkThreads[chunk] = std::this_thread::get_id();
+            });
+        }
+
+        m_Executor->run(taskFlow).wait();
+
+        for (size_t chunk = 0; chunk < ranges.size(); chunk++)
+            chunkStats[chunk].threadIndex = getRecordingThreadIndex(chunkThreads[chunk]);
+
+        m_RecordingStats.indirect = false;
+        m_RecordingStats.multithreaded = true;
+        m_RecordingStats.threadCount = uint32_t(m_Executor->num_workers());
+        m_RecordingStats.totalTimeMs = duration<double, std::milli>(high_resolution_clock::now() - recordStart).count();
+        m_RecordingStats.chunks = std::move(chunkStats);
+#endif
+    }
+
+    // Copies the color buffer into the next staging texture of the ring. When that one is still in
+    // flight, the GPU is several compared frames behind and the copy waits for it.
+    bool queueDiffReadback(nvrhi::ICommandList* commandList, size_t replayedFrameIndex)
+    {
+        const nvrhi::TextureDesc& colorDesc = m_ColorBuffer->getDesc();
+        if (!IsCaptureFormatSupported(colorDesc.format))
+        {
+            log::warning("Cannot compare frame %d: format %s is not supported", int(replayedFrameIndex), nvrhi::getFormatInfo(colorDesc.format).name);
+            return false;
+        }
+
+        DiffReadback& readback = m_DiffReadbacks[m_DiffReadbackIndex];
+        if (readback.pending)
+        {
+            GetDevice()->waitEventQuery(readback.query);
+            resolveDiffReadback(readback);
+        }
+
+        if (readback.stagingTexture)
+        {
+            const nvrhi::TextureDesc& stagingDesc = readback.stagingTexture->getDesc();
+            if (stagingDesc.width != colorDesc.width || stagingDesc.height != colorDesc.height || stagingDesc.format != colorDesc.format)
+                readback.stagingTexture = nullptr;
+        }
+
+        if (!readback.stagingTexture)
+        {
+            nvrhi::TextureDesc stagingDesc;
+            stagingDesc.width = colorDesc.width;
+            stagingDesc.height = colorDesc.height;
+            stagingDesc.format = colorDesc.format;
+            stagingDesc.debugName = "ReplayDiffStaging";
+            readback.stagingTexture = GetDevice()->createStagingTexture(stagingDesc, nvrhi::CpuAccessMode::Read);
+        }
+
+        commandList->copyTexture(readback.stagingTexture, nvrhi::TextureSlice(), m_ColorBuffer, nvrhi::TextureSlice());
+        readback.frameIndex = replayedFrameIndex;
+        readback.modeIndex = m_BatchModeIndex;
+        return true;
+    }
+
+    // Converts a finished copy to 8-bit RGB, then stores it as the reference or compares it with the
+    // reference frame read back from the file
+    void resolveDiffReadback(DiffReadback& readback)
+    {
+        readback.pending = false;
+
+        CapturedImage image;
+        const nvrhi::TextureDesc& desc = readback.stagingTexture->getDesc();
+        image.width = desc.width;
+        image.height = desc.height;
+        image.format = desc.format;
+        image.pixels.resize(image.GetRowSize() * desc.height);
+
+        size_t rowPitch = 0;
+        const uint8_t* mapped = static_cast<const uint8_t*>(GetDevice()->mapStagingTexture(readback.stagingTexture, nvrhi::TextureSlice(), nvrhi::CpuAccessMode::Read, &rowPitch));
+        if (!mapped)
+            return;
+
+        const size_t rowSize = image.GetRowSize();
+        for (uint32_t y = 0; y < desc.height; y++)
+            memcpy(image.pixels.data() + y * rowSize, mapped + y * rowPitch, rowSize);
+
+        GetDevice()->unmapStagingTexture(readback.stagingTexture);
+
+        std::vector<uint8_t> pixels(size_t(desc.width) * desc.height * 3);
+        for (uint32_t y = 0; y < desc.height; y++)
+        {
+            for (uint32_t x = 0; x < desc.width; x++)
+            {
+                dm::float4 pixel = image.GetPixel(x, y);
+                uint8_t* dst = &pixels[(size_t(y) * desc.width + x) * 3];
+                dst[0] = uint8_t(std::clamp(pixel.x, 0.f, 1.f) * 255.f + 0.5f);
+                dst[1] = uint8_t(std::clamp(pixel.y, 0.f, 1.f) * 255.f + 0.5f);
+                dst[2] = uint8_t(std::clamp(pixel.z, 0.f, 1.f) * 255.f + 0.5f);
+            }
+        }
+
+        if (readback.modeIndex == 0)
+        {
+            m_ReferenceFile.seekp(0, std::ios::end);
+            m_ReferenceOffsets[readback.frameIndex] = uint64_t(m_ReferenceFile.tellp());
+            m_ReferenceFile.write(reinterpret_cast<const char*>(pixels.data()), std::streamsize(pixels.size()));
+            return;
+        }
+
+        auto offset = m_ReferenceOffsets.find(readback.frameIndex);
+        if (offset == m_ReferenceOffsets.end())
+            return;
+
+        std::vector<uint8_t> reference(pixels.size());
+        m_ReferenceFile.seekg(std::streamoff(offset->second));
+        if (!m_ReferenceFile.read(reinterpret_cast<char*>(reference.data()), std::streamsize(reference.size())))
+        {
+            // A reference frame of another size runs past the end of the file
+            m_ReferenceFile.clear();
+            return;
+        }
+
+        ReplayModeStats& stats = m_BatchStats[readback.modeIndex];
+        for (size_t i = 0; i < pixels.size(); i++)
+        {
+            double diff = double(pixels[i]) - double(reference[i]);
+            stats.squaredErrorSum += diff * diff;
+        }
+        stats.comparedSamples += pixels.size();
+        ++stats.comparedFrames;
+    }
+
+    // Resolves the finished copies oldest first, so that reference frames are stored before any mode compares against them
+    void pollDiffReadbacks(bool wait)
+    {
+        for (size_t i = 0; i < m_DiffReadbacks.size(); i++)
+        {
+            DiffReadback& readback = m_DiffReadbacks[(m_DiffReadbackIndex + i) % m_DiffReadbacks.size()];
+            if (!readback.pending)
+                continue;
+
+            if (wait)
+                GetDevice()->waitEventQuery(readback.query);
+            else if (!GetDevice()->pollEventQuery(readback.query))
+                break;
+
+            resolveDiffReadback(readback);
+        }
+    }
+
+    void updateBatchReplay(std::chrono::high_resolution_clock::time_point frameStart)
+    {
+        using namespace std::chrono;
+
+        ReplayModeStats& stats = m_BatchStats.back();
+
+        double cpuTime = duration<double, std::milli>(high_resolution_clock::now() - frameStart).count();
+        stats.cpuTimeSum += cpuTime;
+        stats.cpuTimeMax = std::max(stats.cpuTimeMax, cpuTime);
+        if (stats.frames > 0)
+        {
+            stats.frameIntervalSum += duration<double, std::milli>(frameStart - m_LastFrameStart).count();
+            ++stats.frameIntervals;
+        }
+        ++stats.frames;
+        m_LastFrameStart = frameStart;
+
+        pollDiffReadbacks(false);
+
+        if (currentFrameIndex < m_TrailReader.GetFrameCount())
+            return;
+
+        ++m_BatchModeIndex;
+        if (m_BatchModeIndex < m_Options.replayModes.size())
+        {
+            beginReplay(m_Options.replayModes[m_BatchModeIndex]);
+            return;
+        }
+
+        pollDiffReadbacks(true);
+        writeBatchReplayStats();
+
+        m_ReferenceFile.close();
+        std::error_code error;
+        std::filesystem::remove(m_ReferenceFileName, error);
+
+        bReplayCapturedFrame = false;
+        glfwSetWindowShouldClose(GetDeviceManager()->GetWindow(), GLFW_TRUE);
+    }
+
+    void writeBatchReplayStats()
+    {
+        std::ofstream csv(m_Options.replayStatsFileName);
+        csv << "mode,frames,avg_cpu_ms,max_cpu_ms,avg_frame_ms,compared_frames,rmse,psnr_db\n";
+
+        const char* referenceName = GetAAModeName(m_Options.replayModes[0]);
+        log::info("Replayed %d frames per mode, image differences are relative to %s:", int(m_TrailReader.GetFrameCount()), referenceName);
+
+        for (const ReplayModeStats& stats : m_BatchStats)
+        {
+            double avgCpu = stats.frames ? stats.cpuTimeSum / stats.frames : 0.0;
+            double avgFrame = stats.frameIntervals ? stats.frameIntervalSum / stats.frameIntervals : 0.0;
+            double rmse = stats.comparedSamples ? std::sqrt(stats.squaredErrorSum / double(stats.comparedSamples)) : 0.0;
+            double psnr = rmse > 0.0 ? 20.0 * std::log10(255.0 / rmse) : std::numeric_limits<double>::infinity();
+
+            log::info("  %-18s cpu %.3f ms (max %.3f), frame %.3f ms, rmse %.3f, psnr %.2f dB",
+                GetAAModeName(stats.mode), avgCpu, stats.cpuTimeMax, avgFrame, rmse, psnr);
+
+            csv << GetAAModeName(stats.mode) << ',' << stats.frames << ',' << avgCpu << ',' << stats.cpuTimeMax << ','
+                << avgFrame << ',' << stats.comparedFrames << ',' << rmse << ',' << psnr << '\n';
+        }
+    }
+
+    std::string getCaptureFileName(size_t frameIndex) const
+    {
+        return "./" + currentAAModeToStr + "_" + std::to_string(frameIndex) + "." + m_Options.captureFormat;
+    }
+};
+
+// Overlay with the main pass recording times, one row per chunk and per worker thread
+class RecordingStatsOverlay : public app::ImGui_Renderer
+{
+private:
+    BindlessRendering& m_App;
+
+public:
+    RecordingStatsOverlay(app::DeviceManager* deviceManager, BindlessRendering& app)
+        : ImGui_Renderer(deviceManager)
+        , m_App(app)
+    {
+        ImGui::GetIO().IniFilename = nullptr;
+    }
+
+private:
+    // The recording window returns early in the indirect mode, so it is drawn separately from the stage window
+    void buildRecordingWindow()
+    {
+        const MainPassRecordingStats& stats = m_App.GetRecordingStats();
+
+        ImGui::SetNextWindowPos(ImVec2(10.f, 10.f), 0);
+        ImGui::Begin("Main Pass Recording", 0, ImGuiWindowFlags_AlwaysAutoResize);
+
+        bool indirect = m_App.IsIndirectDrawingEnabled();
+        if (ImGui::Checkbox("Indirect draws (I)", &indirect))
+            m_App.SetIndirectDrawing(indirect);
+
+        if (stats.indirect)
         {
-            if (currentFrameIndex < recordedFrameIndex)
+            const RecordingChunkStats& chunk = stats.chunks[0];
+            ImGui::Text("Recording: %.3f ms, 1 drawIndirect for %u draws", stats.totalTimeMs, chunk.drawCount);
+            ImGui::Text("Draw records updated this frame: %u", stats.updatedDraws);
+
+            ImGui::Separator();
+            bool frustumCulling = m_App.IsFrustumCullingEnabled();
+            if (ImGui::Checkbox("Frustum culling (F)", &frustumCulling))
+                m_App.SetFrustumCulling(frustumCulling);
+            bool occlusionCulling = m_App.IsOcclusionCullingEnabled();
+            if (ImGui::Checkbox("Occlusion culling (O)", &occlusionCulling))
+                m_App.SetOcclusionCulling(occlusionCulling);
+
+            const CullingStats& culling = stats.culling;
+            if (culling.valid && culling.drawCount > 0 && (frustumCulling || occlusionCulling))
             {
-                captureCurrentFrame();
+                const double toPercent = 100.0 / culling.drawCount;
+                ImGui::Text("Visible: %u (%.1f%%)", culling.counts[CULL_STAT_VISIBLE], culling.counts[CULL_STAT_VISIBLE] * toPercent);
+                ImGui::Text("Frustum culled: %u (%.1f%%)", culling.counts[CULL_STAT_FRUSTUM], culling.counts[CULL_STAT_FRUSTUM] * toPercent);
+                ImGui::Text("Occlusion culled: %u (%.1f%%)", culling.counts[CULL_STAT_OCCLUSION], culling.counts[CULL_STAT_OCCLUSION] * toPercent);
             }
+
+            ImGui::End();
+            return;
+        }
+
+        bool multithreaded = m_App.IsMultithreadedRecordingEnabled();
+        if (m_App.IsMultithreadedRecordingSupported())
+        {
+            if (ImGui::Checkbox("Multithreaded recording (M)", &multithreaded))
+                m_App.SetMultithreadedRecording(multithreaded);
         }
+        else
+        {
+            ImGui::Text("Multithreaded recording requires Taskflow");
+        }
+
+        ImGui::Text("Recording: %.3f ms on %u thread(s), %d chunk(s)", stats.totalTimeMs, stats.threadCount, int(stats.chunks.size()));
+
+        std::vector<double> threadTimes;
+        for (const RecordingChunkStats& chunk : stats.chunks)
+        {
+            if (threadTimes.size() <= chunk.threadIndex)
+                threadTimes.resize(chunk.threadIndex + 1, 0.0);
+            threadTimes[chunk.threadIndex] += chunk.recordTimeMs;
+        }
+
+        ImGui::Separator();
+        for (size_t chunk = 0; chunk < stats.chunks.size(); chunk++)
+        {
+            const RecordingChunkStats& chunkStats = stats.chunks[chunk];
+            ImGui::Text("Chunk %d: thread %u, %u instances, %u draws, %.3f ms",
+                int(chunk), chunkStats.threadIndex, chunkStats.instanceCount, chunkStats.drawCount, chunkStats.recordTimeMs);
+        }
+
+        if (stats.multithreaded)
+        {
+            ImGui::Separator();
+            for (size_t thread = 0; thread < threadTimes.size(); thread++)
+            {
+                if (threadTimes[thread] > 0.0)
+                    ImGui::Text("Thread %d: %.3f ms", int(thread), threadTimes[thread]);
+            }
+        }
+
+        ImGui::End();
     }
 
-    void captureCurrentFrame()
+    void buildFrameStagesWindow()
     {
-        std::string frameBmpName = "./" + currentAAModeToStr + "_" + std::to_string(currentFrameIndex) + ".bmp";
-        donut::engine::SaveTextureToFile(GetDevice(), m_CommonPasses.get(), m_ColorBufferBackup, nvrhi::ResourceStates::RenderTarget, frameBmpName.c_str());
+        const FrameStageStats& stageStats = m_App.GetFrameStageStats();
+
+        ImGui::SetNextWindowPos(ImVec2(10.f, 400.f), ImGuiCond_FirstUseEver);
+        ImGui::Begin("Frame Stages", 0, ImGuiWindowFlags_AlwaysAutoResize);
+
+        double cpuTotal = 0.0;
+        double gpuTotal = 0.0;
+        uint64_t trafficTotal = 0;
+        for (int stage = 0; stage < FRAME_STAGE_COUNT; stage++)
+        {
+            ImGui::Text("%-10s CPU %.3f ms, GPU %.3f ms, %.1f MB", GetFrameStageName(stage), stageStats.cpuTimeMs[stage], stageStats.gpuTimeMs[stage],
+                double(stageStats.trafficBytes[stage]) / (1024.0 * 1024.0));
+            cpuTotal += stageStats.cpuTimeMs[stage];
+            gpuTotal += stageStats.gpuTimeMs[stage];
+            trafficTotal += stageStats.trafficBytes[stage];
+        }
+        ImGui::Separator();
+        ImGui::Text("%-10s CPU %.3f ms, GPU %.3f ms, %.1f MB", "Total", cpuTotal, gpuTotal, double(trafficTotal) / (1024.0 * 1024.0));
+        ImGui::TextDisabled("MB: full-screen clears, copies, blits and resolve outputs");
+        ImGui::Text("Submissions: %u with %u command list(s), %.3f ms", stageStats.submissions, stageStats.commandLists, stageStats.submitTimeMs);
+
+        ImGui::End();
+    }
+
+protected:
+    void buildUI() override
+    {
+        buildRecordingWindow();
+        buildFrameStagesWindow();
     }
 };
 
@@ -971,6 +2341,19 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLine
 int main(int __argc, const char** __argv)
 #endif
 {
+    // The CPU references of the culling stage and the TSS resolve need neither a window nor a device
+    for (int i = 1; i < __argc; i++)
+    {
+        if (strcmp(__argv[i], "-cull-selftest") == 0)
+            return RunCullingSelfTest() == 0 ? 0 : 1;
+        if (strcmp(__argv[i], "-upload-ring-selftest") == 0)
+            return RunUploadRingSelfTest() == 0 ? 0 : 1;
+        if (strcmp(__argv[i], "-tss-benchmark") == 0)
+            return RunTssBenchmark() == 0 ? 0 : 1;
+        if (strcmp(__argv[i], "-tss-reference") == 0 && i + 1 < __argc)
+            return RunTssReference(__argv[i + 1]) == 0 ? 0 : 1;
+    }
+
     nvrhi::GraphicsAPI api = app::GetGraphicsAPIFromCommandLine(__argc, __argv);
     if (api == nvrhi::GraphicsAPI::D3D11)
     {
@@ -989,6 +2372,89 @@ int main(int __argc, const char** __argv)
     deviceParams.backBufferWidth = 1920;
     deviceParams.backBufferHeight = 1080;
 
+    BindlessRenderingOptions options;
+    options.pipelinesMatchFramebufferSize = deviceParams.enableNvrhiValidationLayer;
+    for (int i = 1; i < __argc; i++)
+    {
+        if (strcmp(__argv[i], "-trail") == 0 && i + 1 < __argc)
+        {
+            options.trailFileName = __argv[++i];
+        }
+        else if (strcmp(__argv[i], "-trail-raw") == 0)
+        {
+            options.quantizeTrail = false;
+        }
+        else if (strcmp(__argv[i], "-replay") == 0 && i + 1 < __argc)
+        {
+            options.replayFileName = __argv[++i];
+        }
+        else if (strcmp(__argv[i], "-replay-stats") == 0 && i + 1 < __argc)
+        {
+            options.replayStatsFileName = __argv[++i];
+        }
+        else if (strcmp(__argv[i], "-diff-interval") == 0 && i + 1 < __argc)
+        {
+            options.diffInterval = std::max(1, atoi(__argv[++i]));
+        }
+        else if (strcmp(__argv[i], "-capture-format") == 0 && i + 1 < __argc)
+        {
+            options.captureFormat = __argv[++i];
+        }
+        else if (strcmp(__argv[i], "-direct-draws") == 0)
+        {
+            options.indirectDraws = false;
+        }
+        else if (strcmp(__argv[i], "-no-frustum-culling") == 0)
+        {
+            options.frustumCulling = false;
+        }
+        else if (strcmp(__argv[i], "-no-occlusion-culling") == 0)
+        {
+            options.occlusionCulling = false;
+        }
+        else if (strcmp(__argv[i], "-tss-compute") == 0)
+        {
+            options.computeTSS = true;
+        }
+        else if (strcmp(__argv[i], "-single-threaded") == 0)
+        {
+            options.multithreadedRecording = false;
+        }
+        else if (strcmp(__argv[i], "-record-threads") == 0 && i + 1 < __argc)
+        {
+            options.recordingThreads = std::max(0, atoi(__argv[++i]));
+        }
+        else if (strcmp(__argv[i], "-aa-modes") == 0 && i + 1 < __argc)
+        {
+            std::string modes = __argv[++i];
+            if (modes == "all")
+            {
+                for (int mode = 0; mode < PLACE_HOLDER; mode++)
+                    options.replayModes.push_back(mode);
+            }
+            else
+            {
+                std::stringstream modeStream(modes);
+                std::string mode;
+                while (std::getline(modeStream, mode, ','))
+                {
+                    int value = atoi(mode.c_str());
+                    if (value >= 0 && value < PLACE_HOLDER)
+                        options.replayModes.push_back(value);
+                }
+            }
+        }
+    }
+
+    if (!options.replayFileName.empty())
+    {
+        if (options.replayModes.empty())
+            options.replayModes.push_back(TEMPORAL_SUPERSAMPLING);
+
+        // Measure the actual rendering cost rather than the display refresh rate
+        deviceParams.vsyncEnabled = false;
+    }
+
     if (!deviceManager->CreateWindowDeviceAndSwapChain(deviceParams, g_WindowTitle))
     {
         log::fatal("Cannot initialize a graphics device with the requested parameters");
@@ -997,10 +2463,22 @@ int main(int __argc, const char** __argv)
     
     {
         BindlessRendering example(deviceManager);
-        if (example.Init())
+        if (example.Init(options))
         {
+            // Batch replays measure the example alone, without the overlay
+            std::unique_ptr<RecordingStatsOverlay> overlay;
+            if (options.replayFileName.empty())
+            {
+                overlay = std::make_unique<RecordingStatsOverlay>(deviceManager, example);
+                overlay->Init(example.GetShaderFactory());
+            }
+
             deviceManager->AddRenderPassToBack(&example);
+            if (overlay)
+                deviceManager->AddRenderPassToBack(overlay.get());
             deviceManager->RunMessageLoop();
+            if (overlay)
+                deviceManager->RemoveRenderPass(overlay.get());
             deviceManager->RemoveRenderPass(&example);
         }
     }
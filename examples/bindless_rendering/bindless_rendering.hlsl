@@ -25,6 +25,7 @@
 #include <donut/shaders/bindless.h>
 #include <donut/shaders/view_cb.h>
 #include <donut/shaders/packing.hlsli>
+#include "culling_cb.h"
 
 #ifdef SPIRV
 #define VK_PUSH_CONSTANT [[vk::push_constant]]
@@ -49,24 +50,27 @@ VK_PUSH_CONSTANT ConstantBuffer<InstanceConstants> g_Instance : register(b4);
 StructuredBuffer<InstanceData> t_InstanceData : register(t0);
 StructuredBuffer<GeometryData> t_GeometryData : register(t1);
 StructuredBuffer<MaterialConstants> t_MaterialConstants : register(t2);
+StructuredBuffer<DrawRecord> t_DrawRecords : register(t3);
 
 SamplerState s_MaterialSampler : register(s0);
 
 VK_BINDING(0, 1) ByteAddressBuffer t_BindlessBuffers[] : register(t0, space1);
 VK_BINDING(1, 1) Texture2D t_BindlessTextures[] : register(t0, space2);
 
-void vs_main(
-    in uint i_vertexID : SV_VertexID,
-    out float4 o_position : SV_Position,
-    out float4 o_curr_position : CURR_POSITION,
-    out float4 o_prev_position : PREV_POSITION,
-    out float3 o_normal_vector : NORMAL_VECTOR,
-    out float3 o_prev_normal : PREV_NORMAL,
-    out float2 o_uv : TEXCOORD,
-    out uint o_material : MATERIAL)
+void TransformVertex(
+    uint instanceIndex,
+    uint geometryInMesh,
+    uint i_vertexID,
+    out float4 o_position,
+    out float4 o_curr_position,
+    out float4 o_prev_position,
+    out float3 o_normal_vector,
+    out float3 o_prev_normal,
+    out float2 o_uv,
+    out uint o_material)
 {
-    InstanceData instance = t_InstanceData[g_Instance.instance];
-    GeometryData geometry = t_GeometryData[instance.firstGeometryIndex + g_Instance.geometryInMesh];
+    InstanceData instance = t_InstanceData[instanceIndex];
+    GeometryData geometry = t_GeometryData[instance.firstGeometryIndex + geometryInMesh];
 
     ByteAddressBuffer indexBuffer = t_BindlessBuffers[geometry.indexBufferIndex];
     ByteAddressBuffer vertexBuffer = t_BindlessBuffers[geometry.vertexBufferIndex];
@@ -93,6 +97,39 @@ void vs_main(
     o_material = geometry.materialIndex;
 }
 
+void vs_main(
+    in uint i_vertexID : SV_VertexID,
+    out float4 o_position : SV_Position,
+    out float4 o_curr_position : CURR_POSITION,
+    out float4 o_prev_position : PREV_POSITION,
+    out float3 o_normal_vector : NORMAL_VECTOR,
+    out float3 o_prev_normal : PREV_NORMAL,
+    out float2 o_uv : TEXCOORD,
+    out uint o_material : MATERIAL)
+{
+    TransformVertex(g_Instance.instance, g_Instance.geometryInMesh, i_vertexID,
+        o_position, o_curr_position, o_prev_position, o_normal_vector, o_prev_normal, o_uv, o_material);
+}
+
+// SV_InstanceID does not include the start instance location on every API, so the draw index
+// comes from an instance-rate vertex attribute: draw N starts at instance N of a 0, 1, 2... buffer.
+void vs_main_indirect(
+    in uint i_drawID : DRAW_ID,
+    in uint i_vertexID : SV_VertexID,
+    out float4 o_position : SV_Position,
+    out float4 o_curr_position : CURR_POSITION,
+    out float4 o_prev_position : PREV_POSITION,
+    out float3 o_normal_vector : NORMAL_VECTOR,
+    out float3 o_prev_normal : PREV_NORMAL,
+    out float2 o_uv : TEXCOORD,
+    out uint o_material : MATERIAL)
+{
+    DrawRecord draw = t_DrawRecords[i_drawID];
+
+    TransformVertex(draw.instance, draw.geometryInMesh, i_vertexID,
+        o_position, o_curr_position, o_prev_position, o_normal_vector, o_prev_normal, o_uv, o_material);
+}
+
 void ps_main(
     in float4 i_position : SV_Position,
     in float4 i_curr_position : CURR_POSITION,
@@ -0,0 +1,216 @@
+/*
+* Copyright (c) 2014-2021, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#include "camera_trail.h"
+#include <donut/core/log.h>
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstddef>
+#include <cstring>
+
+using namespace donut;
+
+struct CameraTrailRecordRaw
+{
+    float pos[3];
+    float dir[3];
+    float up[3];
+};
+
+struct CameraTrailRecordQuantized
+{
+    float pos[3];
+    int16_t dir[2];
+    int16_t up[2];
+};
+
+static float SignNotZero(float v)
+{
+    return v >= 0.f ? 1.f : -1.f;
+}
+
+static int16_t QuantizeSnorm16(float v)
+{
+    return int16_t(std::lround(std::clamp(v, -1.f, 1.f) * 32767.f));
+}
+
+// Octahedral encoding of a unit vector into two 16-bit signed integers
+static void EncodeOctahedral(dm::float3 v, int16_t out[2])
+{
+    v /= std::abs(v.x) + std::abs(v.y) + std::abs(v.z);
+
+    float x = v.x;
+    float y = v.y;
+    if (v.z < 0.f)
+    {
+        x = (1.f - std::abs(v.y)) * SignNotZero(v.x);
+        y = (1.f - std::abs(v.x)) * SignNotZero(v.y);
+    }
+
+    out[0] = QuantizeSnorm16(x);
+    out[1] = QuantizeSnorm16(y);
+}
+
+static dm::float3 DecodeOctahedral(const int16_t in[2])
+{
+    float x = float(in[0]) / 32767.f;
+    float y = float(in[1]) / 32767.f;
+    dm::float3 v = dm::float3(x, y, 1.f - std::abs(x) - std::abs(y));
+    if (v.z < 0.f)
+    {
+        v.x = (1.f - std::abs(y)) * SignNotZero(x);
+        v.y = (1.f - std::abs(x)) * SignNotZero(y);
+    }
+    return dm::normalize(v);
+}
+
+static size_t GetRecordSize(uint32_t flags)
+{
+    return (flags & CameraTrailFlags_Quantized) ? sizeof(CameraTrailRecordQuantized) : sizeof(CameraTrailRecordRaw);
+}
+
+CameraTrailWriter::~CameraTrailWriter()
+{
+    Close();
+}
+
+bool CameraTrailWriter::Open(const std::filesystem::path& fileName, bool quantize)
+{
+    Close();
+
+    m_File.open(fileName, std::ios::binary | std::ios::trunc);
+    if (!m_File.is_open())
+    {
+        log::error("Cannot open camera trail file '%s' for writing", fileName.generic_string().c_str());
+        return false;
+    }
+
+    m_Flags = quantize ? CameraTrailFlags_Quantized : CameraTrailFlags_None;
+    m_FrameCount = 0;
+
+    // The frame count is patched in Close()
+    CameraTrailHeader header = { c_CameraTrailMagic, c_CameraTrailVersion, m_Flags, 0 };
+    m_File.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+    return true;
+}
+
+void CameraTrailWriter::Append(const CameraRolling& frame)
+{
+    if (!m_File.is_open())
+        return;
+
+    if (m_Flags & CameraTrailFlags_Quantized)
+    {
+        CameraTrailRecordQuantized record;
+        std::memcpy(record.pos, &frame.pos, sizeof(record.pos));
+        EncodeOctahedral(frame.dir, record.dir);
+        EncodeOctahedral(frame.up, record.up);
+        m_File.write(reinterpret_cast<const char*>(&record), sizeof(record));
+    }
+    else
+    {
+        CameraTrailRecordRaw record;
+        std::memcpy(record.pos, &frame.pos, sizeof(record.pos));
+        std::memcpy(record.dir, &frame.dir, sizeof(record.dir));
+        std::memcpy(record.up, &frame.up, sizeof(record.up));
+        m_File.write(reinterpret_cast<const char*>(&record), sizeof(record));
+    }
+
+    ++m_FrameCount;
+}
+
+void CameraTrailWriter::Close()
+{
+    if (!m_File.is_open())
+        return;
+
+    m_File.seekp(offsetof(CameraTrailHeader, frameCount));
+    m_File.write(reinterpret_cast<const char*>(&m_FrameCount), sizeof(m_FrameCount));
+    m_File.close();
+}
+
+CameraTrailReader::~CameraTrailReader()
+{
+    Close();
+}
+
+bool CameraTrailReader::Open(const std::filesystem::path& fileName)
+{
+    Close();
+
+    if (!m_File.Open(fileName))
+    {
+        log::error("Cannot open camera trail file '%s'", fileName.generic_string().c_str());
+        return false;
+    }
+
+    const CameraTrailHeader* header = reinterpret_cast<const CameraTrailHeader*>(m_File.GetData());
+    if (m_File.GetSize() < sizeof(CameraTrailHeader) || header->magic != c_CameraTrailMagic || header->version != c_CameraTrailVersion)
+    {
+        log::error("File '%s' is not a valid camera trail", fileName.generic_string().c_str());
+        Close();
+        return false;
+    }
+
+    m_Flags = header->flags;
+    m_RecordSize = GetRecordSize(m_Flags);
+
+    uint32_t framesInFile = uint32_t((m_File.GetSize() - sizeof(CameraTrailHeader)) / m_RecordSize);
+    m_FrameCount = header->frameCount ? std::min(header->frameCount, framesInFile) : framesInFile;
+
+    return true;
+}
+
+void CameraTrailReader::Close()
+{
+    m_File.Close();
+    m_FrameCount = 0;
+}
+
+CameraRolling CameraTrailReader::GetFrame(uint32_t index) const
+{
+    assert(index < m_FrameCount);
+
+    const uint8_t* recordData = m_File.GetData() + sizeof(CameraTrailHeader) + size_t(index) * m_RecordSize;
+
+    CameraRolling frame;
+    if (m_Flags & CameraTrailFlags_Quantized)
+    {
+        CameraTrailRecordQuantized record;
+        std::memcpy(&record, recordData, sizeof(record));
+        frame.pos = dm::float3(record.pos[0], record.pos[1], record.pos[2]);
+        frame.dir = DecodeOctahedral(record.dir);
+        frame.up = DecodeOctahedral(record.up);
+    }
+    else
+    {
+        CameraTrailRecordRaw record;
+        std::memcpy(&record, recordData, sizeof(record));
+        frame.pos = dm::float3(record.pos[0], record.pos[1], record.pos[2]);
+        frame.dir = dm::float3(record.dir[0], record.dir[1], record.dir[2]);
+        frame.up = dm::float3(record.up[0], record.up[1], record.up[2]);
+    }
+
+    return frame;
+}
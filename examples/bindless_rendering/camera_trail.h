@@ -0,0 +1,104 @@
+/*
+* Copyright (c) 2014-2021, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#pragma once
+
+#include "MappedFile.h"
+#include <donut/core/math/math.h>
+#include <filesystem>
+#include <fstream>
+#include <cstdint>
+
+struct CameraRolling
+{
+    dm::float3 pos;
+    dm::float3 dir;
+    dm::float3 up;
+    CameraRolling() {}
+    CameraRolling(const dm::float3& pos, const dm::float3& dir, const dm::float3& up) : pos(pos), dir(dir), up(up) {}
+};
+
+// Camera trail file layout:
+//   CameraTrailHeader
+//   frameCount fixed-size records, either raw (3 x float3) or quantized
+//   (float3 position + octahedral-encoded 16-bit direction and up vectors).
+// Records have a fixed size so that the file can be mapped and indexed directly.
+// The frame count in the header is patched when recording stops; if recording was
+// interrupted, the reader derives the count from the file size instead.
+
+static const uint32_t c_CameraTrailMagic = 0x4C525443; // 'CTRL'
+static const uint32_t c_CameraTrailVersion = 1;
+
+enum CameraTrailFlags : uint32_t
+{
+    CameraTrailFlags_None = 0,
+    CameraTrailFlags_Quantized = 1
+};
+
+struct CameraTrailHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t flags;
+    uint32_t frameCount;
+};
+
+class CameraTrailWriter
+{
+public:
+    ~CameraTrailWriter();
+
+    bool Open(const std::filesystem::path& fileName, bool quantize);
+    void Append(const CameraRolling& frame);
+    void Close();
+
+    [[nodiscard]] bool IsOpen() const { return m_File.is_open(); }
+    [[nodiscard]] uint32_t GetFrameCount() const { return m_FrameCount; }
+
+private:
+    std::ofstream m_File;
+    uint32_t m_Flags = CameraTrailFlags_None;
+    uint32_t m_FrameCount = 0;
+};
+
+// Read-only view of a camera trail file mapped into memory
+class CameraTrailReader
+{
+public:
+    CameraTrailReader() = default;
+    CameraTrailReader(const CameraTrailReader&) = delete;
+    CameraTrailReader& operator=(const CameraTrailReader&) = delete;
+    ~CameraTrailReader();
+
+    bool Open(const std::filesystem::path& fileName);
+    void Close();
+
+    [[nodiscard]] bool IsOpen() const { return m_File.IsOpen(); }
+    [[nodiscard]] uint32_t GetFrameCount() const { return m_FrameCount; }
+    [[nodiscard]] CameraRolling GetFrame(uint32_t index) const;
+
+private:
+    MappedFile m_File;
+    uint32_t m_Flags = CameraTrailFlags_None;
+    uint32_t m_FrameCount = 0;
+    size_t m_RecordSize = 0;
+};
@@ -0,0 +1,145 @@
+/*
+* Copyright (c) 2014-2021, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#pragma pack_matrix(row_major)
+
+#include <donut/shaders/bindless.h>
+#include "culling_cb.h"
+
+// Keep in sync with CullDrawReference in culling.cpp
+
+ConstantBuffer<CullingConstants> g_Culling : register(b0);
+
+StructuredBuffer<InstanceData> t_InstanceData : register(t0);
+StructuredBuffer<DrawRecord> t_DrawRecords : register(t1);
+Texture2D<float> t_Hzb : register(t2);
+
+RWByteAddressBuffer u_DrawArguments : register(u0);
+RWByteAddressBuffer u_Stats : register(u1);
+
+bool IsOutsideFrustum(float3 center, float3 extent)
+{
+    [unroll]
+    for (uint i = 0; i < 6; i++)
+    {
+        float4 plane = g_Culling.frustumPlanes[i];
+        if (dot(plane.xyz, center) + plane.w + dot(abs(plane.xyz), extent) < 0)
+            return true;
+    }
+    return false;
+}
+
+bool IsOccluded(float3 center, float3 extent)
+{
+    float2 minUV = 1;
+    float2 maxUV = 0;
+    float maxDepth = 0;
+
+    [unroll]
+    for (uint i = 0; i < 8; i++)
+    {
+        float3 corner = center + extent * float3((i & 1) ? 1 : -1, (i & 2) ? 1 : -1, (i & 4) ? 1 : -1);
+        float4 clip = mul(float4(corner, 1), g_Culling.matWorldToClipHzb);
+
+        // Crossing the near plane: no conservative screen rectangle
+        if (clip.w <= 1e-5)
+            return false;
+
+        float3 ndc = clip.xyz / clip.w;
+        float2 uv = float2(ndc.x * 0.5 + 0.5, 0.5 - ndc.y * 0.5);
+        minUV = min(minUV, uv);
+        maxUV = max(maxUV, uv);
+        maxDepth = max(maxDepth, ndc.z);
+    }
+
+    minUV = saturate(minUV);
+    maxUV = saturate(maxUV);
+
+    float2 minPixel = minUV * float2(g_Culling.depthSize);
+    float2 maxPixel = min(maxUV * float2(g_Culling.depthSize), float2(g_Culling.depthSize) - 1);
+    float2 extentPixels = max(maxPixel - minPixel, 1);
+
+    // An HZB texel of level L covers 2^(L+1) depth pixels, pick the level where the rectangle spans at most 2x2 texels
+    int level = max(int(ceil(log2(max(extentPixels.x, extentPixels.y)))) - 1, 0);
+    level = min(level, int(g_Culling.hzbMipCount) - 1);
+
+    uint mipWidth, mipHeight, mipLevels;
+    t_Hzb.GetDimensions(level, mipWidth, mipHeight, mipLevels);
+    uint2 maxTexel = uint2(mipWidth, mipHeight) - 1;
+
+    uint shift = uint(level + 1);
+    uint2 minTexel = min(uint2(minPixel) >> shift, maxTexel);
+    uint2 maxTexelRect = min(uint2(maxPixel) >> shift, maxTexel);
+
+    float hzbDepth = min(
+        min(t_Hzb.Load(int3(minTexel.x, minTexel.y, level)), t_Hzb.Load(int3(maxTexelRect.x, minTexel.y, level))),
+        min(t_Hzb.Load(int3(minTexel.x, maxTexelRect.y, level)), t_Hzb.Load(int3(maxTexelRect.x, maxTexelRect.y, level))));
+
+    // Reverse Z: occluded if the nearest point of the box is farther than the farthest occluder
+    return maxDepth < hzbDepth;
+}
+
+[numthreads(64, 1, 1)]
+void main(uint drawIndex : SV_DispatchThreadID)
+{
+    if (drawIndex >= g_Culling.drawCount)
+        return;
+
+    DrawRecord draw = t_DrawRecords[drawIndex];
+    InstanceData instance = t_InstanceData[draw.instance];
+
+    float3 localCenter = (draw.boundsMin.xyz + draw.boundsMax.xyz) * 0.5;
+    float3 localExtent = (draw.boundsMax.xyz - draw.boundsMin.xyz) * 0.5;
+    float3 center = mul(instance.transform, float4(localCenter, 1)).xyz;
+    float3 extent = mul(abs((float3x3)instance.transform), localExtent);
+
+    uint result = CULL_STAT_VISIBLE;
+    if ((g_Culling.flags & CULL_FRUSTUM) && IsOutsideFrustum(center, extent))
+        result = CULL_STAT_FRUSTUM;
+    else if ((g_Culling.flags & CULL_OCCLUSION) && IsOccluded(center, extent))
+        result = CULL_STAT_OCCLUSION;
+
+    // One atomic per wave and category; the visible counter also gives the compacted slot
+    bool visible = result == CULL_STAT_VISIBLE;
+    uint visibleCount = WaveActiveCountBits(visible);
+    uint frustumCount = WaveActiveCountBits(result == CULL_STAT_FRUSTUM);
+    uint occlusionCount = WaveActiveCountBits(result == CULL_STAT_OCCLUSION);
+
+    uint waveOffset = 0;
+    if (WaveIsFirstLane())
+    {
+        u_Stats.InterlockedAdd(CULL_STAT_VISIBLE * 4, visibleCount, waveOffset);
+        if (frustumCount)
+            u_Stats.InterlockedAdd(CULL_STAT_FRUSTUM * 4, frustumCount);
+        if (occlusionCount)
+            u_Stats.InterlockedAdd(CULL_STAT_OCCLUSION * 4, occlusionCount);
+    }
+    waveOffset = WaveReadLaneFirst(waveOffset);
+
+    if (visible)
+    {
+        uint slot = waveOffset + WavePrefixCountBits(visible);
+
+        // DrawIndirectArguments: the start instance keeps selecting the original draw record
+        u_DrawArguments.Store4(slot * 16, uint4(draw.vertexCount, 1, 0, drawIndex));
+    }
+}
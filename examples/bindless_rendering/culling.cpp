@@ -0,0 +1,332 @@
+/*
+* Copyright (c) 2014-2021, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#include "culling.h"
+#include <donut/core/log.h>
+#include <algorithm>
+#include <cmath>
+
+using namespace donut;
+
+uint32_t GetHzbMipCount(uint32_t depthWidth, uint32_t depthHeight)
+{
+    uint32_t width = std::max((depthWidth + 1) / 2, 1u);
+    uint32_t height = std::max((depthHeight + 1) / 2, 1u);
+    uint32_t count = 1;
+    while (width > 1 || height > 1)
+    {
+        width = std::max(width / 2, 1u);
+        height = std::max(height / 2, 1u);
+        ++count;
+    }
+    return count;
+}
+
+static uint2 GetHzbMipSize(uint2 level0Size, uint32_t level)
+{
+    return uint2(std::max(level0Size.x >> level, 1u), std::max(level0Size.y >> level, 1u));
+}
+
+static void DownsampleMin(const float* src, uint2 srcSize, float* dst, uint2 dstSize)
+{
+    for (uint32_t y = 0; y < dstSize.y; y++)
+    {
+        for (uint32_t x = 0; x < dstSize.x; x++)
+        {
+            // The last row and column also take the texel left over by an odd source size
+            uint32_t x0 = x * 2;
+            uint32_t y0 = y * 2;
+            uint32_t x1 = (x == dstSize.x - 1) ? srcSize.x - 1 : x0 + 1;
+            uint32_t y1 = (y == dstSize.y - 1) ? srcSize.y - 1 : y0 + 1;
+
+            float depth = src[y0 * srcSize.x + x0];
+            for (uint32_t sy = y0; sy <= y1; sy++)
+            {
+                for (uint32_t sx = x0; sx <= x1; sx++)
+                    depth = std::min(depth, src[sy * srcSize.x + sx]);
+            }
+            dst[y * dstSize.x + x] = depth;
+        }
+    }
+}
+
+void CpuHzb::Build(const float* depth, uint32_t width, uint32_t height)
+{
+    uint32_t mipCount = GetHzbMipCount(width, height);
+    m_MipSizes.resize(mipCount);
+    m_Mips.resize(mipCount);
+
+    const uint2 level0Size = uint2(std::max((width + 1) / 2, 1u), std::max((height + 1) / 2, 1u));
+    uint2 srcSize = uint2(width, height);
+    const float* src = depth;
+    for (uint32_t level = 0; level < mipCount; level++)
+    {
+        uint2 dstSize = GetHzbMipSize(level0Size, level);
+        m_MipSizes[level] = dstSize;
+        m_Mips[level].resize(size_t(dstSize.x) * dstSize.y);
+        DownsampleMin(src, srcSize, m_Mips[level].data(), dstSize);
+
+        src = m_Mips[level].data();
+        srcSize = dstSize;
+    }
+}
+
+float CpuHzb::Load(uint32_t level, uint32_t x, uint32_t y) const
+{
+    const uint2 size = m_MipSizes[level];
+    return m_Mips[level][std::min(y, size.y - 1) * size.x + std::min(x, size.x - 1)];
+}
+
+void ComputeFrustumPlanes(const float4x4& worldToClip, float4 planes[6])
+{
+    // Row vectors: clip = float4(p, 1) * worldToClip, so each clip component is a column
+    float4 column[4];
+    for (int c = 0; c < 4; c++)
+        column[c] = float4(worldToClip[0][c], worldToClip[1][c], worldToClip[2][c], worldToClip[3][c]);
+
+    planes[0] = column[3] + column[0]; // left
+    planes[1] = column[3] - column[0]; // right
+    planes[2] = column[3] + column[1]; // bottom
+    planes[3] = column[3] - column[1]; // top
+    planes[4] = column[3] - column[2]; // near, z <= w
+    planes[5] = column[2];             // far, z >= 0
+
+    for (int i = 0; i < 6; i++)
+    {
+        float len = length(planes[i].xyz());
+
+        // An infinite far plane degenerates to a constant; treat it as always passing
+        if (len < 1e-6f)
+            planes[i] = float4(0.f, 0.f, 0.f, 1.f);
+        else
+            planes[i] /= len;
+    }
+}
+
+static bool IsOutsideFrustum(const CullingConstants& constants, float3 center, float3 extent)
+{
+    for (int i = 0; i < 6; i++)
+    {
+        const float4& plane = constants.frustumPlanes[i];
+        if (dot(plane.xyz(), center) + plane.w + dot(abs(plane.xyz()), extent) < 0.f)
+            return true;
+    }
+    return false;
+}
+
+static bool IsOccluded(const CullingConstants& constants, float3 center, float3 extent, const CpuHzb& hzb)
+{
+    float2 minUV = 1.f;
+    float2 maxUV = 0.f;
+    float maxDepth = 0.f;
+
+    for (uint32_t i = 0; i < 8; i++)
+    {
+        float3 corner = center + extent * float3((i & 1) ? 1.f : -1.f, (i & 2) ? 1.f : -1.f, (i & 4) ? 1.f : -1.f);
+        float4 clip = float4(corner, 1.f) * constants.matWorldToClipHzb;
+
+        if (clip.w <= 1e-5f)
+            return false;
+
+        float3 ndc = clip.xyz() / clip.w;
+        float2 uv = float2(ndc.x * 0.5f + 0.5f, 0.5f - ndc.y * 0.5f);
+        minUV = min(minUV, uv);
+        maxUV = max(maxUV, uv);
+        maxDepth = std::max(maxDepth, ndc.z);
+    }
+
+    minUV = saturate(minUV);
+    maxUV = saturate(maxUV);
+
+    const float2 depthSize = float2(constants.depthSize);
+    float2 minPixel = minUV * depthSize;
+    float2 maxPixel = min(maxUV * depthSize, depthSize - 1.f);
+    float2 extentPixels = max(maxPixel - minPixel, float2(1.f));
+
+    int level = std::max(int(std::ceil(std::log2(std::max(extentPixels.x, extentPixels.y)))) - 1, 0);
+    level = std::min(level, int(constants.hzbMipCount) - 1);
+
+    uint2 maxTexel = hzb.GetMipSize(level) - 1u;
+    uint32_t shift = uint32_t(level + 1);
+    uint2 minTexel = min(uint2(uint32_t(minPixel.x) >> shift, uint32_t(minPixel.y) >> shift), maxTexel);
+    uint2 maxTexelRect = min(uint2(uint32_t(maxPixel.x) >> shift, uint32_t(maxPixel.y) >> shift), maxTexel);
+
+    float hzbDepth = std::min(
+        std::min(hzb.Load(level, minTexel.x, minTexel.y), hzb.Load(level, maxTexelRect.x, minTexel.y)),
+        std::min(hzb.Load(level, minTexel.x, maxTexelRect.y), hzb.Load(level, maxTexelRect.x, maxTexelRect.y)));
+
+    return maxDepth < hzbDepth;
+}
+
+uint32_t CullDrawReference(const CullingConstants& constants, const affine3& instanceTransform, const DrawRecord& draw, const CpuHzb* hzb)
+{
+    float3 localCenter = (draw.boundsMin.xyz() + draw.boundsMax.xyz()) * 0.5f;
+    float3 localExtent = (draw.boundsMax.xyz() - draw.boundsMin.xyz()) * 0.5f;
+
+    float3 center = instanceTransform.transformPoint(localCenter);
+    float3 extent;
+    for (int i = 0; i < 3; i++)
+    {
+        extent[i] = std::abs(instanceTransform.m_linear[0][i]) * localExtent.x
+                  + std::abs(instanceTransform.m_linear[1][i]) * localExtent.y
+                  + std::abs(instanceTransform.m_linear[2][i]) * localExtent.z;
+    }
+
+    if ((constants.flags & CULL_FRUSTUM) && IsOutsideFrustum(constants, center, extent))
+        return CULL_STAT_FRUSTUM;
+
+    if ((constants.flags & CULL_OCCLUSION) && hzb && IsOccluded(constants, center, extent, *hzb))
+        return CULL_STAT_OCCLUSION;
+
+    return CULL_STAT_VISIBLE;
+}
+
+// Brute force: a box is in the frustum if any point of a 5x5x5 lattice over it is inside the clip volume
+static bool BruteForceInFrustum(const float4x4& worldToClip, float3 boxMin, float3 boxMax)
+{
+    for (int z = 0; z <= 4; z++)
+    for (int y = 0; y <= 4; y++)
+    for (int x = 0; x <= 4; x++)
+    {
+        float3 p = lerp(boxMin, boxMax, float3(float(x), float(y), float(z)) * 0.25f);
+        float4 clip = float4(p, 1.f) * worldToClip;
+        if (clip.w > 0.f && std::abs(clip.x) <= clip.w && std::abs(clip.y) <= clip.w && clip.z >= 0.f && clip.z <= clip.w)
+            return true;
+    }
+    return false;
+}
+
+// Brute force: a box is visible if its nearest depth passes the depth test at any pixel under its screen rectangle
+static bool BruteForceVisible(const float4x4& worldToClip, float3 boxMin, float3 boxMax, const std::vector<float>& depth, uint2 size)
+{
+    float2 minPixel = float2(float(size.x), float(size.y));
+    float2 maxPixel = 0.f;
+    float maxDepth = 0.f;
+    for (uint32_t i = 0; i < 8; i++)
+    {
+        float3 corner = float3((i & 1) ? boxMax.x : boxMin.x, (i & 2) ? boxMax.y : boxMin.y, (i & 4) ? boxMax.z : boxMin.z);
+        float4 clip = float4(corner, 1.f) * worldToClip;
+        if (clip.w <= 1e-5f)
+            return true;
+
+        float3 ndc = clip.xyz() / clip.w;
+        float2 pixel = float2(ndc.x * 0.5f + 0.5f, 0.5f - ndc.y * 0.5f) * float2(size);
+        minPixel = min(minPixel, pixel);
+        maxPixel = max(maxPixel, pixel);
+        maxDepth = std::max(maxDepth, ndc.z);
+    }
+
+    int x0 = std::clamp(int(minPixel.x), 0, int(size.x) - 1);
+    int x1 = std::clamp(int(maxPixel.x), 0, int(size.x) - 1);
+    int y0 = std::clamp(int(minPixel.y), 0, int(size.y) - 1);
+    int y1 = std::clamp(int(maxPixel.y), 0, int(size.y) - 1);
+    for (int y = y0; y <= y1; y++)
+    {
+        for (int x = x0; x <= x1; x++)
+        {
+            if (maxDepth >= depth[y * size.x + x])
+                return true;
+        }
+    }
+    return false;
+}
+
+int RunCullingSelfTest()
+{
+    // Camera at the origin looking down +Z, with a wall at z = 20 that covers the left half of the view
+    const uint2 size = uint2(643, 361); // odd, so that the HZB edge texels are exercised
+    const float zNear = 0.1f;
+    const float wallDistance = 20.f;
+    const float4x4 worldToClip = perspProjD3DStyleReverse(PI_f * 0.25f, float(size.x) / float(size.y), zNear);
+
+    std::vector<float> depth(size_t(size.x) * size.y, 0.f);
+    const float wallDepth = (float4(0.f, 0.f, wallDistance, 1.f) * worldToClip).z / wallDistance;
+    for (uint32_t y = 0; y < size.y; y++)
+    {
+        for (uint32_t x = 0; x < size.x / 2; x++)
+            depth[y * size.x + x] = wallDepth;
+    }
+
+    CpuHzb hzb;
+    hzb.Build(depth.data(), size.x, size.y);
+
+    CullingConstants constants = {};
+    ComputeFrustumPlanes(worldToClip, constants.frustumPlanes);
+    constants.matWorldToClipHzb = worldToClip;
+    constants.depthSize = size;
+    constants.hzbMipCount = hzb.GetMipCount();
+    constants.flags = CULL_FRUSTUM | CULL_OCCLUSION;
+
+    uint32_t counts[CULL_STAT_COUNT] = {};
+    int violations = 0;
+    int total = 0;
+
+    // Boxes of different sizes in front of, behind and beside the wall, some behind the camera
+    for (int iz = -4; iz < 40; iz++)
+    {
+        for (int ix = -30; ix <= 30; ix++)
+        {
+            for (int iy = -2; iy <= 2; iy++)
+            {
+                float boxSize = 0.25f + 0.5f * float((ix + iy + iz + 100) % 4);
+                float3 center = float3(float(ix) * 1.5f, float(iy) * 2.f, float(iz) * 1.5f);
+
+                DrawRecord draw = {};
+                draw.boundsMin = float4(-boxSize, -boxSize, -boxSize, 0.f);
+                draw.boundsMax = float4(boxSize, boxSize, boxSize, 0.f);
+                affine3 transform = translation(center);
+
+                uint32_t result = CullDrawReference(constants, transform, draw, &hzb);
+                ++counts[result];
+                ++total;
+
+                float3 boxMin = center - boxSize;
+                float3 boxMax = center + boxSize;
+                if (result == CULL_STAT_FRUSTUM && BruteForceInFrustum(worldToClip, boxMin, boxMax))
+                {
+                    log::warning("Culling self-test: box at (%.1f, %.1f, %.1f) is in the frustum but was frustum culled", center.x, center.y, center.z);
+                    ++violations;
+                }
+                if (result == CULL_STAT_OCCLUSION && BruteForceVisible(worldToClip, boxMin, boxMax, depth, size))
+                {
+                    log::warning("Culling self-test: box at (%.1f, %.1f, %.1f) is visible but was occlusion culled", center.x, center.y, center.z);
+                    ++violations;
+                }
+            }
+        }
+    }
+
+    log::info("Culling self-test: %d boxes, %u visible, %u frustum culled (%.1f%%), %u occlusion culled (%.1f%%), %d violations",
+        total, counts[CULL_STAT_VISIBLE],
+        counts[CULL_STAT_FRUSTUM], 100.0 * counts[CULL_STAT_FRUSTUM] / total,
+        counts[CULL_STAT_OCCLUSION], 100.0 * counts[CULL_STAT_OCCLUSION] / total,
+        violations);
+
+    // The scene is built so that both tests must reject something
+    if (counts[CULL_STAT_FRUSTUM] == 0 || counts[CULL_STAT_OCCLUSION] == 0)
+    {
+        log::warning("Culling self-test: expected both frustum and occlusion culling to reject boxes");
+        ++violations;
+    }
+
+    return violations;
+}
@@ -0,0 +1,60 @@
+/*
+* Copyright (c) 2014-2021, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#pragma once
+
+#include <donut/core/math/math.h>
+#include <vector>
+
+using namespace donut::math;
+
+#include "culling_cb.h"
+
+// CPU reference of the culling stage in hzb.hlsl and cull.hlsl, using the same
+// constants, HZB layout and tests so that results can be compared draw by draw.
+
+class CpuHzb
+{
+public:
+    void Build(const float* depth, uint32_t width, uint32_t height);
+
+    [[nodiscard]] uint32_t GetMipCount() const { return uint32_t(m_Mips.size()); }
+    [[nodiscard]] uint2 GetMipSize(uint32_t level) const { return m_MipSizes[level]; }
+    [[nodiscard]] float Load(uint32_t level, uint32_t x, uint32_t y) const;
+
+private:
+    std::vector<uint2> m_MipSizes;
+    std::vector<std::vector<float>> m_Mips;
+};
+
+// Number of HZB levels for a depth buffer, down to 1x1
+uint32_t GetHzbMipCount(uint32_t depthWidth, uint32_t depthHeight);
+
+// Gribb-Hartmann planes for a D3D-style reverse-Z projection (near at z = w, far at z = 0)
+void ComputeFrustumPlanes(const float4x4& worldToClip, float4 planes[6]);
+
+// Returns CULL_STAT_VISIBLE, CULL_STAT_FRUSTUM or CULL_STAT_OCCLUSION
+uint32_t CullDrawReference(const CullingConstants& constants, const affine3& instanceTransform, const DrawRecord& draw, const CpuHzb* hzb);
+
+// Culls a synthetic scene without a GPU, checks that the reference never culls a box that a brute-force
+// test finds visible, and reports culling rates. Returns the number of violations.
+int RunCullingSelfTest();
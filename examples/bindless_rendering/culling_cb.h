@@ -0,0 +1,65 @@
+/*
+* Copyright (c) 2014-2021, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef CULLING_CB_H
+#define CULLING_CB_H
+
+// One record per geometry in the indirect draw list, indexed by the per-instance DRAW_ID attribute
+struct DrawRecord
+{
+    uint instance;
+    uint geometryInMesh;
+    uint vertexCount;
+    uint padding;
+    float4 boundsMin; // object space, w unused
+    float4 boundsMax;
+};
+
+#define CULL_FRUSTUM 1
+#define CULL_OCCLUSION 2
+
+// Slots of the statistics buffer; the visible count is also the number of compacted draws
+#define CULL_STAT_VISIBLE 0
+#define CULL_STAT_FRUSTUM 1
+#define CULL_STAT_OCCLUSION 2
+#define CULL_STAT_COUNT 4
+
+struct CullingConstants
+{
+    float4 frustumPlanes[6];        // world space, dot(plane.xyz, p) + plane.w >= 0 inside
+    float4x4 matWorldToClipHzb;     // view the HZB depth was rendered with, including jitter
+    uint2 depthSize;                // depth buffer the HZB was built from
+    uint hzbMipCount;
+    uint drawCount;
+    uint flags;
+    uint3 padding;
+};
+
+// The HZB stores the farthest depth (minimum, reverse Z) of 2x2 texels of the level above;
+// level 0 is half the depth buffer resolution rounded up, the other levels use regular mip sizes
+struct HzbConstants
+{
+    uint2 srcSize;
+    uint2 dstSize;
+};
+
+#endif // CULLING_CB_H
@@ -0,0 +1,119 @@
+// FidelityFX Super Resolution Sample
+//
+// Copyright (c) 2021 Advanced Micro Devices, Inc. All rights reserved.
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+cbuffer cb : register(b0)
+{
+	uint4 Const0;
+	uint4 Const1;
+	uint4 Const2;
+	uint4 Const3;
+	uint4 Sample;		// x: square the output, y: sharpen with RCAS
+	uint4 RcasConst;
+};
+
+#define A_GPU 1
+#define A_HLSL 1
+#define A_HALF
+#include "ffx_a.h"
+
+SamplerState		samLinearClamp : register(s0);
+Texture2D<AH4>		InputTexture : register(t0);
+RWTexture2D<AH4>	OutputTexture : register(u0);
+
+// EASU and RCAS in one dispatch: a group upscales its 16x16 tile and a 1-pixel border into groupshared
+// memory, then sharpens the tile from there, so the upscaled image never goes through memory.
+#define TILE_SIZE 16
+#define BORDERED_TILE_SIZE (TILE_SIZE + 2)
+
+groupshared float3 IntermediateTile[BORDERED_TILE_SIZE * BORDERED_TILE_SIZE];
+static int2 IntermediateOrigin;
+
+#define FSR_EASU_H 1
+AH4 FsrEasuRH(AF2 p) { AH4 res = InputTexture.GatherRed(samLinearClamp, p, int2(0, 0)); return res; }
+AH4 FsrEasuGH(AF2 p) { AH4 res = InputTexture.GatherGreen(samLinearClamp, p, int2(0, 0)); return res; }
+AH4 FsrEasuBH(AF2 p) { AH4 res = InputTexture.GatherBlue(samLinearClamp, p, int2(0, 0)); return res; }
+
+#define FSR_RCAS_H
+AH4 FsrRcasLoadH(ASW2 p) { int2 t = int2(p) - IntermediateOrigin; return AH4(AH3(IntermediateTile[t.y * BORDERED_TILE_SIZE + t.x]), 1); }
+void FsrRcasInputH(inout AH1 r,inout AH1 g,inout AH1 b){}
+
+#include "ffx_fsr1.h"
+
+void StoreOutput(AU2 pos, AH3 c)
+{
+	if (Sample.x == 1)
+		c *= c;
+	OutputTexture[pos] = AH4(c, 1);
+}
+
+void EasuFilter(AU2 pos)
+{
+	AH3 c;
+	FsrEasuH(c, pos, Const0, Const1, Const2, Const3);
+	StoreOutput(pos, c);
+}
+
+void RcasFilter(AU2 pos)
+{
+	AH3 c;
+	FsrRcasH(c.r, c.g, c.b, pos, RcasConst);
+	StoreOutput(pos, c);
+}
+
+[numthreads(64, 1, 1)]
+void mainCS(uint3 LocalThreadId : SV_GroupThreadID, uint3 WorkGroupId : SV_GroupID, uint3 Dtid : SV_DispatchThreadID)
+{
+	// Do remapping of local xy in workgroup for a more PS-like swizzle pattern.
+	AU2 gxy = ARmp8x8(LocalThreadId.x) + AU2(WorkGroupId.x << 4u, WorkGroupId.y << 4u);
+
+	if (Sample.y == 0)
+	{
+		EasuFilter(gxy);
+		gxy.x += 8u;
+		EasuFilter(gxy);
+		gxy.y += 8u;
+		EasuFilter(gxy);
+		gxy.x -= 8u;
+		EasuFilter(gxy);
+		return;
+	}
+
+	uint2 outputSize;
+	OutputTexture.GetDimensions(outputSize.x, outputSize.y);
+
+	// Border pixels outside the image read as zero, like the loads of a separate RCAS pass
+	IntermediateOrigin = int2(WorkGroupId.xy * TILE_SIZE) - 1;
+	for (uint i = LocalThreadId.x; i < BORDERED_TILE_SIZE * BORDERED_TILE_SIZE; i += 64u)
+	{
+		int2 pos = IntermediateOrigin + int2(i % BORDERED_TILE_SIZE, i / BORDERED_TILE_SIZE);
+		AH3 c = AH3(0, 0, 0);
+		if (all(pos >= 0) && all(pos < int2(outputSize)))
+			FsrEasuH(c, AU2(pos), Const0, Const1, Const2, Const3);
+		IntermediateTile[i] = float3(c);
+	}
+
+	GroupMemoryBarrierWithGroupSync();
+
+	RcasFilter(gxy);
+	gxy.x += 8u;
+	RcasFilter(gxy);
+	gxy.y += 8u;
+	RcasFilter(gxy);
+	gxy.x -= 8u;
+	RcasFilter(gxy);
+}
@@ -118,11 +118,29 @@ float cubicBSplineValue(float2 center, float2 position, float h)
     return Nx * Ny;
 }
 
-float catmullRomValue(float2 center, float2 position, float h)
+float catmullRomAxis(float x)
 {
+    float absx = abs(x);
+    float xsqr = x * x;
+    float absxcubic = xsqr * absx;
+
+    if (absx < 1.0f)
+    {
+        return 1.5f * absxcubic - 2.5f * xsqr + 1.0f;
+    }
+    else if (absx < 2.0f)
+    {
+        return -0.5f * absxcubic + 2.5f * xsqr - 4.0f * absx + 2.0f;
+    }
     return 0.0f;
 }
 
+float catmullRomValue(float2 center, float2 position, float h)
+{
+    float2 x = (position - center) / h;
+    return catmullRomAxis(x.x) * catmullRomAxis(x.y);
+}
+
 bool isWithInNDC(float2 ndcCoordinates)
 {
     if (ndcCoordinates.x < 0.0f || ndcCoordinates.y < 0.0f || ndcCoordinates.x > 1.0f || ndcCoordinates.y > 1.0f)
@@ -191,6 +209,7 @@ void ps_main(
                     float probedSampleWeight = tentValue(jitterSpaceSVPosition, probedSamplePosition, 2.0f * samplingRate);
                     //float probedSampleWeight = tentValue(jitterSpaceSVPosition, probedSamplePosition, samplingRate * (1.0f + i_Position.z));
                     //float probedSampleWeight = cubicBSplineValue(jitterSpaceSVPosition, probedSamplePosition, samplingRate);
+                    //float probedSampleWeight = catmullRomValue(jitterSpaceSVPosition, probedSamplePosition, samplingRate);
 
                     upsampledJitter += probedSampleWeight * probedJitteredSample.xyz;
                     normalizationFactor += probedSampleWeight;
@@ -372,3 +391,231 @@ void ps_main(
     o_CurrentBuffer = float4(blended, 1.0f);
     o_ColorBuffer = float4(blended, 1.0f);
 }
+
+#if TSS_COMPUTE
+
+// Compute variant of ps_main. A group resolves a 16x16 tile: the per-pixel state that ps_main evaluates for
+// each of its 3x3 neighbours is evaluated once per pixel of the tile and its border and shared through
+// groupshared memory, as are the motion vectors and the jittered samples under the tile.
+// Compute shaders have no derivatives, so the history is sampled bilinearly at mip 0 instead of anisotropically.
+
+#define TSS_TILE_SIZE 16
+#define TSS_STATE_SIZE (TSS_TILE_SIZE + 2)      // every pixel of the tile reads its 3x3 neighbours
+#define TSS_MOTION_SIZE (TSS_TILE_SIZE + 4)     // and every neighbour averages the motion of its own 3x3 neighbours
+#define TSS_JITTER_CACHE_SIZE 24                // input texels under the tile for sampling rates up to 1
+#define TSS_THREAD_COUNT (TSS_TILE_SIZE * TSS_TILE_SIZE)
+
+RWTexture2D<float4> u_ColorBuffer : register(u3);
+RWTexture2D<float4> u_CurrentBuffer : register(u4);
+
+groupshared float2 s_Motion[TSS_MOTION_SIZE * TSS_MOTION_SIZE];
+groupshared float3 s_Jittered[TSS_JITTER_CACHE_SIZE * TSS_JITTER_CACHE_SIZE];
+groupshared float3 s_Curr[TSS_STATE_SIZE * TSS_STATE_SIZE];
+groupshared float3 s_Hist[TSS_STATE_SIZE * TSS_STATE_SIZE];
+groupshared float3 s_VarSqrdTemp[TSS_STATE_SIZE * TSS_STATE_SIZE];
+groupshared float2 s_PrevLocation[TSS_STATE_SIZE * TSS_STATE_SIZE];
+groupshared float s_Confidence[TSS_STATE_SIZE * TSS_STATE_SIZE];
+
+float3 loadJittered(int2 texel, int2 cacheOrigin, bool useCache)
+{
+    if (useCache)
+    {
+        int2 cached = texel - cacheOrigin;
+        return s_Jittered[cached.y * TSS_JITTER_CACHE_SIZE + cached.x];
+    }
+    return t_JitteredCurrentBuffer[texel].xyz;
+}
+
+[numthreads(TSS_TILE_SIZE, TSS_TILE_SIZE, 1)]
+void cs_main(
+    in uint2 i_GroupId : SV_GroupID,
+    in uint2 i_ThreadId : SV_GroupThreadID,
+    in uint i_ThreadIndex : SV_GroupIndex)
+{
+    const int nativeResolution = 0;
+    const int nativeWithTAA = 1;
+    const int rawUpscaled = 2;
+    const int temporalSupersamplingAA = 3;
+
+    const int patchSize = 3;
+    const float normalizationFactorPatch = 1.0f / (patchSize * patchSize);
+    const float epsilon = 0.00001f;
+
+    float2 pixelOffset = g_View.pixelOffset;
+    float samplingRate = ((b_FrameIndex.currentAAMode == nativeResolution || b_FrameIndex.currentAAMode == nativeWithTAA) ? 1.0f : g_SamplingRate.samplingRate);
+    int2 groupOrigin = int2(i_GroupId) * TSS_TILE_SIZE;
+
+    // Jittered texels read by the state pass, including the 3x3 tent footprint of the border pixels
+    int2 cacheOrigin = int2(floor(samplingRate * (float2(groupOrigin) - 0.5f))) - 1;
+    int2 cacheEnd = int2(floor(samplingRate * (float2(groupOrigin) + TSS_TILE_SIZE + 0.5f))) + 1;
+    bool useCache = all(cacheEnd - cacheOrigin < TSS_JITTER_CACHE_SIZE);
+
+    if (useCache)
+    {
+        for (uint entry = i_ThreadIndex; entry < TSS_JITTER_CACHE_SIZE * TSS_JITTER_CACHE_SIZE; entry += TSS_THREAD_COUNT)
+        {
+            int2 texel = cacheOrigin + int2(entry % TSS_JITTER_CACHE_SIZE, entry / TSS_JITTER_CACHE_SIZE);
+            s_Jittered[entry] = t_JitteredCurrentBuffer[texel].xyz;
+        }
+    }
+
+    for (uint entry = i_ThreadIndex; entry < TSS_MOTION_SIZE * TSS_MOTION_SIZE; entry += TSS_THREAD_COUNT)
+    {
+        float2 position = float2(groupOrigin - 2 + int2(entry % TSS_MOTION_SIZE, entry / TSS_MOTION_SIZE)) + 0.5f;
+        s_Motion[entry] = t_MotionVector.SampleLevel(s_LinearSampler, position * g_View.viewportSizeInv, 0).xy;
+    }
+
+    GroupMemoryBarrierWithGroupSync();
+
+    for (uint entry = i_ThreadIndex; entry < TSS_STATE_SIZE * TSS_STATE_SIZE; entry += TSS_THREAD_COUNT)
+    {
+        int2 local = int2(entry % TSS_STATE_SIZE, entry / TSS_STATE_SIZE);
+        float2 position = float2(groupOrigin - 1 + local) + 0.5f;
+        float2 jitterSpaceSVPosition = samplingRate * position;
+        int2 floorSampleIndex = int2(floor(jitterSpaceSVPosition));
+
+        float3 upsampledJitter = float3(0.0f, 0.0f, 0.0f);
+        float2 motionFirstMoment = float2(0.0f, 0.0f);
+        float maximumWeight = 0.0f;
+        float normalizationFactor = 0.0f;
+
+        for (int dy = -(patchSize / 2); dy <= (patchSize / 2); ++dy)
+        {
+            for (int dx = -(patchSize / 2); dx <= (patchSize / 2); ++dx)
+            {
+                int2 probedSampleIndex = floorSampleIndex + int2(dx, dy);
+                float2 probedSamplePosition = float2(probedSampleIndex) + float2(0.5f, 0.5f) - pixelOffset;
+                float3 probedJitteredSample = loadJittered(probedSampleIndex, cacheOrigin, useCache);
+
+                float probedSampleWeight = tentValue(jitterSpaceSVPosition, probedSamplePosition, 2.0f * samplingRate);
+
+                upsampledJitter += probedSampleWeight * probedJitteredSample;
+                normalizationFactor += probedSampleWeight;
+                maximumWeight = max(maximumWeight, probedSampleWeight);
+
+                motionFirstMoment += s_Motion[(local.y + 1 + dy) * TSS_MOTION_SIZE + local.x + 1 + dx];
+            }
+        }
+        if (maximumWeight != 0.0f)
+        {
+            upsampledJitter /= normalizationFactor;
+        }
+        else
+        {
+            upsampledJitter = t_JitteredCurrentBuffer.SampleLevel(s_LinearSampler, position * g_View.viewportSizeInv, 0).xyz;
+        }
+
+        float3 currSample;
+        float confidence;
+        if (b_FrameIndex.currentAAMode != temporalSupersamplingAA)
+        {
+            currSample = loadJittered(int2(floor(position * samplingRate)), cacheOrigin, useCache);
+            confidence = 1.0f;
+        }
+        else
+        {
+            currSample = upsampledJitter;
+            confidence = maximumWeight;
+        }
+
+        float2 prevLocation = position * g_View.viewportSizeInv - motionFirstMoment * normalizationFactorPatch;
+        float3 prevSample = t_HistoryColor.SampleLevel(s_LinearSampler, prevLocation, 0).xyz;
+        if (!isWithInNDC(prevLocation))
+        {
+            prevSample = float3(0.0f, 0.0f, 0.0f);
+            confidence = 1.0f;
+        }
+        int2 prevTexel = int2(g_View.viewportSize * prevLocation);
+        float3 prevExpectancy = t_1stOrderMoment[prevTexel].xyz;
+
+        s_Curr[entry] = currSample;
+        s_Hist[entry] = prevSample;
+        s_VarSqrdTemp[entry] = t_2ndOrderMoment[prevTexel].xyz - prevExpectancy * prevExpectancy;
+        s_PrevLocation[entry] = prevLocation;
+        s_Confidence[entry] = confidence;
+    }
+
+    GroupMemoryBarrierWithGroupSync();
+
+    int center = (int(i_ThreadId.y) + 1) * TSS_STATE_SIZE + int(i_ThreadId.x) + 1;
+
+    float tempMaNormSqrdDiff = 0.0f;
+    float tempMaximalMaSqrd = 0.0f;
+
+    [unroll]
+    for (int dk = -1; dk <= 1; ++dk)
+    {
+        [unroll]
+        for (int dl = -1; dl <= 1; ++dl)
+        {
+            int neighbour = center + dl * TSS_STATE_SIZE + dk;
+
+            float diffConfidence = s_Confidence[neighbour];
+            if (diffConfidence < epsilon)
+            {
+                continue;
+            }
+
+            float3 currVector = s_Curr[neighbour];
+            float3 histVector = s_Hist[neighbour];
+            float3 diffVector = abs(currVector - histVector) * diffConfidence;
+
+            float3 allInvSigmaTemporal = s_VarSqrdTemp[neighbour];
+            for (int compT = 0; compT < 3; ++compT)
+            {
+                float sigmaComponent = allInvSigmaTemporal[compT];
+                allInvSigmaTemporal[compT] = (sigmaComponent < epsilon) ? 1.0f / epsilon : 1.0f / sigmaComponent;
+            }
+
+            tempMaNormSqrdDiff += dot(diffVector * diffVector, allInvSigmaTemporal);
+            tempMaximalMaSqrd += dot(currVector * currVector, allInvSigmaTemporal);
+            tempMaximalMaSqrd += dot(histVector * histVector, allInvSigmaTemporal);
+        }
+    }
+
+    float derivativeDiffed = sqrt(tempMaNormSqrdDiff) / (sqrt(tempMaximalMaSqrd) + epsilon);
+    derivativeDiffed = clamp(derivativeDiffed, 0.0f, 1.0f);
+
+    float2 prevLocationCriterion = s_PrevLocation[center];
+    if (!isWithInNDC(prevLocationCriterion) || b_FrameIndex.currentAAMode == nativeResolution || b_FrameIndex.currentAAMode == rawUpscaled)
+    {
+        derivativeDiffed = 1.0f;
+    }
+
+    float3 centerHist = s_Hist[center];
+    float3 centerCurr = s_Curr[center];
+
+    float3 blended = float3(0.0f, 0.0f, 0.0f);
+    if (b_FrameIndex.frameHasReset == 0)
+    {
+        if (s_Confidence[center] < epsilon)
+        {
+            derivativeDiffed = 0.0f;
+        }
+        blended = centerHist + derivativeDiffed * (centerCurr - centerHist);
+    }
+
+    int2 pixel = groupOrigin + int2(i_ThreadId);
+    if (any(pixel >= int2(g_View.viewportSize)))
+    {
+        return;
+    }
+
+    int2 prevTexel = int2(g_View.viewportSize * prevLocationCriterion);
+    float3 firstOrderHist = t_1stOrderMoment[prevTexel].xyz;
+    float3 secondOrderHist = t_2ndOrderMoment[prevTexel].xyz;
+    float sequenceSqrdSumHist = t_SequenceSqrdSum[prevTexel];
+
+    float3 firstOrderUpdated = (1.0f - derivativeDiffed) * firstOrderHist + derivativeDiffed * centerCurr;
+    float3 secondOrderUpdated = (1.0f - derivativeDiffed) * secondOrderHist + derivativeDiffed * centerCurr * centerCurr;
+    float sequenceSqrdSum = sequenceSqrdSumHist * (1.0f - derivativeDiffed) * (1.0f - derivativeDiffed) + derivativeDiffed * derivativeDiffed;
+
+    t_SequenceSqrdSum[pixel] = sequenceSqrdSum;
+    t_1stOrderMoment[pixel] = float4(firstOrderUpdated, 0.0f);
+    t_2ndOrderMoment[pixel] = float4(secondOrderUpdated, 0.0f);
+
+    u_CurrentBuffer[pixel] = float4(blended, 1.0f);
+    u_ColorBuffer[pixel] = float4(blended, 1.0f);
+}
+
+#endif
@@ -0,0 +1,582 @@
+/*
+* Copyright (c) 2014-2021, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#include "AnimationSampler.h"
+#include <donut/engine/KeyframeAnimation.h>
+#include <donut/engine/SceneGraph.h>
+#include <donut/core/log.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <optional>
+#include <random>
+#include <string>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define ANIMATION_AVX2 1
+#endif
+
+#ifdef DONUT_WITH_TASKFLOW
+#include <taskflow/taskflow.hpp>
+#endif
+
+using namespace donut;
+using namespace donut::math;
+using namespace donut::engine;
+
+// Channels per task, and per segment search and interpolation pass within a task
+constexpr size_t c_ChannelBlockSize = 1024;
+
+uint32_t AnimationSampler::AddAnimation(const std::shared_ptr<SceneGraphAnimation>& animation)
+{
+    const uint32_t animationIndex = m_AnimationCount++;
+    m_Times.resize(m_AnimationCount, 0.f);
+
+    for (const auto& channel : animation->GetChannels())
+    {
+        const auto& sampler = channel->GetSampler();
+        AnimationAttribute attribute = channel->GetAttribute();
+        animation::InterpolationMode mode = sampler->GetInterpolationMode();
+
+        bool transform = attribute == AnimationAttribute::Translation
+            || attribute == AnimationAttribute::Rotation
+            || attribute == AnimationAttribute::Scaling;
+        bool interpolation = mode == animation::InterpolationMode::Step
+            || mode == animation::InterpolationMode::Linear
+            || mode == animation::InterpolationMode::Slerp;
+
+        const auto& keyframes = sampler->GetKeyframes();
+        if (!transform || !interpolation || keyframes.empty() || !channel->GetTargetNode())
+        {
+            m_FallbackChannels.push_back({ channel, animationIndex });
+            continue;
+        }
+
+        ChannelGroup& group = mode == animation::InterpolationMode::Slerp ? m_Slerp : m_Lerp;
+        group.channels.push_back(channel);
+        group.animation.push_back(animationIndex);
+        group.firstKey.push_back(uint32_t(m_KeyTimes.size()));
+        group.keyCount.push_back(uint32_t(keyframes.size()));
+        group.step.push_back(mode == animation::InterpolationMode::Step);
+        group.lastSegment.push_back(0);
+        group.key0.push_back(0);
+        group.key1.push_back(0);
+        group.alpha.push_back(0.f);
+        group.x.push_back(0.f);
+        group.y.push_back(0.f);
+        group.z.push_back(0.f);
+        group.w.push_back(0.f);
+
+        for (const auto& keyframe : keyframes)
+        {
+            m_KeyTimes.push_back(keyframe.time);
+            m_KeyX.push_back(keyframe.value.x);
+            m_KeyY.push_back(keyframe.value.y);
+            m_KeyZ.push_back(keyframe.value.z);
+            m_KeyW.push_back(keyframe.value.w);
+        }
+    }
+
+    return animationIndex;
+}
+
+void AnimationSampler::FindSegments(ChannelGroup& group, size_t begin, size_t end) const
+{
+    for (size_t channel = begin; channel < end; channel++)
+    {
+        const uint32_t first = group.firstKey[channel];
+        const uint32_t count = group.keyCount[channel];
+        const float* keyTimes = &m_KeyTimes[first];
+        const float time = m_Times[group.animation[channel]];
+
+        if (count == 1 || time <= keyTimes[0])
+        {
+            group.key0[channel] = group.key1[channel] = int32_t(first);
+            group.alpha[channel] = 0.f;
+            continue;
+        }
+
+        if (time >= keyTimes[count - 1])
+        {
+            group.key0[channel] = group.key1[channel] = int32_t(first + count - 1);
+            group.alpha[channel] = 0.f;
+            continue;
+        }
+
+        // The segment satisfies keyTimes[segment] <= time < keyTimes[segment + 1]. Forward playback stays
+        // in the cached segment or moves to the next one; anything else is a search.
+        uint32_t segment = group.lastSegment[channel];
+        if (keyTimes[segment] > time || keyTimes[segment + 1] <= time)
+        {
+            if (keyTimes[segment] <= time && keyTimes[segment + 2] > time)
+                segment++;
+            else
+                segment = uint32_t(std::upper_bound(keyTimes, keyTimes + count, time) - keyTimes) - 1;
+        }
+
+        group.lastSegment[channel] = segment;
+        group.key0[channel] = int32_t(first + segment);
+        group.key1[channel] = int32_t(first + segment + 1);
+        group.alpha[channel] = group.step[channel] ? 0.f : (time - keyTimes[segment]) / (keyTimes[segment + 1] - keyTimes[segment]);
+    }
+}
+
+void AnimationSampler::LerpChannels(ChannelGroup& group, size_t begin, size_t end) const
+{
+    size_t channel = begin;
+
+#if ANIMATION_AVX2
+    for (; channel + 8 <= end; channel += 8)
+    {
+        __m256i key0 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(&group.key0[channel]));
+        __m256i key1 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(&group.key1[channel]));
+        __m256 alpha = _mm256_loadu_ps(&group.alpha[channel]);
+
+        auto lerp = [&](const std::vector<float>& keys, std::vector<float>& result)
+        {
+            __m256 a = _mm256_i32gather_ps(keys.data(), key0, 4);
+            __m256 b = _mm256_i32gather_ps(keys.data(), key1, 4);
+            _mm256_storeu_ps(&result[channel], _mm256_fmadd_ps(_mm256_sub_ps(b, a), alpha, a));
+        };
+
+        lerp(m_KeyX, group.x);
+        lerp(m_KeyY, group.y);
+        lerp(m_KeyZ, group.z);
+        lerp(m_KeyW, group.w);
+    }
+#endif
+
+    for (; channel < end; channel++)
+    {
+        const int32_t key0 = group.key0[channel];
+        const int32_t key1 = group.key1[channel];
+        const float alpha = group.alpha[channel];
+
+        group.x[channel] = m_KeyX[key0] + (m_KeyX[key1] - m_KeyX[key0]) * alpha;
+        group.y[channel] = m_KeyY[key0] + (m_KeyY[key1] - m_KeyY[key0]) * alpha;
+        group.z[channel] = m_KeyZ[key0] + (m_KeyZ[key1] - m_KeyZ[key0]) * alpha;
+        group.w[channel] = m_KeyW[key0] + (m_KeyW[key1] - m_KeyW[key0]) * alpha;
+    }
+}
+
+// Above this cosine the quaternions are interpolated linearly, as the slerp weights lose precision
+constexpr float c_SlerpLinearThreshold = 0.9995f;
+
+#if ANIMATION_AVX2
+// acos on [0, 1] as sqrt(1 - x) times a polynomial, Abramowitz and Stegun 4.4.46, error below 2e-8
+static __m256 AcosPositive(__m256 x)
+{
+    __m256 p = _mm256_set1_ps(-0.0012624911f);
+    p = _mm256_fmadd_ps(p, x, _mm256_set1_ps(0.0066700901f));
+    p = _mm256_fmadd_ps(p, x, _mm256_set1_ps(-0.0170881256f));
+    p = _mm256_fmadd_ps(p, x, _mm256_set1_ps(0.0308918810f));
+    p = _mm256_fmadd_ps(p, x, _mm256_set1_ps(-0.0501743046f));
+    p = _mm256_fmadd_ps(p, x, _mm256_set1_ps(0.0889789874f));
+    p = _mm256_fmadd_ps(p, x, _mm256_set1_ps(-0.2145988016f));
+    p = _mm256_fmadd_ps(p, x, _mm256_set1_ps(1.5707963050f));
+    return _mm256_mul_ps(_mm256_sqrt_ps(_mm256_sub_ps(_mm256_set1_ps(1.f), x)), p);
+}
+
+// sin on [0, pi/2] by its Taylor series up to x^11, error below 6e-8
+static __m256 SinQuarterTurn(__m256 x)
+{
+    __m256 x2 = _mm256_mul_ps(x, x);
+    __m256 p = _mm256_set1_ps(-1.f / 39916800.f);
+    p = _mm256_fmadd_ps(p, x2, _mm256_set1_ps(1.f / 362880.f));
+    p = _mm256_fmadd_ps(p, x2, _mm256_set1_ps(-1.f / 5040.f));
+    p = _mm256_fmadd_ps(p, x2, _mm256_set1_ps(1.f / 120.f));
+    p = _mm256_fmadd_ps(p, x2, _mm256_set1_ps(-1.f / 6.f));
+    p = _mm256_fmadd_ps(p, x2, _mm256_set1_ps(1.f));
+    return _mm256_mul_ps(p, x);
+}
+#endif
+
+void AnimationSampler::SlerpChannels(ChannelGroup& group, size_t begin, size_t end) const
+{
+    size_t channel = begin;
+
+#if ANIMATION_AVX2
+    const __m256 one = _mm256_set1_ps(1.f);
+    const __m256 signBit = _mm256_set1_ps(-0.f);
+
+    for (; channel + 8 <= end; channel += 8)
+    {
+        __m256i key0 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(&group.key0[channel]));
+        __m256i key1 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(&group.key1[channel]));
+        __m256 u = _mm256_loadu_ps(&group.alpha[channel]);
+
+        __m256 ax = _mm256_i32gather_ps(m_KeyX.data(), key0, 4);
+        __m256 ay = _mm256_i32gather_ps(m_KeyY.data(), key0, 4);
+        __m256 az = _mm256_i32gather_ps(m_KeyZ.data(), key0, 4);
+        __m256 aw = _mm256_i32gather_ps(m_KeyW.data(), key0, 4);
+        __m256 bx = _mm256_i32gather_ps(m_KeyX.data(), key1, 4);
+        __m256 by = _mm256_i32gather_ps(m_KeyY.data(), key1, 4);
+        __m256 bz = _mm256_i32gather_ps(m_KeyZ.data(), key1, 4);
+        __m256 bw = _mm256_i32gather_ps(m_KeyW.data(), key1, 4);
+
+        __m256 cosine = _mm256_fmadd_ps(ax, bx, _mm256_fmadd_ps(ay, by, _mm256_fmadd_ps(az, bz, _mm256_mul_ps(aw, bw))));
+
+        // Take the shorter arc by flipping the second quaternion where the cosine is negative
+        __m256 flip = _mm256_and_ps(cosine, signBit);
+        cosine = _mm256_min_ps(_mm256_xor_ps(cosine, flip), one);
+        bx = _mm256_xor_ps(bx, flip);
+        by = _mm256_xor_ps(by, flip);
+        bz = _mm256_xor_ps(bz, flip);
+        bw = _mm256_xor_ps(bw, flip);
+
+        __m256 theta = AcosPositive(cosine);
+        __m256 inverseSin = _mm256_div_ps(one, SinQuarterTurn(theta));
+        __m256 weightA = _mm256_mul_ps(SinQuarterTurn(_mm256_mul_ps(_mm256_sub_ps(one, u), theta)), inverseSin);
+        __m256 weightB = _mm256_mul_ps(SinQuarterTurn(_mm256_mul_ps(u, theta)), inverseSin);
+
+        __m256 nearlyEqual = _mm256_cmp_ps(cosine, _mm256_set1_ps(c_SlerpLinearThreshold), _CMP_GT_OQ);
+        weightA = _mm256_blendv_ps(weightA, _mm256_sub_ps(one, u), nearlyEqual);
+        weightB = _mm256_blendv_ps(weightB, u, nearlyEqual);
+
+        __m256 x = _mm256_fmadd_ps(ax, weightA, _mm256_mul_ps(bx, weightB));
+        __m256 y = _mm256_fmadd_ps(ay, weightA, _mm256_mul_ps(by, weightB));
+        __m256 z = _mm256_fmadd_ps(az, weightA, _mm256_mul_ps(bz, weightB));
+        __m256 w = _mm256_fmadd_ps(aw, weightA, _mm256_mul_ps(bw, weightB));
+
+        __m256 length = _mm256_sqrt_ps(_mm256_fmadd_ps(x, x, _mm256_fmadd_ps(y, y, _mm256_fmadd_ps(z, z, _mm256_mul_ps(w, w)))));
+        __m256 inverseLength = _mm256_div_ps(one, length);
+
+        _mm256_storeu_ps(&group.x[channel], _mm256_mul_ps(x, inverseLength));
+        _mm256_storeu_ps(&group.y[channel], _mm256_mul_ps(y, inverseLength));
+        _mm256_storeu_ps(&group.z[channel], _mm256_mul_ps(z, inverseLength));
+        _mm256_storeu_ps(&group.w[channel], _mm256_mul_ps(w, inverseLength));
+    }
+#endif
+
+    for (; channel < end; channel++)
+    {
+        const int32_t key0 = group.key0[channel];
+        const int32_t key1 = group.key1[channel];
+        const float u = group.alpha[channel];
+
+        float4 a(m_KeyX[key0], m_KeyY[key0], m_KeyZ[key0], m_KeyW[key0]);
+        float4 b(m_KeyX[key1], m_KeyY[key1], m_KeyZ[key1], m_KeyW[key1]);
+
+        float cosine = dot(a, b);
+        if (cosine < 0.f)
+        {
+            b = -b;
+            cosine = -cosine;
+        }
+
+        float weightA = 1.f - u;
+        float weightB = u;
+        if (cosine <= c_SlerpLinearThreshold)
+        {
+            float theta = std::acos(cosine);
+            float inverseSin = 1.f / std::sin(theta);
+            weightA = std::sin((1.f - u) * theta) * inverseSin;
+            weightB = std::sin(u * theta) * inverseSin;
+        }
+
+        float4 result = normalize(a * weightA + b * weightB);
+        group.x[channel] = result.x;
+        group.y[channel] = result.y;
+        group.z[channel] = result.z;
+        group.w[channel] = result.w;
+    }
+}
+
+void AnimationSampler::Evaluate(const float* times, tf::Executor* executor)
+{
+    std::copy(times, times + m_AnimationCount, m_Times.begin());
+
+    auto evaluateBlock = [this](ChannelGroup& group, bool slerp, size_t begin)
+    {
+        size_t end = std::min(begin + c_ChannelBlockSize, group.GetCount());
+        FindSegments(group, begin, end);
+        if (slerp)
+            SlerpChannels(group, begin, end);
+        else
+            LerpChannels(group, begin, end);
+    };
+
+#ifdef DONUT_WITH_TASKFLOW
+    if (executor && GetChannelCount() > c_ChannelBlockSize)
+    {
+        tf::Taskflow taskflow;
+        for (size_t begin = 0; begin < m_Lerp.GetCount(); begin += c_ChannelBlockSize)
+            taskflow.emplace([this, &evaluateBlock, begin]() { evaluateBlock(m_Lerp, false, begin); });
+        for (size_t begin = 0; begin < m_Slerp.GetCount(); begin += c_ChannelBlockSize)
+            taskflow.emplace([this, &evaluateBlock, begin]() { evaluateBlock(m_Slerp, true, begin); });
+        executor->run(taskflow).wait();
+        return;
+    }
+#else
+    (void)executor;
+#endif
+
+    for (size_t begin = 0; begin < m_Lerp.GetCount(); begin += c_ChannelBlockSize)
+        evaluateBlock(m_Lerp, false, begin);
+    for (size_t begin = 0; begin < m_Slerp.GetCount(); begin += c_ChannelBlockSize)
+        evaluateBlock(m_Slerp, true, begin);
+}
+
+void AnimationSampler::Apply() const
+{
+    for (const ChannelGroup* group : { &m_Lerp, &m_Slerp })
+    {
+        for (size_t channel = 0; channel < group->GetCount(); channel++)
+        {
+            auto node = group->channels[channel]->GetTargetNode();
+            if (!node)
+                continue;
+
+            double4 value(group->x[channel], group->y[channel], group->z[channel], group->w[channel]);
+            switch (group->channels[channel]->GetAttribute())
+            {
+            case AnimationAttribute::Translation:
+                node->SetTranslation(value.xyz());
+                break;
+            case AnimationAttribute::Rotation:
+                node->SetRotation(normalize(dquat::fromXYZW(value)));
+                break;
+            case AnimationAttribute::Scaling:
+                node->SetScaling(value.xyz());
+                break;
+            default:
+                break;
+            }
+        }
+    }
+
+    for (const FallbackChannel& fallback : m_FallbackChannels)
+        (void)fallback.channel->Apply(m_Times[fallback.animation]);
+}
+
+const std::shared_ptr<SceneGraphAnimationChannel>& AnimationSampler::GetChannel(uint32_t index) const
+{
+    return index < m_Lerp.GetCount() ? m_Lerp.channels[index] : m_Slerp.channels[index - m_Lerp.GetCount()];
+}
+
+uint32_t AnimationSampler::GetChannelAnimation(uint32_t index) const
+{
+    return index < m_Lerp.GetCount() ? m_Lerp.animation[index] : m_Slerp.animation[index - m_Lerp.GetCount()];
+}
+
+float4 AnimationSampler::GetValue(uint32_t index) const
+{
+    const ChannelGroup& group = index < m_Lerp.GetCount() ? m_Lerp : m_Slerp;
+    if (index >= m_Lerp.GetCount())
+        index -= uint32_t(m_Lerp.GetCount());
+
+    return float4(group.x[index], group.y[index], group.z[index], group.w[index]);
+}
+
+namespace
+{
+    double MillisecondsSince(std::chrono::high_resolution_clock::time_point start)
+    {
+        return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+    }
+
+    // Rotations are compared by angle, since q and -q are the same rotation
+    bool ValuesMatch(const float4& value, const float4& reference, bool rotation)
+    {
+        if (rotation)
+            return 1.f - std::abs(dot(normalize(value), normalize(reference))) < 1e-5f;
+
+        float4 error = abs(value - reference);
+        float scale = std::max(1.f, std::max(std::max(std::abs(reference.x), std::abs(reference.y)), std::max(std::abs(reference.z), std::abs(reference.w))));
+        return std::max(std::max(error.x, error.y), std::max(error.z, error.w)) < 1e-4f * scale;
+    }
+
+    animation::Keyframe MakeKeyframe(float time, const float4& value)
+    {
+        animation::Keyframe keyframe;
+        keyframe.time = time;
+        keyframe.value = value;
+        return keyframe;
+    }
+
+    // A baked clip of 60 keyframes at 30 Hz per joint: swaying translation, rotation about a fixed axis,
+    // and constant scaling with two keyframes, as exported rigs usually have
+    std::shared_ptr<SceneGraphAnimation> BuildSyntheticRig(SceneGraph& graph, uint32_t jointCount, uint32_t seed)
+    {
+        const uint32_t keyCount = 60;
+        const float keyInterval = 1.f / 30.f;
+
+        std::mt19937 random(seed);
+        std::uniform_real_distribution<float> unit(-1.f, 1.f);
+
+        auto animation = std::make_shared<SceneGraphAnimation>();
+        std::vector<std::shared_ptr<SceneGraphNode>> joints;
+        joints.push_back(std::make_shared<SceneGraphNode>());
+        graph.SetRootNode(joints.back());
+
+        for (uint32_t joint = 0; joint < jointCount; joint++)
+        {
+            // Chains with occasional branches, like limbs and fingers
+            size_t parentIndex = joints.size() - 1 - std::min<size_t>(random() % 4, joints.size() - 1);
+            auto node = graph.Attach(joints[parentIndex], std::make_shared<SceneGraphNode>());
+            joints.push_back(node);
+
+            float3 offset(unit(random), unit(random), unit(random));
+            float3 axis = normalize(float3(unit(random), unit(random), unit(random)) + float3(0.f, 0.f, 1e-3f));
+            float amplitude = 0.5f + 0.5f * unit(random);
+            float phase = PI_f * unit(random);
+
+            auto translation = std::make_shared<animation::Sampler>();
+            auto rotation = std::make_shared<animation::Sampler>();
+            auto scaling = std::make_shared<animation::Sampler>();
+            translation->SetInterpolationMode(animation::InterpolationMode::Linear);
+            rotation->SetInterpolationMode(animation::InterpolationMode::Slerp);
+            scaling->SetInterpolationMode(animation::InterpolationMode::Linear);
+
+            for (uint32_t key = 0; key < keyCount; key++)
+            {
+                float time = float(key) * keyInterval;
+                float wave = std::sin(phase + time * 2.f * PI_f);
+                float angle = amplitude * wave;
+
+                translation->AddKeyframe(MakeKeyframe(time, float4(offset * (1.f + 0.1f * wave), 0.f)));
+                rotation->AddKeyframe(MakeKeyframe(time, float4(axis * std::sin(angle * 0.5f), std::cos(angle * 0.5f))));
+            }
+
+            scaling->AddKeyframe(MakeKeyframe(0.f, float4(1.f, 1.f, 1.f, 0.f)));
+            scaling->AddKeyframe(MakeKeyframe(float(keyCount - 1) * keyInterval, float4(1.f, 1.f, 1.f, 0.f)));
+
+            animation->AddChannel(std::make_shared<SceneGraphAnimationChannel>(translation, node, AnimationAttribute::Translation));
+            animation->AddChannel(std::make_shared<SceneGraphAnimationChannel>(rotation, node, AnimationAttribute::Rotation));
+            animation->AddChannel(std::make_shared<SceneGraphAnimationChannel>(scaling, node, AnimationAttribute::Scaling));
+        }
+
+        return animation;
+    }
+}
+
+int RunAnimationSamplerBenchmark(const std::vector<std::shared_ptr<SceneGraphAnimation>>& animations, const char* name, tf::Executor* executor)
+{
+    if (animations.empty())
+    {
+        log::info("Animation sampler benchmark (%s): no animations", name);
+        return 0;
+    }
+
+    AnimationSampler sampler;
+    for (const auto& animation : animations)
+        sampler.AddAnimation(animation);
+
+    // Five seconds of forward playback, wrapping around at the end of each animation
+    const uint32_t frameCount = 300;
+    const float frameTime = 1.f / 60.f;
+    std::vector<float> times(animations.size());
+    auto setTimes = [&](uint32_t frame)
+    {
+        for (size_t index = 0; index < animations.size(); index++)
+        {
+            float duration = animations[index]->GetDuration();
+            times[index] = duration > 0.f ? std::fmod(float(frame) * frameTime, duration) : 0.f;
+        }
+    };
+
+    auto start = std::chrono::high_resolution_clock::now();
+    for (uint32_t frame = 0; frame < frameCount; frame++)
+    {
+        setTimes(frame);
+        for (size_t index = 0; index < animations.size(); index++)
+            (void)animations[index]->Apply(times[index]);
+    }
+    double donutMs = MillisecondsSince(start) / frameCount;
+
+    start = std::chrono::high_resolution_clock::now();
+    for (uint32_t frame = 0; frame < frameCount; frame++)
+    {
+        setTimes(frame);
+        sampler.Evaluate(times.data());
+    }
+    double serialMs = MillisecondsSince(start) / frameCount;
+
+    start = std::chrono::high_resolution_clock::now();
+    for (uint32_t frame = 0; frame < frameCount; frame++)
+    {
+        setTimes(frame);
+        sampler.Evaluate(times.data(), executor);
+    }
+    double parallelMs = MillisecondsSince(start) / frameCount;
+
+    start = std::chrono::high_resolution_clock::now();
+    for (uint32_t frame = 0; frame < frameCount; frame++)
+    {
+        setTimes(frame);
+        sampler.Evaluate(times.data(), executor);
+        sampler.Apply();
+    }
+    double applyMs = MillisecondsSince(start) / frameCount;
+
+    // Every seventh frame against Donut's samplers, which also covers the wrap-around searches
+    int violations = 0;
+    for (uint32_t frame = 0; frame < frameCount; frame += 7)
+    {
+        setTimes(frame);
+        sampler.Evaluate(times.data(), executor);
+
+        for (uint32_t index = 0; index < sampler.GetChannelCount(); index++)
+        {
+            const auto& channel = sampler.GetChannel(index);
+            float time = times[sampler.GetChannelAnimation(index)];
+            std::optional<float4> reference = channel->GetSampler()->Evaluate(time, true);
+            bool rotation = channel->GetAttribute() == AnimationAttribute::Rotation;
+
+            if (reference.has_value() && !ValuesMatch(sampler.GetValue(index), *reference, rotation))
+            {
+                if (violations < 10)
+                {
+                    float4 value = sampler.GetValue(index);
+                    log::warning("Animation sampler benchmark (%s): channel %u at %.4f s is (%f, %f, %f, %f), expected (%f, %f, %f, %f)",
+                        name, index, time, value.x, value.y, value.z, value.w, reference->x, reference->y, reference->z, reference->w);
+                }
+                ++violations;
+            }
+        }
+    }
+
+    log::info("Animation sampler benchmark (%s): %u animations, %u channels (%u through Donut), %u keyframes",
+        name, sampler.GetAnimationCount(), sampler.GetChannelCount(), sampler.GetFallbackChannelCount(), sampler.GetKeyframeCount());
+    log::info("Animation sampler benchmark (%s): Donut %.3f ms, sampler %.3f ms serial, %.3f ms parallel, %.3f ms with Apply per frame; %d mismatches",
+        name, donutMs, serialMs, parallelMs, applyMs, violations);
+
+    return violations;
+}
+
+int RunSyntheticAnimationBenchmark(tf::Executor* executor)
+{
+    const uint32_t jointCounts[] = { 1000, 4000, 10000 };
+    int violations = 0;
+
+    for (uint32_t jointCount : jointCounts)
+    {
+        auto graph = std::make_shared<SceneGraph>();
+        std::vector<std::shared_ptr<SceneGraphAnimation>> animations = { BuildSyntheticRig(*graph, jointCount, jointCount) };
+
+        std::string name = std::to_string(jointCount) + " joints";
+        violations += RunAnimationSamplerBenchmark(animations, name.c_str(), executor);
+    }
+
+    return violations;
+}
@@ -0,0 +1,119 @@
+/*
+* Copyright (c) 2014-2021, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#pragma once
+
+#include <donut/core/math/math.h>
+#include <memory>
+#include <vector>
+
+namespace donut::engine
+{
+    class SceneGraphAnimation;
+    class SceneGraphAnimationChannel;
+    class SceneGraphNode;
+}
+
+namespace tf
+{
+    class Executor;
+}
+
+// Evaluates the translation, rotation and scaling channels of many animations at once.
+//
+// The keyframes of all channels are flattened into structure-of-arrays buffers with one array per
+// component. Each channel remembers the keyframe segment of its previous evaluation, so that forward
+// playback finds the next segment in constant time; jumps backwards use a binary search. Channels are
+// grouped into lerped and slerped ones, which the AVX2 path (DONUT_EXAMPLES_WITH_AVX2) interpolates eight
+// at a time from gathered keyframes, and blocks of channels are evaluated in parallel on the executor.
+// Channels with other targets or spline interpolation are left to the Donut sampler.
+//
+// Evaluate() only writes the sampler's own arrays. Apply() writes the results into the scene graph and
+// must run on the thread that owns it.
+class AnimationSampler
+{
+public:
+    // Returns the index of the animation in the times passed to Evaluate()
+    uint32_t AddAnimation(const std::shared_ptr<donut::engine::SceneGraphAnimation>& animation);
+
+    // The times are indexed by animation and clamped to the keyframes of each channel
+    void Evaluate(const float* times, tf::Executor* executor = nullptr);
+    void Apply() const;
+
+    [[nodiscard]] uint32_t GetAnimationCount() const { return m_AnimationCount; }
+    [[nodiscard]] uint32_t GetKeyframeCount() const { return uint32_t(m_KeyTimes.size()); }
+    [[nodiscard]] uint32_t GetFallbackChannelCount() const { return uint32_t(m_FallbackChannels.size()); }
+
+    // Channels evaluated by the sampler, and their values from the last Evaluate()
+    [[nodiscard]] uint32_t GetChannelCount() const { return uint32_t(m_Lerp.GetCount() + m_Slerp.GetCount()); }
+    [[nodiscard]] const std::shared_ptr<donut::engine::SceneGraphAnimationChannel>& GetChannel(uint32_t index) const;
+    [[nodiscard]] uint32_t GetChannelAnimation(uint32_t index) const;
+    [[nodiscard]] donut::math::float4 GetValue(uint32_t index) const;
+
+private:
+    struct ChannelGroup
+    {
+        // Source
+        std::vector<std::shared_ptr<donut::engine::SceneGraphAnimationChannel>> channels;
+        std::vector<uint32_t> animation;
+        std::vector<uint32_t> firstKey;
+        std::vector<uint32_t> keyCount;
+        std::vector<uint8_t> step;
+
+        // Segment search
+        std::vector<uint32_t> lastSegment;
+        std::vector<int32_t> key0;
+        std::vector<int32_t> key1;
+        std::vector<float> alpha;
+
+        // Results
+        std::vector<float> x, y, z, w;
+
+        [[nodiscard]] size_t GetCount() const { return channels.size(); }
+    };
+
+    struct FallbackChannel
+    {
+        std::shared_ptr<donut::engine::SceneGraphAnimationChannel> channel;
+        uint32_t animation;
+    };
+
+    std::vector<float> m_KeyTimes;
+    std::vector<float> m_KeyX, m_KeyY, m_KeyZ, m_KeyW;
+    ChannelGroup m_Lerp;
+    ChannelGroup m_Slerp;
+    std::vector<FallbackChannel> m_FallbackChannels;
+    std::vector<float> m_Times;
+    uint32_t m_AnimationCount = 0;
+
+    void FindSegments(ChannelGroup& group, size_t begin, size_t end) const;
+    void LerpChannels(ChannelGroup& group, size_t begin, size_t end) const;
+    void SlerpChannels(ChannelGroup& group, size_t begin, size_t end) const;
+};
+
+// Plays the animations forward for a few seconds with Donut's per-animation Apply() and with the sampler,
+// serially and on the executor, checks the sampled values against Donut's samplers and logs the timings.
+// Returns the number of mismatching values.
+int RunAnimationSamplerBenchmark(const std::vector<std::shared_ptr<donut::engine::SceneGraphAnimation>>& animations, const char* name, tf::Executor* executor);
+
+// Runs the benchmark over synthetic rigs of 1k to 16k joints with baked translation, rotation and scaling
+int RunSyntheticAnimationBenchmark(tf::Executor* executor);
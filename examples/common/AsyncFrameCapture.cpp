@@ -0,0 +1,270 @@
+/*
+* Copyright (c) 2014-2021, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#include "AsyncFrameCapture.h"
+#include <donut/core/log.h>
+#include <algorithm>
+#include <cstring>
+
+using namespace donut;
+
+AsyncFrameCapture::AsyncFrameCapture(nvrhi::IDevice* device, uint32_t ringSize, uint32_t encoderThreads)
+    : m_Device(device)
+    , m_Slots(std::max(ringSize, 1u))
+    , m_MaxQueuedJobs(std::max(ringSize, 1u) * 2)
+{
+    for (Slot& slot : m_Slots)
+        slot.query = m_Device->createEventQuery();
+
+    encoderThreads = std::max(encoderThreads, 1u);
+    for (uint32_t i = 0; i < encoderThreads; i++)
+        m_Workers.emplace_back(&AsyncFrameCapture::WorkerThread, this);
+}
+
+AsyncFrameCapture::~AsyncFrameCapture()
+{
+    Flush();
+
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        m_Terminate = true;
+    }
+    m_JobAvailable.notify_all();
+
+    for (std::thread& worker : m_Workers)
+        worker.join();
+}
+
+AsyncFrameCapture::Slot* AsyncFrameCapture::FindOldestInFlight()
+{
+    Slot* oldest = nullptr;
+    for (Slot& slot : m_Slots)
+    {
+        if (slot.state == SlotState::InFlight && (!oldest || slot.sequence < oldest->sequence))
+            oldest = &slot;
+    }
+    return oldest;
+}
+
+AsyncFrameCapture::Slot* AsyncFrameCapture::AcquireSlot()
+{
+    for (Slot& slot : m_Slots)
+    {
+        if (slot.state == SlotState::Free)
+            return &slot;
+    }
+
+    // Every staging texture is busy: wait for the oldest submitted copy.
+    Slot* oldest = FindOldestInFlight();
+
+    // All slots were recorded in the current frame and are not submitted yet
+    if (!oldest)
+        return nullptr;
+
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        ++m_Stats.stallsOnRing;
+    }
+
+    m_Device->waitEventQuery(oldest->query);
+    ReadbackSlot(*oldest);
+    return oldest;
+}
+
+bool AsyncFrameCapture::Capture(nvrhi::ICommandList* commandList, nvrhi::ITexture* texture, const std::filesystem::path& fileName)
+{
+    const nvrhi::TextureDesc& srcDesc = texture->getDesc();
+
+    if (!IsCaptureFormatSupported(srcDesc.format))
+    {
+        log::warning("Cannot capture texture '%s': format %s is not supported",
+            srcDesc.debugName.c_str(), nvrhi::getFormatInfo(srcDesc.format).name);
+        return false;
+    }
+
+    Slot* slot = AcquireSlot();
+    if (!slot)
+    {
+        log::warning("Frame capture ring is full, dropping '%s'", fileName.generic_string().c_str());
+        return false;
+    }
+
+    if (slot->stagingTexture)
+    {
+        const nvrhi::TextureDesc& stagingDesc = slot->stagingTexture->getDesc();
+        if (stagingDesc.width != srcDesc.width || stagingDesc.height != srcDesc.height || stagingDesc.format != srcDesc.format)
+            slot->stagingTexture = nullptr;
+    }
+
+    if (!slot->stagingTexture)
+    {
+        nvrhi::TextureDesc stagingDesc;
+        stagingDesc.width = srcDesc.width;
+        stagingDesc.height = srcDesc.height;
+        stagingDesc.format = srcDesc.format;
+        stagingDesc.debugName = "CaptureStagingTexture";
+        slot->stagingTexture = m_Device->createStagingTexture(stagingDesc, nvrhi::CpuAccessMode::Read);
+    }
+
+    commandList->copyTexture(slot->stagingTexture, nvrhi::TextureSlice(), texture, nvrhi::TextureSlice());
+
+    slot->state = SlotState::Recorded;
+    slot->fileName = fileName;
+    slot->sequence = m_NextSequence++;
+
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    ++m_Stats.captured;
+    return true;
+}
+
+void AsyncFrameCapture::EndFrame()
+{
+    for (Slot& slot : m_Slots)
+    {
+        if (slot.state == SlotState::Recorded)
+        {
+            m_Device->resetEventQuery(slot.query);
+            m_Device->setEventQuery(slot.query, nvrhi::CommandQueue::Graphics);
+            slot.state = SlotState::InFlight;
+        }
+    }
+
+    // Collect finished copies in submission order so that files appear in sequence
+    while (true)
+    {
+        Slot* oldest = FindOldestInFlight();
+        if (!oldest || !m_Device->pollEventQuery(oldest->query))
+            break;
+
+        ReadbackSlot(*oldest);
+    }
+}
+
+void AsyncFrameCapture::ReadbackSlot(Slot& slot)
+{
+    EncodeJob job;
+    job.fileName = std::move(slot.fileName);
+
+    const nvrhi::TextureDesc& desc = slot.stagingTexture->getDesc();
+    job.image.width = desc.width;
+    job.image.height = desc.height;
+    job.image.format = desc.format;
+    job.image.pixels.resize(job.image.GetRowSize() * desc.height);
+
+    size_t rowPitch = 0;
+    const uint8_t* mapped = static_cast<const uint8_t*>(m_Device->mapStagingTexture(slot.stagingTexture, nvrhi::TextureSlice(), nvrhi::CpuAccessMode::Read, &rowPitch));
+    slot.state = SlotState::Free;
+
+    if (!mapped)
+    {
+        log::warning("Cannot map capture staging texture for '%s'", job.fileName.generic_string().c_str());
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        ++m_Stats.failed;
+        return;
+    }
+
+    const size_t rowSize = job.image.GetRowSize();
+    for (uint32_t y = 0; y < desc.height; y++)
+        std::memcpy(job.image.pixels.data() + y * rowSize, mapped + y * rowPitch, rowSize);
+
+    m_Device->unmapStagingTexture(slot.stagingTexture);
+
+    std::unique_lock<std::mutex> lock(m_Mutex);
+    if (m_Jobs.size() >= m_MaxQueuedJobs)
+    {
+        ++m_Stats.stallsOnEncoder;
+        m_JobFinished.wait(lock, [this]() { return m_Jobs.size() < m_MaxQueuedJobs; });
+    }
+    m_Jobs.push_back(std::move(job));
+    lock.unlock();
+
+    m_JobAvailable.notify_one();
+}
+
+void AsyncFrameCapture::WorkerThread()
+{
+    while (true)
+    {
+        EncodeJob job;
+        {
+            std::unique_lock<std::mutex> lock(m_Mutex);
+            m_JobAvailable.wait(lock, [this]() { return m_Terminate || !m_Jobs.empty(); });
+
+            if (m_Jobs.empty())
+                return;
+
+            job = std::move(m_Jobs.front());
+            m_Jobs.pop_front();
+            ++m_ActiveJobs;
+        }
+        m_JobFinished.notify_all();
+
+        bool success = WriteCapturedImage(job.image, job.fileName);
+
+        {
+            std::lock_guard<std::mutex> lock(m_Mutex);
+            --m_ActiveJobs;
+            if (success)
+                ++m_Stats.written;
+            else
+                ++m_Stats.failed;
+        }
+        m_JobFinished.notify_all();
+    }
+}
+
+void AsyncFrameCapture::Flush()
+{
+    for (Slot& slot : m_Slots)
+    {
+        if (slot.state == SlotState::Recorded)
+            log::warning("Frame capture '%s' was recorded but never submitted", slot.fileName.generic_string().c_str());
+    }
+
+    while (Slot* oldest = FindOldestInFlight())
+    {
+        m_Device->waitEventQuery(oldest->query);
+        ReadbackSlot(*oldest);
+    }
+
+    std::unique_lock<std::mutex> lock(m_Mutex);
+    m_JobFinished.wait(lock, [this]() { return m_Jobs.empty() && m_ActiveJobs == 0; });
+}
+
+AsyncFrameCapture::Stats AsyncFrameCapture::GetStats()
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    return m_Stats;
+}
+
+uint32_t AsyncFrameCapture::GetPendingCount()
+{
+    uint32_t count = 0;
+    for (const Slot& slot : m_Slots)
+    {
+        if (slot.state != SlotState::Free)
+            ++count;
+    }
+
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    return count + uint32_t(m_Jobs.size()) + m_ActiveJobs;
+}
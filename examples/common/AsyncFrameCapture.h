@@ -0,0 +1,118 @@
+/*
+* Copyright (c) 2014-2021, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#pragma once
+
+#include "ImageEncoders.h"
+#include <nvrhi/nvrhi.h>
+#include <condition_variable>
+#include <deque>
+#include <filesystem>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Pipelined texture capture that does not stall the frame.
+//
+// Usage per frame:
+//   capture.Capture(commandList, texture, fileName);   // while the command list is open
+//   device->executeCommandList(commandList);
+//   capture.EndFrame();                                 // after the command list is submitted
+//
+// Capture() records a copy into one of a ring of staging textures. EndFrame() signals
+// an event query behind the submitted work and hands every staging texture whose query
+// has completed to a pool of encoder threads. When all staging textures are in flight,
+// Capture() waits for the oldest one (back-pressure on the GPU side); when too many
+// images are waiting to be encoded, readback waits for the encoders (back-pressure on
+// the CPU side), so memory use stays bounded if the disk cannot keep up.
+class AsyncFrameCapture
+{
+public:
+    struct Stats
+    {
+        uint64_t captured = 0;
+        uint64_t written = 0;
+        uint64_t failed = 0;
+        uint64_t stallsOnRing = 0;
+        uint64_t stallsOnEncoder = 0;
+    };
+
+    AsyncFrameCapture(nvrhi::IDevice* device, uint32_t ringSize = 4, uint32_t encoderThreads = 2);
+    ~AsyncFrameCapture();
+
+    AsyncFrameCapture(const AsyncFrameCapture&) = delete;
+    AsyncFrameCapture& operator=(const AsyncFrameCapture&) = delete;
+
+    // Records a copy of mip 0 of the texture; the output format follows the file extension (see WriteCapturedImage)
+    bool Capture(nvrhi::ICommandList* commandList, nvrhi::ITexture* texture, const std::filesystem::path& fileName);
+
+    // Must be called once per frame after the command lists containing this frame's Capture() calls were executed
+    void EndFrame();
+
+    // Waits until every capture has been read back and written to disk
+    void Flush();
+
+    [[nodiscard]] Stats GetStats();
+    [[nodiscard]] uint32_t GetPendingCount();
+
+private:
+    enum class SlotState
+    {
+        Free,
+        Recorded,   // copy recorded, not yet submitted
+        InFlight    // event query signaled behind the copy
+    };
+
+    struct Slot
+    {
+        nvrhi::StagingTextureHandle stagingTexture;
+        nvrhi::EventQueryHandle query;
+        SlotState state = SlotState::Free;
+        std::filesystem::path fileName;
+        uint64_t sequence = 0;
+    };
+
+    struct EncodeJob
+    {
+        CapturedImage image;
+        std::filesystem::path fileName;
+    };
+
+    nvrhi::DeviceHandle m_Device;
+    std::vector<Slot> m_Slots;
+    uint64_t m_NextSequence = 0;
+
+    std::vector<std::thread> m_Workers;
+    std::mutex m_Mutex;
+    std::condition_variable m_JobAvailable;
+    std::condition_variable m_JobFinished;
+    std::deque<EncodeJob> m_Jobs;
+    uint32_t m_ActiveJobs = 0;
+    uint32_t m_MaxQueuedJobs;
+    bool m_Terminate = false;
+    Stats m_Stats;
+
+    Slot* FindOldestInFlight();
+    Slot* AcquireSlot();
+    void ReadbackSlot(Slot& slot);
+    void WorkerThread();
+};
@@ -0,0 +1,921 @@
+/*
+* Copyright (c) 2014-2021, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+#include "CpuRayTracer.h"
+#include <donut/engine/SceneGraph.h>
+#include <donut/core/log.h>
+#include <algorithm>
+#include <atomic>
+#include <cfloat>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <future>
+#include <numeric>
+#include <thread>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define CPU_RT_AVX2 1
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define CPU_RT_SSE2 1
+#endif
+
+using namespace donut::math;
+
+namespace
+{
+    constexpr uint32_t c_BinCount = 16;
+    constexpr uint32_t c_MinLeafTriangles = 4;  // never split below this
+    constexpr uint32_t c_MaxLeafTriangles = 16; // always split above this
+    constexpr uint32_t c_ParallelBuildThreshold = 8192;
+    constexpr uint32_t c_MaxStackDepth = 128;
+    constexpr float c_TraversalCost = 1.f;
+    constexpr float c_IntersectionCost = 1.f;
+
+    // ---[ SIMD lanes ]---
+    // A minimal set of lane-wise operations; masks are lanes with all bits set or clear.
+
+#if CPU_RT_AVX2
+    constexpr uint32_t c_Lanes = 8;
+    struct Lanes { __m256 v; };
+    inline Lanes Splat(float a) { return { _mm256_set1_ps(a) }; }
+    inline Lanes Load(const float* p) { return { _mm256_loadu_ps(p) }; }
+    inline void Store(float* p, Lanes a) { _mm256_storeu_ps(p, a.v); }
+    inline Lanes operator+(Lanes a, Lanes b) { return { _mm256_add_ps(a.v, b.v) }; }
+    inline Lanes operator-(Lanes a, Lanes b) { return { _mm256_sub_ps(a.v, b.v) }; }
+    inline Lanes operator*(Lanes a, Lanes b) { return { _mm256_mul_ps(a.v, b.v) }; }
+    inline Lanes operator/(Lanes a, Lanes b) { return { _mm256_div_ps(a.v, b.v) }; }
+    inline Lanes Min(Lanes a, Lanes b) { return { _mm256_min_ps(a.v, b.v) }; }
+    inline Lanes Max(Lanes a, Lanes b) { return { _mm256_max_ps(a.v, b.v) }; }
+    inline Lanes Less(Lanes a, Lanes b) { return { _mm256_cmp_ps(a.v, b.v, _CMP_LT_OQ) }; }
+    inline Lanes LessEqual(Lanes a, Lanes b) { return { _mm256_cmp_ps(a.v, b.v, _CMP_LE_OQ) }; }
+    inline Lanes operator&(Lanes a, Lanes b) { return { _mm256_and_ps(a.v, b.v) }; }
+    inline Lanes operator|(Lanes a, Lanes b) { return { _mm256_or_ps(a.v, b.v) }; }
+    inline Lanes AndNot(Lanes mask, Lanes a) { return { _mm256_andnot_ps(mask.v, a.v) }; }
+    inline Lanes Select(Lanes mask, Lanes a, Lanes b) { return { _mm256_blendv_ps(b.v, a.v, mask.v) }; }
+    inline uint32_t MaskBits(Lanes mask) { return uint32_t(_mm256_movemask_ps(mask.v)); }
+    inline Lanes MaskFromBits(uint32_t bits)
+    {
+        const __m256i laneBits = _mm256_setr_epi32(1, 2, 4, 8, 16, 32, 64, 128);
+        __m256i selected = _mm256_and_si256(_mm256_set1_epi32(int(bits)), laneBits);
+        return { _mm256_castsi256_ps(_mm256_cmpeq_epi32(selected, laneBits)) };
+    }
+#elif CPU_RT_SSE2
+    constexpr uint32_t c_Lanes = 4;
+    struct Lanes { __m128 v; };
+    inline Lanes Splat(float a) { return { _mm_set1_ps(a) }; }
+    inline Lanes Load(const float* p) { return { _mm_loadu_ps(p) }; }
+    inline void Store(float* p, Lanes a) { _mm_storeu_ps(p, a.v); }
+    inline Lanes operator+(Lanes a, Lanes b) { return { _mm_add_ps(a.v, b.v) }; }
+    inline Lanes operator-(Lanes a, Lanes b) { return { _mm_sub_ps(a.v, b.v) }; }
+    inline Lanes operator*(Lanes a, Lanes b) { return { _mm_mul_ps(a.v, b.v) }; }
+    inline Lanes operator/(Lanes a, Lanes b) { return { _mm_div_ps(a.v, b.v) }; }
+    inline Lanes Min(Lanes a, Lanes b) { return { _mm_min_ps(a.v, b.v) }; }
+    inline Lanes Max(Lanes a, Lanes b) { return { _mm_max_ps(a.v, b.v) }; }
+    inline Lanes Less(Lanes a, Lanes b) { return { _mm_cmplt_ps(a.v, b.v) }; }
+    inline Lanes LessEqual(Lanes a, Lanes b) { return { _mm_cmple_ps(a.v, b.v) }; }
+    inline Lanes operator&(Lanes a, Lanes b) { return { _mm_and_ps(a.v, b.v) }; }
+    inline Lanes operator|(Lanes a, Lanes b) { return { _mm_or_ps(a.v, b.v) }; }
+    inline Lanes AndNot(Lanes mask, Lanes a) { return { _mm_andnot_ps(mask.v, a.v) }; }
+    inline Lanes Select(Lanes mask, Lanes a, Lanes b) { return { _mm_or_ps(_mm_and_ps(mask.v, a.v), _mm_andnot_ps(mask.v, b.v)) }; }
+    inline uint32_t MaskBits(Lanes mask) { return uint32_t(_mm_movemask_ps(mask.v)); }
+    inline Lanes MaskFromBits(uint32_t bits)
+    {
+        const __m128i laneBits = _mm_setr_epi32(1, 2, 4, 8);
+        __m128i selected = _mm_and_si128(_mm_set1_epi32(int(bits)), laneBits);
+        return { _mm_castsi128_ps(_mm_cmpeq_epi32(selected, laneBits)) };
+    }
+#else
+    constexpr uint32_t c_Lanes = 4;
+    struct Lanes { float v[c_Lanes]; };
+
+    inline uint32_t AsBits(float a) { uint32_t u; memcpy(&u, &a, sizeof(u)); return u; }
+    inline float FromBits(uint32_t u) { float a; memcpy(&a, &u, sizeof(a)); return a; }
+    inline float FromBool(bool b) { return FromBits(b ? ~0u : 0u); }
+
+    template<typename F> inline Lanes Map(Lanes a, Lanes b, F f) { Lanes r; for (uint32_t i = 0; i < c_Lanes; i++) r.v[i] = f(a.v[i], b.v[i]); return r; }
+
+    inline Lanes Splat(float a) { Lanes r; for (float& x : r.v) x = a; return r; }
+    inline Lanes Load(const float* p) { Lanes r; memcpy(r.v, p, sizeof(r.v)); return r; }
+    inline void Store(float* p, Lanes a) { memcpy(p, a.v, sizeof(a.v)); }
+    inline Lanes operator+(Lanes a, Lanes b) { return Map(a, b, [](float x, float y) { return x + y; }); }
+    inline Lanes operator-(Lanes a, Lanes b) { return Map(a, b, [](float x, float y) { return x - y; }); }
+    inline Lanes operator*(Lanes a, Lanes b) { return Map(a, b, [](float x, float y) { return x * y; }); }
+    inline Lanes operator/(Lanes a, Lanes b) { return Map(a, b, [](float x, float y) { return x / y; }); }
+    inline Lanes Min(Lanes a, Lanes b) { return Map(a, b, [](float x, float y) { return x < y ? x : y; }); }
+    inline Lanes Max(Lanes a, Lanes b) { return Map(a, b, [](float x, float y) { return x > y ? x : y; }); }
+    inline Lanes Less(Lanes a, Lanes b) { return Map(a, b, [](float x, float y) { return FromBool(x < y); }); }
+    inline Lanes LessEqual(Lanes a, Lanes b) { return Map(a, b, [](float x, float y) { return FromBool(x <= y); }); }
+    inline Lanes operator&(Lanes a, Lanes b) { return Map(a, b, [](float x, float y) { return FromBits(AsBits(x) & AsBits(y)); }); }
+    inline Lanes operator|(Lanes a, Lanes b) { return Map(a, b, [](float x, float y) { return FromBits(AsBits(x) | AsBits(y)); }); }
+    inline Lanes AndNot(Lanes mask, Lanes a) { return Map(mask, a, [](float m, float x) { return FromBits(~AsBits(m) & AsBits(x)); }); }
+    inline Lanes Select(Lanes mask, Lanes a, Lanes b) { return (mask & a) | AndNot(mask, b); }
+    inline uint32_t MaskBits(Lanes mask) { uint32_t bits = 0; for (uint32_t i = 0; i < c_Lanes; i++) bits |= (AsBits(mask.v[i]) >> 31) << i; return bits; }
+    inline Lanes MaskFromBits(uint32_t bits) { Lanes r; for (uint32_t i = 0; i < c_Lanes; i++) r.v[i] = FromBool(bits & (1u << i)); return r; }
+#endif
+
+    inline Lanes Abs(Lanes a) { return AndNot(Splat(-0.f), a); }
+
+    // Reinterprets lanes holding integers stored as float bit patterns
+    inline Lanes SplatBits(uint32_t u) { float f; memcpy(&f, &u, sizeof(f)); return Splat(f); }
+
+    struct Lanes3
+    {
+        Lanes x, y, z;
+    };
+
+    inline Lanes3 Splat3(const float3& a) { return { Splat(a.x), Splat(a.y), Splat(a.z) }; }
+    inline Lanes3 operator-(const Lanes3& a, const Lanes3& b) { return { a.x - b.x, a.y - b.y, a.z - b.z }; }
+    inline Lanes Dot(const Lanes3& a, const Lanes3& b) { return a.x * b.x + a.y * b.y + a.z * b.z; }
+    inline Lanes3 Cross(const Lanes3& a, const Lanes3& b) { return { a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x }; }
+
+    // ---[ BVH construction ]---
+
+    struct BuildBox
+    {
+        float3 mins = float3(FLT_MAX);
+        float3 maxs = float3(-FLT_MAX);
+
+        void Grow(const float3& p) { mins = min(mins, p); maxs = max(maxs, p); }
+        void Grow(const BuildBox& b) { mins = min(mins, b.mins); maxs = max(maxs, b.maxs); }
+
+        [[nodiscard]] float Area() const
+        {
+            float3 d = max(maxs - mins, float3(0.f));
+            return 2.f * (d.x * d.y + d.y * d.z + d.z * d.x);
+        }
+    };
+
+    struct BuildContext
+    {
+        std::vector<BuildBox> triangleBounds;
+        std::vector<float3> centroids;
+        std::vector<uint32_t> order;
+        uint32_t parallelDepth = 0;
+    };
+
+    struct BuildResult
+    {
+        std::vector<CpuRayTracer::Node> nodes;
+        uint32_t leaves = 0;
+        uint32_t maxDepth = 0;
+    };
+
+    void MakeLeaf(BuildResult& result, const BuildBox& bounds, uint32_t first, uint32_t count, uint32_t depth)
+    {
+        CpuRayTracer::Node node;
+        node.boundsMin = bounds.mins;
+        node.boundsMax = bounds.maxs;
+        node.rightOrFirst = first;
+        node.triangleCount = uint16_t(count);
+        node.splitAxis = 0;
+        result.nodes.push_back(node);
+        result.leaves++;
+        result.maxDepth = std::max(result.maxDepth, depth);
+    }
+
+    // Appends the subtree in depth-first order, so that left children directly follow their parent
+    void BuildSubtree(BuildContext& context, BuildResult& result, uint32_t first, uint32_t count, uint32_t depth)
+    {
+        BuildBox bounds;
+        BuildBox centroidBounds;
+        for (uint32_t i = first; i < first + count; i++)
+        {
+            bounds.Grow(context.triangleBounds[context.order[i]]);
+            centroidBounds.Grow(context.centroids[context.order[i]]);
+        }
+
+        // The depth limit keeps the traversal stacks bounded on pathological inputs
+        if (count <= c_MinLeafTriangles || depth + 2 >= c_MaxStackDepth)
+        {
+            MakeLeaf(result, bounds, first, count, depth);
+            return;
+        }
+
+        // Find the cheapest of the binned splits along all three axes
+        float bestCost = FLT_MAX;
+        int bestAxis = -1;
+        uint32_t bestBin = 0;
+        float3 extent = centroidBounds.maxs - centroidBounds.mins;
+
+        for (int axis = 0; axis < 3; axis++)
+        {
+            if (extent[axis] <= 0.f)
+                continue;
+
+            BuildBox binBounds[c_BinCount];
+            uint32_t binCounts[c_BinCount] = {};
+            float binScale = float(c_BinCount) / extent[axis];
+
+            for (uint32_t i = first; i < first + count; i++)
+            {
+                uint32_t triangle = context.order[i];
+                uint32_t bin = std::min(uint32_t((context.centroids[triangle][axis] - centroidBounds.mins[axis]) * binScale), c_BinCount - 1);
+                binBounds[bin].Grow(context.triangleBounds[triangle]);
+                binCounts[bin]++;
+            }
+
+            // Sweep from the right to get the cost of every right side, then from the left
+            float rightAreas[c_BinCount];
+            uint32_t rightCounts[c_BinCount];
+            BuildBox accumulated;
+            uint32_t accumulatedCount = 0;
+            for (uint32_t bin = c_BinCount - 1; bin > 0; bin--)
+            {
+                accumulated.Grow(binBounds[bin]);
+                accumulatedCount += binCounts[bin];
+                rightAreas[bin] = accumulated.Area();
+                rightCounts[bin] = accumulatedCount;
+            }
+
+            accumulated = BuildBox();
+            accumulatedCount = 0;
+            for (uint32_t bin = 0; bin < c_BinCount - 1; bin++)
+            {
+                accumulated.Grow(binBounds[bin]);
+                accumulatedCount += binCounts[bin];
+                if (accumulatedCount == 0 || rightCounts[bin + 1] == 0)
+                    continue;
+
+                float cost = accumulated.Area() * float(accumulatedCount) + rightAreas[bin + 1] * float(rightCounts[bin + 1]);
+                if (cost < bestCost)
+                {
+                    bestCost = cost;
+                    bestAxis = axis;
+                    bestBin = bin;
+                }
+            }
+        }
+
+        float leafCost = bounds.Area() * float(count) * c_IntersectionCost;
+        float splitCost = bounds.Area() * c_TraversalCost + bestCost * c_IntersectionCost;
+
+        uint32_t leftCount;
+        if (bestAxis >= 0 && (splitCost < leafCost || count > c_MaxLeafTriangles))
+        {
+            float binScale = float(c_BinCount) / extent[bestAxis];
+            float axisMin = centroidBounds.mins[bestAxis];
+            auto middle = std::partition(context.order.begin() + first, context.order.begin() + first + count,
+                [&context, bestAxis, bestBin, binScale, axisMin](uint32_t triangle)
+                {
+                    uint32_t bin = std::min(uint32_t((context.centroids[triangle][bestAxis] - axisMin) * binScale), c_BinCount - 1);
+                    return bin <= bestBin;
+                });
+            leftCount = uint32_t(middle - (context.order.begin() + first));
+        }
+        else if (count > c_MaxLeafTriangles)
+        {
+            // All centroids coincide, split by index
+            leftCount = count / 2;
+        }
+        else
+        {
+            MakeLeaf(result, bounds, first, count, depth);
+            return;
+        }
+
+        uint32_t nodeIndex = uint32_t(result.nodes.size());
+        CpuRayTracer::Node node;
+        node.boundsMin = bounds.mins;
+        node.boundsMax = bounds.maxs;
+        node.rightOrFirst = 0;
+        node.triangleCount = 0;
+        node.splitAxis = uint16_t(std::max(bestAxis, 0));
+        result.nodes.push_back(node);
+
+        if (depth < context.parallelDepth && count >= c_ParallelBuildThreshold)
+        {
+            // Build the left subtree on another thread; both halves are appended once done
+            BuildResult leftResult;
+            auto leftTask = std::async(std::launch::async, [&context, &leftResult, first, leftCount, depth]()
+            {
+                BuildSubtree(context, leftResult, first, leftCount, depth + 1);
+            });
+
+            BuildResult rightResult;
+            BuildSubtree(context, rightResult, first + leftCount, count - leftCount, depth + 1);
+            leftTask.wait();
+
+            for (const BuildResult* subtree : { &leftResult, &rightResult })
+            {
+                uint32_t offset = uint32_t(result.nodes.size());
+                if (subtree == &rightResult)
+                    result.nodes[nodeIndex].rightOrFirst = offset;
+
+                for (CpuRayTracer::Node child : subtree->nodes)
+                {
+                    if (child.triangleCount == 0)
+                        child.rightOrFirst += offset;
+                    result.nodes.push_back(child);
+                }
+                result.leaves += subtree->leaves;
+                result.maxDepth = std::max(result.maxDepth, subtree->maxDepth);
+            }
+        }
+        else
+        {
+            BuildSubtree(context, result, first, leftCount, depth + 1);
+            result.nodes[nodeIndex].rightOrFirst = uint32_t(result.nodes.size());
+            BuildSubtree(context, result, first + leftCount, count - leftCount, depth + 1);
+        }
+    }
+
+    // Runs the function over [0, count) in chunks on the given number of threads
+    template<typename F>
+    void ParallelFor(size_t count, size_t chunkSize, uint32_t threadCount, F function)
+    {
+        std::atomic<size_t> nextChunk = 0;
+        auto worker = [&]()
+        {
+            for (size_t begin = nextChunk.fetch_add(chunkSize); begin < count; begin = nextChunk.fetch_add(chunkSize))
+                function(begin, std::min(begin + chunkSize, count));
+        };
+
+        std::vector<std::thread> threads;
+        for (uint32_t i = 1; i < threadCount; i++)
+            threads.emplace_back(worker);
+        worker();
+        for (auto& thread : threads)
+            thread.join();
+    }
+
+    // Avoids infinities times zero in the slab test
+    float SafeInverse(float d)
+    {
+        const float epsilon = 1e-20f;
+        if (std::abs(d) < epsilon)
+            d = std::copysign(epsilon, d);
+        return 1.f / d;
+    }
+
+    bool IsCloserHit(const CpuRayHit& hit, float t)
+    {
+        return !hit.IsHit() || t < hit.committedRayT;
+    }
+}
+
+void CpuRayTracer::AddTriangles(
+    const uint32_t* indices, size_t indexCount,
+    const float3* positions,
+    const affine3& objectToWorld,
+    uint32_t instanceID, uint32_t geometryIndex, bool alphaTested)
+{
+    const float3x3& linear = objectToWorld.m_linear;
+    float determinant = dot(linear[0], cross(linear[1], linear[2]));
+    float frontSign = determinant < 0.f ? -1.f : 1.f;
+
+    for (size_t i = 0; i + 2 < indexCount; i += 3)
+    {
+        float3 p0 = objectToWorld.transformPoint(positions[indices[i + 0]]);
+        float3 p1 = objectToWorld.transformPoint(positions[indices[i + 1]]);
+        float3 p2 = objectToWorld.transformPoint(positions[indices[i + 2]]);
+
+        Triangle triangle;
+        triangle.v0 = p0;
+        triangle.edge1 = p1 - p0;
+        triangle.edge2 = p2 - p0;
+        triangle.frontSign = frontSign;
+        triangle.source = uint32_t(m_Sources.size());
+        m_Triangles.push_back(triangle);
+
+        TriangleSource source;
+        source.instanceID = instanceID;
+        source.geometryIndex = geometryIndex;
+        source.primitiveIndex = uint32_t(i / 3);
+        source.flags = alphaTested ? c_CpuHitAlphaTested : 0;
+        m_Sources.push_back(source);
+    }
+}
+
+void CpuRayTracer::AddSceneGraph(const donut::engine::SceneGraph& sceneGraph)
+{
+    for (const auto& instance : sceneGraph.GetMeshInstances())
+    {
+        const auto& mesh = instance->GetMesh();
+        const auto& buffers = mesh->buffers;
+        // Skinned meshes only have GPU vertex data and are skipped
+        if (buffers->indexData.empty() || buffers->positionData.empty())
+            continue;
+
+        affine3 objectToWorld = instance->GetNode()->GetLocalToWorldTransformFloat();
+
+        for (size_t geometryIndex = 0; geometryIndex < mesh->geometries.size(); geometryIndex++)
+        {
+            const auto& geometry = mesh->geometries[geometryIndex];
+            const uint32_t* indices = buffers->indexData.data() + mesh->indexOffset + geometry->indexOffsetInMesh;
+            const float3* positions = buffers->positionData.data() + mesh->vertexOffset + geometry->vertexOffsetInMesh;
+            bool alphaTested = geometry->material && geometry->material->domain == donut::engine::MaterialDomain::AlphaTested;
+
+            AddTriangles(indices, geometry->numIndices, positions, objectToWorld, uint32_t(instance->GetInstanceIndex()), uint32_t(geometryIndex), alphaTested);
+        }
+    }
+}
+
+void CpuRayTracer::Build(uint32_t threadCount)
+{
+    auto buildStart = std::chrono::high_resolution_clock::now();
+
+    const uint32_t triangleCount = uint32_t(m_Triangles.size());
+
+    BuildContext context;
+    context.triangleBounds.resize(triangleCount);
+    context.centroids.resize(triangleCount);
+    context.order.resize(triangleCount);
+    std::iota(context.order.begin(), context.order.end(), 0u);
+
+    ParallelFor(triangleCount, 4096, threadCount, [this, &context](size_t begin, size_t end)
+    {
+        for (size_t i = begin; i < end; i++)
+        {
+            const Triangle& triangle = m_Triangles[i];
+            BuildBox& bounds = context.triangleBounds[i];
+            bounds.Grow(triangle.v0);
+            bounds.Grow(triangle.v0 + triangle.edge1);
+            bounds.Grow(triangle.v0 + triangle.edge2);
+            context.centroids[i] = (bounds.mins + bounds.maxs) * 0.5f;
+        }
+    });
+
+    // Two tasks per thread at the parallel levels
+    while ((1u << context.parallelDepth) < threadCount * 2)
+        context.parallelDepth++;
+
+    BuildResult result;
+    if (triangleCount > 0)
+        BuildSubtree(context, result, 0, triangleCount, 0);
+
+    // Reorder the triangles to match the leaves
+    std::vector<Triangle> ordered(triangleCount);
+    for (uint32_t i = 0; i < triangleCount; i++)
+        ordered[i] = m_Triangles[context.order[i]];
+    m_Triangles = std::move(ordered);
+    m_Nodes = std::move(result.nodes);
+
+    m_Stats = CpuBvhStats();
+    m_Stats.triangles = triangleCount;
+    m_Stats.nodes = uint32_t(m_Nodes.size());
+    m_Stats.leaves = result.leaves;
+    m_Stats.maxDepth = result.maxDepth;
+
+    if (!m_Nodes.empty())
+    {
+        auto nodeArea = [](const Node& node)
+        {
+            BuildBox box;
+            box.mins = node.boundsMin;
+            box.maxs = node.boundsMax;
+            return box.Area();
+        };
+
+        float rootArea = nodeArea(m_Nodes[0]);
+        float cost = 0.f;
+        for (const Node& node : m_Nodes)
+            cost += nodeArea(node) * (node.triangleCount ? float(node.triangleCount) * c_IntersectionCost : c_TraversalCost);
+        m_Stats.sahCost = rootArea > 0.f ? cost / rootArea : 0.f;
+    }
+
+    m_Stats.buildTimeMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - buildStart).count();
+}
+
+const char* CpuRayTracer::GetSimdName()
+{
+#if CPU_RT_AVX2
+    return "AVX2";
+#elif CPU_RT_SSE2
+    return "SSE2";
+#else
+    return "scalar";
+#endif
+}
+
+uint32_t CpuRayTracer::GetPacketWidth()
+{
+    return c_Lanes;
+}
+
+CpuRayHit CpuRayTracer::TraceRayBruteForce(const CpuRay& ray, const CpuTraceOptions& options) const
+{
+    CpuRayHit hit;
+
+    for (const Triangle& triangle : m_Triangles)
+    {
+        // Moller-Trumbore; a positive determinant means the triangle appears clockwise from the origin
+        float3 p = cross(ray.direction, triangle.edge2);
+        float det = dot(triangle.edge1, p) * triangle.frontSign;
+        if (options.cullBackFaces ? det <= 0.f : det == 0.f)
+            continue;
+
+        float invDet = triangle.frontSign / det;
+        float3 s = ray.origin - triangle.v0;
+        float u = dot(s, p) * invDet;
+        float3 q = cross(s, triangle.edge1);
+        float v = dot(ray.direction, q) * invDet;
+        float t = dot(triangle.edge2, q) * invDet;
+
+        if (u < 0.f || v < 0.f || u + v > 1.f || t < ray.tMin || t >= ray.tMax || !IsCloserHit(hit, t))
+            continue;
+
+        const TriangleSource& source = m_Sources[triangle.source];
+        hit.instanceID = source.instanceID;
+        hit.geometryIndex = source.geometryIndex;
+        hit.primitiveIndex = source.primitiveIndex;
+        hit.flags = source.flags;
+        hit.committedRayT = t;
+        hit.barycentrics = float2(u, v);
+
+        if (options.acceptFirstHit)
+            break;
+    }
+
+    return hit;
+}
+
+CpuRayHit CpuRayTracer::TraceRay(const CpuRay& ray, const CpuTraceOptions& options) const
+{
+    CpuRayHit hit;
+    if (m_Nodes.empty())
+        return hit;
+
+    float3 invDir = float3(SafeInverse(ray.direction.x), SafeInverse(ray.direction.y), SafeInverse(ray.direction.z));
+    float tMax = ray.tMax;
+
+    uint32_t stack[c_MaxStackDepth];
+    uint32_t stackSize = 0;
+    stack[stackSize++] = 0;
+
+    while (stackSize > 0)
+    {
+        const Node& node = m_Nodes[stack[--stackSize]];
+
+        float3 t0 = (node.boundsMin - ray.origin) * invDir;
+        float3 t1 = (node.boundsMax - ray.origin) * invDir;
+        float3 tNear = min(t0, t1);
+        float3 tFar = max(t0, t1);
+        float enter = std::max(std::max(tNear.x, tNear.y), std::max(tNear.z, ray.tMin));
+        float exit = std::min(std::min(tFar.x, tFar.y), std::min(tFar.z, tMax));
+        if (enter > exit)
+            continue;
+
+        if (node.triangleCount == 0)
+        {
+            uint32_t left = uint32_t(&node - m_Nodes.data()) + 1;
+            uint32_t right = node.rightOrFirst;
+            // Visit the near child first
+            if (ray.direction[node.splitAxis] < 0.f)
+                std::swap(left, right);
+            stack[stackSize++] = right;
+            stack[stackSize++] = left;
+            continue;
+        }
+
+        for (uint32_t i = node.rightOrFirst; i < node.rightOrFirst + node.triangleCount; i++)
+        {
+            const Triangle& triangle = m_Triangles[i];
+            float3 p = cross(ray.direction, triangle.edge2);
+            float det = dot(triangle.edge1, p) * triangle.frontSign;
+            if (options.cullBackFaces ? det <= 0.f : det == 0.f)
+                continue;
+
+            float invDet = triangle.frontSign / det;
+            float3 s = ray.origin - triangle.v0;
+            float u = dot(s, p) * invDet;
+            float3 q = cross(s, triangle.edge1);
+            float v = dot(ray.direction, q) * invDet;
+            float t = dot(triangle.edge2, q) * invDet;
+
+            if (u < 0.f || v < 0.f || u + v > 1.f || t < ray.tMin || t >= tMax)
+                continue;
+
+            const TriangleSource& source = m_Sources[triangle.source];
+            hit.instanceID = source.instanceID;
+            hit.geometryIndex = source.geometryIndex;
+            hit.primitiveIndex = source.primitiveIndex;
+            hit.flags = source.flags;
+            hit.committedRayT = t;
+            hit.barycentrics = float2(u, v);
+            tMax = t;
+
+            if (options.acceptFirstHit)
+                return hit;
+        }
+    }
+
+    return hit;
+}
+
+void CpuRayTracer::TracePacket(const CpuRay* rays, CpuRayHit* hits, uint32_t count, const CpuTraceOptions& options) const
+{
+    // Transpose the rays into lanes; unused lanes start inactive
+    alignas(32) float ox[c_Lanes], oy[c_Lanes], oz[c_Lanes], dx[c_Lanes], dy[c_Lanes], dz[c_Lanes];
+    alignas(32) float ix[c_Lanes], iy[c_Lanes], iz[c_Lanes], tMin[c_Lanes], tMax[c_Lanes];
+    alignas(32) uint32_t hitTriangle[c_Lanes];
+    alignas(32) float hitU[c_Lanes], hitV[c_Lanes];
+
+    uint32_t activeBits = 0;
+    for (uint32_t lane = 0; lane < c_Lanes; lane++)
+    {
+        const CpuRay& ray = rays[std::min(lane, count - 1)];
+        ox[lane] = ray.origin.x; oy[lane] = ray.origin.y; oz[lane] = ray.origin.z;
+        dx[lane] = ray.direction.x; dy[lane] = ray.direction.y; dz[lane] = ray.direction.z;
+        ix[lane] = SafeInverse(ray.direction.x); iy[lane] = SafeInverse(ray.direction.y); iz[lane] = SafeInverse(ray.direction.z);
+        tMin[lane] = ray.tMin;
+        tMax[lane] = ray.tMax;
+        hitTriangle[lane] = ~0u;
+        hitU[lane] = hitV[lane] = 0.f;
+
+        if (lane < count && ray.tMin <= ray.tMax)
+            activeBits |= 1u << lane;
+    }
+
+    if (activeBits == 0 || m_Nodes.empty())
+    {
+        for (uint32_t lane = 0; lane < count; lane++)
+            hits[lane] = CpuRayHit();
+        return;
+    }
+
+    const Lanes3 origin = { Load(ox), Load(oy), Load(oz) };
+    const Lanes3 direction = { Load(dx), Load(dy), Load(dz) };
+    const Lanes3 invDir = { Load(ix), Load(iy), Load(iz) };
+    const Lanes rayTMin = Load(tMin);
+    Lanes rayTMax = Load(tMax);
+    Lanes active = MaskFromBits(activeBits);
+    Lanes triangleIds = SplatBits(~0u);
+    Lanes hitULanes = Splat(0.f);
+    Lanes hitVLanes = Splat(0.f);
+
+    // The packet is coherent enough to order the children by the first active ray
+    uint32_t firstLane = 0;
+    while (!(activeBits & (1u << firstLane)))
+        firstLane++;
+    const bool negative[3] = { dx[firstLane] < 0.f, dy[firstLane] < 0.f, dz[firstLane] < 0.f };
+
+    uint32_t stack[c_MaxStackDepth];
+    uint32_t stackSize = 0;
+    stack[stackSize++] = 0;
+
+    while (stackSize > 0)
+    {
+        uint32_t nodeIndex = stack[--stackSize];
+        const Node& node = m_Nodes[nodeIndex];
+
+        Lanes3 t0 = { (Splat(node.boundsMin.x) - origin.x) * invDir.x, (Splat(node.boundsMin.y) - origin.y) * invDir.y, (Splat(node.boundsMin.z) - origin.z) * invDir.z };
+        Lanes3 t1 = { (Splat(node.boundsMax.x) - origin.x) * invDir.x, (Splat(node.boundsMax.y) - origin.y) * invDir.y, (Splat(node.boundsMax.z) - origin.z) * invDir.z };
+        Lanes enter = Max(Max(Min(t0.x, t1.x), Min(t0.y, t1.y)), Max(Min(t0.z, t1.z), rayTMin));
+        Lanes exit = Min(Min(Max(t0.x, t1.x), Max(t0.y, t1.y)), Min(Max(t0.z, t1.z), rayTMax));
+        Lanes boxHit = LessEqual(enter, exit) & active;
+
+        if (MaskBits(boxHit) == 0)
+            continue;
+
+        if (node.triangleCount == 0)
+        {
+            uint32_t left = nodeIndex + 1;
+            uint32_t right = node.rightOrFirst;
+            if (negative[node.splitAxis])
+                std::swap(left, right);
+            stack[stackSize++] = right;
+            stack[stackSize++] = left;
+            continue;
+        }
+
+        for (uint32_t i = node.rightOrFirst; i < node.rightOrFirst + node.triangleCount; i++)
+        {
+            const Triangle& triangle = m_Triangles[i];
+            const Lanes3 edge1 = Splat3(triangle.edge1);
+            const Lanes3 edge2 = Splat3(triangle.edge2);
+            const Lanes frontSign = Splat(triangle.frontSign);
+
+            Lanes3 p = Cross(direction, edge2);
+            Lanes det = Dot(edge1, p) * frontSign;
+            Lanes valid = options.cullBackFaces
+                ? Less(Splat(0.f), det)
+                : Less(Splat(0.f), Abs(det));
+
+            Lanes invDet = frontSign / det;
+            Lanes3 s = origin - Splat3(triangle.v0);
+            Lanes u = Dot(s, p) * invDet;
+            Lanes3 q = Cross(s, edge1);
+            Lanes v = Dot(direction, q) * invDet;
+            Lanes t = Dot(edge2, q) * invDet;
+
+            valid = valid & boxHit
+                & LessEqual(Splat(0.f), u) & LessEqual(Splat(0.f), v) & LessEqual(u + v, Splat(1.f))
+                & LessEqual(rayTMin, t) & Less(t, rayTMax);
+
+            uint32_t validBits = MaskBits(valid);
+            if (validBits == 0)
+                continue;
+
+            rayTMax = Select(valid, t, rayTMax);
+            hitULanes = Select(valid, u, hitULanes);
+            hitVLanes = Select(valid, v, hitVLanes);
+            triangleIds = Select(valid, SplatBits(i), triangleIds);
+
+            if (options.acceptFirstHit)
+            {
+                active = AndNot(valid, active);
+                boxHit = AndNot(valid, boxHit);
+            }
+        }
+
+        if (MaskBits(active) == 0)
+            break;
+    }
+
+    Store(tMax, rayTMax);
+    Store(hitU, hitULanes);
+    Store(hitV, hitVLanes);
+    Store(reinterpret_cast<float*>(hitTriangle), triangleIds);
+
+    for (uint32_t lane = 0; lane < count; lane++)
+    {
+        CpuRayHit& hit = hits[lane];
+        hit = CpuRayHit();
+        if (hitTriangle[lane] == ~0u)
+            continue;
+
+        const TriangleSource& source = m_Sources[m_Triangles[hitTriangle[lane]].source];
+        hit.instanceID = source.instanceID;
+        hit.geometryIndex = source.geometryIndex;
+        hit.primitiveIndex = source.primitiveIndex;
+        hit.flags = source.flags;
+        hit.committedRayT = tMax[lane];
+        hit.barycentrics = float2(hitU[lane], hitV[lane]);
+    }
+}
+
+void CpuRayTracer::TraceRays(const CpuRay* rays, CpuRayHit* hits, size_t count, const CpuTraceOptions& options, uint32_t threadCount) const
+{
+    const size_t packetsPerChunk = 64;
+    const size_t packetCount = (count + c_Lanes - 1) / c_Lanes;
+
+    ParallelFor(packetCount, packetsPerChunk, std::max(threadCount, 1u), [this, rays, hits, count, &options](size_t begin, size_t end)
+    {
+        for (size_t packet = begin; packet < end; packet++)
+        {
+            size_t first = packet * c_Lanes;
+            TracePacket(rays + first, hits + first, uint32_t(std::min<size_t>(c_Lanes, count - first)), options);
+        }
+    });
+}
+
+void GeneratePrimaryRays(const float4x4& clipToWorld, const float3& cameraPosition,
+    uint32_t width, uint32_t height, float tMax, std::vector<CpuRay>& rays)
+{
+    rays.resize(size_t(width) * size_t(height));
+
+    for (uint32_t y = 0; y < height; y++)
+    {
+        for (uint32_t x = 0; x < width; x++)
+        {
+            float u = (float(x) + 0.5f) / float(width);
+            float v = (float(y) + 0.5f) / float(height);
+            float4 clipPos = float4(u * 2.f - 1.f, 1.f - v * 2.f, 0.5f, 1.f);
+
+            // Row vectors, as mul(clipPos, view.matClipToWorld)
+            float4 worldPos;
+            for (int c = 0; c < 4; c++)
+                worldPos[c] = clipPos.x * clipToWorld[0][c] + clipPos.y * clipToWorld[1][c] + clipPos.z * clipToWorld[2][c] + clipPos.w * clipToWorld[3][c];
+
+            CpuRay& ray = rays[size_t(y) * width + x];
+            ray.origin = cameraPosition;
+            ray.direction = normalize(float3(worldPos.x, worldPos.y, worldPos.z) / worldPos.w - cameraPosition);
+            ray.tMin = 0.f;
+            ray.tMax = tMax;
+        }
+    }
+}
+
+void GenerateShadowRays(const std::vector<CpuRay>& primaryRays, const std::vector<CpuRayHit>& primaryHits,
+    const float3& lightDirection, float tMin, float tMax, std::vector<CpuRay>& rays)
+{
+    rays.resize(primaryRays.size());
+    float3 toLight = -normalize(lightDirection);
+
+    for (size_t i = 0; i < primaryRays.size(); i++)
+    {
+        CpuRay& ray = rays[i];
+        const CpuRayHit& hit = primaryHits[i];
+
+        ray.origin = primaryRays[i].origin + primaryRays[i].direction * hit.committedRayT;
+        ray.direction = toLight;
+        ray.tMin = tMin;
+        ray.tMax = hit.IsHit() ? tMax : -1.f;
+    }
+}
+
+int ValidateCpuRayTracer(const CpuRayTracer& tracer, const std::vector<CpuRay>& rays, const CpuTraceOptions& options, uint32_t sampleStride)
+{
+    std::vector<CpuRayHit> packetHits(rays.size());
+    tracer.TraceRays(rays.data(), packetHits.data(), rays.size(), options, std::thread::hardware_concurrency());
+
+    // Any-hit queries may legitimately return different hits, so only their visibility is compared
+    auto matches = [&options](const CpuRayHit& a, const CpuRayHit& b)
+    {
+        if (a.IsHit() != b.IsHit())
+            return false;
+        if (!a.IsHit() || options.acceptFirstHit)
+            return true;
+        if (a.instanceID == b.instanceID && a.geometryIndex == b.geometryIndex && a.primitiveIndex == b.primitiveIndex)
+            return true;
+        // Ties between triangles sharing an edge can go either way
+        return std::abs(a.committedRayT - b.committedRayT) <= 1e-4f * std::max(1.f, a.committedRayT);
+    };
+
+    std::atomic<int> mismatches = 0;
+    ParallelFor(rays.size(), 256, std::max(std::thread::hardware_concurrency(), 1u), [&](size_t begin, size_t end)
+    {
+        for (size_t i = begin; i < end; i++)
+        {
+            if (!matches(packetHits[i], tracer.TraceRay(rays[i], options)))
+                mismatches++;
+            else if (sampleStride > 0 && i % sampleStride == 0 && !matches(packetHits[i], tracer.TraceRayBruteForce(rays[i], options)))
+                mismatches++;
+        }
+    });
+
+    return mismatches;
+}
+
+std::vector<CpuTraceBenchmark> BenchmarkCpuRayTracer(const CpuRayTracer& tracer, const std::vector<CpuRay>& rays, const CpuTraceOptions& options, uint32_t repeats)
+{
+    std::vector<CpuTraceBenchmark> results;
+    std::vector<CpuRayHit> hits(rays.size());
+    uint32_t maxThreads = std::max(std::thread::hardware_concurrency(), 1u);
+
+    for (uint32_t threadCount = 1; ; threadCount = std::min(threadCount * 2, maxThreads))
+    {
+        auto start = std::chrono::high_resolution_clock::now();
+        for (uint32_t repeat = 0; repeat < repeats; repeat++)
+            tracer.TraceRays(rays.data(), hits.data(), rays.size(), options, threadCount);
+        double seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+
+        CpuTraceBenchmark result;
+        result.threadCount = threadCount;
+        result.raysPerSecond = seconds > 0.0 ? double(rays.size()) * double(repeats) / seconds : 0.0;
+        results.push_back(result);
+
+        if (threadCount == maxThreads)
+            break;
+    }
+
+    return results;
+}
+
+bool ReportCpuRayTracer(const CpuRayTracer& tracer, const char* name, const std::vector<CpuRay>& rays, const CpuTraceOptions& options)
+{
+    const CpuBvhStats& stats = tracer.GetStats();
+    donut::log::info("CPU BVH: %u triangles, %u nodes, %u leaves, depth %u, SAH cost %.2f, built in %.1f ms",
+        stats.triangles, stats.nodes, stats.leaves, stats.maxDepth, stats.sahCost, stats.buildTimeMs);
+
+    int mismatches = ValidateCpuRayTracer(tracer, rays, options, 97);
+    bool passed = uint64_t(mismatches) * 10000 <= rays.size();
+    donut::log::info("%s rays: %d of %llu disagree with the reference tracers%s", name, mismatches, (unsigned long long)rays.size(), passed ? "" : " - FAILED");
+
+    for (const CpuTraceBenchmark& result : BenchmarkCpuRayTracer(tracer, rays, options, 3))
+    {
+        donut::log::info("%s rays, %s packets of %u, %u thread(s): %.2f Mrays/s",
+            name, CpuRayTracer::GetSimdName(), CpuRayTracer::GetPacketWidth(), result.threadCount, result.raysPerSecond * 1e-6);
+    }
+
+    return passed;
+}
+
+bool WriteCpuRayHits(const std::vector<CpuRayHit>& hits, uint32_t width, uint32_t height, const std::filesystem::path& fileName)
+{
+    std::ofstream file(fileName, std::ios::binary);
+    if (!file)
+        return false;
+
+    CpuRayHitsHeader header;
+    header.magic = 0x48545243; // 'CRTH'
+    header.width = width;
+    header.height = height;
+    header.hitSize = sizeof(CpuRayHit);
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    file.write(reinterpret_cast<const char*>(hits.data()), std::streamsize(hits.size() * sizeof(CpuRayHit)));
+
+    return file.good();
+}
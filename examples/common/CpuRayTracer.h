@@ -0,0 +1,179 @@
+/*
+* Copyright (c) 2014-2021, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+#pragma once
+
+#include <donut/core/math/math.h>
+#include <cstdint>
+#include <filesystem>
+#include <vector>
+
+namespace donut::engine
+{
+    class SceneGraph;
+}
+
+// Reference ray tracer for the rt_* examples, so that their output can be checked on machines
+// without ray tracing hardware.
+//
+// Mesh instances are flattened into world space triangles under a single SAH-binned BVH, built in
+// parallel. Rays are traced in packets with SSE, or AVX2 when the library is compiled with
+// DONUT_EXAMPLES_WITH_AVX2. The hit rules follow DXR: triangles are front facing when they appear
+// clockwise from the ray origin in object space, and a hit is accepted for TMin <= t < TMax.
+// Alpha testing is not emulated, alpha-tested hits are flagged instead.
+
+struct CpuRay
+{
+    donut::math::float3 origin;
+    float tMin = 0.f;
+    donut::math::float3 direction;
+    float tMax = 0.f;
+};
+
+constexpr uint32_t c_CpuHitAlphaTested = 1;
+
+// Same fields as RayPayload in rt_bindless.hlsl
+struct CpuRayHit
+{
+    uint32_t instanceID = ~0u; // ~0u on a miss
+    uint32_t geometryIndex = 0;
+    uint32_t primitiveIndex = 0;
+    float committedRayT = 0.f;
+    donut::math::float2 barycentrics = 0.f;
+    uint32_t flags = 0;
+
+    [[nodiscard]] bool IsHit() const { return instanceID != ~0u; }
+};
+
+struct CpuTraceOptions
+{
+    bool acceptFirstHit = false;  // RAY_FLAG_ACCEPT_FIRST_HIT_AND_END_SEARCH, for shadow rays
+    bool cullBackFaces = false;   // RAY_FLAG_CULL_BACK_FACING_TRIANGLES
+};
+
+struct CpuBvhStats
+{
+    uint32_t triangles = 0;
+    uint32_t nodes = 0;
+    uint32_t leaves = 0;
+    uint32_t maxDepth = 0;
+    float sahCost = 0.f; // relative to the root area, lower is better
+    double buildTimeMs = 0.0;
+};
+
+class CpuRayTracer
+{
+public:
+    // Adds the triangles of every mesh instance, using the instance index as the instance ID like rt_bindless
+    void AddSceneGraph(const donut::engine::SceneGraph& sceneGraph);
+
+    void AddTriangles(
+        const uint32_t* indices, size_t indexCount,
+        const donut::math::float3* positions,
+        const donut::math::affine3& objectToWorld,
+        uint32_t instanceID, uint32_t geometryIndex, bool alphaTested);
+
+    void Build(uint32_t threadCount);
+
+    // Traces the rays in SIMD packets of consecutive rays, spread over the threads
+    void TraceRays(const CpuRay* rays, CpuRayHit* hits, size_t count, const CpuTraceOptions& options, uint32_t threadCount) const;
+
+    [[nodiscard]] CpuRayHit TraceRay(const CpuRay& ray, const CpuTraceOptions& options) const;
+
+    // Tests every triangle, for validation
+    [[nodiscard]] CpuRayHit TraceRayBruteForce(const CpuRay& ray, const CpuTraceOptions& options) const;
+
+    [[nodiscard]] const CpuBvhStats& GetStats() const { return m_Stats; }
+    [[nodiscard]] static const char* GetSimdName();
+    [[nodiscard]] static uint32_t GetPacketWidth();
+
+    struct Node
+    {
+        donut::math::float3 boundsMin;
+        uint32_t rightOrFirst;  // internal nodes: the right child, the left one follows the node
+        donut::math::float3 boundsMax;
+        uint16_t triangleCount; // zero for internal nodes
+        uint16_t splitAxis;
+    };
+
+    struct Triangle
+    {
+        donut::math::float3 v0;
+        donut::math::float3 edge1;
+        donut::math::float3 edge2;
+        float frontSign;   // -1 when the instance transform mirrors the object
+        uint32_t source;   // index into m_Sources
+    };
+
+    struct TriangleSource
+    {
+        uint32_t instanceID;
+        uint32_t geometryIndex;
+        uint32_t primitiveIndex;
+        uint32_t flags;
+    };
+
+private:
+    void TracePacket(const CpuRay* rays, CpuRayHit* hits, uint32_t count, const CpuTraceOptions& options) const;
+
+    std::vector<Node> m_Nodes;
+    std::vector<Triangle> m_Triangles;
+    std::vector<TriangleSource> m_Sources;
+    CpuBvhStats m_Stats;
+};
+
+// Primary rays as generated by setupPrimaryRay in rt_bindless.hlsl, row by row
+void GeneratePrimaryRays(const donut::math::float4x4& clipToWorld, const donut::math::float3& cameraPosition,
+    uint32_t width, uint32_t height, float tMax, std::vector<CpuRay>& rays);
+
+// Shadow rays from the primary hits towards a directional light, as in rt_shadows.hlsl.
+// Rays for missed pixels are empty (tMax < tMin) and never hit.
+void GenerateShadowRays(const std::vector<CpuRay>& primaryRays, const std::vector<CpuRayHit>& primaryHits,
+    const donut::math::float3& lightDirection, float tMin, float tMax, std::vector<CpuRay>& rays);
+
+// Compares the packet tracer against the single-ray tracer for every ray, and against brute force
+// for every sampleStride-th ray. Returns the number of mismatches. The triangle test is not watertight,
+// so rays that graze a shared edge can rarely disagree between the SIMD and scalar paths.
+int ValidateCpuRayTracer(const CpuRayTracer& tracer, const std::vector<CpuRay>& rays, const CpuTraceOptions& options, uint32_t sampleStride);
+
+struct CpuTraceBenchmark
+{
+    uint32_t threadCount = 0;
+    double raysPerSecond = 0.0;
+};
+
+// Traces the rays with 1, 2, 4... threads up to the hardware concurrency
+std::vector<CpuTraceBenchmark> BenchmarkCpuRayTracer(const CpuRayTracer& tracer, const std::vector<CpuRay>& rays, const CpuTraceOptions& options, uint32_t repeats);
+
+// Logs the BVH statistics, the validation result and the throughput per thread count for a set of rays.
+// Returns false if more than one ray in 10000 disagrees with the reference.
+bool ReportCpuRayTracer(const CpuRayTracer& tracer, const char* name, const std::vector<CpuRay>& rays, const CpuTraceOptions& options);
+
+// Writes the hits row by row behind a small header (see CpuRayHitsHeader)
+bool WriteCpuRayHits(const std::vector<CpuRayHit>& hits, uint32_t width, uint32_t height, const std::filesystem::path& fileName);
+
+struct CpuRayHitsHeader
+{
+    uint32_t magic; // 'CRTH'
+    uint32_t width;
+    uint32_t height;
+    uint32_t hitSize; // sizeof(CpuRayHit)
+};
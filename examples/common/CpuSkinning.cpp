@@ -0,0 +1,283 @@
+/*
+* Copyright (c) 2014-2021, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#include "CpuSkinning.h"
+#include <donut/core/log.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <random>
+#include <thread>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define CPU_SKINNING_AVX2 1
+#endif
+
+using namespace donut;
+using namespace donut::math;
+
+static_assert(sizeof(SkinningJointMatrix) == 48, "SkinningJointMatrix must match the skinning shader");
+
+SkinningJointMatrix PackSkinningJointMatrix(const affine3& transform)
+{
+    // Row-vector convention: p' = p.x * row0 + p.y * row1 + p.z * row2 + translation
+    const float3x3& m = transform.m_linear;
+    const float3& t = transform.m_translation;
+
+    SkinningJointMatrix packed;
+    packed.x = float4(m.row0.x, m.row1.x, m.row2.x, t.x);
+    packed.y = float4(m.row0.y, m.row1.y, m.row2.y, t.y);
+    packed.z = float4(m.row0.z, m.row1.z, m.row2.z, t.z);
+    return packed;
+}
+
+void SkinVerticesScalar(const CpuSkinningInput& input, const SkinningJointMatrix* joints, const CpuSkinningOutput& output, uint32_t first, uint32_t end)
+{
+    const bool skinNormals = input.normals && output.normals;
+
+    for (uint32_t vertex = first; vertex < end; vertex++)
+    {
+        const uint16_t* indices = &input.jointIndices[size_t(vertex) * 4];
+        const float4& weights = input.jointWeights[vertex];
+        const float weightArray[4] = { weights.x, weights.y, weights.z, weights.w };
+
+        // Blend the matrices first, which is linear, then transform once
+        float4 x = 0.f, y = 0.f, z = 0.f;
+        for (int influence = 0; influence < 4; influence++)
+        {
+            const SkinningJointMatrix& joint = joints[indices[influence]];
+            x += joint.x * weightArray[influence];
+            y += joint.y * weightArray[influence];
+            z += joint.z * weightArray[influence];
+        }
+
+        float4 position = float4(input.positions[vertex], 1.f);
+        output.positions[vertex] = float3(dot(position, x), dot(position, y), dot(position, z));
+
+        if (skinNormals)
+        {
+            const float3& normal = input.normals[vertex];
+            output.normals[vertex] = normalize(float3(dot(normal, x.xyz()), dot(normal, y.xyz()), dot(normal, z.xyz())));
+        }
+    }
+}
+
+void SkinVertices(const CpuSkinningInput& input, const SkinningJointMatrix* joints, const CpuSkinningOutput& output, uint32_t first, uint32_t end)
+{
+    uint32_t vertex = first;
+
+#if CPU_SKINNING_AVX2
+    // Two vertices per iteration, one in each 128-bit lane. Joint rows are contiguous, so blending them
+    // takes plain loads instead of gathers, and the transform is three dot products by horizontal adds.
+    const bool skinNormals = input.normals && output.normals;
+
+    auto transform = [](__m256 h, __m256 rx, __m256 ry, __m256 rz)
+    {
+        __m256 xy = _mm256_hadd_ps(_mm256_mul_ps(h, rx), _mm256_mul_ps(h, ry));
+        __m256 zz = _mm256_hadd_ps(_mm256_mul_ps(h, rz), _mm256_mul_ps(h, rz));
+        return _mm256_hadd_ps(xy, zz); // (x, y, z, z) in each lane
+    };
+
+    auto store = [](float3& low, float3& high, __m256 value)
+    {
+        alignas(32) float result[8];
+        _mm256_store_ps(result, value);
+        low = float3(result[0], result[1], result[2]);
+        high = float3(result[4], result[5], result[6]);
+    };
+
+    for (; vertex + 2 <= end; vertex += 2)
+    {
+        const uint16_t* indicesA = &input.jointIndices[size_t(vertex) * 4];
+        const uint16_t* indicesB = indicesA + 4;
+        const float* weightsA = &input.jointWeights[vertex].x;
+        const float* weightsB = &input.jointWeights[vertex + 1].x;
+
+        __m256 rx = _mm256_setzero_ps();
+        __m256 ry = _mm256_setzero_ps();
+        __m256 rz = _mm256_setzero_ps();
+        for (int influence = 0; influence < 4; influence++)
+        {
+            const SkinningJointMatrix& jointA = joints[indicesA[influence]];
+            const SkinningJointMatrix& jointB = joints[indicesB[influence]];
+            __m256 weight = _mm256_set_m128(_mm_broadcast_ss(weightsB + influence), _mm_broadcast_ss(weightsA + influence));
+
+            rx = _mm256_fmadd_ps(weight, _mm256_loadu2_m128(&jointB.x.x, &jointA.x.x), rx);
+            ry = _mm256_fmadd_ps(weight, _mm256_loadu2_m128(&jointB.y.x, &jointA.y.x), ry);
+            rz = _mm256_fmadd_ps(weight, _mm256_loadu2_m128(&jointB.z.x, &jointA.z.x), rz);
+        }
+
+        const float3& positionA = input.positions[vertex];
+        const float3& positionB = input.positions[vertex + 1];
+        __m256 position = _mm256_setr_ps(positionA.x, positionA.y, positionA.z, 1.f, positionB.x, positionB.y, positionB.z, 1.f);
+        store(output.positions[vertex], output.positions[vertex + 1], transform(position, rx, ry, rz));
+
+        if (skinNormals)
+        {
+            const float3& normalA = input.normals[vertex];
+            const float3& normalB = input.normals[vertex + 1];
+            __m256 normal = _mm256_setr_ps(normalA.x, normalA.y, normalA.z, 0.f, normalB.x, normalB.y, normalB.z, 0.f);
+            __m256 skinned = transform(normal, rx, ry, rz);
+
+            // The fourth element repeats z, so mask it out of the length
+            __m256 xyz = _mm256_blend_ps(skinned, _mm256_setzero_ps(), 0x88);
+            __m256 lengthSquared = _mm256_mul_ps(xyz, xyz);
+            lengthSquared = _mm256_hadd_ps(lengthSquared, lengthSquared);
+            lengthSquared = _mm256_hadd_ps(lengthSquared, lengthSquared);
+            store(output.normals[vertex], output.normals[vertex + 1], _mm256_div_ps(xyz, _mm256_sqrt_ps(lengthSquared)));
+        }
+    }
+#endif
+
+    SkinVerticesScalar(input, joints, output, vertex, end);
+}
+
+void SkinVerticesParallel(const CpuSkinningInput& input, const SkinningJointMatrix* joints, const CpuSkinningOutput& output, uint32_t threadCount)
+{
+    if (threadCount == 0)
+        threadCount = std::max(std::thread::hardware_concurrency(), 1u);
+
+    // Ranges are even so that only the last one can have a scalar tail
+    uint32_t rangeSize = (input.vertexCount + threadCount - 1) / threadCount;
+    rangeSize = std::max((rangeSize + 1) & ~1u, 1024u);
+
+    std::vector<std::thread> threads;
+    for (uint32_t first = rangeSize; first < input.vertexCount; first += rangeSize)
+    {
+        uint32_t end = std::min(first + rangeSize, input.vertexCount);
+        threads.emplace_back([&input, joints, &output, first, end]() { SkinVertices(input, joints, output, first, end); });
+    }
+
+    SkinVertices(input, joints, output, 0, std::min(rangeSize, input.vertexCount));
+
+    for (std::thread& thread : threads)
+        thread.join();
+}
+
+int RunCpuSkinningBenchmark(uint32_t threadCount)
+{
+    if (threadCount == 0)
+        threadCount = std::max(std::thread::hardware_concurrency(), 1u);
+
+    // A large crowd in one buffer: 1M vertices with four influences each out of 256 joints
+    const uint32_t vertexCount = 1u << 20;
+    const uint32_t jointCount = 256;
+    const int runs = 5;
+
+    std::mt19937 random(42);
+    std::uniform_real_distribution<float> unit(-1.f, 1.f);
+    std::uniform_real_distribution<float> positive(0.f, 1.f);
+
+    std::vector<SkinningJointMatrix> joints(jointCount);
+    for (SkinningJointMatrix& joint : joints)
+    {
+        affine3 transform = yawPitchRoll(PI_f * unit(random), PI_f * unit(random), PI_f * unit(random))
+            * translation(float3(unit(random), unit(random), unit(random)));
+        joint = PackSkinningJointMatrix(transform);
+    }
+
+    std::vector<float3> positions(vertexCount);
+    std::vector<float3> normals(vertexCount);
+    std::vector<uint16_t> jointIndices(size_t(vertexCount) * 4);
+    std::vector<float4> jointWeights(vertexCount);
+    for (uint32_t vertex = 0; vertex < vertexCount; vertex++)
+    {
+        positions[vertex] = float3(unit(random), unit(random), unit(random));
+        normals[vertex] = normalize(float3(unit(random), unit(random), unit(random)) + float3(0.f, 0.f, 1e-3f));
+
+        // Mostly one or two dominant joints, as in real rigs; unused influences have zero weight
+        float4 weights(positive(random), positive(random) * 0.5f, positive(random) * 0.2f, 0.f);
+        weights /= weights.x + weights.y + weights.z + weights.w;
+        jointWeights[vertex] = weights;
+
+        for (int influence = 0; influence < 4; influence++)
+            jointIndices[size_t(vertex) * 4 + influence] = uint16_t(random() % jointCount);
+    }
+
+    CpuSkinningInput input;
+    input.positions = positions.data();
+    input.normals = normals.data();
+    input.jointIndices = jointIndices.data();
+    input.jointWeights = jointWeights.data();
+    input.vertexCount = vertexCount;
+
+    std::vector<float3> referencePositions(vertexCount), referenceNormals(vertexCount);
+    std::vector<float3> simdPositions(vertexCount), simdNormals(vertexCount);
+    std::vector<float3> parallelPositions(vertexCount), parallelNormals(vertexCount);
+
+    // Best of several runs, to keep page faults of the first write out of the numbers
+    auto measure = [runs](auto function)
+    {
+        double bestMs = 1e30;
+        for (int run = 0; run < runs; run++)
+        {
+            auto start = std::chrono::high_resolution_clock::now();
+            function();
+            bestMs = std::min(bestMs, std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count());
+        }
+        return bestMs;
+    };
+
+    double scalarMs = measure([&]() { SkinVerticesScalar(input, joints.data(), { referencePositions.data(), referenceNormals.data() }, 0, vertexCount); });
+    double simdMs = measure([&]() { SkinVertices(input, joints.data(), { simdPositions.data(), simdNormals.data() }, 0, vertexCount); });
+    double parallelMs = measure([&]() { SkinVerticesParallel(input, joints.data(), { parallelPositions.data(), parallelNormals.data() }, threadCount); });
+
+    // FMA contraction differs between the paths, so compare with a tolerance
+    auto differs = [](const float3& a, const float3& b)
+    {
+        float3 error = abs(a - b);
+        return std::max(error.x, std::max(error.y, error.z)) > 1e-4f;
+    };
+
+    int violations = 0;
+    for (uint32_t vertex = 0; vertex < vertexCount; vertex++)
+    {
+        bool mismatch = differs(simdPositions[vertex], referencePositions[vertex])
+            || differs(simdNormals[vertex], referenceNormals[vertex])
+            || differs(parallelPositions[vertex], referencePositions[vertex])
+            || differs(parallelNormals[vertex], referenceNormals[vertex]);
+
+        if (mismatch)
+        {
+            if (violations < 10)
+            {
+                log::warning("CPU skinning benchmark: vertex %u is (%f, %f, %f), expected (%f, %f, %f)", vertex,
+                    simdPositions[vertex].x, simdPositions[vertex].y, simdPositions[vertex].z,
+                    referencePositions[vertex].x, referencePositions[vertex].y, referencePositions[vertex].z);
+            }
+            ++violations;
+        }
+    }
+
+    auto throughput = [vertexCount](double ms) { return double(vertexCount) / ms * 1e-3; };
+    log::info("CPU skinning benchmark: %u vertices, %u joints: scalar %.2f ms (%.0f M vertices/s), %s %.2f ms (%.0f M vertices/s), %u threads %.2f ms (%.0f M vertices/s), %d mismatches",
+        vertexCount, jointCount, scalarMs, throughput(scalarMs),
+#if CPU_SKINNING_AVX2
+        "AVX2",
+#else
+        "scalar",
+#endif
+        simdMs, throughput(simdMs), threadCount, parallelMs, throughput(parallelMs), violations);
+
+    return violations;
+}
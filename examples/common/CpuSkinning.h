@@ -0,0 +1,72 @@
+/*
+* Copyright (c) 2014-2021, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#pragma once
+
+#include <donut/core/math/math.h>
+#include <cstdint>
+
+// Reference linear blend skinning on the CPU, matching the batched skinning shader of rt_bindless, so
+// that its output can be validated and its throughput measured without a GPU.
+//
+// Joint matrices are stored transposed, three rows of four, so that each output coordinate is one dot
+// product with the homogeneous input position. The same palette layout is uploaded for the shader.
+// With DONUT_EXAMPLES_WITH_AVX2, two vertices are skinned per instruction with contiguous joint loads
+// instead of gathers. The multithreaded path splits the vertices into ranges over worker threads.
+
+struct SkinningJointMatrix
+{
+    donut::math::float4 x;
+    donut::math::float4 y;
+    donut::math::float4 z;
+};
+
+// Converts a row-vector affine transform, as used by Donut, into the palette layout
+SkinningJointMatrix PackSkinningJointMatrix(const donut::math::affine3& transform);
+
+struct CpuSkinningInput
+{
+    const donut::math::float3* positions = nullptr;
+    const donut::math::float3* normals = nullptr; // optional
+    const uint16_t* jointIndices = nullptr;       // four per vertex
+    const donut::math::float4* jointWeights = nullptr;
+    uint32_t vertexCount = 0;
+};
+
+struct CpuSkinningOutput
+{
+    donut::math::float3* positions = nullptr;
+    donut::math::float3* normals = nullptr; // written when both this and the input normals are set
+};
+
+// Skins vertices [first, end) with scalar code, the reference for the other paths
+void SkinVerticesScalar(const CpuSkinningInput& input, const SkinningJointMatrix* joints, const CpuSkinningOutput& output, uint32_t first, uint32_t end);
+
+// Skins vertices [first, end) with the widest available SIMD path
+void SkinVertices(const CpuSkinningInput& input, const SkinningJointMatrix* joints, const CpuSkinningOutput& output, uint32_t first, uint32_t end);
+
+// Skins all vertices on the given number of threads; 0 uses all hardware threads
+void SkinVerticesParallel(const CpuSkinningInput& input, const SkinningJointMatrix* joints, const CpuSkinningOutput& output, uint32_t threadCount = 0);
+
+// Skins synthetic meshes with the scalar, SIMD and multithreaded paths, compares the outputs and logs the
+// throughput. Returns the number of mismatching vertices.
+int RunCpuSkinningBenchmark(uint32_t threadCount = 0);
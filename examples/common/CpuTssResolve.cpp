@@ -0,0 +1,1244 @@
+/*
+* Copyright (c) 2014-2021, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#include "CpuTssResolve.h"
+#include "ImageEncoders.h"
+#include <donut/core/log.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <string>
+#include <thread>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define CPU_TSS_AVX2 1
+#endif
+
+using namespace donut;
+using namespace donut::math;
+
+static constexpr float c_Epsilon = 0.00001f;
+static constexpr float c_NormalizationFactorPatch = 1.0f / 9.0f;
+
+const char* GetTssFilterKernelName(TssFilterKernel kernel)
+{
+    switch (kernel)
+    {
+    case TssFilterKernel::Tent: return "tent";
+    case TssFilterKernel::CubicBSpline: return "bspline";
+    case TssFilterKernel::CatmullRom: return "catmullrom";
+    default: return "";
+    }
+}
+
+void TssImage::Resize(uint32_t newWidth, uint32_t newHeight)
+{
+    width = newWidth;
+    height = newHeight;
+    pixels.assign(size_t(width) * height, float4(0.f));
+}
+
+// Everything the 3x3 block of ps_main needs from one neighbour, stored as planes over the tile
+enum TssPixelState : uint32_t
+{
+    STATE_CURR_R, STATE_CURR_G, STATE_CURR_B,
+    STATE_HIST_R, STATE_HIST_G, STATE_HIST_B,
+    STATE_MOMENT1_R, STATE_MOMENT1_G, STATE_MOMENT1_B,
+    STATE_MOMENT2_R, STATE_MOMENT2_G, STATE_MOMENT2_B,
+    STATE_SEQUENCE_SQRD_SUM,
+    STATE_CONFIDENCE,       // maximalConfidence
+    STATE_INSIDE,           // 1 if the reprojected location is on screen
+
+    STATE_COUNT
+};
+
+struct TssFrame
+{
+    const TssConstants& constants;
+    const TssInputs& inputs;
+    float samplingRate;
+    float2 outputSize;
+    float2 outputSizeInv;
+    bool supersampling;
+};
+
+struct TssTile
+{
+    int x0, y0, x1, y1;
+
+    // Bilinear motion at the output pixel centres of the tile and a two pixel border
+    int motionX0, motionY0, motionStride;
+    std::vector<float> motionX;
+    std::vector<float> motionY;
+
+    // Pixel state of the tile and a one pixel border
+    int stateX0, stateY0, stateStride;
+    std::vector<float> state[STATE_COUNT];
+
+    [[nodiscard]] size_t MotionIndex(int x, int y) const { return size_t(y - motionY0) * motionStride + (x - motionX0); }
+    [[nodiscard]] size_t StateIndex(int x, int y) const { return size_t(y - stateY0) * stateStride + (x - stateX0); }
+};
+
+// Texture2D loads and RWTexture2D reads return zero outside the texture
+static float4 Load(const TssImage& image, int x, int y)
+{
+    if (x < 0 || y < 0 || x >= int(image.width) || y >= int(image.height))
+        return float4(0.f);
+
+    return image.At(uint32_t(x), uint32_t(y));
+}
+
+// int() of a texel coordinate, or -1 where the conversion would leave the texture anyway
+static int ToTexelIndex(float value, uint32_t size)
+{
+    return (value > -1.f && value < float(size)) ? int(value) : -1;
+}
+
+// Linear filtering with clamp addressing, like s_LinearSampler
+static float4 SampleBilinear(const TssImage& image, float u, float v)
+{
+    const float tx = u * float(image.width) - 0.5f;
+    const float ty = v * float(image.height) - 0.5f;
+    const float floorX = std::floor(tx);
+    const float floorY = std::floor(ty);
+    const float fx = tx - floorX;
+    const float fy = ty - floorY;
+
+    const int maxX = int(image.width) - 1;
+    const int maxY = int(image.height) - 1;
+    const int x0 = int(std::clamp(floorX, -1.f, float(maxX)));
+    const int y0 = int(std::clamp(floorY, -1.f, float(maxY)));
+    const uint32_t xa = uint32_t(std::clamp(x0, 0, maxX));
+    const uint32_t xb = uint32_t(std::clamp(x0 + 1, 0, maxX));
+    const uint32_t ya = uint32_t(std::clamp(y0, 0, maxY));
+    const uint32_t yb = uint32_t(std::clamp(y0 + 1, 0, maxY));
+
+    const float4 a = image.At(xa, ya);
+    const float4 b = image.At(xb, ya);
+    const float4 c = image.At(xa, yb);
+    const float4 d = image.At(xb, yb);
+    const float4 top = a + (b - a) * fx;
+    const float4 bottom = c + (d - c) * fx;
+    return top + (bottom - top) * fy;
+}
+
+// The filter kernels of tss.hlsl, separable, on the distance in input pixels along one axis
+
+static float TentAxis(float diff, float tentWidth)
+{
+    const float k = 1.0f / (0.5f * tentWidth);
+    const float contribution = (diff > 0.5f * tentWidth) ? 0.0f : 1.0f - k * diff;
+    return std::clamp(contribution, 0.0f, 1.0f);
+}
+
+static float CubicBSplineAxis(float x)
+{
+    const float absx = std::abs(x);
+    const float xsqr = x * x;
+    const float absxcubic = xsqr * absx;
+
+    if (absx < 1.0f)
+        return 0.5f * absxcubic - xsqr + 2.0f / 3.0f;
+    if (absx < 2.0f)
+        return -1.0f / 6.0f * absxcubic + xsqr - 2.0f * absx + 4.0f / 3.0f;
+    return 0.0f;
+}
+
+static float CatmullRomAxis(float x)
+{
+    const float absx = std::abs(x);
+    const float xsqr = x * x;
+    const float absxcubic = xsqr * absx;
+
+    if (absx < 1.0f)
+        return 1.5f * absxcubic - 2.5f * xsqr + 1.0f;
+    if (absx < 2.0f)
+        return -0.5f * absxcubic + 2.5f * xsqr - 4.0f * absx + 2.0f;
+    return 0.0f;
+}
+
+static float KernelWeight(TssFilterKernel kernel, float2 center, float2 position, float samplingRate)
+{
+    switch (kernel)
+    {
+    case TssFilterKernel::CubicBSpline: {
+        const float2 x = (position - center) / samplingRate;
+        return CubicBSplineAxis(x.x) * CubicBSplineAxis(x.y);
+    }
+    case TssFilterKernel::CatmullRom: {
+        const float2 x = (position - center) / samplingRate;
+        return CatmullRomAxis(x.x) * CatmullRomAxis(x.y);
+    }
+    default: {
+        const float2 diff = abs(position - center);
+        const float tentWidth = 2.0f * samplingRate;
+        return TentAxis(diff.x, tentWidth) * TentAxis(diff.y, tentWidth);
+    }
+    }
+}
+
+static void ComputeMotionScalar(const TssFrame& frame, TssTile& tile, int x, int y)
+{
+    const float2 uv = float2(float(x) + 0.5f, float(y) + 0.5f) * frame.outputSizeInv;
+    const float4 motion = SampleBilinear(frame.inputs.motionVectors, uv.x, uv.y);
+
+    const size_t index = tile.MotionIndex(x, y);
+    tile.motionX[index] = motion.x;
+    tile.motionY[index] = motion.y;
+}
+
+// The first loop of ps_main for one neighbour. The derivative and spatial variance terms of the shader
+// do not contribute to its outputs and are left out.
+static void ComputeStateScalar(const TssFrame& frame, TssTile& tile, int x, int y)
+{
+    const TssConstants& constants = frame.constants;
+    const TssInputs& inputs = frame.inputs;
+
+    const float2 position = float2(float(x) + 0.5f, float(y) + 0.5f);
+    const float2 jitterSpacePosition = frame.samplingRate * position;
+    const int2 floorSampleIndex = int2(int(std::floor(jitterSpacePosition.x)), int(std::floor(jitterSpacePosition.y)));
+
+    float3 upsampled = 0.f;
+    float normalizationFactor = 0.f;
+    float maximumWeight = 0.f;
+    float2 motion = 0.f;
+
+    for (int dy = -1; dy <= 1; ++dy)
+    {
+        for (int dx = -1; dx <= 1; ++dx)
+        {
+            if (frame.supersampling)
+            {
+                const int2 sampleIndex = floorSampleIndex + int2(dx, dy);
+                const float2 samplePosition = float2(float(sampleIndex.x), float(sampleIndex.y)) + float2(0.5f) - constants.pixelOffset;
+                const float3 sample = Load(inputs.jitteredColor, sampleIndex.x, sampleIndex.y).xyz();
+
+                const float weight = KernelWeight(constants.kernel, jitterSpacePosition, samplePosition, frame.samplingRate);
+                upsampled += weight * sample;
+                normalizationFactor += weight;
+                maximumWeight = std::max(maximumWeight, weight);
+            }
+
+            const size_t motionIndex = tile.MotionIndex(x + dx, y + dy);
+            motion += float2(tile.motionX[motionIndex], tile.motionY[motionIndex]);
+        }
+    }
+
+    float3 curr;
+    float confidence;
+    if (frame.supersampling)
+    {
+        if (maximumWeight != 0.f)
+            upsampled /= normalizationFactor;
+        else
+            upsampled = SampleBilinear(inputs.jitteredColor, position.x * frame.outputSizeInv.x, position.y * frame.outputSizeInv.y).xyz();
+
+        curr = upsampled;
+        confidence = maximumWeight;
+    }
+    else
+    {
+        curr = Load(inputs.jitteredColor, int(std::floor(position.x * frame.samplingRate)), int(std::floor(position.y * frame.samplingRate))).xyz();
+        confidence = 1.f;
+    }
+
+    motion *= c_NormalizationFactorPatch;
+    const float2 prevLocation = position * frame.outputSizeInv - motion;
+    float3 hist = SampleBilinear(inputs.historyColor, prevLocation.x, prevLocation.y).xyz();
+
+    const bool inside = prevLocation.x >= 0.f && prevLocation.y >= 0.f && prevLocation.x <= 1.f && prevLocation.y <= 1.f;
+    if (!inside)
+    {
+        hist = 0.f;
+        confidence = 1.f;
+    }
+
+    const int momentX = ToTexelIndex(frame.outputSize.x * prevLocation.x, constants.outputSize.x);
+    const int momentY = ToTexelIndex(frame.outputSize.y * prevLocation.y, constants.outputSize.y);
+    const float4 moment1 = Load(inputs.firstMoment, momentX, momentY);
+    const float4 moment2 = Load(inputs.secondMoment, momentX, momentY);
+    const float4 sequenceSqrdSum = Load(inputs.sequenceSqrdSum, momentX, momentY);
+
+    const size_t index = tile.StateIndex(x, y);
+    const float values[STATE_COUNT] = {
+        curr.x, curr.y, curr.z,
+        hist.x, hist.y, hist.z,
+        moment1.x, moment1.y, moment1.z,
+        moment2.x, moment2.y, moment2.z,
+        sequenceSqrdSum.x,
+        confidence,
+        inside ? 1.f : 0.f
+    };
+    for (uint32_t i = 0; i < STATE_COUNT; i++)
+        tile.state[i][index] = values[i];
+}
+
+struct TssResolvedPixel
+{
+    float3 blended;
+    float3 firstMoment;
+    float3 secondMoment;
+    float sequenceSqrdSum;
+};
+
+static void StorePixel(TssOutputs& outputs, int x, int y, const TssResolvedPixel& pixel)
+{
+    const size_t index = size_t(y) * outputs.color.width + x;
+    outputs.color.pixels[index] = float4(pixel.blended, 1.f);
+    outputs.firstMoment.pixels[index] = float4(pixel.firstMoment, 0.f);
+    outputs.secondMoment.pixels[index] = float4(pixel.secondMoment, 0.f);
+    outputs.sequenceSqrdSum.pixels[index] = float4(pixel.sequenceSqrdSum, 0.f, 0.f, 0.f);
+}
+
+// The second half of ps_main: the temporal derivative over the block, the blend and the moment update
+static void ResolvePixelScalar(const TssFrame& frame, const TssTile& tile, TssOutputs& outputs, int x, int y)
+{
+    const TssConstants& constants = frame.constants;
+
+    auto state = [&tile](uint32_t plane, int sx, int sy) { return tile.state[plane][tile.StateIndex(sx, sy)]; };
+    auto state3 = [&state](uint32_t plane, int sx, int sy) { return float3(state(plane, sx, sy), state(plane + 1, sx, sy), state(plane + 2, sx, sy)); };
+
+    float tempMaNormSqrdDiff = 0.f;
+    float tempMaximalMaSqrd = 0.f;
+
+    for (int dk = -1; dk <= 1; ++dk)
+    {
+        for (int dl = -1; dl <= 1; ++dl)
+        {
+            const float confidence = state(STATE_CONFIDENCE, x + dk, y + dl);
+            if (confidence < c_Epsilon)
+                continue;
+
+            const float3 curr = state3(STATE_CURR_R, x + dk, y + dl);
+            const float3 hist = state3(STATE_HIST_R, x + dk, y + dl);
+            const float3 moment1 = state3(STATE_MOMENT1_R, x + dk, y + dl);
+            const float3 diff = abs(curr - hist) * confidence;
+
+            float3 invSigmaTemporal = state3(STATE_MOMENT2_R, x + dk, y + dl) - moment1 * moment1;
+            for (int component = 0; component < 3; ++component)
+            {
+                const float sigma = invSigmaTemporal[component];
+                invSigmaTemporal[component] = (sigma < c_Epsilon) ? 1.f / c_Epsilon : 1.f / sigma;
+            }
+
+            tempMaNormSqrdDiff += dot(diff * diff, invSigmaTemporal);
+            tempMaximalMaSqrd += dot(curr * curr, invSigmaTemporal);
+            tempMaximalMaSqrd += dot(hist * hist, invSigmaTemporal);
+        }
+    }
+
+    float derivative = std::sqrt(tempMaNormSqrdDiff) / (std::sqrt(tempMaximalMaSqrd) + c_Epsilon);
+    derivative = std::clamp(derivative, 0.f, 1.f);
+
+    if (state(STATE_INSIDE, x, y) == 0.f)
+        derivative = 1.f;
+    if (constants.aaMode == TSS_NATIVE_RESOLUTION || constants.aaMode == TSS_RAW_UPSCALED)
+        derivative = 1.f;
+
+    const float3 curr = state3(STATE_CURR_R, x, y);
+    const float3 hist = state3(STATE_HIST_R, x, y);
+
+    TssResolvedPixel pixel;
+    pixel.blended = 0.f;
+    if (!constants.frameHasReset)
+    {
+        if (state(STATE_CONFIDENCE, x, y) < c_Epsilon)
+            derivative = 0.f;
+        pixel.blended = hist + derivative * (curr - hist);
+    }
+
+    pixel.firstMoment = (1.f - derivative) * state3(STATE_MOMENT1_R, x, y) + derivative * curr;
+    pixel.secondMoment = (1.f - derivative) * state3(STATE_MOMENT2_R, x, y) + derivative * curr * curr;
+    pixel.sequenceSqrdSum = state(STATE_SEQUENCE_SQRD_SUM, x, y) * (1.f - derivative) * (1.f - derivative) + derivative * derivative;
+
+    StorePixel(outputs, x, y, pixel);
+}
+
+#ifdef CPU_TSS_AVX2
+
+// Eight pixels of a row in the lanes, with gathers for every texture read
+
+static __m256 Abs8(__m256 v)
+{
+    return _mm256_andnot_ps(_mm256_set1_ps(-0.f), v);
+}
+
+static __m256 Select8(__m256 mask, __m256 a, __m256 b)
+{
+    return _mm256_blendv_ps(b, a, mask);
+}
+
+static __m256 Clamp8(__m256 v, float low, float high)
+{
+    return _mm256_min_ps(_mm256_max_ps(v, _mm256_set1_ps(low)), _mm256_set1_ps(high));
+}
+
+// Float offsets of the texels for the gathers, zero where the mask is clear
+static __m256i TexelOffsets8(const TssImage& image, __m256i x, __m256i y, __m256i mask)
+{
+    __m256i index = _mm256_add_epi32(_mm256_mullo_epi32(y, _mm256_set1_epi32(int(image.width))), x);
+    return _mm256_and_si256(_mm256_slli_epi32(index, 2), mask);
+}
+
+static __m256i InBounds8(const TssImage& image, __m256i x, __m256i y)
+{
+    const __m256i minusOne = _mm256_set1_epi32(-1);
+    __m256i mask = _mm256_and_si256(_mm256_cmpgt_epi32(x, minusOne), _mm256_cmpgt_epi32(y, minusOne));
+    mask = _mm256_and_si256(mask, _mm256_cmpgt_epi32(_mm256_set1_epi32(int(image.width)), x));
+    return _mm256_and_si256(mask, _mm256_cmpgt_epi32(_mm256_set1_epi32(int(image.height)), y));
+}
+
+static __m256 GatherChannel8(const TssImage& image, uint32_t channel, __m256i offsets, __m256i mask)
+{
+    const float* base = reinterpret_cast<const float*>(image.pixels.data()) + channel;
+    return _mm256_mask_i32gather_ps(_mm256_setzero_ps(), base, offsets, _mm256_castsi256_ps(mask), 4);
+}
+
+struct Bilinear8
+{
+    __m256i offsets[4]; // top left, top right, bottom left, bottom right
+    __m256 fx;
+    __m256 fy;
+};
+
+static Bilinear8 SetupBilinear8(const TssImage& image, __m256 u, __m256 v)
+{
+    const __m256 tx = _mm256_sub_ps(_mm256_mul_ps(u, _mm256_set1_ps(float(image.width))), _mm256_set1_ps(0.5f));
+    const __m256 ty = _mm256_sub_ps(_mm256_mul_ps(v, _mm256_set1_ps(float(image.height))), _mm256_set1_ps(0.5f));
+    const __m256 floorX = _mm256_floor_ps(tx);
+    const __m256 floorY = _mm256_floor_ps(ty);
+
+    Bilinear8 bilinear;
+    bilinear.fx = _mm256_sub_ps(tx, floorX);
+    bilinear.fy = _mm256_sub_ps(ty, floorY);
+
+    const int maxX = int(image.width) - 1;
+    const int maxY = int(image.height) - 1;
+    const __m256i x0 = _mm256_cvttps_epi32(Clamp8(floorX, -1.f, float(maxX)));
+    const __m256i y0 = _mm256_cvttps_epi32(Clamp8(floorY, -1.f, float(maxY)));
+    const __m256i one = _mm256_set1_epi32(1);
+    const __m256i zero = _mm256_setzero_si256();
+
+    auto clampIndex = [zero](__m256i value, int maximum) { return _mm256_min_epi32(_mm256_max_epi32(value, zero), _mm256_set1_epi32(maximum)); };
+    const __m256i xa = clampIndex(x0, maxX);
+    const __m256i xb = clampIndex(_mm256_add_epi32(x0, one), maxX);
+    const __m256i ya = clampIndex(y0, maxY);
+    const __m256i yb = clampIndex(_mm256_add_epi32(y0, one), maxY);
+
+    const __m256i all = _mm256_set1_epi32(-1);
+    bilinear.offsets[0] = TexelOffsets8(image, xa, ya, all);
+    bilinear.offsets[1] = TexelOffsets8(image, xb, ya, all);
+    bilinear.offsets[2] = TexelOffsets8(image, xa, yb, all);
+    bilinear.offsets[3] = TexelOffsets8(image, xb, yb, all);
+    return bilinear;
+}
+
+static __m256 SampleChannel8(const TssImage& image, const Bilinear8& bilinear, uint32_t channel)
+{
+    const float* base = reinterpret_cast<const float*>(image.pixels.data()) + channel;
+    const __m256 a = _mm256_i32gather_ps(base, bilinear.offsets[0], 4);
+    const __m256 b = _mm256_i32gather_ps(base, bilinear.offsets[1], 4);
+    const __m256 c = _mm256_i32gather_ps(base, bilinear.offsets[2], 4);
+    const __m256 d = _mm256_i32gather_ps(base, bilinear.offsets[3], 4);
+    const __m256 top = _mm256_add_ps(a, _mm256_mul_ps(_mm256_sub_ps(b, a), bilinear.fx));
+    const __m256 bottom = _mm256_add_ps(c, _mm256_mul_ps(_mm256_sub_ps(d, c), bilinear.fx));
+    return _mm256_add_ps(top, _mm256_mul_ps(_mm256_sub_ps(bottom, top), bilinear.fy));
+}
+
+static __m256 TentAxis8(__m256 diff, float tentWidth)
+{
+    const __m256 k = _mm256_set1_ps(1.0f / (0.5f * tentWidth));
+    const __m256 outside = _mm256_cmp_ps(diff, _mm256_set1_ps(0.5f * tentWidth), _CMP_GT_OQ);
+    const __m256 contribution = _mm256_sub_ps(_mm256_set1_ps(1.f), _mm256_mul_ps(k, diff));
+    return Clamp8(_mm256_andnot_ps(outside, contribution), 0.f, 1.f);
+}
+
+// Evaluates both pieces of a cubic kernel and selects per lane: c1 for |x| < 1, c2 for |x| < 2
+static __m256 PiecewiseCubicAxis8(__m256 x, const float c1[3], const float c2[4])
+{
+    const __m256 absx = Abs8(x);
+    const __m256 xsqr = _mm256_mul_ps(x, x);
+    const __m256 absxcubic = _mm256_mul_ps(xsqr, absx);
+
+    __m256 inner = _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(c1[0]), absxcubic), _mm256_mul_ps(_mm256_set1_ps(c1[1]), xsqr));
+    inner = _mm256_add_ps(inner, _mm256_set1_ps(c1[2]));
+
+    __m256 outer = _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(c2[0]), absxcubic), _mm256_mul_ps(_mm256_set1_ps(c2[1]), xsqr));
+    outer = _mm256_add_ps(outer, _mm256_mul_ps(_mm256_set1_ps(c2[2]), absx));
+    outer = _mm256_add_ps(outer, _mm256_set1_ps(c2[3]));
+
+    const __m256 lessThanOne = _mm256_cmp_ps(absx, _mm256_set1_ps(1.f), _CMP_LT_OQ);
+    const __m256 lessThanTwo = _mm256_cmp_ps(absx, _mm256_set1_ps(2.f), _CMP_LT_OQ);
+    return Select8(lessThanOne, inner, _mm256_and_ps(lessThanTwo, outer));
+}
+
+static __m256 KernelWeight8(TssFilterKernel kernel, __m256 centerX, __m256 centerY, __m256 positionX, __m256 positionY, float samplingRate)
+{
+    static const float bsplineInner[3] = { 0.5f, -1.f, 2.0f / 3.0f };
+    static const float bsplineOuter[4] = { -1.0f / 6.0f, 1.f, -2.f, 4.0f / 3.0f };
+    static const float catmullRomInner[3] = { 1.5f, -2.5f, 1.f };
+    static const float catmullRomOuter[4] = { -0.5f, 2.5f, -4.f, 2.f };
+
+    switch (kernel)
+    {
+    case TssFilterKernel::CubicBSpline:
+    case TssFilterKernel::CatmullRom: {
+        const __m256 h = _mm256_set1_ps(samplingRate);
+        const __m256 x = _mm256_div_ps(_mm256_sub_ps(positionX, centerX), h);
+        const __m256 y = _mm256_div_ps(_mm256_sub_ps(positionY, centerY), h);
+        const bool bspline = kernel == TssFilterKernel::CubicBSpline;
+        const float* inner = bspline ? bsplineInner : catmullRomInner;
+        const float* outer = bspline ? bsplineOuter : catmullRomOuter;
+        return _mm256_mul_ps(PiecewiseCubicAxis8(x, inner, outer), PiecewiseCubicAxis8(y, inner, outer));
+    }
+    default: {
+        const float tentWidth = 2.0f * samplingRate;
+        const __m256 weightX = TentAxis8(Abs8(_mm256_sub_ps(positionX, centerX)), tentWidth);
+        const __m256 weightY = TentAxis8(Abs8(_mm256_sub_ps(positionY, centerY)), tentWidth);
+        return _mm256_mul_ps(weightX, weightY);
+    }
+    }
+}
+
+static __m256 PixelCenters8(int x)
+{
+    return _mm256_add_ps(_mm256_set1_ps(float(x) + 0.5f), _mm256_setr_ps(0.f, 1.f, 2.f, 3.f, 4.f, 5.f, 6.f, 7.f));
+}
+
+static void ComputeMotion8(const TssFrame& frame, TssTile& tile, int x, int y)
+{
+    const __m256 u = _mm256_mul_ps(PixelCenters8(x), _mm256_set1_ps(frame.outputSizeInv.x));
+    const __m256 v = _mm256_set1_ps((float(y) + 0.5f) * frame.outputSizeInv.y);
+    const Bilinear8 bilinear = SetupBilinear8(frame.inputs.motionVectors, u, v);
+
+    const size_t index = tile.MotionIndex(x, y);
+    _mm256_storeu_ps(&tile.motionX[index], SampleChannel8(frame.inputs.motionVectors, bilinear, 0));
+    _mm256_storeu_ps(&tile.motionY[index], SampleChannel8(frame.inputs.motionVectors, bilinear, 1));
+}
+
+static void ComputeState8(const TssFrame& frame, TssTile& tile, int x, int y)
+{
+    const TssConstants& constants = frame.constants;
+    const TssInputs& inputs = frame.inputs;
+
+    const __m256 positionX = PixelCenters8(x);
+    const __m256 positionY = _mm256_set1_ps(float(y) + 0.5f);
+    const __m256 rate = _mm256_set1_ps(frame.samplingRate);
+    const __m256 jitterX = _mm256_mul_ps(rate, positionX);
+    const __m256 jitterY = _mm256_mul_ps(rate, positionY);
+    const __m256 floorX = _mm256_floor_ps(jitterX);
+    const __m256 floorY = _mm256_floor_ps(jitterY);
+    const __m256i floorIndexX = _mm256_cvttps_epi32(floorX);
+    const __m256i floorIndexY = _mm256_cvttps_epi32(floorY);
+
+    __m256 upsampled[3] = { _mm256_setzero_ps(), _mm256_setzero_ps(), _mm256_setzero_ps() };
+    __m256 normalizationFactor = _mm256_setzero_ps();
+    __m256 maximumWeight = _mm256_setzero_ps();
+    __m256 motionX = _mm256_setzero_ps();
+    __m256 motionY = _mm256_setzero_ps();
+
+    for (int dy = -1; dy <= 1; ++dy)
+    {
+        for (int dx = -1; dx <= 1; ++dx)
+        {
+            if (frame.supersampling)
+            {
+                const __m256i sampleX = _mm256_add_epi32(floorIndexX, _mm256_set1_epi32(dx));
+                const __m256i sampleY = _mm256_add_epi32(floorIndexY, _mm256_set1_epi32(dy));
+                const __m256 samplePositionX = _mm256_sub_ps(_mm256_add_ps(_mm256_cvtepi32_ps(sampleX), _mm256_set1_ps(0.5f)), _mm256_set1_ps(constants.pixelOffset.x));
+                const __m256 samplePositionY = _mm256_sub_ps(_mm256_add_ps(_mm256_cvtepi32_ps(sampleY), _mm256_set1_ps(0.5f)), _mm256_set1_ps(constants.pixelOffset.y));
+
+                const __m256i mask = InBounds8(inputs.jitteredColor, sampleX, sampleY);
+                const __m256i offsets = TexelOffsets8(inputs.jitteredColor, sampleX, sampleY, mask);
+                const __m256 weight = KernelWeight8(constants.kernel, jitterX, jitterY, samplePositionX, samplePositionY, frame.samplingRate);
+
+                for (uint32_t channel = 0; channel < 3; channel++)
+                    upsampled[channel] = _mm256_add_ps(upsampled[channel], _mm256_mul_ps(weight, GatherChannel8(inputs.jitteredColor, channel, offsets, mask)));
+                normalizationFactor = _mm256_add_ps(normalizationFactor, weight);
+                maximumWeight = _mm256_max_ps(maximumWeight, weight);
+            }
+
+            const size_t motionIndex = tile.MotionIndex(x + dx, y + dy);
+            motionX = _mm256_add_ps(motionX, _mm256_loadu_ps(&tile.motionX[motionIndex]));
+            motionY = _mm256_add_ps(motionY, _mm256_loadu_ps(&tile.motionY[motionIndex]));
+        }
+    }
+
+    const __m256 inverseSizeX = _mm256_set1_ps(frame.outputSizeInv.x);
+    const __m256 inverseSizeY = _mm256_set1_ps(frame.outputSizeInv.y);
+
+    __m256 curr[3];
+    __m256 confidence;
+    if (frame.supersampling)
+    {
+        const __m256 hasWeight = _mm256_cmp_ps(maximumWeight, _mm256_setzero_ps(), _CMP_NEQ_OQ);
+        for (uint32_t channel = 0; channel < 3; channel++)
+            curr[channel] = _mm256_div_ps(upsampled[channel], normalizationFactor);
+
+        // Pixels that no input sample reaches fall back to the linear sampler
+        if (_mm256_movemask_ps(hasWeight) != 0xff)
+        {
+            const Bilinear8 bilinear = SetupBilinear8(inputs.jitteredColor, _mm256_mul_ps(positionX, inverseSizeX), _mm256_mul_ps(positionY, inverseSizeY));
+            for (uint32_t channel = 0; channel < 3; channel++)
+                curr[channel] = Select8(hasWeight, curr[channel], SampleChannel8(inputs.jitteredColor, bilinear, channel));
+        }
+        confidence = maximumWeight;
+    }
+    else
+    {
+        const __m256i sampleX = _mm256_cvttps_epi32(_mm256_floor_ps(_mm256_mul_ps(positionX, rate)));
+        const __m256i sampleY = _mm256_cvttps_epi32(_mm256_floor_ps(_mm256_mul_ps(positionY, rate)));
+        const __m256i mask = InBounds8(inputs.jitteredColor, sampleX, sampleY);
+        const __m256i offsets = TexelOffsets8(inputs.jitteredColor, sampleX, sampleY, mask);
+        for (uint32_t channel = 0; channel < 3; channel++)
+            curr[channel] = GatherChannel8(inputs.jitteredColor, channel, offsets, mask);
+        confidence = _mm256_set1_ps(1.f);
+    }
+
+    const __m256 patchNormalization = _mm256_set1_ps(c_NormalizationFactorPatch);
+    const __m256 prevX = _mm256_sub_ps(_mm256_mul_ps(positionX, inverseSizeX), _mm256_mul_ps(motionX, patchNormalization));
+    const __m256 prevY = _mm256_sub_ps(_mm256_mul_ps(positionY, inverseSizeY), _mm256_mul_ps(motionY, patchNormalization));
+
+    const __m256 zero = _mm256_setzero_ps();
+    const __m256 one = _mm256_set1_ps(1.f);
+    __m256 inside = _mm256_and_ps(_mm256_cmp_ps(prevX, zero, _CMP_GE_OQ), _mm256_cmp_ps(prevY, zero, _CMP_GE_OQ));
+    inside = _mm256_and_ps(inside, _mm256_and_ps(_mm256_cmp_ps(prevX, one, _CMP_LE_OQ), _mm256_cmp_ps(prevY, one, _CMP_LE_OQ)));
+
+    const Bilinear8 historyBilinear = SetupBilinear8(inputs.historyColor, prevX, prevY);
+    __m256 hist[3];
+    for (uint32_t channel = 0; channel < 3; channel++)
+        hist[channel] = _mm256_and_ps(inside, SampleChannel8(inputs.historyColor, historyBilinear, channel));
+    confidence = Select8(inside, confidence, one);
+
+    // Truncation like int2() in the shader; NaNs and overflows convert to INT_MIN and are masked out
+    const __m256i momentX = _mm256_cvttps_epi32(_mm256_mul_ps(_mm256_set1_ps(frame.outputSize.x), prevX));
+    const __m256i momentY = _mm256_cvttps_epi32(_mm256_mul_ps(_mm256_set1_ps(frame.outputSize.y), prevY));
+    const __m256i momentMask = InBounds8(inputs.firstMoment, momentX, momentY);
+    const __m256i momentOffsets = TexelOffsets8(inputs.firstMoment, momentX, momentY, momentMask);
+
+    const size_t index = tile.StateIndex(x, y);
+    for (uint32_t channel = 0; channel < 3; channel++)
+    {
+        _mm256_storeu_ps(&tile.state[STATE_CURR_R + channel][index], curr[channel]);
+        _mm256_storeu_ps(&tile.state[STATE_HIST_R + channel][index], hist[channel]);
+        _mm256_storeu_ps(&tile.state[STATE_MOMENT1_R + channel][index], GatherChannel8(inputs.firstMoment, channel, momentOffsets, momentMask));
+        _mm256_storeu_ps(&tile.state[STATE_MOMENT2_R + channel][index], GatherChannel8(inputs.secondMoment, channel, momentOffsets, momentMask));
+    }
+    _mm256_storeu_ps(&tile.state[STATE_SEQUENCE_SQRD_SUM][index], GatherChannel8(inputs.sequenceSqrdSum, 0, momentOffsets, momentMask));
+    _mm256_storeu_ps(&tile.state[STATE_CONFIDENCE][index], confidence);
+    _mm256_storeu_ps(&tile.state[STATE_INSIDE][index], _mm256_and_ps(inside, one));
+}
+
+static void ResolvePixels8(const TssFrame& frame, const TssTile& tile, TssOutputs& outputs, int x, int y)
+{
+    const TssConstants& constants = frame.constants;
+    auto load = [&tile](uint32_t plane, int sx, int sy) { return _mm256_loadu_ps(&tile.state[plane][tile.StateIndex(sx, sy)]); };
+
+    const __m256 epsilon = _mm256_set1_ps(c_Epsilon);
+    const __m256 inverseEpsilon = _mm256_set1_ps(1.f / c_Epsilon);
+    const __m256 one = _mm256_set1_ps(1.f);
+    __m256 tempMaNormSqrdDiff = _mm256_setzero_ps();
+    __m256 tempMaximalMaSqrd = _mm256_setzero_ps();
+
+    for (int dk = -1; dk <= 1; ++dk)
+    {
+        for (int dl = -1; dl <= 1; ++dl)
+        {
+            const __m256 confidence = load(STATE_CONFIDENCE, x + dk, y + dl);
+            const __m256 valid = _mm256_cmp_ps(confidence, epsilon, _CMP_GE_OQ);
+            if (_mm256_movemask_ps(valid) == 0)
+                continue;
+
+            __m256 diffDot = _mm256_setzero_ps();
+            __m256 currDot = _mm256_setzero_ps();
+            __m256 histDot = _mm256_setzero_ps();
+            for (uint32_t channel = 0; channel < 3; channel++)
+            {
+                const __m256 curr = load(STATE_CURR_R + channel, x + dk, y + dl);
+                const __m256 hist = load(STATE_HIST_R + channel, x + dk, y + dl);
+                const __m256 moment1 = load(STATE_MOMENT1_R + channel, x + dk, y + dl);
+                const __m256 sigma = _mm256_sub_ps(load(STATE_MOMENT2_R + channel, x + dk, y + dl), _mm256_mul_ps(moment1, moment1));
+                const __m256 invSigma = Select8(_mm256_cmp_ps(sigma, epsilon, _CMP_LT_OQ), inverseEpsilon, _mm256_div_ps(one, sigma));
+                const __m256 diff = _mm256_mul_ps(Abs8(_mm256_sub_ps(curr, hist)), confidence);
+
+                diffDot = _mm256_add_ps(diffDot, _mm256_mul_ps(_mm256_mul_ps(diff, diff), invSigma));
+                currDot = _mm256_add_ps(currDot, _mm256_mul_ps(_mm256_mul_ps(curr, curr), invSigma));
+                histDot = _mm256_add_ps(histDot, _mm256_mul_ps(_mm256_mul_ps(hist, hist), invSigma));
+            }
+
+            tempMaNormSqrdDiff = _mm256_add_ps(tempMaNormSqrdDiff, _mm256_and_ps(valid, diffDot));
+            tempMaximalMaSqrd = _mm256_add_ps(tempMaximalMaSqrd, _mm256_and_ps(valid, currDot));
+            tempMaximalMaSqrd = _mm256_add_ps(tempMaximalMaSqrd, _mm256_and_ps(valid, histDot));
+        }
+    }
+
+    __m256 derivative = _mm256_div_ps(_mm256_sqrt_ps(tempMaNormSqrdDiff), _mm256_add_ps(_mm256_sqrt_ps(tempMaximalMaSqrd), epsilon));
+    derivative = Clamp8(derivative, 0.f, 1.f);
+
+    const __m256 inside = _mm256_cmp_ps(load(STATE_INSIDE, x, y), _mm256_setzero_ps(), _CMP_NEQ_OQ);
+    derivative = Select8(inside, derivative, one);
+    if (constants.aaMode == TSS_NATIVE_RESOLUTION || constants.aaMode == TSS_RAW_UPSCALED)
+        derivative = one;
+
+    __m256 curr[3], hist[3], blended[3];
+    for (uint32_t channel = 0; channel < 3; channel++)
+    {
+        curr[channel] = load(STATE_CURR_R + channel, x, y);
+        hist[channel] = load(STATE_HIST_R + channel, x, y);
+        blended[channel] = _mm256_setzero_ps();
+    }
+
+    if (!constants.frameHasReset)
+    {
+        const __m256 confident = _mm256_cmp_ps(load(STATE_CONFIDENCE, x, y), epsilon, _CMP_GE_OQ);
+        derivative = _mm256_and_ps(confident, derivative);
+        for (uint32_t channel = 0; channel < 3; channel++)
+            blended[channel] = _mm256_add_ps(hist[channel], _mm256_mul_ps(derivative, _mm256_sub_ps(curr[channel], hist[channel])));
+    }
+
+    const __m256 keep = _mm256_sub_ps(one, derivative);
+    alignas(32) float results[10][8];
+    for (uint32_t channel = 0; channel < 3; channel++)
+    {
+        const __m256 moment1 = load(STATE_MOMENT1_R + channel, x, y);
+        const __m256 moment2 = load(STATE_MOMENT2_R + channel, x, y);
+        _mm256_store_ps(results[channel], blended[channel]);
+        _mm256_store_ps(results[3 + channel], _mm256_add_ps(_mm256_mul_ps(keep, moment1), _mm256_mul_ps(derivative, curr[channel])));
+        _mm256_store_ps(results[6 + channel], _mm256_add_ps(_mm256_mul_ps(keep, moment2), _mm256_mul_ps(_mm256_mul_ps(derivative, curr[channel]), curr[channel])));
+    }
+    const __m256 sequenceSqrdSum = _mm256_mul_ps(_mm256_mul_ps(load(STATE_SEQUENCE_SQRD_SUM, x, y), keep), keep);
+    _mm256_store_ps(results[9], _mm256_add_ps(sequenceSqrdSum, _mm256_mul_ps(derivative, derivative)));
+
+    for (int lane = 0; lane < 8; lane++)
+    {
+        TssResolvedPixel pixel;
+        pixel.blended = float3(results[0][lane], results[1][lane], results[2][lane]);
+        pixel.firstMoment = float3(results[3][lane], results[4][lane], results[5][lane]);
+        pixel.secondMoment = float3(results[6][lane], results[7][lane], results[8][lane]);
+        pixel.sequenceSqrdSum = results[9][lane];
+        StorePixel(outputs, x + lane, y, pixel);
+    }
+}
+
+#endif // CPU_TSS_AVX2
+
+static void ResolveTile(const TssFrame& frame, TssTile& tile, TssOutputs& outputs, bool simd)
+{
+    tile.motionX0 = tile.x0 - 2;
+    tile.motionY0 = tile.y0 - 2;
+    tile.motionStride = tile.x1 - tile.x0 + 4;
+    const size_t motionSize = size_t(tile.motionStride) * (tile.y1 - tile.y0 + 4);
+    tile.motionX.resize(motionSize);
+    tile.motionY.resize(motionSize);
+
+    tile.stateX0 = tile.x0 - 1;
+    tile.stateY0 = tile.y0 - 1;
+    tile.stateStride = tile.x1 - tile.x0 + 2;
+    for (auto& plane : tile.state)
+        plane.resize(size_t(tile.stateStride) * (tile.y1 - tile.y0 + 2));
+
+#ifndef CPU_TSS_AVX2
+    simd = false;
+#endif
+
+    // Each stage runs over the region the next one reads, eight pixels at a time and the rest one by one
+    auto runRows = [simd](int x0, int y0, int x1, int y1, auto&& scalar, auto&& vector)
+    {
+        for (int y = y0; y < y1; y++)
+        {
+            int x = x0;
+            if (simd)
+            {
+                for (; x + 8 <= x1; x += 8)
+                    vector(x, y);
+            }
+            for (; x < x1; x++)
+                scalar(x, y);
+        }
+    };
+
+#ifdef CPU_TSS_AVX2
+    auto motion8 = [&](int x, int y) { ComputeMotion8(frame, tile, x, y); };
+    auto state8 = [&](int x, int y) { ComputeState8(frame, tile, x, y); };
+    auto resolve8 = [&](int x, int y) { ResolvePixels8(frame, tile, outputs, x, y); };
+#else
+    auto motion8 = [](int, int) { };
+    auto state8 = [](int, int) { };
+    auto resolve8 = [](int, int) { };
+#endif
+
+    runRows(tile.x0 - 2, tile.y0 - 2, tile.x1 + 2, tile.y1 + 2, [&](int x, int y) { ComputeMotionScalar(frame, tile, x, y); }, motion8);
+    runRows(tile.x0 - 1, tile.y0 - 1, tile.x1 + 1, tile.y1 + 1, [&](int x, int y) { ComputeStateScalar(frame, tile, x, y); }, state8);
+    runRows(tile.x0, tile.y0, tile.x1, tile.y1, [&](int x, int y) { ResolvePixelScalar(frame, tile, outputs, x, y); }, resolve8);
+}
+
+void ResolveTss(const TssConstants& constants, const TssInputs& inputs, TssOutputs& outputs, const TssResolveOptions& options)
+{
+    const uint32_t width = constants.outputSize.x;
+    const uint32_t height = constants.outputSize.y;
+
+    outputs.color.Resize(width, height);
+    outputs.firstMoment.Resize(width, height);
+    outputs.secondMoment.Resize(width, height);
+    outputs.sequenceSqrdSum.Resize(width, height);
+
+    if (width == 0 || height == 0 || inputs.jitteredColor.IsEmpty() || inputs.motionVectors.IsEmpty() || inputs.historyColor.IsEmpty())
+        return;
+
+    // The moments start out cleared
+    TssImage emptyMoment;
+    emptyMoment.Resize(width, height);
+    TssInputs clearedInputs;
+    const bool clearMoments = inputs.firstMoment.IsEmpty() || inputs.secondMoment.IsEmpty() || inputs.sequenceSqrdSum.IsEmpty();
+    if (clearMoments)
+    {
+        clearedInputs = inputs;
+        clearedInputs.firstMoment = emptyMoment;
+        clearedInputs.secondMoment = emptyMoment;
+        clearedInputs.sequenceSqrdSum = emptyMoment;
+    }
+
+    const bool native = constants.aaMode == TSS_NATIVE_RESOLUTION || constants.aaMode == TSS_NATIVE_WITH_TAA;
+    const TssFrame frame = {
+        constants,
+        clearMoments ? clearedInputs : inputs,
+        native ? 1.f : constants.samplingRate,
+        float2(float(width), float(height)),
+        float2(1.f / float(width), 1.f / float(height)),
+        constants.aaMode == TSS_TEMPORAL_SUPERSAMPLING
+    };
+
+    const uint32_t tileSize = std::max(options.tileSize, 8u);
+    const uint32_t tilesX = (width + tileSize - 1) / tileSize;
+    const uint32_t tilesY = (height + tileSize - 1) / tileSize;
+    const uint32_t tileCount = tilesX * tilesY;
+
+    uint32_t threadCount = options.threadCount;
+    if (threadCount == 0)
+        threadCount = std::max(std::thread::hardware_concurrency(), 1u);
+    threadCount = std::min(threadCount, tileCount);
+
+    std::atomic<uint32_t> nextTile = 0;
+    auto worker = [&]()
+    {
+        TssTile tile;
+        for (uint32_t index = nextTile++; index < tileCount; index = nextTile++)
+        {
+            tile.x0 = int((index % tilesX) * tileSize);
+            tile.y0 = int((index / tilesX) * tileSize);
+            tile.x1 = std::min(tile.x0 + int(tileSize), int(width));
+            tile.y1 = std::min(tile.y0 + int(tileSize), int(height));
+            ResolveTile(frame, tile, outputs, options.simd);
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (uint32_t thread = 1; thread < threadCount; thread++)
+        threads.emplace_back(worker);
+    worker();
+    for (std::thread& thread : threads)
+        thread.join();
+}
+
+TssImageDifference CompareTssImages(const TssImage& a, const TssImage& b, float tolerance)
+{
+    TssImageDifference difference;
+    if (a.width != b.width || a.height != b.height)
+    {
+        difference.maxError = std::numeric_limits<float>::infinity();
+        difference.mismatches = std::max(a.pixels.size(), b.pixels.size());
+        return difference;
+    }
+
+    double totalError = 0.0;
+    for (size_t i = 0; i < a.pixels.size(); i++)
+    {
+        bool mismatch = false;
+        for (int channel = 0; channel < 3; channel++)
+        {
+            const float error = std::abs(a.pixels[i][channel] - b.pixels[i][channel]);
+            const float scale = std::max(1.f, std::abs(b.pixels[i][channel]));
+            // NaNs compare as mismatches
+            if (!(error <= tolerance * scale))
+                mismatch = true;
+            if (error == error)
+            {
+                difference.maxError = std::max(difference.maxError, error);
+                totalError += error;
+            }
+        }
+        if (mismatch)
+            ++difference.mismatches;
+    }
+
+    if (!a.pixels.empty())
+        difference.meanError = totalError / double(a.pixels.size() * 3);
+
+    return difference;
+}
+
+std::filesystem::path GetTssCaptureFileName(const std::filesystem::path& prefix, const char* name)
+{
+    return prefix.string() + "_" + name + ".raw";
+}
+
+bool SaveTssConstants(const TssConstants& constants, const std::filesystem::path& fileName)
+{
+    std::ofstream file(fileName);
+    if (!file.is_open())
+        return false;
+
+    file.precision(9);
+    file << "outputSize " << constants.outputSize.x << " " << constants.outputSize.y << "\n";
+    file << "pixelOffset " << constants.pixelOffset.x << " " << constants.pixelOffset.y << "\n";
+    file << "samplingRate " << constants.samplingRate << "\n";
+    file << "aaMode " << constants.aaMode << "\n";
+    file << "frameHasReset " << (constants.frameHasReset ? 1 : 0) << "\n";
+
+    return file.good();
+}
+
+static bool LoadTssConstants(const std::filesystem::path& fileName, TssConstants& constants)
+{
+    std::ifstream file(fileName);
+    if (!file.is_open())
+        return false;
+
+    std::string key;
+    while (file >> key)
+    {
+        if (key == "outputSize")
+            file >> constants.outputSize.x >> constants.outputSize.y;
+        else if (key == "pixelOffset")
+            file >> constants.pixelOffset.x >> constants.pixelOffset.y;
+        else if (key == "samplingRate")
+            file >> constants.samplingRate;
+        else if (key == "aaMode")
+            file >> constants.aaMode;
+        else if (key == "frameHasReset")
+        {
+            int reset = 0;
+            file >> reset;
+            constants.frameHasReset = reset != 0;
+        }
+        else
+            std::getline(file, key);
+    }
+
+    return constants.outputSize.x > 0 && constants.outputSize.y > 0;
+}
+
+static bool LoadTssImage(const std::filesystem::path& fileName, TssImage& image)
+{
+    CapturedImage captured;
+    if (!ReadRaw(fileName, captured))
+        return false;
+
+    image.Resize(captured.width, captured.height);
+    for (uint32_t y = 0; y < captured.height; y++)
+    {
+        for (uint32_t x = 0; x < captured.width; x++)
+            image.pixels[size_t(y) * captured.width + x] = captured.GetPixel(x, y);
+    }
+
+    return true;
+}
+
+bool LoadTssCapture(const std::filesystem::path& prefix, TssConstants& constants, TssInputs& inputs)
+{
+    const std::filesystem::path constantsFileName = prefix.string() + "_constants.txt";
+    if (!LoadTssConstants(constantsFileName, constants))
+    {
+        log::error("Cannot read the TSS constants from '%s'", constantsFileName.generic_string().c_str());
+        return false;
+    }
+
+    const std::pair<const char*, TssImage*> images[] = {
+        { "jittered", &inputs.jitteredColor },
+        { "motion", &inputs.motionVectors },
+        { "history", &inputs.historyColor },
+        { "moment1", &inputs.firstMoment },
+        { "moment2", &inputs.secondMoment },
+        { "sequence", &inputs.sequenceSqrdSum }
+    };
+
+    for (const auto& [name, image] : images)
+    {
+        const std::filesystem::path fileName = GetTssCaptureFileName(prefix, name);
+        if (!LoadTssImage(fileName, *image))
+        {
+            log::error("Cannot read the TSS input '%s'", fileName.generic_string().c_str());
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static bool WriteTssImage(const TssImage& image, const std::filesystem::path& fileName)
+{
+    CapturedImage captured;
+    captured.width = image.width;
+    captured.height = image.height;
+    captured.format = nvrhi::Format::RGBA32_FLOAT;
+    captured.pixels.resize(image.pixels.size() * sizeof(float4));
+    memcpy(captured.pixels.data(), image.pixels.data(), captured.pixels.size());
+
+    return WriteCapturedImage(captured, fileName);
+}
+
+template<typename Function>
+static double MeasureMs(int runs, Function&& function)
+{
+    double best = std::numeric_limits<double>::max();
+    for (int run = 0; run < runs; run++)
+    {
+        auto start = std::chrono::high_resolution_clock::now();
+        function();
+        best = std::min(best, std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count());
+    }
+    return best;
+}
+
+// Compares every output of the fast path with the scalar reference; returns 1 on mismatch
+static int CheckTssOutputs(const TssOutputs& reference, const TssOutputs& outputs, const char* label)
+{
+    static constexpr float c_Tolerance = 1e-3f;
+
+    const std::pair<const TssImage*, const TssImage*> images[] = {
+        { &outputs.color, &reference.color },
+        { &outputs.firstMoment, &reference.firstMoment },
+        { &outputs.secondMoment, &reference.secondMoment },
+        { &outputs.sequenceSqrdSum, &reference.sequenceSqrdSum }
+    };
+
+    uint64_t mismatches = 0;
+    float maxError = 0.f;
+    for (const auto& [image, referenceImage] : images)
+    {
+        TssImageDifference difference = CompareTssImages(*image, *referenceImage, c_Tolerance);
+        mismatches += difference.mismatches;
+        maxError = std::max(maxError, difference.maxError);
+    }
+
+    if (mismatches == 0)
+        return 0;
+
+    log::warning("TSS reference: %s differs from the scalar path in %llu pixels, max error %g", label, (unsigned long long)mismatches, maxError);
+    return 1;
+}
+
+int RunTssReference(const std::filesystem::path& prefix, uint32_t threadCount)
+{
+    TssConstants constants;
+    TssInputs inputs;
+    if (!LoadTssCapture(prefix, constants, inputs))
+        return 1;
+
+    log::info("TSS reference: %ux%u from %ux%u, sampling rate %.3f, jitter (%.3f, %.3f), mode %d%s",
+        constants.outputSize.x, constants.outputSize.y, inputs.jitteredColor.width, inputs.jitteredColor.height,
+        constants.samplingRate, constants.pixelOffset.x, constants.pixelOffset.y, constants.aaMode, constants.frameHasReset ? ", reset" : "");
+
+    TssImage gpuOutput;
+    const bool hasGpuOutput = LoadTssImage(GetTssCaptureFileName(prefix, "output"), gpuOutput);
+
+    TssResolveOptions options;
+    options.threadCount = threadCount;
+
+    int failures = 0;
+    for (uint32_t kernel = 0; kernel < uint32_t(TssFilterKernel::Count); kernel++)
+    {
+        constants.kernel = TssFilterKernel(kernel);
+        const char* kernelName = GetTssFilterKernelName(constants.kernel);
+
+        TssOutputs outputs;
+        double timeMs = MeasureMs(3, [&]() { ResolveTss(constants, inputs, outputs, options); });
+
+        TssOutputs reference;
+        TssResolveOptions scalarOptions;
+        scalarOptions.simd = false;
+        scalarOptions.threadCount = 1;
+        ResolveTss(constants, inputs, reference, scalarOptions);
+        failures += CheckTssOutputs(reference, outputs, kernelName);
+
+        std::string suffix = std::string("cpu_") + kernelName;
+        std::filesystem::path fileName = prefix.string() + "_" + suffix + ".exr";
+        if (!WriteTssImage(outputs.color, fileName))
+            ++failures;
+
+        if (hasGpuOutput)
+        {
+            // The GPU output is half precision and uses hardware filtering, so the comparison is loose
+            TssImageDifference difference = CompareTssImages(outputs.color, gpuOutput, 0.02f);
+            double mismatchRate = outputs.color.pixels.empty() ? 0.0 : double(difference.mismatches) / double(outputs.color.pixels.size());
+            log::info("TSS reference: %s %.2f ms, vs GPU: mean error %.5f, max error %.4f, %.2f%% of pixels differ",
+                kernelName, timeMs, difference.meanError, difference.maxError, mismatchRate * 100.0);
+
+            // Only the kernel that the shader uses is expected to match it
+            if (constants.kernel == TssFilterKernel::Tent && mismatchRate > 0.01)
+            {
+                log::warning("TSS reference: the GPU output differs from the reference in more than 1%% of the pixels");
+                ++failures;
+            }
+        }
+        else
+        {
+            log::info("TSS reference: %s %.2f ms, wrote '%s'", kernelName, timeMs, fileName.generic_string().c_str());
+        }
+    }
+
+    return failures;
+}
+
+// Smooth gradients with hard edges, so that the kernels and the derivative both have work to do
+static float4 SyntheticColor(float x, float y, float phase)
+{
+    const float checker = ((int(std::floor(x * 0.05f + phase)) ^ int(std::floor(y * 0.05f))) & 1) ? 0.8f : 0.2f;
+    return float4(
+        checker + 0.15f * std::sin(x * 0.13f + phase),
+        checker * 0.5f + 0.25f * std::cos(y * 0.07f),
+        0.5f + 0.4f * std::sin((x + y) * 0.02f + phase),
+        1.f);
+}
+
+static void CreateSyntheticTssFrame(TssConstants& constants, TssInputs& inputs, uint32_t width, uint32_t height, float samplingRate)
+{
+    constants.outputSize = uint2(width, height);
+    constants.pixelOffset = float2(0.23f, -0.31f);
+    constants.samplingRate = samplingRate;
+
+    const uint32_t inputWidth = uint32_t(float(width) * samplingRate);
+    const uint32_t inputHeight = uint32_t(float(height) * samplingRate);
+
+    inputs.jitteredColor.Resize(inputWidth, inputHeight);
+    inputs.motionVectors.Resize(inputWidth, inputHeight);
+    for (uint32_t y = 0; y < inputHeight; y++)
+    {
+        for (uint32_t x = 0; x < inputWidth; x++)
+        {
+            const float outputX = (float(x) + 0.5f - constants.pixelOffset.x) / samplingRate;
+            const float outputY = (float(y) + 0.5f - constants.pixelOffset.y) / samplingRate;
+            const size_t index = size_t(y) * inputWidth + x;
+            inputs.jitteredColor.pixels[index] = SyntheticColor(outputX, outputY, 0.f);
+
+            // A slow pan, with a fast object in the middle that drags history in from off screen
+            const bool fast = std::abs(float(x) / float(inputWidth) - 0.5f) < 0.1f;
+            inputs.motionVectors.pixels[index] = float4(fast ? 0.02f : 0.002f, fast ? -0.6f * float(y) / float(inputHeight) : 0.001f, 0.f, 0.f);
+        }
+    }
+
+    inputs.historyColor.Resize(width, height);
+    inputs.firstMoment.Resize(width, height);
+    inputs.secondMoment.Resize(width, height);
+    inputs.sequenceSqrdSum.Resize(width, height);
+    for (uint32_t y = 0; y < height; y++)
+    {
+        for (uint32_t x = 0; x < width; x++)
+        {
+            const size_t index = size_t(y) * width + x;
+            const float4 history = SyntheticColor(float(x) + 0.5f, float(y) + 0.5f, 0.3f);
+            inputs.historyColor.pixels[index] = history;
+            inputs.firstMoment.pixels[index] = float4(history.xyz(), 0.f);
+            const float variance = (x + y) % 7 == 0 ? 0.f : 0.002f * float((x * 3 + y) % 5);
+            inputs.secondMoment.pixels[index] = float4(history.xyz() * history.xyz() + variance, 0.f);
+            inputs.sequenceSqrdSum.pixels[index] = float4(0.2f, 0.f, 0.f, 0.f);
+        }
+    }
+}
+
+int RunTssBenchmark(uint32_t threadCount)
+{
+    if (threadCount == 0)
+        threadCount = std::max(std::thread::hardware_concurrency(), 1u);
+
+    const uint32_t width = 1920;
+    const uint32_t height = 1080;
+    TssConstants constants;
+    TssInputs inputs;
+    CreateSyntheticTssFrame(constants, inputs, width, height, 0.5f);
+
+#ifdef CPU_TSS_AVX2
+    const char* simdName = "AVX2";
+#else
+    const char* simdName = "scalar (no AVX2)";
+#endif
+
+    const double megapixels = double(width) * double(height) * 1e-6;
+    int failures = 0;
+
+    for (uint32_t kernel = 0; kernel < uint32_t(TssFilterKernel::Count); kernel++)
+    {
+        constants.kernel = TssFilterKernel(kernel);
+        const char* kernelName = GetTssFilterKernelName(constants.kernel);
+
+        TssResolveOptions scalarOptions;
+        scalarOptions.simd = false;
+        scalarOptions.threadCount = 1;
+        TssResolveOptions simdOptions;
+        simdOptions.threadCount = 1;
+        TssResolveOptions threadedOptions;
+        threadedOptions.threadCount = threadCount;
+
+        TssOutputs reference, simdOutputs, threadedOutputs;
+        const double scalarMs = MeasureMs(3, [&]() { ResolveTss(constants, inputs, reference, scalarOptions); });
+        const double simdMs = MeasureMs(3, [&]() { ResolveTss(constants, inputs, simdOutputs, simdOptions); });
+        const double threadedMs = MeasureMs(5, [&]() { ResolveTss(constants, inputs, threadedOutputs, threadedOptions); });
+
+        failures += CheckTssOutputs(reference, simdOutputs, simdName);
+        failures += CheckTssOutputs(reference, threadedOutputs, "the threaded path");
+
+        log::info("TSS benchmark: %ux%u from %ux%u, %s: scalar %.2f ms (%.1f Mpix/s), %s %.2f ms (%.1f Mpix/s), %u threads %.2f ms (%.1f Mpix/s)",
+            width, height, inputs.jitteredColor.width, inputs.jitteredColor.height, kernelName,
+            scalarMs, megapixels / scalarMs * 1000.0, simdName, simdMs, megapixels / simdMs * 1000.0,
+            threadCount, threadedMs, megapixels / threadedMs * 1000.0);
+    }
+
+    // The other modes and a reset frame take different branches
+    constants.kernel = TssFilterKernel::Tent;
+    const std::pair<int, bool> variants[] = {
+        { TSS_NATIVE_RESOLUTION, false }, { TSS_NATIVE_WITH_TAA, false }, { TSS_RAW_UPSCALED, false },
+        { TSS_TEMPORAL_ANTIALIASING, false }, { TSS_TEMPORAL_SUPERSAMPLING, true }
+    };
+    for (const auto& [aaMode, reset] : variants)
+    {
+        constants.aaMode = aaMode;
+        constants.frameHasReset = reset;
+
+        TssResolveOptions scalarOptions;
+        scalarOptions.simd = false;
+        scalarOptions.threadCount = 1;
+        TssOutputs reference, outputs;
+        ResolveTss(constants, inputs, reference, scalarOptions);
+        ResolveTss(constants, inputs, outputs, TssResolveOptions());
+
+        std::string label = "mode " + std::to_string(aaMode) + (reset ? " after a reset" : "");
+        failures += CheckTssOutputs(reference, outputs, label.c_str());
+    }
+
+    log::info("TSS benchmark: %d failed checks", failures);
+    return failures;
+}
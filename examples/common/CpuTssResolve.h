@@ -0,0 +1,135 @@
+/*
+* Copyright (c) 2014-2021, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#pragma once
+
+#include <donut/core/math/math.h>
+#include <cstdint>
+#include <filesystem>
+#include <vector>
+
+// CPU reference of the temporal supersampling resolve in examples/bindless_rendering/tss.hlsl (ps_main).
+//
+// Each output pixel combines a 3x3 block of neighbours. The shader recomputes the upsampled current
+// sample, the reprojected history and the moments of every neighbour for each pixel that uses it.
+// The reference computes them once per pixel over a tile with a one pixel border and then combines
+// the blocks. The result is the same, with a ninth of the texture reads. Tiles run in parallel, and
+// eight pixels of a row are processed at a time with AVX2 when DONUT_EXAMPLES_WITH_AVX2 is enabled.
+//
+// Differences from the GPU: the history is sampled bilinearly where the shader uses an anisotropic
+// sampler, and bilinear weights are not quantized. The moments are read from the previous frame,
+// where the shader reads and writes them in place. The normal buffers are bound to the shader but
+// never read, so they are not inputs here.
+
+enum class TssFilterKernel : uint8_t
+{
+    Tent,           // tentValue with a width of two input pixels, the kernel used by the shader
+    CubicBSpline,   // cubicBSplineValue
+    CatmullRom,     // catmullRomValue
+
+    Count
+};
+
+const char* GetTssFilterKernelName(TssFilterKernel kernel);
+
+// The AA modes of ps_main, in the order of the example's AAMode
+enum TssAAMode : int
+{
+    TSS_NATIVE_RESOLUTION = 0,
+    TSS_NATIVE_WITH_TAA = 1,
+    TSS_RAW_UPSCALED = 2,
+    TSS_TEMPORAL_SUPERSAMPLING = 3,
+    TSS_TEMPORAL_ANTIALIASING = 4
+};
+
+struct TssConstants
+{
+    dm::uint2 outputSize = dm::uint2(0u);       // g_View.viewportSize
+    dm::float2 pixelOffset = dm::float2(0.f);   // g_View.pixelOffset, the jitter of the current frame
+    float samplingRate = 1.f;                   // g_SamplingRate, input resolution over output resolution
+    int aaMode = TSS_TEMPORAL_SUPERSAMPLING;    // b_FrameIndex.currentAAMode
+    bool frameHasReset = false;                 // b_FrameIndex.frameHasReset
+    TssFilterKernel kernel = TssFilterKernel::Tent;
+};
+
+// RGBA float image with tightly packed rows
+struct TssImage
+{
+    uint32_t width = 0;
+    uint32_t height = 0;
+    std::vector<dm::float4> pixels;
+
+    void Resize(uint32_t newWidth, uint32_t newHeight);
+    [[nodiscard]] bool IsEmpty() const { return pixels.empty(); }
+    [[nodiscard]] const dm::float4& At(uint32_t x, uint32_t y) const { return pixels[size_t(y) * width + x]; }
+};
+
+struct TssInputs
+{
+    TssImage jitteredColor;     // t_JitteredCurrentBuffer, input resolution
+    TssImage motionVectors;     // t_MotionVector, input resolution
+    TssImage historyColor;      // t_HistoryColor, output resolution
+    TssImage firstMoment;       // t_1stOrderMoment before the pass
+    TssImage secondMoment;      // t_2ndOrderMoment before the pass
+    TssImage sequenceSqrdSum;   // t_SequenceSqrdSum before the pass, in x
+};
+
+struct TssOutputs
+{
+    TssImage color;             // SV_Target0, which SV_Target1 duplicates
+    TssImage firstMoment;
+    TssImage secondMoment;
+    TssImage sequenceSqrdSum;
+};
+
+struct TssResolveOptions
+{
+    bool simd = true;           // AVX2 when it is compiled in
+    uint32_t threadCount = 0;   // 0 means one per hardware thread
+    uint32_t tileSize = 64;
+};
+
+void ResolveTss(const TssConstants& constants, const TssInputs& inputs, TssOutputs& outputs, const TssResolveOptions& options = TssResolveOptions());
+
+struct TssImageDifference
+{
+    float maxError = 0.f;
+    double meanError = 0.0;
+    uint64_t mismatches = 0;    // pixels with an RGB channel differing by more than the tolerance, relative above 1
+};
+
+TssImageDifference CompareTssImages(const TssImage& a, const TssImage& b, float tolerance);
+
+// A captured frame is <prefix>_constants.txt plus one raw image per input (see RawImageHeader),
+// and optionally <prefix>_output.raw with the GPU result
+std::filesystem::path GetTssCaptureFileName(const std::filesystem::path& prefix, const char* name);
+bool SaveTssConstants(const TssConstants& constants, const std::filesystem::path& fileName);
+bool LoadTssCapture(const std::filesystem::path& prefix, TssConstants& constants, TssInputs& inputs);
+
+// Resolves a captured frame with every filter kernel and writes <prefix>_cpu_<kernel>.exr. Checks the
+// fast path against the scalar one, and the tent kernel against the GPU output when it was captured.
+// Returns the number of failed checks.
+int RunTssReference(const std::filesystem::path& prefix, uint32_t threadCount = 0);
+
+// Resolves a synthetic 1080p frame from a half resolution input with every kernel, checks the AVX2 and
+// threaded paths against the scalar one, and prints the throughput. Returns the number of failed checks.
+int RunTssBenchmark(uint32_t threadCount = 0);
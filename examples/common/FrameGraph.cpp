@@ -0,0 +1,296 @@
+/*
+* Copyright (c) 2014-2021, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#include "FrameGraph.h"
+#include <algorithm>
+#include <random>
+
+static uint64_t AlignUp(uint64_t value, uint64_t alignment)
+{
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+uint32_t FrameGraph::AddResource(const char* name, bool transient)
+{
+    Resource resource;
+    resource.name = name;
+    resource.transient = transient;
+    m_Resources.push_back(resource);
+    m_Placed = false;
+    return uint32_t(m_Resources.size() - 1);
+}
+
+void FrameGraph::SetResourceSize(uint32_t resource, uint64_t size, uint64_t alignment)
+{
+    m_Resources[resource].size = size;
+    m_Resources[resource].alignment = std::max<uint64_t>(alignment, 1);
+    m_Placed = false;
+}
+
+void FrameGraph::ClearPasses()
+{
+    m_Passes.clear();
+}
+
+uint32_t FrameGraph::AddPass(const char* name, std::vector<uint32_t> reads, std::vector<uint32_t> writes, bool clearsWrites)
+{
+    Pass pass;
+    pass.name = name;
+    pass.reads = std::move(reads);
+    pass.writes = std::move(writes);
+    pass.clearsWrites = clearsWrites;
+    m_Passes.push_back(std::move(pass));
+    return uint32_t(m_Passes.size() - 1);
+}
+
+void FrameGraph::ComputeLifetimes()
+{
+    for (Resource& resource : m_Resources)
+    {
+        resource.firstPass = c_Invalid;
+        resource.lastPass = c_Invalid;
+    }
+
+    for (uint32_t passIndex = 0; passIndex < uint32_t(m_Passes.size()); passIndex++)
+    {
+        const Pass& pass = m_Passes[passIndex];
+        for (const auto* accesses : { &pass.reads, &pass.writes })
+        {
+            for (uint32_t index : *accesses)
+            {
+                Resource& resource = m_Resources[index];
+                if (resource.firstPass == c_Invalid)
+                    resource.firstPass = passIndex;
+                resource.lastPass = passIndex;
+            }
+        }
+    }
+}
+
+bool FrameGraph::LifetimesOverlap(uint32_t a, uint32_t b) const
+{
+    if (!IsUsed(a) || !IsUsed(b))
+        return false;
+
+    // Used persistent resources hold their contents through the whole frame
+    const Resource& ra = m_Resources[a];
+    const Resource& rb = m_Resources[b];
+    if (!ra.transient || !rb.transient)
+        return true;
+
+    return ra.firstPass <= rb.lastPass && rb.firstPass <= ra.lastPass;
+}
+
+bool FrameGraph::MemoryOverlaps(uint32_t a, uint32_t b) const
+{
+    const Resource& ra = m_Resources[a];
+    const Resource& rb = m_Resources[b];
+    if (ra.size == 0 || rb.size == 0)
+        return false;
+
+    return ra.offset < rb.offset + rb.size && rb.offset < ra.offset + ra.size;
+}
+
+bool FrameGraph::IsAliased(uint32_t resource) const
+{
+    for (uint32_t other = 0; other < uint32_t(m_Resources.size()); other++)
+    {
+        if (other != resource && IsUsed(other) && MemoryOverlaps(resource, other))
+            return true;
+    }
+    return false;
+}
+
+bool FrameGraph::NeedsInitialization(uint32_t resource, uint32_t pass) const
+{
+    return pass != c_Invalid && m_Resources[resource].firstPass == pass && !m_Passes[pass].clearsWrites && IsAliased(resource);
+}
+
+uint64_t FrameGraph::PlaceResources()
+{
+    std::vector<uint32_t> order;
+    for (uint32_t index = 0; index < uint32_t(m_Resources.size()); index++)
+    {
+        if (IsUsed(index))
+            order.push_back(index);
+        else
+            m_Resources[index].offset = 0;
+    }
+
+    // Persistent resources first so that they stay at stable offsets, then the largest transient ones
+    std::stable_sort(order.begin(), order.end(), [this](uint32_t a, uint32_t b)
+    {
+        const Resource& ra = m_Resources[a];
+        const Resource& rb = m_Resources[b];
+        if (ra.transient != rb.transient)
+            return !ra.transient;
+        if (ra.transient)
+            return ra.size > rb.size;
+        return false;
+    });
+
+    std::vector<uint32_t> placed;
+    std::vector<std::pair<uint64_t, uint64_t>> occupied;
+
+    for (uint32_t index : order)
+    {
+        Resource& resource = m_Resources[index];
+
+        occupied.clear();
+        for (uint32_t other : placed)
+        {
+            if (LifetimesOverlap(index, other))
+                occupied.emplace_back(m_Resources[other].offset, m_Resources[other].offset + m_Resources[other].size);
+        }
+        std::sort(occupied.begin(), occupied.end());
+
+        uint64_t offset = 0;
+        for (const auto& range : occupied)
+        {
+            if (AlignUp(offset, resource.alignment) + resource.size <= range.first)
+                break;
+            offset = std::max(offset, range.second);
+        }
+
+        resource.offset = AlignUp(offset, resource.alignment);
+        placed.push_back(index);
+    }
+
+    m_HeapSize = 0;
+    for (const Resource& resource : m_Resources)
+        m_HeapSize = std::max(m_HeapSize, resource.offset + resource.size);
+
+    m_Placed = true;
+    return m_HeapSize;
+}
+
+std::string FrameGraph::ValidatePlacement() const
+{
+    if (!m_Placed)
+        return "the resources are not placed";
+
+    for (uint32_t a = 0; a < uint32_t(m_Resources.size()); a++)
+    {
+        const Resource& resource = m_Resources[a];
+        if (resource.offset % resource.alignment != 0)
+            return resource.name + " is not aligned";
+        if (resource.offset + resource.size > m_HeapSize)
+            return resource.name + " is outside of the heap";
+
+        for (uint32_t b = a + 1; b < uint32_t(m_Resources.size()); b++)
+        {
+            if (LifetimesOverlap(a, b) && MemoryOverlaps(a, b))
+                return resource.name + " and " + m_Resources[b].name + " are alive at the same time and share memory";
+        }
+    }
+
+    return std::string();
+}
+
+uint64_t FrameGraph::GetUnaliasedSize() const
+{
+    uint64_t size = 0;
+    for (const Resource& resource : m_Resources)
+        size = AlignUp(size, resource.alignment) + resource.size;
+    return size;
+}
+
+uint64_t FrameGraph::GetPeakLiveSize() const
+{
+    uint64_t persistentSize = 0;
+    for (const Resource& resource : m_Resources)
+    {
+        if (!resource.transient && resource.firstPass != c_Invalid)
+            persistentSize += resource.size;
+    }
+
+    uint64_t peak = persistentSize;
+    for (uint32_t pass = 0; pass < uint32_t(m_Passes.size()); pass++)
+    {
+        uint64_t live = persistentSize;
+        for (const Resource& resource : m_Resources)
+        {
+            if (resource.transient && resource.firstPass != c_Invalid && resource.firstPass <= pass && pass <= resource.lastPass)
+                live += resource.size;
+        }
+        peak = std::max(peak, live);
+    }
+    return peak;
+}
+
+std::string TestFrameGraphPlacement(uint32_t trials, uint32_t seed)
+{
+    std::mt19937 rng(seed);
+    const uint64_t alignments[] = { 256, 64 * 1024, 4 * 1024 * 1024 };
+
+    for (uint32_t trial = 0; trial < trials; trial++)
+    {
+        FrameGraph graph;
+
+        const uint32_t resourceCount = 1 + rng() % 16;
+        for (uint32_t i = 0; i < resourceCount; i++)
+        {
+            std::string name = "R" + std::to_string(i);
+            uint32_t resource = graph.AddResource(name.c_str(), rng() % 8 != 0);
+            uint64_t alignment = alignments[rng() % 3];
+            graph.SetResourceSize(resource, alignment * (1 + rng() % 8) - (rng() % 2) * (alignment / 2), alignment);
+        }
+
+        // Each resource gets a random lifetime, some are never used
+        const uint32_t passCount = 1 + rng() % 12;
+        std::vector<std::vector<uint32_t>> readsPerPass(passCount);
+        std::vector<std::vector<uint32_t>> writesPerPass(passCount);
+        for (uint32_t i = 0; i < resourceCount; i++)
+        {
+            if (rng() % 6 == 0)
+                continue;
+            uint32_t first = rng() % passCount;
+            uint32_t last = first + rng() % (passCount - first);
+            writesPerPass[first].push_back(i);
+            if (last != first)
+                readsPerPass[last].push_back(i);
+        }
+
+        for (uint32_t pass = 0; pass < passCount; pass++)
+            graph.AddPass("P", readsPerPass[pass], writesPerPass[pass]);
+
+        graph.ComputeLifetimes();
+        graph.PlaceResources();
+
+        const std::string prefix = "trial " + std::to_string(trial) + ": ";
+        std::string error = graph.ValidatePlacement();
+        if (!error.empty())
+            return prefix + error;
+
+        if (graph.GetHeapSize() < graph.GetPeakLiveSize())
+            return prefix + "the heap is smaller than the resources alive during one pass";
+
+        for (uint32_t i = 0; i < resourceCount; i++)
+        {
+            const FrameGraph::Resource& resource = graph.GetResource(i);
+            if (!graph.IsUsed(i) && resource.offset != 0)
+                return prefix + resource.name + " is unused but not at offset 0";
+        }
+    }
+
+    return std::string();
+}
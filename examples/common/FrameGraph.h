@@ -0,0 +1,106 @@
+/*
+* Copyright (c) 2014-2021, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Records the passes of a frame with the resources they read and write, derives the lifetime of
+// every resource and places the resources in one heap so that those with disjoint lifetimes alias.
+// Passes are indexed in execution order. Transient resources only live between their first and last
+// access within a frame; persistent resources keep their contents between frames and only alias while
+// no pass uses them.
+class FrameGraph
+{
+public:
+    static constexpr uint32_t c_Invalid = ~0u;
+
+    struct Resource
+    {
+        std::string name;
+        uint64_t size = 0;
+        uint64_t alignment = 1;
+        bool transient = true;
+        uint32_t firstPass = c_Invalid; // c_Invalid when no pass accesses the resource
+        uint32_t lastPass = c_Invalid;
+        uint64_t offset = 0;
+    };
+
+    struct Pass
+    {
+        std::string name;
+        std::vector<uint32_t> reads;
+        std::vector<uint32_t> writes;
+        bool clearsWrites = false; // the pass clears what it writes before anything else
+    };
+
+    uint32_t AddResource(const char* name, bool transient);
+    void SetResourceSize(uint32_t resource, uint64_t size, uint64_t alignment);
+
+    void ClearPasses();
+    uint32_t AddPass(const char* name, std::vector<uint32_t> reads, std::vector<uint32_t> writes, bool clearsWrites = false);
+
+    // Derives the first and last pass of every resource from the current passes
+    void ComputeLifetimes();
+
+    // Assigns heap offsets from the current lifetimes, largest resources first, each at the lowest
+    // offset that does not overlap a resource alive at the same time. Unused resources are placed at
+    // offset 0 because nothing reads them. Returns the heap size.
+    uint64_t PlaceResources();
+
+    // Checks the placement against the current lifetimes, which may have changed since PlaceResources.
+    // Returns an empty string if no two resources alive at the same time share memory.
+    [[nodiscard]] std::string ValidatePlacement() const;
+
+    [[nodiscard]] bool IsUsed(uint32_t resource) const { return m_Resources[resource].firstPass != c_Invalid; }
+    [[nodiscard]] bool LifetimesOverlap(uint32_t a, uint32_t b) const;
+    [[nodiscard]] bool MemoryOverlaps(uint32_t a, uint32_t b) const;
+    // True if another used resource shares memory with this one, so its contents do not survive until its first access
+    [[nodiscard]] bool IsAliased(uint32_t resource) const;
+    // True if the pass is the first to access an aliased resource without clearing it, so the memory
+    // must be initialized first
+    [[nodiscard]] bool NeedsInitialization(uint32_t resource, uint32_t pass) const;
+
+    [[nodiscard]] bool IsPlaced() const { return m_Placed; }
+    [[nodiscard]] uint64_t GetHeapSize() const { return m_HeapSize; }
+    // Heap size without aliasing, every resource at its own aligned offset
+    [[nodiscard]] uint64_t GetUnaliasedSize() const;
+    // Largest total size of the resources alive during one pass, a lower bound for the heap size
+    [[nodiscard]] uint64_t GetPeakLiveSize() const;
+
+    [[nodiscard]] const Resource& GetResource(uint32_t resource) const { return m_Resources[resource]; }
+    [[nodiscard]] uint32_t GetResourceCount() const { return uint32_t(m_Resources.size()); }
+    [[nodiscard]] const Pass& GetPass(uint32_t pass) const { return m_Passes[pass]; }
+    [[nodiscard]] uint32_t GetPassCount() const { return uint32_t(m_Passes.size()); }
+
+private:
+    std::vector<Resource> m_Resources;
+    std::vector<Pass> m_Passes;
+    uint64_t m_HeapSize = 0;
+    bool m_Placed = false;
+};
+
+// Places random resource sets and checks each placement for overlaps, alignment and the heap size bounds.
+// Returns an empty string on success.
+std::string TestFrameGraphPlacement(uint32_t trials, uint32_t seed);
@@ -0,0 +1,351 @@
+/*
+* Copyright (c) 2014-2021, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#include "ImageEncoders.h"
+#include <donut/core/log.h>
+#include <donut/core/string_utils.h>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <limits>
+
+// stb_image_write is compiled privately here, like stb_image in TextureTranscoder.cpp
+#define STB_IMAGE_WRITE_STATIC
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include <stb_image_write.h>
+
+using namespace donut;
+
+float HalfToFloat(uint16_t value)
+{
+    uint32_t sign = value >> 15;
+    uint32_t exponent = (value >> 10) & 0x1f;
+    uint32_t mantissa = value & 0x3ff;
+
+    float result;
+    if (exponent == 0)
+        result = std::ldexp(float(mantissa), -24);
+    else if (exponent == 31)
+        result = mantissa ? std::numeric_limits<float>::quiet_NaN() : std::numeric_limits<float>::infinity();
+    else
+        result = std::ldexp(float(mantissa | 0x400), int(exponent) - 25);
+
+    return sign ? -result : result;
+}
+
+uint16_t FloatToHalf(float value)
+{
+    uint32_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+
+    uint32_t sign = (bits >> 16) & 0x8000;
+    int32_t exponent = int32_t((bits >> 23) & 0xff) - 127 + 15;
+    uint32_t mantissa = bits & 0x7fffff;
+
+    if (exponent >= 31)
+    {
+        // Overflow to infinity, keep NaNs as NaNs
+        bool isNan = ((bits >> 23) & 0xff) == 0xff && mantissa != 0;
+        return uint16_t(sign | 0x7c00 | (isNan ? 0x200 : 0));
+    }
+
+    if (exponent <= 0)
+    {
+        if (exponent < -10)
+            return uint16_t(sign);
+
+        // Denormal: shift the implicit leading one into the mantissa and round to nearest
+        mantissa |= 0x800000;
+        uint32_t shift = uint32_t(14 - exponent);
+        uint32_t halfMantissa = mantissa >> shift;
+        if ((mantissa >> (shift - 1)) & 1)
+            ++halfMantissa;
+        return uint16_t(sign | halfMantissa);
+    }
+
+    uint32_t half = sign | (uint32_t(exponent) << 10) | (mantissa >> 13);
+    if (mantissa & 0x1000)
+        ++half; // round to nearest, a carry into the exponent is still correct
+    return uint16_t(half);
+}
+
+static float SrgbToLinear(float value)
+{
+    return value <= 0.04045f ? value / 12.92f : std::pow((value + 0.055f) / 1.055f, 2.4f);
+}
+
+bool IsCaptureFormatSupported(nvrhi::Format format)
+{
+    switch (format)
+    {
+    case nvrhi::Format::RGBA8_UNORM:
+    case nvrhi::Format::SRGBA8_UNORM:
+    case nvrhi::Format::BGRA8_UNORM:
+    case nvrhi::Format::SBGRA8_UNORM:
+    case nvrhi::Format::RGBA16_FLOAT:
+    case nvrhi::Format::RGBA32_FLOAT:
+    case nvrhi::Format::R32_FLOAT:
+        return true;
+    default:
+        return false;
+    }
+}
+
+dm::float4 CapturedImage::GetPixel(uint32_t x, uint32_t y) const
+{
+    const uint8_t* row = pixels.data() + size_t(y) * GetRowSize();
+
+    switch (format)
+    {
+    case nvrhi::Format::RGBA8_UNORM:
+    case nvrhi::Format::SRGBA8_UNORM: {
+        const uint8_t* p = row + size_t(x) * 4;
+        return dm::float4(p[0], p[1], p[2], p[3]) / 255.f;
+    }
+    case nvrhi::Format::BGRA8_UNORM:
+    case nvrhi::Format::SBGRA8_UNORM: {
+        const uint8_t* p = row + size_t(x) * 4;
+        return dm::float4(p[2], p[1], p[0], p[3]) / 255.f;
+    }
+    case nvrhi::Format::RGBA16_FLOAT: {
+        const uint16_t* p = reinterpret_cast<const uint16_t*>(row) + size_t(x) * 4;
+        return dm::float4(HalfToFloat(p[0]), HalfToFloat(p[1]), HalfToFloat(p[2]), HalfToFloat(p[3]));
+    }
+    case nvrhi::Format::RGBA32_FLOAT: {
+        const float* p = reinterpret_cast<const float*>(row) + size_t(x) * 4;
+        return dm::float4(p[0], p[1], p[2], p[3]);
+    }
+    case nvrhi::Format::R32_FLOAT: {
+        const float* p = reinterpret_cast<const float*>(row) + x;
+        return dm::float4(p[0], 0.f, 0.f, 1.f);
+    }
+    default:
+        return dm::float4(0.f);
+    }
+}
+
+static uint8_t ToUnorm8(float value)
+{
+    return uint8_t(std::clamp(value, 0.f, 1.f) * 255.f + 0.5f);
+}
+
+// Converts any supported capture format into tightly packed 8-bit RGB rows for stb_image_write
+static std::vector<uint8_t> ConvertToRGB8(const CapturedImage& image)
+{
+    std::vector<uint8_t> rgb(size_t(image.width) * image.height * 3);
+    uint8_t* dst = rgb.data();
+    for (uint32_t y = 0; y < image.height; y++)
+    {
+        for (uint32_t x = 0; x < image.width; x++)
+        {
+            dm::float4 pixel = image.GetPixel(x, y);
+            *dst++ = ToUnorm8(pixel.x);
+            *dst++ = ToUnorm8(pixel.y);
+            *dst++ = ToUnorm8(pixel.z);
+        }
+    }
+    return rgb;
+}
+
+bool WritePNG(const CapturedImage& image, const std::filesystem::path& fileName)
+{
+    std::vector<uint8_t> rgb = ConvertToRGB8(image);
+    return stbi_write_png(fileName.generic_string().c_str(), int(image.width), int(image.height), 3, rgb.data(), int(image.width) * 3) != 0;
+}
+
+bool WriteBMP(const CapturedImage& image, const std::filesystem::path& fileName)
+{
+    std::vector<uint8_t> rgb = ConvertToRGB8(image);
+    return stbi_write_bmp(fileName.generic_string().c_str(), int(image.width), int(image.height), 3, rgb.data()) != 0;
+}
+
+template<typename T>
+static void AppendValue(std::vector<uint8_t>& data, const T& value)
+{
+    const uint8_t* bytes = reinterpret_cast<const uint8_t*>(&value);
+    data.insert(data.end(), bytes, bytes + sizeof(T));
+}
+
+static void AppendString(std::vector<uint8_t>& data, const char* str)
+{
+    data.insert(data.end(), str, str + strlen(str) + 1);
+}
+
+static void AppendExrAttribute(std::vector<uint8_t>& data, const char* name, const char* type, const std::vector<uint8_t>& value)
+{
+    AppendString(data, name);
+    AppendString(data, type);
+    AppendValue(data, int32_t(value.size()));
+    data.insert(data.end(), value.begin(), value.end());
+}
+
+bool WriteEXR(const CapturedImage& image, const std::filesystem::path& fileName)
+{
+    std::ofstream file(fileName, std::ios::binary);
+    if (!file.is_open())
+        return false;
+
+    const bool srgb = image.format == nvrhi::Format::SRGBA8_UNORM || image.format == nvrhi::Format::SBGRA8_UNORM;
+
+    // Channels must be listed in alphabetical order
+    static const char* channelNames[] = { "A", "B", "G", "R" };
+
+    std::vector<uint8_t> header;
+    AppendValue(header, uint32_t(20000630)); // magic
+    AppendValue(header, uint32_t(2)); // version 2, scanline image
+
+    std::vector<uint8_t> channels;
+    for (const char* name : channelNames)
+    {
+        AppendString(channels, name);
+        AppendValue(channels, int32_t(1)); // HALF
+        AppendValue(channels, uint32_t(0)); // pLinear + reserved
+        AppendValue(channels, int32_t(1)); // xSampling
+        AppendValue(channels, int32_t(1)); // ySampling
+    }
+    channels.push_back(0);
+    AppendExrAttribute(header, "channels", "chlist", channels);
+
+    AppendExrAttribute(header, "compression", "compression", { 0 });
+
+    std::vector<uint8_t> window;
+    AppendValue(window, int32_t(0));
+    AppendValue(window, int32_t(0));
+    AppendValue(window, int32_t(image.width - 1));
+    AppendValue(window, int32_t(image.height - 1));
+    AppendExrAttribute(header, "dataWindow", "box2i", window);
+    AppendExrAttribute(header, "displayWindow", "box2i", window);
+
+    AppendExrAttribute(header, "lineOrder", "lineOrder", { 0 });
+
+    std::vector<uint8_t> floatOne;
+    AppendValue(floatOne, 1.f);
+    AppendExrAttribute(header, "pixelAspectRatio", "float", floatOne);
+
+    std::vector<uint8_t> center;
+    AppendValue(center, 0.f);
+    AppendValue(center, 0.f);
+    AppendExrAttribute(header, "screenWindowCenter", "v2f", center);
+    AppendExrAttribute(header, "screenWindowWidth", "float", floatOne);
+
+    header.push_back(0);
+
+    // One scanline per block: y, data size, then each channel's row of halves
+    const uint32_t lineDataSize = image.width * 4 * sizeof(uint16_t);
+    const uint64_t blockSize = sizeof(int32_t) * 2 + lineDataSize;
+    uint64_t blockOffset = header.size() + sizeof(uint64_t) * image.height;
+    for (uint32_t y = 0; y < image.height; y++)
+    {
+        AppendValue(header, blockOffset);
+        blockOffset += blockSize;
+    }
+    file.write(reinterpret_cast<const char*>(header.data()), header.size());
+
+    std::vector<uint16_t> line(size_t(image.width) * 4);
+    for (uint32_t y = 0; y < image.height; y++)
+    {
+        for (uint32_t x = 0; x < image.width; x++)
+        {
+            dm::float4 pixel = image.GetPixel(x, y);
+            if (srgb)
+            {
+                pixel.x = SrgbToLinear(pixel.x);
+                pixel.y = SrgbToLinear(pixel.y);
+                pixel.z = SrgbToLinear(pixel.z);
+            }
+            line[x + image.width * 0] = FloatToHalf(pixel.w);
+            line[x + image.width * 1] = FloatToHalf(pixel.z);
+            line[x + image.width * 2] = FloatToHalf(pixel.y);
+            line[x + image.width * 3] = FloatToHalf(pixel.x);
+        }
+
+        int32_t lineHeader[2] = { int32_t(y), int32_t(lineDataSize) };
+        file.write(reinterpret_cast<const char*>(lineHeader), sizeof(lineHeader));
+        file.write(reinterpret_cast<const char*>(line.data()), lineDataSize);
+    }
+
+    return file.good();
+}
+
+bool WriteRaw(const CapturedImage& image, const std::filesystem::path& fileName)
+{
+    std::ofstream file(fileName, std::ios::binary);
+    if (!file.is_open())
+        return false;
+
+    RawImageHeader header;
+    header.magic = 0x49574152; // 'RAWI'
+    header.width = image.width;
+    header.height = image.height;
+    header.format = uint32_t(image.format);
+    header.bytesPerPixel = nvrhi::getFormatInfo(image.format).bytesPerBlock;
+
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    file.write(reinterpret_cast<const char*>(image.pixels.data()), image.pixels.size());
+
+    return file.good();
+}
+
+bool ReadRaw(const std::filesystem::path& fileName, CapturedImage& image)
+{
+    std::ifstream file(fileName, std::ios::binary);
+    if (!file.is_open())
+        return false;
+
+    RawImageHeader header;
+    file.read(reinterpret_cast<char*>(&header), sizeof(header));
+    if (!file.good() || header.magic != 0x49574152)
+        return false;
+
+    image.width = header.width;
+    image.height = header.height;
+    image.format = nvrhi::Format(header.format);
+    if (!IsCaptureFormatSupported(image.format) || header.bytesPerPixel != nvrhi::getFormatInfo(image.format).bytesPerBlock)
+        return false;
+
+    image.pixels.resize(image.GetRowSize() * image.height);
+    file.read(reinterpret_cast<char*>(image.pixels.data()), image.pixels.size());
+
+    return file.good();
+}
+
+bool WriteCapturedImage(const CapturedImage& image, const std::filesystem::path& fileName)
+{
+    std::string extension = fileName.extension().generic_string();
+    string_utils::tolower(extension);
+
+    bool success;
+    if (extension == ".png")
+        success = WritePNG(image, fileName);
+    else if (extension == ".bmp")
+        success = WriteBMP(image, fileName);
+    else if (extension == ".exr")
+        success = WriteEXR(image, fileName);
+    else
+        success = WriteRaw(image, fileName);
+
+    if (!success)
+        log::warning("Cannot write captured image '%s'", fileName.generic_string().c_str());
+
+    return success;
+}
@@ -0,0 +1,70 @@
+/*
+* Copyright (c) 2014-2021, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#pragma once
+
+#include <nvrhi/nvrhi.h>
+#include <donut/core/math/math.h>
+#include <cstdint>
+#include <filesystem>
+#include <vector>
+
+// Pixels read back from a staging texture, rows are tightly packed
+struct CapturedImage
+{
+    uint32_t width = 0;
+    uint32_t height = 0;
+    nvrhi::Format format = nvrhi::Format::UNKNOWN;
+    std::vector<uint8_t> pixels;
+
+    [[nodiscard]] size_t GetRowSize() const { return size_t(width) * nvrhi::getFormatInfo(format).bytesPerBlock; }
+    [[nodiscard]] dm::float4 GetPixel(uint32_t x, uint32_t y) const;
+};
+
+float HalfToFloat(uint16_t value);
+uint16_t FloatToHalf(float value);
+
+// Returns true if the format can be decoded by CapturedImage::GetPixel
+bool IsCaptureFormatSupported(nvrhi::Format format);
+
+// PNG and BMP are written with stb_image_write as clamped 8-bit RGB. EXR stores uncompressed
+// 16-bit float RGBA, and raw files store the texture data unmodified behind a small header
+// (see RawImageHeader), which is the cheapest option for per-frame captures.
+bool WritePNG(const CapturedImage& image, const std::filesystem::path& fileName);
+bool WriteBMP(const CapturedImage& image, const std::filesystem::path& fileName);
+bool WriteEXR(const CapturedImage& image, const std::filesystem::path& fileName);
+bool WriteRaw(const CapturedImage& image, const std::filesystem::path& fileName);
+
+// Picks the encoder from the file extension: .png, .bmp, .exr, anything else is written raw
+bool WriteCapturedImage(const CapturedImage& image, const std::filesystem::path& fileName);
+
+struct RawImageHeader
+{
+    uint32_t magic; // 'RAWI'
+    uint32_t width;
+    uint32_t height;
+    uint32_t format; // nvrhi::Format
+    uint32_t bytesPerPixel;
+};
+
+// Reads a file written by WriteRaw
+bool ReadRaw(const std::filesystem::path& fileName, CapturedImage& image);
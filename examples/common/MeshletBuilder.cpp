@@ -0,0 +1,416 @@
+/*
+* Copyright (c) 2014-2021, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#include "MeshletBuilder.h"
+#include "HashBytes.h"
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <fstream>
+
+using namespace donut::math;
+
+// Bump when the output of BuildMeshlets changes, so that old cache entries are not reused
+static constexpr uint32_t c_MeshletBuilderVersion = 1;
+static constexpr uint32_t c_MeshletCacheMagic = 0x4c48534d; // 'MSHL'
+static constexpr uint8_t c_NotInMeshlet = 0xff;
+
+static_assert(sizeof(Meshlet) == 48, "Meshlet must match MeshletData in the shaders");
+static_assert(c_MaxMeshletVertices < c_NotInMeshlet, "Meshlet-local indices are stored in 8 bits");
+
+static void ComputeMeshletBounds(Meshlet& meshlet, const MeshletGeometry& geometry, const float3* positions, const float3* normals)
+{
+    float3 boxMin = positions[geometry.vertices[meshlet.vertexOffset]];
+    float3 boxMax = boxMin;
+    for (uint32_t i = 1; i < meshlet.vertexCount; i++)
+    {
+        const float3& position = positions[geometry.vertices[meshlet.vertexOffset + i]];
+        boxMin = min(boxMin, position);
+        boxMax = max(boxMax, position);
+    }
+
+    meshlet.center = (boxMin + boxMax) * 0.5f;
+    float radiusSquared = 0.f;
+    for (uint32_t i = 0; i < meshlet.vertexCount; i++)
+        radiusSquared = std::max(radiusSquared, lengthSquared(positions[geometry.vertices[meshlet.vertexOffset + i]] - meshlet.center));
+    meshlet.radius = std::sqrt(radiusSquared);
+
+    // Normal cone over the face normals; degenerate triangles do not contribute
+    std::array<float3, c_MaxMeshletTriangles> faceNormals;
+    uint32_t faceCount = 0;
+    float3 normalSum = 0.f;
+    for (uint32_t i = 0; i < meshlet.triangleCount; i++)
+    {
+        uint32_t packed = geometry.triangles[meshlet.triangleOffset + i];
+        uint32_t a = geometry.vertices[meshlet.vertexOffset + (packed & 0xff)];
+        uint32_t b = geometry.vertices[meshlet.vertexOffset + ((packed >> 8) & 0xff)];
+        uint32_t c = geometry.vertices[meshlet.vertexOffset + ((packed >> 16) & 0xff)];
+
+        float3 normal = cross(positions[b] - positions[a], positions[c] - positions[a]);
+        if (normals && dot(normal, normals[a] + normals[b] + normals[c]) < 0.f)
+            normal = -normal;
+
+        float len = length(normal);
+        if (len < 1e-12f)
+            continue;
+
+        faceNormals[faceCount++] = normal / len;
+        normalSum += normal / len;
+    }
+
+    meshlet.coneAxis = 0.f;
+    meshlet.coneCutoff = 1.f;
+
+    float sumLength = length(normalSum);
+    if (faceCount == 0 || sumLength < 1e-6f)
+        return;
+
+    float3 axis = normalSum / sumLength;
+    float minDot = 1.f;
+    for (uint32_t i = 0; i < faceCount; i++)
+        minDot = std::min(minDot, dot(faceNormals[i], axis));
+
+    // A cone wider than ~85 degrees almost never culls
+    if (minDot <= 0.1f)
+        return;
+
+    // All faces are back-facing when the view direction is within 90 degrees minus the cone angle of the axis
+    meshlet.coneAxis = axis;
+    meshlet.coneCutoff = std::sqrt(1.f - minDot * minDot);
+}
+
+MeshletGeometry BuildMeshlets(const uint32_t* indices, size_t indexCount, const float3* positions, size_t vertexCount, const float3* normals)
+{
+    const size_t triangleCount = indexCount / 3;
+
+    // Vertex to triangle adjacency in compressed rows
+    std::vector<uint32_t> adjacencyOffsets(vertexCount + 1, 0);
+    for (size_t i = 0; i < triangleCount * 3; i++)
+        ++adjacencyOffsets[indices[i] + 1];
+    for (size_t i = 0; i < vertexCount; i++)
+        adjacencyOffsets[i + 1] += adjacencyOffsets[i];
+
+    std::vector<uint32_t> adjacency(triangleCount * 3);
+    std::vector<uint32_t> adjacencyFill(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+    for (size_t i = 0; i < triangleCount * 3; i++)
+        adjacency[adjacencyFill[indices[i]]++] = uint32_t(i / 3);
+
+    MeshletGeometry geometry;
+    geometry.meshlets.reserve(triangleCount / c_MaxMeshletTriangles + 1);
+    geometry.triangles.reserve(triangleCount);
+
+    std::vector<uint8_t> localIndex(vertexCount, c_NotInMeshlet);
+    std::vector<bool> emitted(triangleCount, false);
+    std::vector<uint32_t> candidates;
+
+    Meshlet current = {};
+    float3 positionSum = 0.f;
+
+    auto countNewVertices = [&](uint32_t triangle)
+    {
+        const uint32_t* tri = indices + triangle * 3;
+        uint32_t count = 0;
+        for (int k = 0; k < 3; k++)
+        {
+            bool repeated = (k > 0 && tri[k] == tri[0]) || (k > 1 && tri[k] == tri[1]);
+            if (!repeated && localIndex[tri[k]] == c_NotInMeshlet)
+                ++count;
+        }
+        return count;
+    };
+
+    auto flush = [&]()
+    {
+        if (current.triangleCount == 0)
+            return;
+
+        ComputeMeshletBounds(current, geometry, positions, normals);
+        geometry.meshlets.push_back(current);
+
+        for (uint32_t i = 0; i < current.vertexCount; i++)
+            localIndex[geometry.vertices[current.vertexOffset + i]] = c_NotInMeshlet;
+
+        current = {};
+        positionSum = 0.f;
+        current.vertexOffset = uint32_t(geometry.vertices.size());
+        current.triangleOffset = uint32_t(geometry.triangles.size());
+        candidates.clear();
+    };
+
+    size_t seed = 0;
+    for (size_t emittedCount = 0; emittedCount < triangleCount; emittedCount++)
+    {
+        // Prefer the candidate that adds the fewest vertices, then the one closest to the meshlet centroid,
+        // which keeps meshlets round instead of growing along strips
+        const float3 centroid = current.vertexCount ? positionSum / float(current.vertexCount) : float3(0.f);
+        uint32_t best = ~0u;
+        uint32_t bestNewVertices = 4;
+        float bestDistance = 0.f;
+        size_t kept = 0;
+        for (size_t i = 0; i < candidates.size(); i++)
+        {
+            uint32_t triangle = candidates[i];
+            if (emitted[triangle])
+                continue;
+            candidates[kept++] = triangle;
+
+            uint32_t newVertices = countNewVertices(triangle);
+            if (newVertices > bestNewVertices)
+                continue;
+
+            const uint32_t* tri = indices + triangle * 3;
+            float distance = lengthSquared((positions[tri[0]] + positions[tri[1]] + positions[tri[2]]) * (1.f / 3.f) - centroid);
+            if (newVertices < bestNewVertices || distance < bestDistance || (distance == bestDistance && triangle < best))
+            {
+                best = triangle;
+                bestNewVertices = newVertices;
+                bestDistance = distance;
+            }
+        }
+        candidates.resize(kept);
+
+        if (best == ~0u)
+        {
+            while (emitted[seed])
+                ++seed;
+            best = uint32_t(seed);
+            bestNewVertices = countNewVertices(best);
+        }
+
+        if (current.vertexCount + bestNewVertices > c_MaxMeshletVertices || current.triangleCount == c_MaxMeshletTriangles)
+            flush();
+
+        const uint32_t* tri = indices + best * 3;
+        uint32_t packed = 0;
+        for (int k = 0; k < 3; k++)
+        {
+            uint32_t vertex = tri[k];
+            if (localIndex[vertex] == c_NotInMeshlet)
+            {
+                localIndex[vertex] = uint8_t(current.vertexCount++);
+                geometry.vertices.push_back(vertex);
+                positionSum += positions[vertex];
+
+                for (uint32_t a = adjacencyOffsets[vertex]; a < adjacencyOffsets[vertex + 1]; a++)
+                {
+                    if (!emitted[adjacency[a]])
+                        candidates.push_back(adjacency[a]);
+                }
+            }
+            packed |= uint32_t(localIndex[vertex]) << (k * 8);
+        }
+
+        geometry.triangles.push_back(packed);
+        ++current.triangleCount;
+        emitted[best] = true;
+    }
+
+    flush();
+
+    return geometry;
+}
+
+std::string ValidateMeshlets(const MeshletGeometry& geometry, const uint32_t* indices, size_t indexCount, const float3* positions)
+{
+    // Triangles are compared with their winding preserved, rotated so that the smallest index comes first
+    auto canonical = [](uint32_t a, uint32_t b, uint32_t c)
+    {
+        if (b < a && b <= c)
+            return std::array<uint32_t, 3>{ b, c, a };
+        if (c < a && c < b)
+            return std::array<uint32_t, 3>{ c, a, b };
+        return std::array<uint32_t, 3>{ a, b, c };
+    };
+
+    std::vector<std::array<uint32_t, 3>> expected;
+    expected.reserve(indexCount / 3);
+    for (size_t i = 0; i + 2 < indexCount; i += 3)
+        expected.push_back(canonical(indices[i], indices[i + 1], indices[i + 2]));
+
+    std::vector<std::array<uint32_t, 3>> actual;
+    actual.reserve(expected.size());
+
+    for (size_t m = 0; m < geometry.meshlets.size(); m++)
+    {
+        const Meshlet& meshlet = geometry.meshlets[m];
+        const std::string name = "meshlet " + std::to_string(m);
+
+        if (meshlet.vertexCount == 0 || meshlet.vertexCount > c_MaxMeshletVertices)
+            return name + " has " + std::to_string(meshlet.vertexCount) + " vertices";
+        if (meshlet.triangleCount == 0 || meshlet.triangleCount > c_MaxMeshletTriangles)
+            return name + " has " + std::to_string(meshlet.triangleCount) + " triangles";
+        if (size_t(meshlet.vertexOffset) + meshlet.vertexCount > geometry.vertices.size() ||
+            size_t(meshlet.triangleOffset) + meshlet.triangleCount > geometry.triangles.size())
+            return name + " is out of range";
+
+        for (uint32_t i = 0; i < meshlet.vertexCount; i++)
+        {
+            const float3& position = positions[geometry.vertices[meshlet.vertexOffset + i]];
+            if (length(position - meshlet.center) > meshlet.radius * 1.0001f + 1e-6f)
+                return name + " has a vertex outside of its bounding sphere";
+        }
+
+        for (uint32_t i = 0; i < meshlet.triangleCount; i++)
+        {
+            uint32_t packed = geometry.triangles[meshlet.triangleOffset + i];
+            uint32_t local[3] = { packed & 0xff, (packed >> 8) & 0xff, (packed >> 16) & 0xff };
+            for (uint32_t k : local)
+            {
+                if (k >= meshlet.vertexCount)
+                    return name + " references a vertex outside of the meshlet";
+            }
+
+            actual.push_back(canonical(
+                geometry.vertices[meshlet.vertexOffset + local[0]],
+                geometry.vertices[meshlet.vertexOffset + local[1]],
+                geometry.vertices[meshlet.vertexOffset + local[2]]));
+        }
+    }
+
+    std::sort(expected.begin(), expected.end());
+    std::sort(actual.begin(), actual.end());
+    if (expected != actual)
+        return "the meshlet triangles differ from the input triangles";
+
+    return std::string();
+}
+
+void MeshletStats::Add(const MeshletGeometry& geometry, size_t vertexCount)
+{
+    meshlets += geometry.meshlets.size();
+    triangles += geometry.triangles.size();
+    meshletVertices += geometry.vertices.size();
+    sourceVertices += vertexCount;
+}
+
+uint64_t HashMeshletInput(const uint32_t* indices, size_t indexCount, const float3* positions, size_t vertexCount, const float3* normals)
+{
+    uint64_t hash = c_HashBytesSeed;
+    hash = HashBytes(hash, &c_MeshletBuilderVersion, sizeof(c_MeshletBuilderVersion));
+    hash = HashBytes(hash, indices, indexCount * sizeof(uint32_t));
+    hash = HashBytes(hash, positions, vertexCount * sizeof(float3));
+    if (normals)
+        hash = HashBytes(hash, normals, vertexCount * sizeof(float3));
+    return hash;
+}
+
+struct MeshletCacheHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t entryCount;
+    uint32_t reserved;
+};
+
+struct MeshletCacheEntryHeader
+{
+    uint64_t hash;
+    uint32_t meshletCount;
+    uint32_t vertexCount;
+    uint32_t triangleCount;
+    uint32_t reserved;
+};
+
+template<typename T>
+static bool ReadArray(std::ifstream& file, std::vector<T>& data, size_t count)
+{
+    data.resize(count);
+    file.read(reinterpret_cast<char*>(data.data()), std::streamsize(count * sizeof(T)));
+    return bool(file);
+}
+
+bool MeshletCache::Load(const std::filesystem::path& fileName)
+{
+    std::ifstream file(fileName, std::ios::binary);
+    if (!file)
+        return false;
+
+    MeshletCacheHeader header = {};
+    file.read(reinterpret_cast<char*>(&header), sizeof(header));
+    if (!file || header.magic != c_MeshletCacheMagic || header.version != c_MeshletBuilderVersion)
+        return false;
+
+    std::unordered_map<uint64_t, MeshletGeometry> entries;
+    for (uint32_t i = 0; i < header.entryCount; i++)
+    {
+        MeshletCacheEntryHeader entryHeader = {};
+        file.read(reinterpret_cast<char*>(&entryHeader), sizeof(entryHeader));
+        if (!file)
+            return false;
+
+        MeshletGeometry geometry;
+        if (!ReadArray(file, geometry.meshlets, entryHeader.meshletCount) ||
+            !ReadArray(file, geometry.vertices, entryHeader.vertexCount) ||
+            !ReadArray(file, geometry.triangles, entryHeader.triangleCount))
+            return false;
+
+        entries[entryHeader.hash] = std::move(geometry);
+    }
+
+    m_Entries = std::move(entries);
+    m_Dirty = false;
+    return true;
+}
+
+bool MeshletCache::Save(const std::filesystem::path& fileName) const
+{
+    // Write to a temporary file first so that an interrupted save does not leave a truncated cache
+    std::filesystem::path tempFileName = fileName;
+    tempFileName += ".tmp";
+
+    {
+        std::ofstream file(tempFileName, std::ios::binary | std::ios::trunc);
+        if (!file)
+            return false;
+
+        MeshletCacheHeader header = { c_MeshletCacheMagic, c_MeshletBuilderVersion, uint32_t(m_Entries.size()), 0 };
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+        for (const auto& [hash, geometry] : m_Entries)
+        {
+            MeshletCacheEntryHeader entryHeader = { hash, uint32_t(geometry.meshlets.size()), uint32_t(geometry.vertices.size()), uint32_t(geometry.triangles.size()), 0 };
+            file.write(reinterpret_cast<const char*>(&entryHeader), sizeof(entryHeader));
+            file.write(reinterpret_cast<const char*>(geometry.meshlets.data()), std::streamsize(geometry.meshlets.size() * sizeof(Meshlet)));
+            file.write(reinterpret_cast<const char*>(geometry.vertices.data()), std::streamsize(geometry.vertices.size() * sizeof(uint32_t)));
+            file.write(reinterpret_cast<const char*>(geometry.triangles.data()), std::streamsize(geometry.triangles.size() * sizeof(uint32_t)));
+        }
+
+        if (!file)
+            return false;
+    }
+
+    std::error_code error;
+    std::filesystem::rename(tempFileName, fileName, error);
+    return !error;
+}
+
+const MeshletGeometry* MeshletCache::Find(uint64_t hash) const
+{
+    auto it = m_Entries.find(hash);
+    return it != m_Entries.end() ? &it->second : nullptr;
+}
+
+void MeshletCache::Insert(uint64_t hash, MeshletGeometry geometry)
+{
+    m_Entries[hash] = std::move(geometry);
+    m_Dirty = true;
+}
@@ -0,0 +1,100 @@
+/*
+* Copyright (c) 2014-2021, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#pragma once
+
+#include <donut/core/math/math.h>
+#include <filesystem>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+constexpr uint32_t c_MaxMeshletVertices = 64;
+constexpr uint32_t c_MaxMeshletTriangles = 124;
+
+// GPU layout, mirrored by MeshletData in the meshlets example shaders
+struct Meshlet
+{
+    uint32_t vertexOffset;   // into MeshletGeometry::vertices
+    uint32_t triangleOffset; // into MeshletGeometry::triangles
+    uint32_t vertexCount;
+    uint32_t triangleCount;
+    donut::math::float3 center; // bounding sphere, object space
+    float radius;
+    donut::math::float3 coneAxis; // normal cone; a zero axis never culls
+    float coneCutoff;
+};
+
+struct MeshletGeometry
+{
+    std::vector<Meshlet> meshlets;
+    std::vector<uint32_t> vertices;  // indices into the source vertex range
+    std::vector<uint32_t> triangles; // three 8-bit meshlet-local indices per triangle
+};
+
+// Splits an indexed triangle list into meshlets of at most c_MaxMeshletVertices vertices and
+// c_MaxMeshletTriangles triangles. Triangles are added greedily, preferring those that share the most
+// vertices with the current meshlet. When normals are given, they orient the face normals of the cone;
+// otherwise counter-clockwise triangles face outwards.
+MeshletGeometry BuildMeshlets(
+    const uint32_t* indices, size_t indexCount,
+    const donut::math::float3* positions, size_t vertexCount,
+    const donut::math::float3* normals = nullptr);
+
+// Checks the limits and that every input triangle appears exactly once. Returns an empty string on success.
+std::string ValidateMeshlets(const MeshletGeometry& geometry, const uint32_t* indices, size_t indexCount, const donut::math::float3* positions);
+
+struct MeshletStats
+{
+    uint64_t meshlets = 0;
+    uint64_t triangles = 0;
+    uint64_t meshletVertices = 0; // vertices transformed by the mesh shaders
+    uint64_t sourceVertices = 0;
+
+    void Add(const MeshletGeometry& geometry, size_t vertexCount);
+
+    // Triangles per transformed vertex; an ideal closed mesh approaches 2
+    [[nodiscard]] double GetVertexReuse() const { return meshletVertices ? double(triangles) / double(meshletVertices) : 0.0; }
+    // Transformed vertices over unique vertices, 1 when nothing is duplicated across meshlets
+    [[nodiscard]] double GetVertexDuplication() const { return sourceVertices ? double(meshletVertices) / double(sourceVertices) : 0.0; }
+};
+
+// Hash of the builder input, used as the cache key
+uint64_t HashMeshletInput(const uint32_t* indices, size_t indexCount, const donut::math::float3* positions, size_t vertexCount, const donut::math::float3* normals);
+
+// Binary file of built meshlets keyed by input hash, so that scenes only pay for the build once
+class MeshletCache
+{
+public:
+    bool Load(const std::filesystem::path& fileName);
+    bool Save(const std::filesystem::path& fileName) const;
+
+    [[nodiscard]] const MeshletGeometry* Find(uint64_t hash) const;
+    void Insert(uint64_t hash, MeshletGeometry geometry);
+
+    [[nodiscard]] bool IsDirty() const { return m_Dirty; }
+    [[nodiscard]] size_t GetEntryCount() const { return m_Entries.size(); }
+
+private:
+    std::unordered_map<uint64_t, MeshletGeometry> m_Entries;
+    bool m_Dirty = false;
+};
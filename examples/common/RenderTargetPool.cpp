@@ -0,0 +1,368 @@
+/*
+* Copyright (c) 2014-2021, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#include "RenderTargetPool.h"
+#include <algorithm>
+
+static bool AreTextureDescsEqual(const nvrhi::TextureDesc& a, const nvrhi::TextureDesc& b)
+{
+    return a.width == b.width
+        && a.height == b.height
+        && a.depth == b.depth
+        && a.arraySize == b.arraySize
+        && a.mipLevels == b.mipLevels
+        && a.sampleCount == b.sampleCount
+        && a.sampleQuality == b.sampleQuality
+        && a.format == b.format
+        && a.dimension == b.dimension
+        && a.debugName == b.debugName
+        && a.isShaderResource == b.isShaderResource
+        && a.isRenderTarget == b.isRenderTarget
+        && a.isUAV == b.isUAV
+        && a.isTypeless == b.isTypeless
+        && a.useClearValue == b.useClearValue
+        && (!a.useClearValue || (a.clearValue.r == b.clearValue.r && a.clearValue.g == b.clearValue.g
+            && a.clearValue.b == b.clearValue.b && a.clearValue.a == b.clearValue.a))
+        && a.initialState == b.initialState
+        && a.keepInitialState == b.keepInitialState;
+}
+
+static bool AreAttachmentsEqual(const nvrhi::FramebufferAttachment& a, const nvrhi::FramebufferAttachment& b)
+{
+    return a.texture == b.texture
+        && a.subresources == b.subresources
+        && a.format == b.format
+        && a.isReadOnly == b.isReadOnly;
+}
+
+static bool AreFramebufferDescsEqual(const nvrhi::FramebufferDesc& a, const nvrhi::FramebufferDesc& b)
+{
+    if (a.colorAttachments.size() != b.colorAttachments.size())
+        return false;
+
+    for (size_t i = 0; i < a.colorAttachments.size(); i++)
+    {
+        if (!AreAttachmentsEqual(a.colorAttachments[i], b.colorAttachments[i]))
+            return false;
+    }
+
+    return AreAttachmentsEqual(a.depthAttachment, b.depthAttachment);
+}
+
+static bool ReferencesTexture(const nvrhi::FramebufferDesc& desc, nvrhi::ITexture* texture)
+{
+    if (desc.depthAttachment.texture == texture)
+        return true;
+
+    return std::any_of(desc.colorAttachments.begin(), desc.colorAttachments.end(),
+        [texture](const nvrhi::FramebufferAttachment& attachment) { return attachment.texture == texture; });
+}
+
+bool IsFramebufferCompatible(const nvrhi::FramebufferInfo& pipelineInfo, const nvrhi::FramebufferInfo& framebufferInfo, bool compareSize)
+{
+    if (compareSize && (pipelineInfo.width != framebufferInfo.width || pipelineInfo.height != framebufferInfo.height))
+        return false;
+
+    if (pipelineInfo.colorFormats.size() != framebufferInfo.colorFormats.size())
+        return false;
+
+    for (size_t i = 0; i < pipelineInfo.colorFormats.size(); i++)
+    {
+        if (pipelineInfo.colorFormats[i] != framebufferInfo.colorFormats[i])
+            return false;
+    }
+
+    return pipelineInfo.depthFormat == framebufferInfo.depthFormat
+        && pipelineInfo.sampleCount == framebufferInfo.sampleCount
+        && pipelineInfo.sampleQuality == framebufferInfo.sampleQuality;
+}
+
+RenderTargetPool::RenderTargetPool(nvrhi::IDevice* device, uint32_t maxIdleFrames, uint64_t idleBudget)
+    : m_Device(device)
+    , m_VirtualResources(device->queryFeatureSupport(nvrhi::Feature::VirtualResources))
+    , m_MaxIdleFrames(maxIdleFrames)
+    , m_IdleBudget(idleBudget)
+{
+}
+
+uint64_t RenderTargetPool::GetSizeBucket(uint64_t size)
+{
+    constexpr uint64_t minBucket = 64 * 1024;
+    if (size <= minBucket)
+        return minBucket;
+
+    // Keep the top 4 bits: 8..15 times a power of two
+    int shift = 0;
+    while ((size >> shift) >= 16)
+        shift++;
+    uint64_t mantissa = (size + (1ull << shift) - 1) >> shift;
+    return mantissa << shift;
+}
+
+nvrhi::HeapHandle RenderTargetPool::AllocateHeap(uint64_t bucket)
+{
+    // The smallest free heap that fits without wasting more than a bucket step, and that no frame in flight uses
+    HeapEntry* best = nullptr;
+    for (HeapEntry& entry : m_Heaps)
+    {
+        if (entry.inUse || entry.capacity < bucket || entry.capacity > bucket * 2 || entry.lastUsedFrame > m_CompletedFrame)
+            continue;
+
+        if (!best || entry.capacity < best->capacity)
+            best = &entry;
+    }
+
+    if (best)
+    {
+        best->inUse = true;
+        m_Stats.heapsReused++;
+        return best->heap;
+    }
+
+    nvrhi::HeapDesc heapDesc;
+    heapDesc.capacity = bucket;
+    heapDesc.type = nvrhi::HeapType::DeviceLocal;
+    heapDesc.debugName = "RenderTargetPool";
+
+    HeapEntry entry;
+    entry.heap = m_Device->createHeap(heapDesc);
+    if (!entry.heap)
+        return nullptr;
+
+    entry.capacity = bucket;
+    entry.inUse = true;
+    m_Heaps.push_back(entry);
+    m_Stats.heapsCreated++;
+    m_Stats.pooledBytes += bucket;
+    return entry.heap;
+}
+
+nvrhi::TextureHandle RenderTargetPool::AcquireTexture(const nvrhi::TextureDesc& desc)
+{
+    for (TextureEntry& entry : m_Textures)
+    {
+        if (!entry.inUse && AreTextureDescsEqual(entry.desc, desc))
+        {
+            entry.inUse = true;
+            m_Stats.texturesReused++;
+            return entry.texture;
+        }
+    }
+
+    TextureEntry entry;
+    entry.desc = desc;
+
+    if (m_VirtualResources)
+    {
+        nvrhi::TextureDesc virtualDesc = desc;
+        virtualDesc.isVirtual = true;
+        entry.texture = m_Device->createTexture(virtualDesc);
+
+        if (entry.texture)
+        {
+            nvrhi::MemoryRequirements requirements = m_Device->getTextureMemoryRequirements(entry.texture);
+            entry.size = requirements.size;
+            entry.heap = AllocateHeap(GetSizeBucket(requirements.size));
+
+            if (!entry.heap || !m_Device->bindTextureMemory(entry.texture, entry.heap, 0))
+            {
+                if (entry.heap)
+                {
+                    auto heapEntry = std::find_if(m_Heaps.begin(), m_Heaps.end(),
+                        [&entry](const HeapEntry& heap) { return heap.heap == entry.heap; });
+                    heapEntry->inUse = false;
+                }
+                entry.texture = nullptr;
+                entry.heap = nullptr;
+            }
+        }
+    }
+
+    // No virtual resources, or the placement failed: a committed texture that is only reused by its desc
+    if (!entry.texture)
+    {
+        entry.texture = m_Device->createTexture(desc);
+        if (!entry.texture)
+            return nullptr;
+
+        entry.size = m_Device->getTextureMemoryRequirements(entry.texture).size;
+        m_Stats.pooledBytes += entry.size;
+    }
+
+    entry.inUse = true;
+    m_Textures.push_back(entry);
+    m_Stats.texturesCreated++;
+    return entry.texture;
+}
+
+nvrhi::HeapHandle RenderTargetPool::AcquireHeap(uint64_t capacity)
+{
+    return AllocateHeap(GetSizeBucket(capacity));
+}
+
+nvrhi::FramebufferHandle RenderTargetPool::AcquireFramebuffer(const nvrhi::FramebufferDesc& desc)
+{
+    for (const FramebufferEntry& entry : m_Framebuffers)
+    {
+        if (AreFramebufferDescsEqual(entry.desc, desc))
+        {
+            m_Stats.framebuffersReused++;
+            return entry.framebuffer;
+        }
+    }
+
+    FramebufferEntry entry;
+    entry.desc = desc;
+    entry.framebuffer = m_Device->createFramebuffer(desc);
+    if (!entry.framebuffer)
+        return nullptr;
+
+    m_Framebuffers.push_back(entry);
+    m_Stats.framebuffersCreated++;
+    return entry.framebuffer;
+}
+
+void RenderTargetPool::ReleaseAll()
+{
+    // The current frame may still record work that uses the released resources
+    for (TextureEntry& entry : m_Textures)
+    {
+        if (entry.inUse)
+        {
+            entry.inUse = false;
+            entry.lastUsedFrame = m_Frame;
+        }
+    }
+
+    for (HeapEntry& entry : m_Heaps)
+    {
+        // Heaps behind pooled textures stay reserved until the texture is evicted
+        bool ownedByTexture = std::any_of(m_Textures.begin(), m_Textures.end(),
+            [&entry](const TextureEntry& texture) { return texture.heap == entry.heap; });
+
+        if (entry.inUse && !ownedByTexture)
+        {
+            entry.inUse = false;
+            entry.lastUsedFrame = m_Frame;
+        }
+    }
+}
+
+void RenderTargetPool::EvictTexture(size_t index)
+{
+    TextureEntry& entry = m_Textures[index];
+
+    m_Framebuffers.erase(std::remove_if(m_Framebuffers.begin(), m_Framebuffers.end(),
+        [&entry](const FramebufferEntry& framebuffer) { return ReferencesTexture(framebuffer.desc, entry.texture); }),
+        m_Framebuffers.end());
+
+    if (entry.heap)
+    {
+        for (HeapEntry& heap : m_Heaps)
+        {
+            if (heap.heap == entry.heap)
+            {
+                heap.inUse = false;
+                heap.lastUsedFrame = std::max(heap.lastUsedFrame, entry.lastUsedFrame);
+            }
+        }
+    }
+    else
+        m_Stats.pooledBytes -= entry.size;
+
+    m_Textures.erase(m_Textures.begin() + ptrdiff_t(index));
+}
+
+void RenderTargetPool::EvictIdleTextures()
+{
+    uint64_t idleBytes = 0;
+    for (const TextureEntry& entry : m_Textures)
+    {
+        if (!entry.inUse)
+            idleBytes += entry.size;
+    }
+
+    // Oldest first, until the remaining idle textures are recent and fit the budget
+    while (true)
+    {
+        size_t oldest = m_Textures.size();
+        for (size_t i = 0; i < m_Textures.size(); i++)
+        {
+            if (!m_Textures[i].inUse && (oldest == m_Textures.size() || m_Textures[i].lastUsedFrame < m_Textures[oldest].lastUsedFrame))
+                oldest = i;
+        }
+
+        if (oldest == m_Textures.size())
+            break;
+
+        bool expired = m_Textures[oldest].lastUsedFrame + m_MaxIdleFrames < m_Frame;
+        if (!expired && idleBytes <= m_IdleBudget)
+            break;
+
+        idleBytes -= m_Textures[oldest].size;
+        EvictTexture(oldest);
+    }
+
+    // Free heaps are only kept while they are likely to be needed again
+    uint64_t freeHeapBytes = 0;
+    for (auto it = m_Heaps.begin(); it != m_Heaps.end(); )
+    {
+        bool expired = it->lastUsedFrame + m_MaxIdleFrames < m_Frame && it->lastUsedFrame <= m_CompletedFrame;
+        if (!it->inUse && (expired || freeHeapBytes + it->capacity > m_IdleBudget))
+        {
+            m_Stats.pooledBytes -= it->capacity;
+            it = m_Heaps.erase(it);
+            continue;
+        }
+
+        if (!it->inUse)
+            freeHeapBytes += it->capacity;
+        ++it;
+    }
+}
+
+void RenderTargetPool::EndFrame()
+{
+    nvrhi::EventQueryHandle query;
+    if (!m_FreeQueries.empty())
+    {
+        query = m_FreeQueries.back();
+        m_FreeQueries.pop_back();
+    }
+    else
+        query = m_Device->createEventQuery();
+
+    m_Device->setEventQuery(query, nvrhi::CommandQueue::Graphics);
+    m_PendingFrames.push_back({ m_Frame, query });
+
+    while (!m_PendingFrames.empty() && m_Device->pollEventQuery(m_PendingFrames.front().query))
+    {
+        m_CompletedFrame = m_PendingFrames.front().frame;
+        m_Device->resetEventQuery(m_PendingFrames.front().query);
+        m_FreeQueries.push_back(m_PendingFrames.front().query);
+        m_PendingFrames.pop_front();
+    }
+
+    m_Frame++;
+
+    EvictIdleTextures();
+}
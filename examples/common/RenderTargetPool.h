@@ -0,0 +1,135 @@
+/*
+* Copyright (c) 2014-2021, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#pragma once
+
+#include <nvrhi/nvrhi.h>
+#include <deque>
+#include <vector>
+
+// Recycles render targets and their memory across resizes and mode changes.
+//
+// Usage:
+//   pool.ReleaseAll();                         // instead of dropping the render targets on a resize
+//   texture = pool.AcquireTexture(desc);       // same desc as before: the same texture comes back
+//   framebuffer = pool.AcquireFramebuffer(fb); // same attachments: the same framebuffer comes back
+//   device->executeCommandList(commandList);
+//   pool.EndFrame();                           // once per frame after the frame's work was submitted
+//
+// A released texture is handed out again when a texture with the same desc, including the debug name,
+// is requested, so switching back to an earlier size or mode allocates nothing. Other textures are
+// created as virtual resources, when the device supports them, and placed in heaps whose capacity is
+// rounded up to a size bucket. When an unused texture is evicted, its heap goes back to the pool and
+// can hold any texture of the same bucket once the GPU has finished the frames that used it, so a
+// continuous resize settles on a few heaps instead of allocating every frame.
+class RenderTargetPool
+{
+public:
+    struct Stats
+    {
+        uint64_t texturesReused = 0;
+        uint64_t texturesCreated = 0;
+        uint64_t heapsReused = 0;
+        uint64_t heapsCreated = 0;
+        uint64_t framebuffersReused = 0;
+        uint64_t framebuffersCreated = 0;
+        uint64_t pooledBytes = 0; // memory of the heaps owned by the pool, in use or not
+    };
+
+    // Unused textures are evicted after maxIdleFrames, or earlier when they hold more than idleBudget bytes
+    explicit RenderTargetPool(nvrhi::IDevice* device, uint32_t maxIdleFrames = 300, uint64_t idleBudget = 256ull << 20);
+
+    RenderTargetPool(const RenderTargetPool&) = delete;
+    RenderTargetPool& operator=(const RenderTargetPool&) = delete;
+
+    nvrhi::TextureHandle AcquireTexture(const nvrhi::TextureDesc& desc);
+
+    // Returns a heap of at least the given capacity for resources that the caller places itself
+    nvrhi::HeapHandle AcquireHeap(uint64_t capacity);
+
+    nvrhi::FramebufferHandle AcquireFramebuffer(const nvrhi::FramebufferDesc& desc);
+
+    // Makes every acquired texture and heap available again. The caller must drop its references.
+    void ReleaseAll();
+
+    // Must be called once per frame after the frame's command lists were executed
+    void EndFrame();
+
+    [[nodiscard]] const Stats& GetStats() const { return m_Stats; }
+
+    // Heap capacities are rounded up to 8 steps per power of two, so at most 12.5% is wasted
+    static uint64_t GetSizeBucket(uint64_t size);
+
+private:
+    struct HeapEntry
+    {
+        nvrhi::HeapHandle heap;
+        uint64_t capacity = 0;
+        uint64_t lastUsedFrame = 0;
+        bool inUse = false;
+    };
+
+    struct TextureEntry
+    {
+        nvrhi::TextureDesc desc;
+        nvrhi::TextureHandle texture;
+        nvrhi::HeapHandle heap; // null for committed textures
+        uint64_t size = 0;
+        uint64_t lastUsedFrame = 0;
+        bool inUse = false;
+    };
+
+    struct FramebufferEntry
+    {
+        nvrhi::FramebufferDesc desc;
+        nvrhi::FramebufferHandle framebuffer;
+    };
+
+    struct FrameQuery
+    {
+        uint64_t frame = 0;
+        nvrhi::EventQueryHandle query;
+    };
+
+    nvrhi::DeviceHandle m_Device;
+    bool m_VirtualResources = false;
+    uint32_t m_MaxIdleFrames;
+    uint64_t m_IdleBudget;
+
+    std::vector<TextureEntry> m_Textures;
+    std::vector<HeapEntry> m_Heaps;
+    std::vector<FramebufferEntry> m_Framebuffers;
+    std::deque<FrameQuery> m_PendingFrames;
+    std::vector<nvrhi::EventQueryHandle> m_FreeQueries;
+
+    uint64_t m_Frame = 1;
+    uint64_t m_CompletedFrame = 0; // every frame up to this one has finished on the GPU
+    Stats m_Stats;
+
+    nvrhi::HeapHandle AllocateHeap(uint64_t bucket);
+    void EvictTexture(size_t index);
+    void EvictIdleTextures();
+};
+
+// True if a pipeline created for one framebuffer can render into the other: same formats and sample count.
+// The NVRHI validation layer also compares the framebuffer size, so pass compareSize when it is enabled.
+bool IsFramebufferCompatible(const nvrhi::FramebufferInfo& pipelineInfo, const nvrhi::FramebufferInfo& framebufferInfo, bool compareSize);
@@ -0,0 +1,612 @@
+/*
+* Copyright (c) 2014-2021, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#include "ScenePack.h"
+#include "HashBytes.h"
+#include <donut/engine/SceneGraph.h>
+#include <donut/engine/TextureCache.h>
+#include <donut/core/vfs/VFS.h>
+#include <donut/core/json.h>
+#include <donut/core/log.h>
+#include <algorithm>
+#include <cctype>
+#include <cfloat>
+#include <cstring>
+#include <fstream>
+
+using namespace donut::math;
+using namespace donut::engine;
+
+static_assert(sizeof(ScenePackVertex) == 28, "ScenePackVertex is read in place from the mapped file");
+static_assert(sizeof(ScenePackInstance) == 64, "ScenePackInstance is read in place from the mapped file");
+static_assert(sizeof(affine3) == sizeof(ScenePackInstance::transform), "affine3 is stored as 12 floats");
+
+static constexpr uint64_t c_ScenePackAlignment = 16;
+
+static uint64_t HashFileStamp(uint64_t hash, const std::filesystem::path& fileName)
+{
+    std::error_code error;
+    uint64_t size = std::filesystem::file_size(fileName, error);
+    auto writeTime = std::filesystem::last_write_time(fileName, error).time_since_epoch().count();
+
+    std::string name = fileName.generic_string();
+    hash = HashBytes(hash, name.data(), name.size());
+    hash = HashBytes(hash, &size, sizeof(size));
+    hash = HashBytes(hash, &writeTime, sizeof(writeTime));
+    return hash;
+}
+
+static std::string GetLowerCaseExtension(const std::filesystem::path& fileName)
+{
+    std::string extension = fileName.extension().string();
+    std::transform(extension.begin(), extension.end(), extension.begin(), [](char c) { return char(std::tolower(c)); });
+    return extension;
+}
+
+// glTF URIs are percent-encoded, e.g. %20 for a space
+static std::string DecodeUri(const std::string& uri)
+{
+    std::string decoded;
+    decoded.reserve(uri.size());
+    for (size_t i = 0; i < uri.size(); i++)
+    {
+        if (uri[i] == '%' && i + 2 < uri.size() && std::isxdigit((unsigned char)uri[i + 1]) && std::isxdigit((unsigned char)uri[i + 2]))
+        {
+            decoded.push_back(char(std::stoi(uri.substr(i + 1, 2), nullptr, 16)));
+            i += 2;
+        }
+        else
+            decoded.push_back(uri[i]);
+    }
+    return decoded;
+}
+
+// Stamps a model file and, for a .gltf, the buffer and image files that it references.
+// Data URIs and the chunks of a .glb are stored in the model file itself.
+static uint64_t HashModelFiles(uint64_t hash, const std::filesystem::path& modelFileName, donut::vfs::IFileSystem& fs)
+{
+    hash = HashFileStamp(hash, modelFileName);
+
+    if (GetLowerCaseExtension(modelFileName) != ".gltf")
+        return hash;
+
+    Json::Value root;
+    if (!donut::json::LoadFromFile(fs, modelFileName, root))
+        return hash;
+
+    for (const char* section : { "buffers", "images" })
+    {
+        for (const auto& node : root[section])
+        {
+            std::string uri = node["uri"].asString();
+            if (uri.empty() || uri.compare(0, 5, "data:") == 0)
+                continue;
+
+            hash = HashFileStamp(hash, modelFileName.parent_path() / DecodeUri(uri));
+        }
+    }
+
+    return hash;
+}
+
+uint64_t HashScenePackSource(const std::filesystem::path& sceneFileName)
+{
+    uint64_t hash = c_HashBytesSeed;
+    hash = HashBytes(hash, &c_ScenePackVersion, sizeof(c_ScenePackVersion));
+
+    donut::vfs::NativeFileSystem fs;
+
+    // A model file can be loaded as the scene directly
+    const std::string extension = GetLowerCaseExtension(sceneFileName);
+    if (extension == ".gltf" || extension == ".glb")
+        return HashModelFiles(hash, sceneFileName, fs);
+
+    hash = HashFileStamp(hash, sceneFileName);
+
+    // Scene files list their models by path relative to the scene file
+    Json::Value root;
+    if (!donut::json::LoadFromFile(fs, sceneFileName, root))
+        return hash;
+
+    for (const auto& model : root["models"])
+    {
+        if (model.isString())
+            hash = HashModelFiles(hash, sceneFileName.parent_path() / model.asString(), fs);
+    }
+
+    return hash;
+}
+
+uint32_t ScenePackBuilder::AddString(const std::string& string)
+{
+    uint32_t offset = uint32_t(m_Strings.size());
+    m_Strings.insert(m_Strings.end(), string.begin(), string.end());
+    m_Strings.push_back(0);
+    return offset;
+}
+
+uint32_t ScenePackBuilder::AddMaterial(const std::shared_ptr<Material>& material)
+{
+    if (!material)
+        return c_ScenePackNone;
+
+    auto it = m_MaterialIndices.find(material.get());
+    if (it != m_MaterialIndices.end())
+        return it->second;
+
+    ScenePackMaterial packed{};
+    packed.name = AddString(material->name);
+    packed.domain = uint32_t(material->domain);
+    packed.flags = (material->doubleSided ? ScenePackMaterial_DoubleSided : 0)
+        | (material->useSpecularGlossModel ? ScenePackMaterial_SpecularGloss : 0);
+    packed.opacity = material->opacity;
+    std::memcpy(packed.baseOrDiffuseColor, &material->baseOrDiffuseColor, sizeof(packed.baseOrDiffuseColor));
+    packed.metalness = material->metalness;
+    std::memcpy(packed.emissiveColor, &material->emissiveColor, sizeof(packed.emissiveColor));
+    packed.roughness = material->roughness;
+    packed.emissiveIntensity = material->emissiveIntensity;
+    packed.alphaCutoff = material->alphaCutoff;
+    packed.normalTextureScale = material->normalTextureScale;
+    packed.occlusionStrength = material->occlusionStrength;
+
+    const std::shared_ptr<LoadedTexture>* textures[ScenePackTexture_Count] = {
+        &material->baseOrDiffuseTexture,
+        &material->metalRoughOrSpecularTexture,
+        &material->normalTexture,
+        &material->emissiveTexture,
+        &material->occlusionTexture
+    };
+    for (uint32_t slot = 0; slot < ScenePackTexture_Count; slot++)
+        packed.textures[slot] = *textures[slot] ? AddString((*textures[slot])->path) : c_ScenePackNone;
+
+    uint32_t index = uint32_t(m_Materials.size());
+    m_Materials.push_back(packed);
+    m_MaterialIndices[material.get()] = index;
+    return index;
+}
+
+uint32_t ScenePackBuilder::AddMesh(const MeshInfo& mesh)
+{
+    auto it = m_MeshIndices.find(&mesh);
+    if (it != m_MeshIndices.end())
+        return it->second;
+
+    const auto& buffers = mesh.buffers;
+
+    ScenePackMesh packedMesh{};
+    packedMesh.name = AddString(mesh.name);
+    packedMesh.firstGeometry = uint32_t(m_Geometries.size());
+    packedMesh.geometryCount = uint32_t(mesh.geometries.size());
+
+    std::vector<float3> normals;
+
+    for (const auto& geometry : mesh.geometries)
+    {
+        const uint32_t* indices = buffers->indexData.data() + mesh.indexOffset + geometry->indexOffsetInMesh;
+        const uint32_t vertexOffset = mesh.vertexOffset + geometry->vertexOffsetInMesh;
+        const float3* positions = buffers->positionData.data() + vertexOffset;
+
+        ScenePackGeometry packedGeometry{};
+        packedGeometry.firstIndex = uint32_t(m_Indices.size());
+        packedGeometry.indexCount = geometry->numIndices;
+        packedGeometry.firstVertex = uint32_t(m_Vertices.size());
+        packedGeometry.vertexCount = geometry->numVertices;
+        packedGeometry.material = AddMaterial(geometry->material);
+        packedGeometry.firstMeshlet = uint32_t(m_Meshlets.size());
+
+        // Indices stay relative to the geometry, as in Donut's index buffers
+        m_Indices.insert(m_Indices.end(), indices, indices + geometry->numIndices);
+
+        for (uint32_t i = 0; i < geometry->numVertices; i++)
+        {
+            ScenePackVertex vertex{};
+            std::memcpy(vertex.position, &positions[i], sizeof(vertex.position));
+            if (!buffers->normalData.empty())
+                vertex.normal = buffers->normalData[vertexOffset + i];
+            if (!buffers->tangentData.empty())
+                vertex.tangent = buffers->tangentData[vertexOffset + i];
+            if (!buffers->texcoord1Data.empty())
+                std::memcpy(vertex.texcoord, &buffers->texcoord1Data[vertexOffset + i], sizeof(vertex.texcoord));
+            m_Vertices.push_back(vertex);
+        }
+
+        if (m_BuildMeshlets)
+        {
+            // Normals are stored as RGBA8 SNORM; they only orient the face normals of the cones
+            const float3* normalData = nullptr;
+            if (!buffers->normalData.empty())
+            {
+                normals.resize(geometry->numVertices);
+                for (uint32_t i = 0; i < geometry->numVertices; i++)
+                {
+                    uint32_t packed = buffers->normalData[vertexOffset + i];
+                    normals[i] = float3(float(int8_t(packed & 0xff)), float(int8_t((packed >> 8) & 0xff)), float(int8_t((packed >> 16) & 0xff))) / 127.f;
+                }
+                normalData = normals.data();
+            }
+
+            MeshletGeometry built = BuildMeshlets(indices, geometry->numIndices, positions, geometry->numVertices, normalData);
+
+            // Rebase the meshlet offsets onto the pack-wide arrays
+            for (Meshlet meshlet : built.meshlets)
+            {
+                meshlet.vertexOffset += uint32_t(m_MeshletVertices.size());
+                meshlet.triangleOffset += uint32_t(m_MeshletTriangles.size());
+                m_Meshlets.push_back(meshlet);
+            }
+            m_MeshletVertices.insert(m_MeshletVertices.end(), built.vertices.begin(), built.vertices.end());
+            m_MeshletTriangles.insert(m_MeshletTriangles.end(), built.triangles.begin(), built.triangles.end());
+        }
+
+        packedGeometry.meshletCount = uint32_t(m_Meshlets.size()) - packedGeometry.firstMeshlet;
+        m_Geometries.push_back(packedGeometry);
+    }
+
+    uint32_t index = uint32_t(m_Meshes.size());
+    m_Meshes.push_back(packedMesh);
+    m_MeshIndices[&mesh] = index;
+    return index;
+}
+
+void ScenePackBuilder::AddSceneGraph(const SceneGraph& sceneGraph)
+{
+    for (const auto& instance : sceneGraph.GetMeshInstances())
+    {
+        const auto& mesh = instance->GetMesh();
+        const auto& buffers = mesh->buffers;
+        if (buffers->indexData.empty() || buffers->positionData.empty())
+        {
+            m_SkippedMeshes++;
+            continue;
+        }
+
+        ScenePackInstance packed{};
+        affine3 objectToWorld = instance->GetNode()->GetLocalToWorldTransformFloat();
+        std::memcpy(packed.transform, &objectToWorld, sizeof(packed.transform));
+        packed.mesh = AddMesh(*mesh);
+        packed.name = AddString(instance->GetNode()->GetName());
+        m_Instances.push_back(packed);
+    }
+}
+
+bool ScenePackBuilder::Write(const std::filesystem::path& fileName, uint64_t sourceHash) const
+{
+    struct SectionData
+    {
+        const void* data;
+        size_t count;
+        size_t stride;
+    };
+
+    const SectionData sections[ScenePackSection_Count] = {
+        { m_Vertices.data(), m_Vertices.size(), sizeof(ScenePackVertex) },
+        { m_Indices.data(), m_Indices.size(), sizeof(uint32_t) },
+        { m_Geometries.data(), m_Geometries.size(), sizeof(ScenePackGeometry) },
+        { m_Meshes.data(), m_Meshes.size(), sizeof(ScenePackMesh) },
+        { m_Instances.data(), m_Instances.size(), sizeof(ScenePackInstance) },
+        { m_Materials.data(), m_Materials.size(), sizeof(ScenePackMaterial) },
+        { m_Meshlets.data(), m_Meshlets.size(), sizeof(Meshlet) },
+        { m_MeshletVertices.data(), m_MeshletVertices.size(), sizeof(uint32_t) },
+        { m_MeshletTriangles.data(), m_MeshletTriangles.size(), sizeof(uint32_t) },
+        { m_Strings.data(), m_Strings.size(), sizeof(char) }
+    };
+
+    ScenePackHeader header{};
+    header.magic = c_ScenePackMagic;
+    header.version = c_ScenePackVersion;
+    header.sourceHash = sourceHash;
+
+    uint64_t offset = sizeof(ScenePackHeader);
+    for (uint32_t type = 0; type < ScenePackSection_Count; type++)
+    {
+        offset = (offset + c_ScenePackAlignment - 1) & ~(c_ScenePackAlignment - 1);
+        header.sections[type] = { offset, sections[type].count };
+        offset += sections[type].count * sections[type].stride;
+    }
+
+    // Write to a temporary file first so that an interrupted cook does not leave a truncated pack
+    std::filesystem::path tempFileName = fileName;
+    tempFileName += ".tmp";
+
+    {
+        std::ofstream file(tempFileName, std::ios::binary | std::ios::trunc);
+        if (!file)
+            return false;
+
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+        const char padding[c_ScenePackAlignment] = {};
+        uint64_t position = sizeof(header);
+        for (uint32_t type = 0; type < ScenePackSection_Count; type++)
+        {
+            file.write(padding, std::streamsize(header.sections[type].offset - position));
+            size_t size = sections[type].count * sections[type].stride;
+            file.write(static_cast<const char*>(sections[type].data), std::streamsize(size));
+            position = header.sections[type].offset + size;
+        }
+
+        if (!file)
+            return false;
+    }
+
+    std::error_code error;
+    std::filesystem::rename(tempFileName, fileName, error);
+    return !error;
+}
+
+bool ScenePack::Open(const std::filesystem::path& fileName)
+{
+    if (!m_File.Open(fileName))
+        return false;
+
+    std::string error = Validate();
+    if (!error.empty())
+    {
+        donut::log::warning("Scene pack '%s' is not usable: %s", fileName.generic_string().c_str(), error.c_str());
+        m_File.Close();
+        return false;
+    }
+
+    return true;
+}
+
+std::string ScenePack::Validate() const
+{
+    if (m_File.GetSize() < sizeof(ScenePackHeader))
+        return "file too small";
+
+    const ScenePackHeader& header = GetHeader();
+    if (header.magic != c_ScenePackMagic || header.version != c_ScenePackVersion)
+        return "unknown format or version";
+
+    const size_t strides[ScenePackSection_Count] = {
+        sizeof(ScenePackVertex), sizeof(uint32_t), sizeof(ScenePackGeometry), sizeof(ScenePackMesh), sizeof(ScenePackInstance),
+        sizeof(ScenePackMaterial), sizeof(Meshlet), sizeof(uint32_t), sizeof(uint32_t), sizeof(char)
+    };
+
+    for (uint32_t type = 0; type < ScenePackSection_Count; type++)
+    {
+        const ScenePackSection& section = header.sections[type];
+        if (section.offset % c_ScenePackAlignment != 0 || section.offset > m_File.GetSize()
+            || section.count > (m_File.GetSize() - section.offset) / strides[type])
+            return "section out of bounds";
+    }
+
+    // Check the ranges between records, so that readers can index without checks. The index and meshlet
+    // contents are not scanned; they are only consumed by GPU loads, which are bounds-checked.
+    auto strings = GetSection<char>(ScenePackSection_Strings);
+    if (strings.size() != 0 && strings[strings.size() - 1] != 0)
+        return "unterminated string section";
+
+    for (const auto& geometry : GetGeometries())
+    {
+        if (uint64_t(geometry.firstIndex) + geometry.indexCount > GetIndices().size()
+            || uint64_t(geometry.firstVertex) + geometry.vertexCount > GetVertices().size()
+            || uint64_t(geometry.firstMeshlet) + geometry.meshletCount > GetMeshlets().size()
+            || (geometry.material != c_ScenePackNone && geometry.material >= GetMaterials().size()))
+            return "geometry out of range";
+    }
+
+    for (const auto& mesh : GetMeshes())
+    {
+        if (uint64_t(mesh.firstGeometry) + mesh.geometryCount > GetGeometries().size())
+            return "mesh out of range";
+    }
+
+    for (const auto& instance : GetInstances())
+    {
+        if (instance.mesh >= GetMeshes().size())
+            return "instance out of range";
+    }
+
+    for (const auto& meshlet : GetMeshlets())
+    {
+        if (uint64_t(meshlet.vertexOffset) + meshlet.vertexCount > GetMeshletVertices().size()
+            || uint64_t(meshlet.triangleOffset) + meshlet.triangleCount > GetMeshletTriangles().size())
+            return "meshlet out of range";
+    }
+
+    return std::string();
+}
+
+const char* ScenePack::GetString(uint32_t offset) const
+{
+    auto strings = GetSection<char>(ScenePackSection_Strings);
+    if (offset >= strings.size())
+        return "";
+    return &strings[offset];
+}
+
+TextureUsage GetScenePackTextureUsage(uint32_t slot)
+{
+    switch (slot)
+    {
+    case ScenePackTexture_BaseOrDiffuse:
+    case ScenePackTexture_Emissive: return TextureUsage::Color;
+    case ScenePackTexture_Normal: return TextureUsage::Normal;
+    case ScenePackTexture_Occlusion: return TextureUsage::SingleChannel;
+    default: return TextureUsage::LinearColor;
+    }
+}
+
+bool ScenePackScene::LoadPack(const ScenePack& pack, const std::filesystem::path& basePath, TextureTranscoder* transcoder)
+{
+    if (!pack.IsOpen())
+        return false;
+
+    auto vertices = pack.GetVertices();
+    auto indices = pack.GetIndices();
+    auto geometries = pack.GetGeometries();
+
+    // All meshes share one buffer group, as the meshes of a glTF file do
+    auto buffers = std::make_shared<BufferGroup>();
+    buffers->indexData.assign(indices.begin(), indices.end());
+    buffers->positionData.resize(vertices.size());
+    buffers->normalData.resize(vertices.size());
+    buffers->tangentData.resize(vertices.size());
+    buffers->texcoord1Data.resize(vertices.size());
+    for (size_t i = 0; i < vertices.size(); i++)
+    {
+        const ScenePackVertex& vertex = vertices[i];
+        buffers->positionData[i] = float3(vertex.position[0], vertex.position[1], vertex.position[2]);
+        buffers->normalData[i] = vertex.normal;
+        buffers->tangentData[i] = vertex.tangent;
+        buffers->texcoord1Data[i] = float2(vertex.texcoord[0], vertex.texcoord[1]);
+    }
+
+    auto loadTexture = [this, &pack, &basePath, transcoder](uint32_t path, uint32_t slot) -> std::shared_ptr<LoadedTexture>
+    {
+        if (path == c_ScenePackNone)
+            return nullptr;
+
+        std::filesystem::path fileName = pack.GetString(path);
+        if (!fileName.is_absolute())
+            fileName = basePath / fileName;
+
+        TextureUsage usage = GetScenePackTextureUsage(slot);
+        std::filesystem::path compressedFileName = transcoder ? transcoder->Find(fileName, usage) : std::filesystem::path();
+        if (!compressedFileName.empty())
+            fileName = compressedFileName;
+
+        // Color textures are sRGB, as in the glTF importer. The cache returns the same texture for repeated paths.
+        return m_TextureCache->LoadTextureFromFileDeferred(fileName, usage == TextureUsage::Color);
+    };
+
+    std::vector<std::shared_ptr<Material>> materials;
+    materials.reserve(pack.GetMaterials().size());
+    for (const auto& packed : pack.GetMaterials())
+    {
+        auto material = std::make_shared<Material>();
+        material->name = pack.GetString(packed.name);
+        material->domain = MaterialDomain(packed.domain);
+        material->doubleSided = (packed.flags & ScenePackMaterial_DoubleSided) != 0;
+        material->useSpecularGlossModel = (packed.flags & ScenePackMaterial_SpecularGloss) != 0;
+        material->opacity = packed.opacity;
+        std::memcpy(&material->baseOrDiffuseColor, packed.baseOrDiffuseColor, sizeof(packed.baseOrDiffuseColor));
+        material->metalness = packed.metalness;
+        std::memcpy(&material->emissiveColor, packed.emissiveColor, sizeof(packed.emissiveColor));
+        material->roughness = packed.roughness;
+        material->emissiveIntensity = packed.emissiveIntensity;
+        material->alphaCutoff = packed.alphaCutoff;
+        material->normalTextureScale = packed.normalTextureScale;
+        material->occlusionStrength = packed.occlusionStrength;
+
+        material->baseOrDiffuseTexture = loadTexture(packed.textures[ScenePackTexture_BaseOrDiffuse], ScenePackTexture_BaseOrDiffuse);
+        material->metalRoughOrSpecularTexture = loadTexture(packed.textures[ScenePackTexture_MetalRoughOrSpecular], ScenePackTexture_MetalRoughOrSpecular);
+        material->normalTexture = loadTexture(packed.textures[ScenePackTexture_Normal], ScenePackTexture_Normal);
+        material->emissiveTexture = loadTexture(packed.textures[ScenePackTexture_Emissive], ScenePackTexture_Emissive);
+        material->occlusionTexture = loadTexture(packed.textures[ScenePackTexture_Occlusion], ScenePackTexture_Occlusion);
+
+        materials.push_back(material);
+    }
+
+    std::vector<std::shared_ptr<MeshInfo>> meshes;
+    meshes.reserve(pack.GetMeshes().size());
+    for (const auto& packed : pack.GetMeshes())
+    {
+        auto mesh = std::make_shared<MeshInfo>();
+        mesh->name = pack.GetString(packed.name);
+        mesh->buffers = buffers;
+        float3 meshMins = float3(FLT_MAX);
+        float3 meshMaxs = float3(-FLT_MAX);
+
+        if (packed.geometryCount != 0)
+        {
+            // The builder appends the geometries of a mesh one after another
+            mesh->indexOffset = geometries[packed.firstGeometry].firstIndex;
+            mesh->vertexOffset = geometries[packed.firstGeometry].firstVertex;
+        }
+
+        for (uint32_t index = packed.firstGeometry; index < packed.firstGeometry + packed.geometryCount; index++)
+        {
+            const ScenePackGeometry& packedGeometry = geometries[index];
+
+            auto geometry = std::make_shared<MeshGeometry>();
+            geometry->material = packedGeometry.material != c_ScenePackNone ? materials[packedGeometry.material] : nullptr;
+            geometry->indexOffsetInMesh = packedGeometry.firstIndex - mesh->indexOffset;
+            geometry->vertexOffsetInMesh = packedGeometry.firstVertex - mesh->vertexOffset;
+            geometry->numIndices = packedGeometry.indexCount;
+            geometry->numVertices = packedGeometry.vertexCount;
+
+            float3 mins = float3(FLT_MAX);
+            float3 maxs = float3(-FLT_MAX);
+            for (uint32_t vertex = 0; vertex < packedGeometry.vertexCount; vertex++)
+            {
+                const float3& position = buffers->positionData[packedGeometry.firstVertex + vertex];
+                mins = min(mins, position);
+                maxs = max(maxs, position);
+            }
+            geometry->objectSpaceBounds = box3(mins, maxs);
+
+            meshMins = min(meshMins, mins);
+            meshMaxs = max(meshMaxs, maxs);
+            mesh->totalIndices += geometry->numIndices;
+            mesh->totalVertices += geometry->numVertices;
+            mesh->geometries.push_back(geometry);
+        }
+
+        mesh->objectSpaceBounds = box3(meshMins, meshMaxs);
+        meshes.push_back(mesh);
+    }
+
+    m_SceneGraph = std::make_shared<SceneGraph>();
+    auto rootNode = std::make_shared<SceneGraphNode>();
+    m_SceneGraph->SetRootNode(rootNode);
+
+    // The instances were flattened to world space, so they are all children of the root
+    for (const auto& packed : pack.GetInstances())
+    {
+        affine3 objectToWorld;
+        std::memcpy(&objectToWorld, packed.transform, sizeof(packed.transform));
+
+        double3 translation;
+        dquat rotation;
+        double3 scaling;
+        decomposeAffine(daffine3(objectToWorld), &translation, &rotation, &scaling);
+
+        auto node = std::make_shared<SceneGraphNode>();
+        node->SetName(pack.GetString(packed.name));
+        node->SetTranslation(translation);
+        node->SetRotation(rotation);
+        node->SetScaling(scaling);
+        node->SetLeaf(std::make_shared<MeshInstance>(meshes[packed.mesh]));
+        m_SceneGraph->Attach(rootNode, node);
+    }
+
+    return true;
+}
+
+bool OpenUpToDateScenePack(const std::filesystem::path& sceneFileName, ScenePack& pack)
+{
+    std::filesystem::path packFileName = GetScenePackFileName(sceneFileName);
+    if (!std::filesystem::exists(packFileName) || !pack.Open(packFileName))
+        return false;
+
+    if (pack.GetSourceHash() != HashScenePackSource(sceneFileName))
+    {
+        donut::log::info("Scene pack '%s' is out of date, run scene_cook to update it", packFileName.generic_string().c_str());
+        pack.Close();
+        return false;
+    }
+
+    return true;
+}
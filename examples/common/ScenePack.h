@@ -0,0 +1,268 @@
+/*
+* Copyright (c) 2014-2021, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#pragma once
+
+#include "MappedFile.h"
+#include "MeshletBuilder.h"
+#include "TextureTranscoder.h"
+#include <donut/engine/Scene.h>
+#include <nvrhi/nvrhi.h>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace donut::engine
+{
+    class SceneGraph;
+    struct Material;
+    struct MeshInfo;
+}
+
+// Scene pack file layout:
+//   ScenePackHeader
+//   one section per record type, each starting at a 16-byte aligned offset
+// Records are plain data, so the reader uses the mapped file in place. Geometry and meshlet ranges are
+// absolute within their sections; meshlet vertices index into the geometry's vertex range. Names and
+// texture paths are offsets into the string section.
+
+static const uint32_t c_ScenePackMagic = 0x4B505353; // 'SSPK'
+static const uint32_t c_ScenePackVersion = 1;
+constexpr uint32_t c_ScenePackNone = ~0u;
+
+enum ScenePackSectionType : uint32_t
+{
+    ScenePackSection_Vertices,
+    ScenePackSection_Indices,
+    ScenePackSection_Geometries,
+    ScenePackSection_Meshes,
+    ScenePackSection_Instances,
+    ScenePackSection_Materials,
+    ScenePackSection_Meshlets,
+    ScenePackSection_MeshletVertices,
+    ScenePackSection_MeshletTriangles,
+    ScenePackSection_Strings,
+    ScenePackSection_Count
+};
+
+struct ScenePackSection
+{
+    uint64_t offset;
+    uint64_t count;
+};
+
+struct ScenePackHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint64_t sourceHash;
+    ScenePackSection sections[ScenePackSection_Count];
+};
+
+// Interleaved vertex; normals and tangents are packed as in Donut's vertex buffers
+struct ScenePackVertex
+{
+    float position[3];
+    uint32_t normal;
+    uint32_t tangent;
+    float texcoord[2];
+};
+
+struct ScenePackGeometry
+{
+    uint32_t firstIndex;
+    uint32_t indexCount;
+    uint32_t firstVertex;
+    uint32_t vertexCount;
+    uint32_t material; // c_ScenePackNone without a material
+    uint32_t firstMeshlet;
+    uint32_t meshletCount;
+    uint32_t padding;
+};
+
+struct ScenePackMesh
+{
+    uint32_t name;
+    uint32_t firstGeometry;
+    uint32_t geometryCount;
+    uint32_t padding;
+};
+
+struct ScenePackInstance
+{
+    float transform[12]; // object to world: the 3x3 linear part by rows, then the translation
+    uint32_t mesh;
+    uint32_t name;
+    uint32_t padding[2];
+};
+
+enum ScenePackTextureSlot : uint32_t
+{
+    ScenePackTexture_BaseOrDiffuse,
+    ScenePackTexture_MetalRoughOrSpecular,
+    ScenePackTexture_Normal,
+    ScenePackTexture_Emissive,
+    ScenePackTexture_Occlusion,
+    ScenePackTexture_Count
+};
+
+enum ScenePackMaterialFlags : uint32_t
+{
+    ScenePackMaterial_DoubleSided = 1,
+    ScenePackMaterial_SpecularGloss = 2
+};
+
+struct ScenePackMaterial
+{
+    uint32_t name;
+    uint32_t domain; // donut::engine::MaterialDomain
+    uint32_t flags;
+    float opacity;
+    float baseOrDiffuseColor[3];
+    float metalness;
+    float emissiveColor[3];
+    float roughness;
+    float emissiveIntensity;
+    float alphaCutoff;
+    float normalTextureScale;
+    float occlusionStrength;
+    uint32_t textures[ScenePackTexture_Count]; // source paths, c_ScenePackNone when unused
+    uint32_t padding[3];
+};
+
+// Flattens the meshes, instances and materials of scene graphs into a pack
+class ScenePackBuilder
+{
+public:
+    explicit ScenePackBuilder(bool buildMeshlets = true) : m_BuildMeshlets(buildMeshlets) { }
+
+    // Skinned meshes only have GPU vertex data and are skipped
+    void AddSceneGraph(const donut::engine::SceneGraph& sceneGraph);
+
+    bool Write(const std::filesystem::path& fileName, uint64_t sourceHash) const;
+
+    [[nodiscard]] size_t GetSkippedMeshCount() const { return m_SkippedMeshes; }
+
+private:
+    bool m_BuildMeshlets;
+    size_t m_SkippedMeshes = 0;
+
+    std::vector<ScenePackVertex> m_Vertices;
+    std::vector<uint32_t> m_Indices;
+    std::vector<ScenePackGeometry> m_Geometries;
+    std::vector<ScenePackMesh> m_Meshes;
+    std::vector<ScenePackInstance> m_Instances;
+    std::vector<ScenePackMaterial> m_Materials;
+    std::vector<Meshlet> m_Meshlets;
+    std::vector<uint32_t> m_MeshletVertices;
+    std::vector<uint32_t> m_MeshletTriangles;
+    std::vector<char> m_Strings;
+
+    std::unordered_map<const donut::engine::MeshInfo*, uint32_t> m_MeshIndices;
+    std::unordered_map<const donut::engine::Material*, uint32_t> m_MaterialIndices;
+
+    uint32_t AddString(const std::string& string);
+    uint32_t AddMaterial(const std::shared_ptr<donut::engine::Material>& material);
+    uint32_t AddMesh(const donut::engine::MeshInfo& mesh);
+};
+
+template<typename T>
+struct ScenePackArray
+{
+    const T* data = nullptr;
+    size_t count = 0;
+
+    [[nodiscard]] const T* begin() const { return data; }
+    [[nodiscard]] const T* end() const { return data + count; }
+    [[nodiscard]] size_t size() const { return count; }
+    const T& operator[](size_t index) const { return data[index]; }
+};
+
+// Read-only view of a mapped scene pack; the arrays point into the mapping
+class ScenePack
+{
+public:
+    // Maps the file and checks that every section and range lies within it
+    bool Open(const std::filesystem::path& fileName);
+    void Close() { m_File.Close(); }
+
+    [[nodiscard]] bool IsOpen() const { return m_File.IsOpen(); }
+    [[nodiscard]] uint64_t GetSourceHash() const { return GetHeader().sourceHash; }
+
+    [[nodiscard]] ScenePackArray<ScenePackVertex> GetVertices() const { return GetSection<ScenePackVertex>(ScenePackSection_Vertices); }
+    [[nodiscard]] ScenePackArray<uint32_t> GetIndices() const { return GetSection<uint32_t>(ScenePackSection_Indices); }
+    [[nodiscard]] ScenePackArray<ScenePackGeometry> GetGeometries() const { return GetSection<ScenePackGeometry>(ScenePackSection_Geometries); }
+    [[nodiscard]] ScenePackArray<ScenePackMesh> GetMeshes() const { return GetSection<ScenePackMesh>(ScenePackSection_Meshes); }
+    [[nodiscard]] ScenePackArray<ScenePackInstance> GetInstances() const { return GetSection<ScenePackInstance>(ScenePackSection_Instances); }
+    [[nodiscard]] ScenePackArray<ScenePackMaterial> GetMaterials() const { return GetSection<ScenePackMaterial>(ScenePackSection_Materials); }
+    [[nodiscard]] ScenePackArray<Meshlet> GetMeshlets() const { return GetSection<Meshlet>(ScenePackSection_Meshlets); }
+    [[nodiscard]] ScenePackArray<uint32_t> GetMeshletVertices() const { return GetSection<uint32_t>(ScenePackSection_MeshletVertices); }
+    [[nodiscard]] ScenePackArray<uint32_t> GetMeshletTriangles() const { return GetSection<uint32_t>(ScenePackSection_MeshletTriangles); }
+
+    // Returns an empty string for c_ScenePackNone
+    [[nodiscard]] const char* GetString(uint32_t offset) const;
+
+private:
+    MappedFile m_File;
+
+    [[nodiscard]] const ScenePackHeader& GetHeader() const { return *reinterpret_cast<const ScenePackHeader*>(m_File.GetData()); }
+
+    template<typename T>
+    [[nodiscard]] ScenePackArray<T> GetSection(ScenePackSectionType type) const
+    {
+        const ScenePackSection& section = GetHeader().sections[type];
+        return { reinterpret_cast<const T*>(m_File.GetData() + section.offset), size_t(section.count) };
+    }
+
+    [[nodiscard]] std::string Validate() const;
+};
+
+// Hash of the scene file, the models it lists and their buffer and image files, stored in the pack to detect stale packs
+uint64_t HashScenePackSource(const std::filesystem::path& sceneFileName);
+
+// Texture usage of a material slot, as the glTF importer loads it
+TextureUsage GetScenePackTextureUsage(uint32_t slot);
+
+// A Donut scene whose scene graph is unpacked from a scene pack instead of parsed from the scene and model
+// files. The vertex arrays are copied out of the mapping into the mesh buffer groups, and FinishedLoading
+// creates and uploads the GPU buffers exactly as after Scene::Load, so the regular render passes draw it.
+// Lights, cameras, animations and skinned meshes are not stored in packs.
+class ScenePackScene : public donut::engine::Scene
+{
+public:
+    using Scene::Scene;
+
+    // Textures are loaded deferred through the scene's texture cache, from the transcoded copies when
+    // a transcoder is given and has them. Relative texture paths are resolved against basePath.
+    bool LoadPack(const ScenePack& pack, const std::filesystem::path& basePath, TextureTranscoder* transcoder = nullptr);
+};
+
+// The pack that scene_cook writes for a scene file by default
+inline std::filesystem::path GetScenePackFileName(const std::filesystem::path& sceneFileName)
+{
+    return std::filesystem::path(sceneFileName).replace_extension(".pack");
+}
+
+// Opens the default pack of a scene if it has been cooked from the current source files
+bool OpenUpToDateScenePack(const std::filesystem::path& sceneFileName, ScenePack& pack);
@@ -0,0 +1,665 @@
+/*
+* Copyright (c) 2014-2021, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#include "TextureTranscoder.h"
+#include "HashBytes.h"
+#include <donut/core/log.h>
+#include <algorithm>
+#include <array>
+#include <cfloat>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+
+// stb_image is compiled privately here so that its symbols cannot clash with another copy in the Donut libraries
+#define STB_IMAGE_STATIC
+#define STB_IMAGE_IMPLEMENTATION
+#define STBI_ONLY_PNG
+#define STBI_ONLY_JPEG
+#define STBI_ONLY_TGA
+#define STBI_ONLY_BMP
+#include <stb_image.h>
+
+// Bump when the encoders change, so that old cache entries are not reused
+static constexpr uint32_t c_TextureTranscoderVersion = 1;
+
+static constexpr uint32_t c_DDSMagic = 0x20534444;    // 'DDS '
+static constexpr uint32_t c_DDSFourCCDX10 = 0x30315844; // 'DX10'
+static constexpr uint32_t c_DXGIFormatBC4 = 80;
+static constexpr uint32_t c_DXGIFormatBC5 = 83;
+static constexpr uint32_t c_DXGIFormatBC7 = 98;
+static constexpr uint32_t c_DXGIFormatBC7sRGB = 99;
+
+struct DDSHeaders
+{
+    uint32_t magic;
+    uint32_t header[31];
+    uint32_t dxgiFormat;
+    uint32_t resourceDimension;
+    uint32_t miscFlag;
+    uint32_t arraySize;
+    uint32_t miscFlags2;
+};
+
+static_assert(sizeof(DDSHeaders) == 148, "DDS magic, DDS_HEADER and DDS_HEADER_DXT10");
+
+static double MillisecondsSince(std::chrono::high_resolution_clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+bool DecodeImage(const void* fileData, size_t fileSize, DecodedImage& image)
+{
+    int width = 0, height = 0, channels = 0;
+    stbi_uc* pixels = stbi_load_from_memory(static_cast<const stbi_uc*>(fileData), int(fileSize), &width, &height, &channels, 4);
+    if (!pixels)
+        return false;
+
+    image.width = uint32_t(width);
+    image.height = uint32_t(height);
+    image.pixels.assign(pixels, pixels + size_t(width) * size_t(height) * 4);
+    stbi_image_free(pixels);
+    return true;
+}
+
+static const std::array<float, 256>& GetSRGBToLinearTable()
+{
+    static const std::array<float, 256> table = []()
+    {
+        std::array<float, 256> result;
+        for (int i = 0; i < 256; i++)
+        {
+            float c = float(i) / 255.f;
+            result[i] = c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+        }
+        return result;
+    }();
+    return table;
+}
+
+static uint8_t LinearToSRGB(float c)
+{
+    c = c <= 0.0031308f ? c * 12.92f : 1.055f * std::pow(c, 1.f / 2.4f) - 0.055f;
+    return uint8_t(std::clamp(c * 255.f + 0.5f, 0.f, 255.f));
+}
+
+static uint8_t FloatToUnorm8(float c)
+{
+    return uint8_t(std::clamp(c * 255.f + 0.5f, 0.f, 255.f));
+}
+
+static DecodedImage Downsample(const DecodedImage& source, TextureUsage usage)
+{
+    DecodedImage result;
+    result.width = std::max(source.width / 2, 1u);
+    result.height = std::max(source.height / 2, 1u);
+    result.pixels.resize(size_t(result.width) * result.height * 4);
+
+    const auto& srgbToLinear = GetSRGBToLinearTable();
+
+    for (uint32_t y = 0; y < result.height; y++)
+    {
+        for (uint32_t x = 0; x < result.width; x++)
+        {
+            // 2x2 box filter; odd source sizes clamp the last row and column
+            float sum[4] = {};
+            for (uint32_t dy = 0; dy < 2; dy++)
+            {
+                for (uint32_t dx = 0; dx < 2; dx++)
+                {
+                    uint32_t sx = std::min(x * 2 + dx, source.width - 1);
+                    uint32_t sy = std::min(y * 2 + dy, source.height - 1);
+                    const uint8_t* pixel = &source.pixels[(size_t(sy) * source.width + sx) * 4];
+
+                    for (uint32_t c = 0; c < 4; c++)
+                    {
+                        if (usage == TextureUsage::Color && c < 3)
+                            sum[c] += srgbToLinear[pixel[c]];
+                        else if (usage == TextureUsage::Normal && c < 3)
+                            sum[c] += float(pixel[c]) / 127.5f - 1.f;
+                        else
+                            sum[c] += float(pixel[c]) / 255.f;
+                    }
+                }
+            }
+
+            uint8_t* pixel = &result.pixels[(size_t(y) * result.width + x) * 4];
+            if (usage == TextureUsage::Normal)
+            {
+                float len = std::sqrt(sum[0] * sum[0] + sum[1] * sum[1] + sum[2] * sum[2]);
+                float scale = len > 1e-6f ? 1.f / len : 0.f;
+                for (uint32_t c = 0; c < 3; c++)
+                    pixel[c] = FloatToUnorm8(sum[c] * scale * 0.5f + 0.5f);
+            }
+            else
+            {
+                for (uint32_t c = 0; c < 3; c++)
+                    pixel[c] = usage == TextureUsage::Color ? LinearToSRGB(sum[c] * 0.25f) : FloatToUnorm8(sum[c] * 0.25f);
+            }
+            pixel[3] = FloatToUnorm8(sum[3] * 0.25f);
+        }
+    }
+
+    return result;
+}
+
+std::vector<DecodedImage> GenerateMips(DecodedImage image, TextureUsage usage)
+{
+    std::vector<DecodedImage> mips;
+    mips.push_back(std::move(image));
+
+    while (mips.back().width > 1 || mips.back().height > 1)
+        mips.push_back(Downsample(mips.back(), usage));
+
+    return mips;
+}
+
+void EncodeBC4Block(const uint8_t* pixels, uint32_t channel, uint8_t* block)
+{
+    uint8_t minValue = 255, maxValue = 0;
+    for (uint32_t i = 0; i < 16; i++)
+    {
+        minValue = std::min(minValue, pixels[i * 4 + channel]);
+        maxValue = std::max(maxValue, pixels[i * 4 + channel]);
+    }
+
+    // The 8-value mode: red0 > red1, interpolants at sevenths
+    block[0] = maxValue;
+    block[1] = minValue;
+
+    uint32_t palette[8] = { maxValue, minValue };
+    for (uint32_t i = 2; i < 8; i++)
+        palette[i] = ((8 - i) * maxValue + (i - 1) * minValue + 3) / 7;
+
+    uint64_t indices = 0;
+    if (maxValue != minValue)
+    {
+        for (uint32_t i = 0; i < 16; i++)
+        {
+            int value = pixels[i * 4 + channel];
+            uint32_t best = 0;
+            int bestError = 256;
+            for (uint32_t j = 0; j < 8; j++)
+            {
+                int error = std::abs(int(palette[j]) - value);
+                if (error < bestError)
+                {
+                    bestError = error;
+                    best = j;
+                }
+            }
+            indices |= uint64_t(best) << (i * 3);
+        }
+    }
+
+    for (uint32_t i = 0; i < 6; i++)
+        block[2 + i] = uint8_t(indices >> (i * 8));
+}
+
+void EncodeBC5Block(const uint8_t* pixels, uint8_t* block)
+{
+    EncodeBC4Block(pixels, 0, block);
+    EncodeBC4Block(pixels, 1, block + 8);
+}
+
+namespace
+{
+    struct BlockWriter
+    {
+        uint64_t bits[2] = {};
+        uint32_t position = 0;
+
+        void Write(uint32_t value, uint32_t count)
+        {
+            for (uint32_t i = 0; i < count; i++, position++)
+            {
+                if (value & (1u << i))
+                    bits[position / 64] |= uint64_t(1) << (position % 64);
+            }
+        }
+    };
+}
+
+void EncodeBC7Block(const uint8_t* pixels, uint8_t* block)
+{
+    static const uint32_t weights[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+    // Endpoints along the principal axis of the RGBA colors, found by power iteration on the covariance
+    float mean[4] = {};
+    for (uint32_t i = 0; i < 16; i++)
+        for (uint32_t c = 0; c < 4; c++)
+            mean[c] += float(pixels[i * 4 + c]) / 16.f;
+
+    float covariance[4][4] = {};
+    for (uint32_t i = 0; i < 16; i++)
+    {
+        float d[4];
+        for (uint32_t c = 0; c < 4; c++)
+            d[c] = float(pixels[i * 4 + c]) - mean[c];
+        for (uint32_t a = 0; a < 4; a++)
+            for (uint32_t b = 0; b < 4; b++)
+                covariance[a][b] += d[a] * d[b];
+    }
+
+    float axis[4] = { 1.f, 1.f, 1.f, 1.f };
+    for (uint32_t iteration = 0; iteration < 8; iteration++)
+    {
+        float next[4] = {};
+        for (uint32_t a = 0; a < 4; a++)
+            for (uint32_t b = 0; b < 4; b++)
+                next[a] += covariance[a][b] * axis[b];
+
+        float len = std::sqrt(next[0] * next[0] + next[1] * next[1] + next[2] * next[2] + next[3] * next[3]);
+        if (len < 1e-6f)
+            break;
+        for (uint32_t c = 0; c < 4; c++)
+            axis[c] = next[c] / len;
+    }
+
+    float minT = 0.f, maxT = 0.f;
+    for (uint32_t i = 0; i < 16; i++)
+    {
+        float t = 0.f;
+        for (uint32_t c = 0; c < 4; c++)
+            t += (float(pixels[i * 4 + c]) - mean[c]) * axis[c];
+        minT = std::min(minT, t);
+        maxT = std::max(maxT, t);
+    }
+
+    // Mode 6 endpoints are 7 bits per channel plus a shared p-bit per endpoint
+    uint32_t quantized[2][4];
+    uint32_t pbits[2];
+    uint32_t endpoints[2][4];
+    for (uint32_t e = 0; e < 2; e++)
+    {
+        float t = e == 0 ? minT : maxT;
+        float bestError = FLT_MAX;
+        for (uint32_t p = 0; p < 2; p++)
+        {
+            float error = 0.f;
+            uint32_t q[4];
+            for (uint32_t c = 0; c < 4; c++)
+            {
+                float value = std::clamp(mean[c] + axis[c] * t, 0.f, 255.f);
+                q[c] = uint32_t(std::clamp(int((value - float(p)) * 0.5f + 0.5f), 0, 127));
+                float reconstructed = float(q[c] * 2 + p);
+                error += (reconstructed - value) * (reconstructed - value);
+            }
+            if (error < bestError)
+            {
+                bestError = error;
+                pbits[e] = p;
+                std::copy(q, q + 4, quantized[e]);
+            }
+        }
+        for (uint32_t c = 0; c < 4; c++)
+            endpoints[e][c] = quantized[e][c] * 2 + pbits[e];
+    }
+
+    uint32_t palette[16][4];
+    for (uint32_t i = 0; i < 16; i++)
+        for (uint32_t c = 0; c < 4; c++)
+            palette[i][c] = ((64 - weights[i]) * endpoints[0][c] + weights[i] * endpoints[1][c] + 32) >> 6;
+
+    uint32_t indices[16];
+    for (uint32_t i = 0; i < 16; i++)
+    {
+        uint32_t bestError = UINT32_MAX;
+        for (uint32_t j = 0; j < 16; j++)
+        {
+            uint32_t error = 0;
+            for (uint32_t c = 0; c < 4; c++)
+            {
+                int d = int(palette[j][c]) - int(pixels[i * 4 + c]);
+                error += uint32_t(d * d);
+            }
+            if (error < bestError)
+            {
+                bestError = error;
+                indices[i] = j;
+            }
+        }
+    }
+
+    // The anchor index has an implicit zero high bit; swap the endpoints when it would be set
+    if (indices[0] & 8)
+    {
+        std::swap(quantized[0], quantized[1]);
+        std::swap(pbits[0], pbits[1]);
+        for (uint32_t& index : indices)
+            index = 15 - index;
+    }
+
+    BlockWriter writer;
+    writer.Write(1u << 6, 7);
+    for (uint32_t c = 0; c < 4; c++)
+    {
+        writer.Write(quantized[0][c], 7);
+        writer.Write(quantized[1][c], 7);
+    }
+    writer.Write(pbits[0], 1);
+    writer.Write(pbits[1], 1);
+    writer.Write(indices[0], 3);
+    for (uint32_t i = 1; i < 16; i++)
+        writer.Write(indices[i], 4);
+
+    std::memcpy(block, writer.bits, 16);
+}
+
+static uint32_t GetBlockSize(TextureUsage usage)
+{
+    return usage == TextureUsage::SingleChannel ? 8 : 16;
+}
+
+static uint32_t GetDXGIFormat(TextureUsage usage)
+{
+    switch (usage)
+    {
+    case TextureUsage::Color: return c_DXGIFormatBC7sRGB;
+    case TextureUsage::Normal: return c_DXGIFormatBC5;
+    case TextureUsage::SingleChannel: return c_DXGIFormatBC4;
+    default: return c_DXGIFormatBC7;
+    }
+}
+
+static void EncodeImage(const DecodedImage& image, TextureUsage usage, std::vector<uint8_t>& output)
+{
+    const uint32_t blocksX = (image.width + 3) / 4;
+    const uint32_t blocksY = (image.height + 3) / 4;
+    const uint32_t blockSize = GetBlockSize(usage);
+
+    size_t offset = output.size();
+    output.resize(offset + size_t(blocksX) * blocksY * blockSize);
+
+    uint8_t pixels[64];
+    for (uint32_t by = 0; by < blocksY; by++)
+    {
+        for (uint32_t bx = 0; bx < blocksX; bx++)
+        {
+            // Partial blocks at the edges repeat the last row and column
+            for (uint32_t y = 0; y < 4; y++)
+            {
+                for (uint32_t x = 0; x < 4; x++)
+                {
+                    uint32_t sx = std::min(bx * 4 + x, image.width - 1);
+                    uint32_t sy = std::min(by * 4 + y, image.height - 1);
+                    std::memcpy(&pixels[(y * 4 + x) * 4], &image.pixels[(size_t(sy) * image.width + sx) * 4], 4);
+                }
+            }
+
+            uint8_t* block = &output[offset + (size_t(by) * blocksX + bx) * blockSize];
+            switch (usage)
+            {
+            case TextureUsage::Normal: EncodeBC5Block(pixels, block); break;
+            case TextureUsage::SingleChannel: EncodeBC4Block(pixels, 0, block); break;
+            default: EncodeBC7Block(pixels, block); break;
+            }
+        }
+    }
+}
+
+bool WriteCompressedDDS(const std::vector<DecodedImage>& mips, TextureUsage usage, const std::filesystem::path& fileName)
+{
+    if (mips.empty())
+        return false;
+
+    std::vector<uint8_t> data;
+    for (const DecodedImage& mip : mips)
+        EncodeImage(mip, usage, data);
+
+    const uint32_t blockSize = GetBlockSize(usage);
+
+    DDSHeaders headers{};
+    headers.magic = c_DDSMagic;
+    headers.header[0] = 124;                        // dwSize
+    headers.header[1] = 0x1 | 0x2 | 0x4 | 0x1000 | 0x20000 | 0x80000; // caps, height, width, pixel format, mip count, linear size
+    headers.header[2] = mips[0].height;
+    headers.header[3] = mips[0].width;
+    headers.header[4] = ((mips[0].width + 3) / 4) * ((mips[0].height + 3) / 4) * blockSize;
+    headers.header[6] = uint32_t(mips.size());
+    headers.header[18] = 32;                        // ddspf.dwSize
+    headers.header[19] = 0x4;                       // DDPF_FOURCC
+    headers.header[20] = c_DDSFourCCDX10;
+    headers.header[26] = 0x1000 | 0x400000 | 0x8;   // texture, mipmap, complex
+    headers.dxgiFormat = GetDXGIFormat(usage);
+    headers.resourceDimension = 3;                  // TEXTURE2D
+    headers.arraySize = 1;
+
+    // Write to a temporary file first so that an interrupted transcode does not leave a truncated entry
+    std::filesystem::path tempFileName = fileName;
+    tempFileName += ".tmp";
+
+    {
+        std::ofstream file(tempFileName, std::ios::binary | std::ios::trunc);
+        if (!file)
+            return false;
+
+        file.write(reinterpret_cast<const char*>(&headers), sizeof(headers));
+        file.write(reinterpret_cast<const char*>(data.data()), std::streamsize(data.size()));
+
+        if (!file)
+            return false;
+    }
+
+    std::error_code error;
+    std::filesystem::rename(tempFileName, fileName, error);
+    return !error;
+}
+
+static uint64_t GetUncompressedSize(uint32_t width, uint32_t height, uint32_t mipLevels)
+{
+    uint64_t size = 0;
+    for (uint32_t mip = 0; mip < mipLevels; mip++)
+        size += uint64_t(std::max(width >> mip, 1u)) * std::max(height >> mip, 1u) * 4;
+    return size;
+}
+
+static bool ReadCachedTexture(const std::filesystem::path& fileName, TranscodedTexture& result)
+{
+    std::ifstream file(fileName, std::ios::binary);
+    DDSHeaders headers;
+    if (!file.read(reinterpret_cast<char*>(&headers), sizeof(headers)))
+        return false;
+
+    if (headers.magic != c_DDSMagic || headers.header[20] != c_DDSFourCCDX10 || headers.dxgiFormat != GetDXGIFormat(result.usage))
+        return false;
+
+    std::error_code error;
+    uint64_t fileSize = std::filesystem::file_size(fileName, error);
+    if (error)
+        return false;
+
+    result.height = headers.header[2];
+    result.width = headers.header[3];
+    result.mipLevels = headers.header[6];
+    result.compressedBytes = fileSize - sizeof(headers);
+    result.uncompressedBytes = GetUncompressedSize(result.width, result.height, result.mipLevels);
+    return true;
+}
+
+TranscodedTexture TranscodeTexture(const std::filesystem::path& sourceFileName, TextureUsage usage,
+    const std::filesystem::path& cacheDirectory, bool ignoreCache)
+{
+    TranscodedTexture result;
+    result.sourceFileName = sourceFileName;
+    result.usage = usage;
+
+    std::vector<char> fileData;
+    {
+        std::ifstream file(sourceFileName, std::ios::binary | std::ios::ate);
+        if (!file)
+        {
+            donut::log::warning("Cannot open texture '%s'", sourceFileName.generic_string().c_str());
+            return result;
+        }
+        fileData.resize(size_t(file.tellg()));
+        file.seekg(0);
+        file.read(fileData.data(), std::streamsize(fileData.size()));
+    }
+
+    uint64_t hash = c_HashBytesSeed;
+    hash = HashBytes(hash, &c_TextureTranscoderVersion, sizeof(c_TextureTranscoderVersion));
+    hash = HashBytes(hash, &usage, sizeof(usage));
+    hash = HashBytes(hash, fileData.data(), fileData.size());
+
+    char cacheName[32];
+    snprintf(cacheName, sizeof(cacheName), "%016llx.dds", (unsigned long long)hash);
+    std::filesystem::path cacheFileName = cacheDirectory / cacheName;
+
+    if (!ignoreCache && ReadCachedTexture(cacheFileName, result))
+    {
+        result.cacheFileName = cacheFileName;
+        result.fromCache = true;
+        return result;
+    }
+
+    auto decodeStart = std::chrono::high_resolution_clock::now();
+    DecodedImage image;
+    if (!DecodeImage(fileData.data(), fileData.size(), image))
+    {
+        donut::log::warning("Cannot decode texture '%s'", sourceFileName.generic_string().c_str());
+        return result;
+    }
+    fileData = std::vector<char>();
+    result.decodeMs = MillisecondsSince(decodeStart);
+
+    auto mipsStart = std::chrono::high_resolution_clock::now();
+    std::vector<DecodedImage> mips = GenerateMips(std::move(image), usage);
+    result.mipsMs = MillisecondsSince(mipsStart);
+
+    auto encodeStart = std::chrono::high_resolution_clock::now();
+    std::error_code error;
+    std::filesystem::create_directories(cacheDirectory, error);
+    if (!WriteCompressedDDS(mips, usage, cacheFileName))
+    {
+        donut::log::warning("Cannot write '%s'", cacheFileName.generic_string().c_str());
+        return result;
+    }
+    result.encodeMs = MillisecondsSince(encodeStart);
+
+    result.cacheFileName = cacheFileName;
+    result.width = mips[0].width;
+    result.height = mips[0].height;
+    result.mipLevels = uint32_t(mips.size());
+    result.uncompressedBytes = GetUncompressedSize(result.width, result.height, result.mipLevels);
+    result.compressedBytes = std::filesystem::file_size(cacheFileName, error) - sizeof(DDSHeaders);
+    return result;
+}
+
+TextureTranscoder::TextureTranscoder(const std::filesystem::path& cacheDirectory, uint32_t threadCount, bool ignoreCache)
+    : m_CacheDirectory(cacheDirectory)
+    , m_IgnoreCache(ignoreCache)
+{
+    if (threadCount == 0)
+        threadCount = std::max(std::thread::hardware_concurrency(), 1u);
+
+    for (uint32_t i = 0; i < threadCount; i++)
+        m_Workers.emplace_back(&TextureTranscoder::WorkerThread, this);
+}
+
+TextureTranscoder::~TextureTranscoder()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        m_Jobs.clear();
+        m_Terminate = true;
+    }
+    m_JobAvailable.notify_all();
+
+    for (std::thread& worker : m_Workers)
+        worker.join();
+}
+
+void TextureTranscoder::Request(const std::filesystem::path& sourceFileName, TextureUsage usage)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+
+        // The result is a placeholder without a cache file until a worker has finished the job
+        TranscodedTexture placeholder;
+        placeholder.sourceFileName = sourceFileName;
+        placeholder.usage = usage;
+        if (!m_Results.emplace(GetKey(sourceFileName, usage), placeholder).second)
+            return;
+
+        m_Jobs.push_back({ sourceFileName, usage });
+    }
+    m_JobAvailable.notify_one();
+}
+
+void TextureTranscoder::Flush()
+{
+    std::unique_lock<std::mutex> lock(m_Mutex);
+    m_JobFinished.wait(lock, [this]() { return m_Jobs.empty() && m_ActiveJobs == 0; });
+}
+
+std::string TextureTranscoder::GetKey(const std::filesystem::path& sourceFileName, TextureUsage usage)
+{
+    return sourceFileName.generic_string() + '|' + std::to_string(uint32_t(usage));
+}
+
+std::filesystem::path TextureTranscoder::Find(const std::filesystem::path& sourceFileName, TextureUsage usage)
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    auto it = m_Results.find(GetKey(sourceFileName, usage));
+    return it != m_Results.end() ? it->second.cacheFileName : std::filesystem::path();
+}
+
+std::vector<TranscodedTexture> TextureTranscoder::GetResults()
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    std::vector<TranscodedTexture> results;
+    results.reserve(m_Results.size());
+    for (const auto& [name, result] : m_Results)
+        results.push_back(result);
+    return results;
+}
+
+void TextureTranscoder::WorkerThread()
+{
+    while (true)
+    {
+        Job job;
+        {
+            std::unique_lock<std::mutex> lock(m_Mutex);
+            m_JobAvailable.wait(lock, [this]() { return m_Terminate || !m_Jobs.empty(); });
+
+            if (m_Jobs.empty())
+                return;
+
+            job = std::move(m_Jobs.front());
+            m_Jobs.pop_front();
+            ++m_ActiveJobs;
+        }
+
+        TranscodedTexture result = TranscodeTexture(job.sourceFileName, job.usage, m_CacheDirectory, m_IgnoreCache);
+
+        {
+            std::lock_guard<std::mutex> lock(m_Mutex);
+            --m_ActiveJobs;
+            m_Results[GetKey(job.sourceFileName, job.usage)] = std::move(result);
+        }
+        m_JobFinished.notify_all();
+    }
+}
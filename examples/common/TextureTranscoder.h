@@ -0,0 +1,135 @@
+/*
+* Copyright (c) 2014-2021, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// How the texture is sampled, which selects the block format:
+//   Color         BC7 sRGB
+//   LinearColor   BC7, for packed data such as metal-rough
+//   Normal        BC5, the shader reconstructs Z
+//   SingleChannel BC4 from the red channel, for occlusion and masks
+enum class TextureUsage : uint32_t
+{
+    Color,
+    LinearColor,
+    Normal,
+    SingleChannel
+};
+
+// Decoded RGBA8 image, rows are tightly packed
+struct DecodedImage
+{
+    uint32_t width = 0;
+    uint32_t height = 0;
+    std::vector<uint8_t> pixels;
+};
+
+// Decodes PNG, JPEG, TGA or BMP file contents to RGBA8
+bool DecodeImage(const void* fileData, size_t fileSize, DecodedImage& image);
+
+// Returns the full mip chain, level 0 first. Colors are filtered in linear space and normals are renormalized.
+std::vector<DecodedImage> GenerateMips(DecodedImage image, TextureUsage usage);
+
+// Block encoders over 4x4 RGBA8 pixels in row order
+void EncodeBC4Block(const uint8_t* pixels, uint32_t channel, uint8_t* block);  // 8 bytes
+void EncodeBC5Block(const uint8_t* pixels, uint8_t* block);                    // 16 bytes
+void EncodeBC7Block(const uint8_t* pixels, uint8_t* block);                    // 16 bytes, mode 6
+
+// Encodes the mips and writes them to a DDS file with a DX10 header, which TextureCache loads directly
+bool WriteCompressedDDS(const std::vector<DecodedImage>& mips, TextureUsage usage, const std::filesystem::path& fileName);
+
+struct TranscodedTexture
+{
+    std::filesystem::path sourceFileName;
+    std::filesystem::path cacheFileName; // empty on failure
+    TextureUsage usage = TextureUsage::Color;
+    bool fromCache = false;
+    uint32_t width = 0;
+    uint32_t height = 0;
+    uint32_t mipLevels = 0;
+    uint64_t uncompressedBytes = 0; // RGBA8 with the full mip chain, as uploaded from the source file
+    uint64_t compressedBytes = 0;
+    double decodeMs = 0.0;
+    double mipsMs = 0.0;
+    double encodeMs = 0.0;
+};
+
+// Transcodes one texture, or returns the cached DDS when the cache has an entry for the same file contents
+// and usage. Entries are named after a hash of the contents, so renamed or copied files share entries.
+TranscodedTexture TranscodeTexture(const std::filesystem::path& sourceFileName, TextureUsage usage,
+    const std::filesystem::path& cacheDirectory, bool ignoreCache = false);
+
+// Pool of threads running TranscodeTexture.
+//
+//   transcoder.Request(path, usage);    // any number of times, duplicates are ignored
+//   transcoder.Flush();                 // waits for every request
+//   transcoder.Find(path, usage);       // the DDS to load instead of the source, empty when unavailable
+//
+// A file used in several ways, such as an occlusion-roughness-metalness texture, has one entry per usage.
+class TextureTranscoder
+{
+public:
+    TextureTranscoder(const std::filesystem::path& cacheDirectory, uint32_t threadCount = 0, bool ignoreCache = false);
+    ~TextureTranscoder();
+
+    TextureTranscoder(const TextureTranscoder&) = delete;
+    TextureTranscoder& operator=(const TextureTranscoder&) = delete;
+
+    void Request(const std::filesystem::path& sourceFileName, TextureUsage usage);
+    void Flush();
+
+    [[nodiscard]] std::filesystem::path Find(const std::filesystem::path& sourceFileName, TextureUsage usage);
+    [[nodiscard]] std::vector<TranscodedTexture> GetResults();
+    [[nodiscard]] uint32_t GetThreadCount() const { return uint32_t(m_Workers.size()); }
+
+private:
+    struct Job
+    {
+        std::filesystem::path sourceFileName;
+        TextureUsage usage;
+    };
+
+    std::filesystem::path m_CacheDirectory;
+    bool m_IgnoreCache;
+
+    std::vector<std::thread> m_Workers;
+    std::mutex m_Mutex;
+    std::condition_variable m_JobAvailable;
+    std::condition_variable m_JobFinished;
+    std::deque<Job> m_Jobs;
+    uint32_t m_ActiveJobs = 0;
+    bool m_Terminate = false;
+    std::unordered_map<std::string, TranscodedTexture> m_Results;
+
+    static std::string GetKey(const std::filesystem::path& sourceFileName, TextureUsage usage);
+    void WorkerThread();
+};
@@ -0,0 +1,427 @@
+/*
+* Copyright (c) 2014-2021, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#include "TransformHierarchy.h"
+#include <donut/core/log.h>
+#include <algorithm>
+#include <cassert>
+#include <cfloat>
+#include <chrono>
+#include <cstring>
+#include <random>
+
+#ifdef DONUT_WITH_TASKFLOW
+#include <taskflow/taskflow.hpp>
+#endif
+
+using namespace donut;
+using namespace donut::math;
+
+static box3 EmptyBox()
+{
+    return box3(float3(FLT_MAX), float3(-FLT_MAX));
+}
+
+static box3 MergeBoxes(const box3& a, const box3& b)
+{
+    return box3(min(a.m_mins, b.m_mins), max(a.m_maxs, b.m_maxs));
+}
+
+// Center and extent form, so that the result stays tight for rotations
+static box3 TransformBox(const box3& box, const affine3& transform)
+{
+    float3 center = transform.transformPoint((box.m_mins + box.m_maxs) * 0.5f);
+    float3 extent = (box.m_maxs - box.m_mins) * 0.5f;
+    float3 worldExtent = abs(transform.m_linear.row0) * extent.x
+        + abs(transform.m_linear.row1) * extent.y
+        + abs(transform.m_linear.row2) * extent.z;
+    return box3(center - worldExtent, center + worldExtent);
+}
+
+uint32_t TransformHierarchy::AddNode(uint32_t parent, const affine3& localTransform)
+{
+    return AddNode(parent, localTransform, EmptyBox());
+}
+
+uint32_t TransformHierarchy::AddNode(uint32_t parent, const affine3& localTransform, const box3& localBounds)
+{
+    while (!m_OpenPath.empty() && m_OpenPath.back() != parent)
+        m_OpenPath.pop_back();
+    assert((parent == c_TransformHierarchyNoParent) == m_OpenPath.empty() && "Nodes must be added in depth-first order");
+
+    const uint32_t node = GetNodeCount();
+    m_Parents.push_back(parent);
+    m_SubtreeEnds.push_back(node + 1);
+    m_LocalTransforms.push_back(localTransform);
+    m_WorldTransforms.push_back(affine3::identity());
+    m_LocalBounds.push_back(localBounds);
+    m_WorldBounds.push_back(EmptyBox());
+    m_HasBounds.push_back(localBounds.m_mins.x <= localBounds.m_maxs.x);
+    m_Dirty.push_back(1);
+    m_SubtreeDirty.push_back(1);
+    m_Changed.push_back(0);
+
+    for (uint32_t ancestor : m_OpenPath)
+    {
+        m_SubtreeEnds[ancestor] = node + 1;
+        m_SubtreeDirty[ancestor] = 1;
+    }
+
+    m_OpenPath.push_back(node);
+    return node;
+}
+
+void TransformHierarchy::SetLocalTransform(uint32_t node, const affine3& localTransform)
+{
+    m_LocalTransforms[node] = localTransform;
+    m_Dirty[node] = 1;
+
+    // Ancestors of a node with the subtree flag already have it
+    for (uint32_t ancestor = node; ancestor != c_TransformHierarchyNoParent && !m_SubtreeDirty[ancestor]; ancestor = m_Parents[ancestor])
+        m_SubtreeDirty[ancestor] = 1;
+}
+
+bool TransformHierarchy::UpdateTransform(uint32_t node, bool parentChanged)
+{
+    bool changed = parentChanged || m_Dirty[node];
+    if (changed)
+    {
+        uint32_t parent = m_Parents[node];
+        m_WorldTransforms[node] = parent == c_TransformHierarchyNoParent
+            ? m_LocalTransforms[node]
+            : m_LocalTransforms[node] * m_WorldTransforms[parent];
+    }
+
+    m_Dirty[node] = 0;
+    m_SubtreeDirty[node] = 0;
+    m_Changed[node] = changed;
+    return changed;
+}
+
+void TransformHierarchy::MergeBounds(uint32_t node)
+{
+    box3 bounds = m_HasBounds[node] ? TransformBox(m_LocalBounds[node], m_WorldTransforms[node]) : EmptyBox();
+
+    const uint32_t end = m_SubtreeEnds[node];
+    for (uint32_t child = node + 1; child < end; child = m_SubtreeEnds[child])
+        bounds = MergeBoxes(bounds, m_WorldBounds[child]);
+
+    m_WorldBounds[node] = bounds;
+}
+
+void TransformHierarchy::UpdateSubtree(uint32_t root, bool parentChanged)
+{
+    // Transforms top-down in storage order, skipping clean subtrees, then bounds over the visited nodes in
+    // reverse order so that children are merged before their parents
+    std::vector<uint32_t> visited;
+
+    const uint32_t end = m_SubtreeEnds[root];
+    uint32_t node = root;
+    while (node < end)
+    {
+        bool parentWorldChanged = node == root ? parentChanged : bool(m_Changed[m_Parents[node]]);
+        if (!NeedsUpdate(node, parentWorldChanged))
+        {
+            node = m_SubtreeEnds[node];
+            continue;
+        }
+
+        UpdateTransform(node, parentWorldChanged);
+        visited.push_back(node);
+        node++;
+    }
+
+    for (auto it = visited.rbegin(); it != visited.rend(); ++it)
+        MergeBounds(*it);
+
+    m_UpdatedNodes.fetch_add(uint32_t(visited.size()), std::memory_order_relaxed);
+}
+
+void TransformHierarchy::UpdateChildren(uint32_t first, uint32_t end, bool parentChanged, tf::Subflow* subflow)
+{
+#ifdef DONUT_WITH_TASKFLOW
+    if (subflow)
+    {
+        // Large subtrees become tasks of their own, small siblings are batched up to the grain size
+        std::vector<uint32_t> batch;
+        uint32_t batchSize = 0;
+
+        for (uint32_t child = first; child < end; child = m_SubtreeEnds[child])
+        {
+            if (!NeedsUpdate(child, parentChanged))
+                continue;
+
+            uint32_t size = m_SubtreeEnds[child] - child;
+            if (size >= m_GrainSize)
+            {
+                subflow->emplace([this, child, parentChanged](tf::Subflow& childSubflow)
+                {
+                    UpdateSubtreeParallel(child, parentChanged, childSubflow);
+                });
+                continue;
+            }
+
+            batch.push_back(child);
+            batchSize += size;
+            if (batchSize >= m_GrainSize)
+            {
+                subflow->emplace([this, batch = std::move(batch), parentChanged]()
+                {
+                    for (uint32_t node : batch)
+                        UpdateSubtree(node, parentChanged);
+                });
+                batch.clear();
+                batchSize = 0;
+            }
+        }
+
+        for (uint32_t node : batch)
+            UpdateSubtree(node, parentChanged);
+
+        subflow->join();
+        return;
+    }
+#else
+    (void)subflow;
+#endif
+
+    for (uint32_t child = first; child < end; child = m_SubtreeEnds[child])
+    {
+        if (NeedsUpdate(child, parentChanged))
+            UpdateSubtree(child, parentChanged);
+    }
+}
+
+#ifdef DONUT_WITH_TASKFLOW
+void TransformHierarchy::UpdateSubtreeParallel(uint32_t node, bool parentChanged, tf::Subflow& subflow)
+{
+    // Chains of single children are followed in a loop, so deep hierarchies do not recurse once per level
+    std::vector<uint32_t> path;
+    while (true)
+    {
+        const uint32_t end = m_SubtreeEnds[node];
+        if (end - node < m_GrainSize)
+        {
+            UpdateSubtree(node, parentChanged);
+            break;
+        }
+
+        bool changed = UpdateTransform(node, parentChanged);
+        path.push_back(node);
+
+        const uint32_t firstChild = node + 1;
+        if (firstChild < end && m_SubtreeEnds[firstChild] == end)
+        {
+            if (!NeedsUpdate(firstChild, changed))
+                break;
+
+            node = firstChild;
+            parentChanged = changed;
+            continue;
+        }
+
+        UpdateChildren(firstChild, end, changed, &subflow);
+        break;
+    }
+
+    for (auto it = path.rbegin(); it != path.rend(); ++it)
+        MergeBounds(*it);
+
+    m_UpdatedNodes.fetch_add(uint32_t(path.size()), std::memory_order_relaxed);
+}
+#endif
+
+void TransformHierarchy::Refresh(tf::Executor* executor, uint32_t grainSize)
+{
+    m_GrainSize = std::max(grainSize, 1u);
+    m_UpdatedNodes.store(0, std::memory_order_relaxed);
+
+    // The roots are treated as the children of a virtual node that spans the whole hierarchy
+    const uint32_t nodeCount = GetNodeCount();
+
+#ifdef DONUT_WITH_TASKFLOW
+    if (executor && nodeCount >= m_GrainSize)
+    {
+        tf::Taskflow taskflow;
+        taskflow.emplace([this, nodeCount](tf::Subflow& subflow)
+        {
+            UpdateChildren(0, nodeCount, false, &subflow);
+        });
+        executor->run(taskflow).wait();
+        return;
+    }
+#else
+    (void)executor;
+#endif
+
+    UpdateChildren(0, nodeCount, false, nullptr);
+}
+
+namespace
+{
+    // Depth-first random tree with scene-like depth and fan-out; about half of the nodes carry bounds
+    void BuildSyntheticHierarchy(TransformHierarchy& hierarchy, uint32_t nodeCount, uint32_t seed)
+    {
+        const size_t maxDepth = 16;
+        std::mt19937 random(seed);
+        std::uniform_real_distribution<float> angle(-PI_f, PI_f);
+        std::uniform_real_distribution<float> offset(-10.f, 10.f);
+        std::uniform_real_distribution<float> scale(0.5f, 1.5f);
+        std::uniform_real_distribution<float> extent(0.1f, 2.f);
+
+        std::vector<uint32_t> ancestors;
+        for (uint32_t node = 0; node < nodeCount; node++)
+        {
+            while (ancestors.size() > 1 && (ancestors.size() >= maxDepth || (random() & 1)))
+                ancestors.pop_back();
+
+            uint32_t parent = ancestors.empty() ? c_TransformHierarchyNoParent : ancestors.back();
+            affine3 transform = scaling(float3(scale(random)))
+                * yawPitchRoll(angle(random), angle(random), angle(random))
+                * translation(float3(offset(random), offset(random), offset(random)));
+
+            if (random() & 1)
+            {
+                float3 halfSize(extent(random), extent(random), extent(random));
+                hierarchy.AddNode(parent, transform, box3(-halfSize, halfSize));
+            }
+            else
+                hierarchy.AddNode(parent, transform);
+
+            ancestors.push_back(node);
+        }
+    }
+
+    // Rotates the given fraction of the nodes, chosen by the seed
+    void AnimateHierarchy(TransformHierarchy& hierarchy, float fraction, uint32_t seed)
+    {
+        const uint32_t nodeCount = hierarchy.GetNodeCount();
+        const affine3 rotation = yawPitchRoll(0.01f, 0.f, 0.f);
+
+        if (fraction >= 1.f)
+        {
+            for (uint32_t node = 0; node < nodeCount; node++)
+                hierarchy.SetLocalTransform(node, rotation * hierarchy.GetLocalTransform(node));
+            return;
+        }
+
+        std::mt19937 random(seed);
+        const uint32_t animatedCount = std::max(uint32_t(float(nodeCount) * fraction), 1u);
+        for (uint32_t i = 0; i < animatedCount; i++)
+        {
+            uint32_t node = random() % nodeCount;
+            hierarchy.SetLocalTransform(node, rotation * hierarchy.GetLocalTransform(node));
+        }
+    }
+
+    // Copies the local state into a new hierarchy where every node is dirty, so that its refresh recomputes
+    // everything without pruning
+    void CopyLocalState(const TransformHierarchy& source, TransformHierarchy& destination)
+    {
+        for (uint32_t node = 0; node < source.GetNodeCount(); node++)
+        {
+            if (source.HasLocalBounds(node))
+                destination.AddNode(source.GetParent(node), source.GetLocalTransform(node), source.GetLocalBounds(node));
+            else
+                destination.AddNode(source.GetParent(node), source.GetLocalTransform(node));
+        }
+    }
+
+    bool BitwiseEqual(const TransformHierarchy& a, const TransformHierarchy& b)
+    {
+        return a.GetNodeCount() == b.GetNodeCount()
+            && memcmp(a.GetWorldTransforms().data(), b.GetWorldTransforms().data(), sizeof(affine3) * a.GetNodeCount()) == 0
+            && memcmp(a.GetWorldBounds().data(), b.GetWorldBounds().data(), sizeof(box3) * a.GetNodeCount()) == 0;
+    }
+}
+
+int RunTransformHierarchyBenchmark(tf::Executor* executor)
+{
+    const uint32_t nodeCounts[] = { 10000, 100000, 1000000 };
+    const float fractions[] = { 1.f, 0.1f, 0.01f };
+    int violations = 0;
+
+    for (uint32_t nodeCount : nodeCounts)
+    {
+        TransformHierarchy serial;
+        TransformHierarchy parallel;
+        BuildSyntheticHierarchy(serial, nodeCount, nodeCount);
+        BuildSyntheticHierarchy(parallel, nodeCount, nodeCount);
+        serial.Refresh();
+        parallel.Refresh(executor);
+
+        const uint32_t runs = std::clamp(2000000u / nodeCount, 3u, 100u);
+
+        for (float fraction : fractions)
+        {
+            double serialMs = 0.0;
+            double parallelMs = 0.0;
+            uint32_t updatedNodes = 0;
+
+            for (uint32_t run = 0; run < runs; run++)
+            {
+                const uint32_t seed = run * 7919u + uint32_t(fraction * 1000.f);
+                AnimateHierarchy(serial, fraction, seed);
+                AnimateHierarchy(parallel, fraction, seed);
+
+                auto start = std::chrono::high_resolution_clock::now();
+                serial.Refresh();
+                auto serialEnd = std::chrono::high_resolution_clock::now();
+                parallel.Refresh(executor);
+                auto parallelEnd = std::chrono::high_resolution_clock::now();
+
+                serialMs += std::chrono::duration<double, std::milli>(serialEnd - start).count();
+                parallelMs += std::chrono::duration<double, std::milli>(parallelEnd - serialEnd).count();
+                updatedNodes += serial.GetUpdatedNodeCount();
+
+                if (parallel.GetUpdatedNodeCount() != serial.GetUpdatedNodeCount())
+                {
+                    log::warning("Transform hierarchy benchmark: %u nodes updated in parallel, %u serially",
+                        parallel.GetUpdatedNodeCount(), serial.GetUpdatedNodeCount());
+                    ++violations;
+                }
+            }
+
+            if (!BitwiseEqual(serial, parallel))
+            {
+                log::warning("Transform hierarchy benchmark: parallel refresh of %u nodes differs from the serial one", nodeCount);
+                ++violations;
+            }
+
+            log::info("Transform hierarchy benchmark: %7u nodes, %5.1f%% animated, %8u nodes updated: serial %8.3f ms, parallel %8.3f ms (%.1fx)",
+                nodeCount, fraction * 100.f, updatedNodes / runs, serialMs / runs, parallelMs / runs, serialMs / parallelMs);
+        }
+
+        // Pruned refreshes must end up where a full refresh of the same local state does
+        TransformHierarchy reference;
+        CopyLocalState(serial, reference);
+        reference.Refresh();
+        if (!BitwiseEqual(serial, reference))
+        {
+            log::warning("Transform hierarchy benchmark: pruned refresh of %u nodes differs from a full refresh", nodeCount);
+            ++violations;
+        }
+    }
+
+    log::info("Transform hierarchy benchmark: %s, %d violations", executor ? "serial and parallel" : "serial only", violations);
+    return violations;
+}
@@ -0,0 +1,102 @@
+/*
+* Copyright (c) 2014-2021, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#pragma once
+
+#include <donut/core/math/math.h>
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+namespace tf
+{
+    class Executor;
+    class Subflow;
+}
+
+constexpr uint32_t c_TransformHierarchyNoParent = ~0u;
+
+// Flat transform hierarchy with dirty-flag pruning and subtree-parallel refresh.
+//
+// Nodes are stored in depth-first order, so that every subtree is a contiguous range and the children of
+// a node are found by jumping from one subtree end to the next. Refresh() computes world transforms
+// top-down and world bounds bottom-up, visiting only nodes whose transform changed or that have a changed
+// descendant; clean subtrees keep the results of the previous refresh.
+//
+// With an executor, subtrees of at least the grain size become Taskflow tasks and smaller siblings are
+// batched into tasks of about the grain size, so that idle workers steal whole subtrees. Every node is
+// written by exactly one task and parents merge their children's bounds after joining them, so the
+// results are identical to a serial refresh.
+class TransformHierarchy
+{
+public:
+    // The parent must be the previously added node or one of its ancestors, which keeps depth-first order
+    uint32_t AddNode(uint32_t parent, const donut::math::affine3& localTransform);
+    // Nodes with local bounds, such as mesh instances, contribute them to their own and their ancestors' world bounds
+    uint32_t AddNode(uint32_t parent, const donut::math::affine3& localTransform, const donut::math::box3& localBounds);
+
+    // Not thread safe, and not allowed during Refresh()
+    void SetLocalTransform(uint32_t node, const donut::math::affine3& localTransform);
+
+    // Uses the executor when built with DONUT_WITH_TASKFLOW and one is given, otherwise runs serially
+    void Refresh(tf::Executor* executor = nullptr, uint32_t grainSize = 4096);
+
+    [[nodiscard]] uint32_t GetNodeCount() const { return uint32_t(m_Parents.size()); }
+    [[nodiscard]] uint32_t GetParent(uint32_t node) const { return m_Parents[node]; }
+    [[nodiscard]] uint32_t GetSubtreeEnd(uint32_t node) const { return m_SubtreeEnds[node]; }
+    [[nodiscard]] const donut::math::affine3& GetLocalTransform(uint32_t node) const { return m_LocalTransforms[node]; }
+    [[nodiscard]] const donut::math::box3& GetLocalBounds(uint32_t node) const { return m_LocalBounds[node]; }
+    [[nodiscard]] bool HasLocalBounds(uint32_t node) const { return m_HasBounds[node] != 0; }
+    [[nodiscard]] const donut::math::affine3& GetWorldTransform(uint32_t node) const { return m_WorldTransforms[node]; }
+    [[nodiscard]] const donut::math::box3& GetWorldBounds(uint32_t node) const { return m_WorldBounds[node]; }
+    [[nodiscard]] const std::vector<donut::math::affine3>& GetWorldTransforms() const { return m_WorldTransforms; }
+    [[nodiscard]] const std::vector<donut::math::box3>& GetWorldBounds() const { return m_WorldBounds; }
+
+    // Nodes whose transform and bounds were recomputed by the last refresh
+    [[nodiscard]] uint32_t GetUpdatedNodeCount() const { return m_UpdatedNodes.load(std::memory_order_relaxed); }
+
+private:
+    std::vector<uint32_t> m_Parents;
+    std::vector<uint32_t> m_SubtreeEnds;
+    std::vector<donut::math::affine3> m_LocalTransforms;
+    std::vector<donut::math::affine3> m_WorldTransforms;
+    std::vector<donut::math::box3> m_LocalBounds;
+    std::vector<donut::math::box3> m_WorldBounds;
+    std::vector<uint8_t> m_HasBounds;
+    std::vector<uint8_t> m_Dirty;         // the local transform changed
+    std::vector<uint8_t> m_SubtreeDirty;  // the node or one of its descendants is dirty
+    std::vector<uint8_t> m_Changed;       // the world transform changed in this refresh, valid for visited nodes
+    std::vector<uint32_t> m_OpenPath;     // ancestors of the next node while adding
+    uint32_t m_GrainSize = 4096;
+    std::atomic<uint32_t> m_UpdatedNodes{ 0 };
+
+    [[nodiscard]] bool NeedsUpdate(uint32_t node, bool parentChanged) const { return parentChanged || m_SubtreeDirty[node]; }
+    bool UpdateTransform(uint32_t node, bool parentChanged);
+    void MergeBounds(uint32_t node);
+    void UpdateSubtree(uint32_t root, bool parentChanged);
+    void UpdateChildren(uint32_t first, uint32_t end, bool parentChanged, tf::Subflow* subflow);
+    void UpdateSubtreeParallel(uint32_t node, bool parentChanged, tf::Subflow& subflow);
+};
+
+// Refreshes synthetic hierarchies of 10k to 1M nodes with all or 1% of the nodes animated, serially and on
+// the executor (when available), compares the results and logs the timings. Returns the number of mismatches.
+int RunTransformHierarchyBenchmark(tf::Executor* executor);
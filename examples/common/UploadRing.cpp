@@ -0,0 +1,419 @@
+/*
+* Copyright (c) 2014-2021, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#include "UploadRing.h"
+#include <donut/core/log.h>
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <cstring>
+#include <mutex>
+#include <random>
+#include <thread>
+
+using namespace donut;
+
+UploadRingAllocator::UploadRingAllocator(uint64_t capacity, uint64_t chunkSize)
+    : m_Capacity((std::max(capacity, chunkSize) + chunkSize - 1) & ~(chunkSize - 1))
+    , m_ChunkSize(chunkSize)
+{
+    assert((chunkSize & (chunkSize - 1)) == 0);
+}
+
+bool UploadRingAllocator::AcquireSpan(uint64_t size, uint64_t& start)
+{
+    uint64_t head = m_Head.load(std::memory_order_relaxed);
+    while (true)
+    {
+        // Spans never wrap around the end of the ring; the remainder before the end is skipped
+        uint64_t begin = head;
+        if (begin % m_Capacity + size > m_Capacity)
+            begin += m_Capacity - begin % m_Capacity;
+
+        if (begin + size - m_Tail.load(std::memory_order_acquire) > m_Capacity)
+            return false;
+
+        if (m_Head.compare_exchange_weak(head, begin + size, std::memory_order_acq_rel, std::memory_order_relaxed))
+        {
+            start = begin;
+            return true;
+        }
+    }
+}
+
+uint64_t UploadRingAllocator::Allocate(Context& context, uint64_t size, uint64_t alignment)
+{
+    assert(alignment != 0 && (alignment & (alignment - 1)) == 0 && alignment <= m_ChunkSize);
+
+    uint64_t start = 0;
+
+    if (size > m_ChunkSize / 4)
+    {
+        if (!AcquireSpan((size + m_ChunkSize - 1) & ~(m_ChunkSize - 1), start))
+        {
+            m_FailedAllocations.fetch_add(1, std::memory_order_relaxed);
+            return c_UploadRingInvalidOffset;
+        }
+        return start % m_Capacity;
+    }
+
+    // Chunks start at multiples of the chunk size, so aligning the position aligns the ring offset
+    const uint64_t frame = m_Frame.load(std::memory_order_acquire);
+    if (context.frame == frame)
+    {
+        uint64_t offset = (context.position + alignment - 1) & ~(alignment - 1);
+        if (offset + size <= context.chunkEnd)
+        {
+            context.position = offset + size;
+            return offset % m_Capacity;
+        }
+    }
+
+    if (!AcquireSpan(m_ChunkSize, start))
+    {
+        m_FailedAllocations.fetch_add(1, std::memory_order_relaxed);
+        return c_UploadRingInvalidOffset;
+    }
+
+    context.frame = frame;
+    context.position = start + size;
+    context.chunkEnd = start + m_ChunkSize;
+    return start % m_Capacity;
+}
+
+uint64_t UploadRingAllocator::EndFrame()
+{
+    // Contexts see the new frame on their next allocation and leave the rest of their chunk behind
+    m_Frame.fetch_add(1, std::memory_order_release);
+    return m_Head.load(std::memory_order_acquire);
+}
+
+void UploadRingAllocator::Release(uint64_t position)
+{
+    if (position > m_Tail.load(std::memory_order_relaxed))
+        m_Tail.store(position, std::memory_order_release);
+}
+
+UploadRing::UploadRing(nvrhi::IDevice* device, uint64_t capacity, uint64_t chunkSize)
+    : m_Device(device)
+    , m_Allocator(capacity, chunkSize)
+{
+    nvrhi::BufferDesc bufferDesc;
+    bufferDesc.byteSize = m_Allocator.GetCapacity();
+    bufferDesc.cpuAccess = nvrhi::CpuAccessMode::Write;
+    bufferDesc.initialState = nvrhi::ResourceStates::CopySource;
+    bufferDesc.keepInitialState = true;
+    bufferDesc.debugName = "UploadRing";
+    m_Buffer = device->createBuffer(bufferDesc);
+
+    // The buffer stays mapped for its lifetime; every write goes through writeBuffer if mapping fails
+    if (m_Buffer)
+        m_MappedData = static_cast<uint8_t*>(device->mapBuffer(m_Buffer, nvrhi::CpuAccessMode::Write));
+
+    if (!m_MappedData)
+        log::warning("Cannot map the upload ring, falling back to writeBuffer");
+}
+
+UploadRing::~UploadRing()
+{
+    if (m_MappedData)
+        m_Device->unmapBuffer(m_Buffer);
+}
+
+UploadRing::Allocation UploadRing::Allocate(Context& context, size_t size, size_t alignment)
+{
+    if (!m_MappedData)
+        return Allocation();
+
+    uint64_t offset = m_Allocator.Allocate(context, size, alignment);
+    if (offset == c_UploadRingInvalidOffset)
+        return Allocation();
+
+    Allocation allocation;
+    allocation.buffer = m_Buffer;
+    allocation.offset = offset;
+    allocation.cpuAddress = m_MappedData + offset;
+    return allocation;
+}
+
+void UploadRing::Write(Context& context, nvrhi::ICommandList* commandList, nvrhi::IBuffer* destination, const void* data, size_t size, uint64_t destinationOffset)
+{
+    // Volatile constant buffers cannot be copy destinations, they are written with writeBuffer
+    // without taking space from the ring
+    if (destination->getDesc().isVolatile)
+    {
+        commandList->writeBuffer(destination, data, size, destinationOffset);
+        return;
+    }
+
+    Allocation allocation = Allocate(context, size);
+    if (!allocation.buffer)
+    {
+        commandList->writeBuffer(destination, data, size, destinationOffset);
+
+        // An unmapped ring sends every write here, which the constructor has already reported
+        if (m_MappedData)
+            m_FallbackWrites.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    std::memcpy(allocation.cpuAddress, data, size);
+    commandList->copyBuffer(destination, destinationOffset, allocation.buffer, allocation.offset, size);
+    m_BytesWritten.fetch_add(size, std::memory_order_relaxed);
+}
+
+void UploadRing::EndFrame()
+{
+    nvrhi::EventQueryHandle query;
+    if (!m_FreeQueries.empty())
+    {
+        query = m_FreeQueries.back();
+        m_FreeQueries.pop_back();
+        m_Device->resetEventQuery(query);
+    }
+    else
+    {
+        query = m_Device->createEventQuery();
+    }
+
+    m_Device->setEventQuery(query, nvrhi::CommandQueue::Graphics);
+    m_PendingFrames.push_back({ query, m_Allocator.EndFrame() });
+
+    while (!m_PendingFrames.empty() && m_Device->pollEventQuery(m_PendingFrames.front().query))
+    {
+        m_Allocator.Release(m_PendingFrames.front().position);
+        m_FreeQueries.push_back(m_PendingFrames.front().query);
+        m_PendingFrames.pop_front();
+    }
+}
+
+UploadRing::Stats UploadRing::GetStats() const
+{
+    Stats stats;
+    stats.bytesWritten = m_BytesWritten.load(std::memory_order_relaxed);
+    stats.fallbackWrites = m_FallbackWrites.load(std::memory_order_relaxed);
+    stats.usedBytes = m_Allocator.GetUsedBytes();
+    stats.framesInFlight = uint32_t(m_PendingFrames.size());
+    return stats;
+}
+
+namespace
+{
+    struct TestAllocation
+    {
+        uint64_t offset;
+        uint32_t size;
+        uint32_t tag;
+    };
+
+    // Baseline for the benchmark: a single bump pointer behind a mutex
+    class LockedBumpAllocator
+    {
+    public:
+        explicit LockedBumpAllocator(uint64_t capacity) : m_Capacity(capacity) { }
+
+        uint64_t Allocate(uint64_t size, uint64_t alignment)
+        {
+            std::lock_guard<std::mutex> lock(m_Mutex);
+            uint64_t begin = (m_Head + alignment - 1) & ~(alignment - 1);
+            if (begin % m_Capacity + size > m_Capacity)
+                begin += m_Capacity - begin % m_Capacity;
+            if (begin + size - m_Tail > m_Capacity)
+                return c_UploadRingInvalidOffset;
+            m_Head = begin + size;
+            return begin % m_Capacity;
+        }
+
+        uint64_t EndFrame() { std::lock_guard<std::mutex> lock(m_Mutex); return m_Head; }
+        void Release(uint64_t position) { std::lock_guard<std::mutex> lock(m_Mutex); m_Tail = std::max(m_Tail, position); }
+
+    private:
+        std::mutex m_Mutex;
+        uint64_t m_Capacity;
+        uint64_t m_Head = 0;
+        uint64_t m_Tail = 0;
+    };
+
+    // Runs the function on every thread for every frame and returns the wall time in seconds. Each frame
+    // is released two frames later, as if the GPU were that far behind.
+    template<typename EndFrame, typename Release, typename Function>
+    double RunFrames(uint32_t threadCount, uint32_t frameCount, EndFrame endFrame, Release release, Function function)
+    {
+        auto start = std::chrono::high_resolution_clock::now();
+
+        std::deque<uint64_t> fences;
+        for (uint32_t frame = 0; frame < frameCount; frame++)
+        {
+            std::vector<std::thread> threads;
+            for (uint32_t thread = 0; thread < threadCount; thread++)
+                threads.emplace_back(function, thread, frame);
+            for (std::thread& thread : threads)
+                thread.join();
+
+            fences.push_back(endFrame());
+            while (fences.size() > 2)
+            {
+                release(fences.front());
+                fences.pop_front();
+            }
+        }
+
+        return std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+    }
+}
+
+int RunUploadRingSelfTest(uint32_t threadCount)
+{
+    if (threadCount == 0)
+        threadCount = std::clamp(std::thread::hardware_concurrency(), 2u, 16u);
+
+    const uint64_t capacity = 8 * 1024 * 1024;
+    const uint64_t chunkSize = 64 * 1024;
+    const uint32_t frameCount = 120;
+    const uint32_t overflowFrame = 60;
+    const uint32_t allocationsPerFrame = 2000;
+
+    // Correctness: every allocation is filled with its own tag, and the tags of all frames that are
+    // not released yet are checked after each frame
+    std::vector<uint32_t> memory(capacity / sizeof(uint32_t));
+    std::vector<UploadRingAllocator::Context> contexts(threadCount);
+    std::deque<std::vector<std::vector<TestAllocation>>> liveFrames;
+    std::atomic<int> violations{ 0 };
+
+    UploadRingAllocator ring(capacity, chunkSize);
+    std::deque<uint64_t> fences;
+    for (uint32_t frame = 0; frame < frameCount; frame++)
+    {
+        liveFrames.emplace_back(threadCount);
+        auto& frameAllocations = liveFrames.back();
+
+        std::vector<std::thread> threads;
+        for (uint32_t thread = 0; thread < threadCount; thread++)
+        {
+            threads.emplace_back([&, thread, frame]()
+            {
+                std::mt19937 random(frame * 7919u + thread);
+                const uint32_t count = frame == overflowFrame ? allocationsPerFrame * 20 : allocationsPerFrame;
+
+                for (uint32_t i = 0; i < count; i++)
+                {
+                    uint32_t size = 16 * (1 + random() % 32);
+                    if (random() % 200 == 0)
+                        size = 16 * 1024 * (2 + random() % 5); // past a quarter chunk, takes a dedicated span
+                    uint64_t alignment = (random() % 4 == 0) ? 256 : 16;
+
+                    uint64_t offset = ring.Allocate(contexts[thread], size, alignment);
+                    if (offset == c_UploadRingInvalidOffset)
+                        continue;
+
+                    if (offset % alignment != 0 || offset + size > ring.GetCapacity())
+                    {
+                        ++violations;
+                        continue;
+                    }
+
+                    uint32_t tag = (frame << 20) ^ (thread << 16) ^ i ^ 0x80000000u;
+                    std::fill_n(&memory[offset / sizeof(uint32_t)], size / sizeof(uint32_t), tag);
+                    frameAllocations[thread].push_back({ offset, size, tag });
+                }
+            });
+        }
+        for (std::thread& thread : threads)
+            thread.join();
+
+        for (const auto& liveFrame : liveFrames)
+        {
+            for (const auto& threadAllocations : liveFrame)
+            {
+                for (const TestAllocation& allocation : threadAllocations)
+                {
+                    const uint32_t* words = &memory[allocation.offset / sizeof(uint32_t)];
+                    if (std::any_of(words, words + allocation.size / sizeof(uint32_t), [&](uint32_t word) { return word != allocation.tag; }))
+                    {
+                        log::warning("Upload ring self-test: allocation at %llu of %u bytes was overwritten", (unsigned long long)allocation.offset, allocation.size);
+                        ++violations;
+                    }
+                }
+            }
+        }
+
+        fences.push_back(ring.EndFrame());
+        while (fences.size() > 2)
+        {
+            ring.Release(fences.front());
+            fences.pop_front();
+            liveFrames.pop_front();
+        }
+    }
+
+    // The overflow frame asks for more than the ring holds, so some allocations must have failed
+    if (ring.GetFailedAllocations() == 0)
+    {
+        log::warning("Upload ring self-test: expected allocations to fail when the ring is full");
+        ++violations;
+    }
+
+    log::info("Upload ring self-test: %u threads, %u frames, %llu failed allocations when full, %d violations",
+        threadCount, frameCount, (unsigned long long)ring.GetFailedAllocations(), violations.load());
+
+    // Throughput of small allocations, with a write of the data as for constants
+    const uint32_t benchmarkFrames = 50;
+    const uint32_t benchmarkAllocations = 20000;
+    const uint32_t benchmarkSize = 256;
+    std::vector<uint8_t> benchmarkMemory(capacity * 4);
+
+    UploadRingAllocator lockFree(benchmarkMemory.size(), chunkSize);
+    std::vector<UploadRingAllocator::Context> benchmarkContexts(threadCount);
+    double lockFreeSeconds = RunFrames(threadCount, benchmarkFrames,
+        [&]() { return lockFree.EndFrame(); },
+        [&](uint64_t position) { lockFree.Release(position); },
+        [&](uint32_t thread, uint32_t)
+        {
+            for (uint32_t i = 0; i < benchmarkAllocations; i++)
+            {
+                uint64_t offset = lockFree.Allocate(benchmarkContexts[thread], benchmarkSize, 256);
+                if (offset != c_UploadRingInvalidOffset)
+                    std::memset(&benchmarkMemory[offset], int(i), benchmarkSize);
+            }
+        });
+
+    LockedBumpAllocator locked(benchmarkMemory.size());
+    double lockedSeconds = RunFrames(threadCount, benchmarkFrames,
+        [&]() { return locked.EndFrame(); },
+        [&](uint64_t position) { locked.Release(position); },
+        [&](uint32_t, uint32_t)
+        {
+            for (uint32_t i = 0; i < benchmarkAllocations; i++)
+            {
+                uint64_t offset = locked.Allocate(benchmarkSize, 256);
+                if (offset != c_UploadRingInvalidOffset)
+                    std::memset(&benchmarkMemory[offset], int(i), benchmarkSize);
+            }
+        });
+
+    const double totalAllocations = double(threadCount) * benchmarkFrames * benchmarkAllocations;
+    log::info("Upload ring benchmark: %.1f M allocations/s (%.1f GB/s), mutex baseline %.1f M allocations/s (%.1f GB/s)",
+        totalAllocations / lockFreeSeconds * 1e-6, totalAllocations * benchmarkSize / lockFreeSeconds * 1e-9,
+        totalAllocations / lockedSeconds * 1e-6, totalAllocations * benchmarkSize / lockedSeconds * 1e-9);
+
+    return violations;
+}
@@ -0,0 +1,142 @@
+/*
+* Copyright (c) 2014-2021, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#pragma once
+
+#include <nvrhi/nvrhi.h>
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+constexpr uint64_t c_UploadRingInvalidOffset = ~0ull;
+
+// Lock-free sub-allocator over a ring of bytes.
+//
+// Positions grow monotonically and map to ring offsets modulo the capacity. Threads take whole chunks
+// from the shared head with a compare-and-swap, then sub-allocate from their chunk through a Context
+// without touching shared state. A Context belongs to one thread at a time, typically one per command
+// list. Allocations larger than a quarter chunk get a dedicated span.
+//
+// EndFrame() must not run concurrently with Allocate(). It returns the position that the frame's
+// allocations end at; once the GPU has finished the frame, Release() with that position frees them.
+// When the ring is full, Allocate() fails instead of waiting.
+class UploadRingAllocator
+{
+public:
+    struct Context
+    {
+        uint64_t position = 0;
+        uint64_t chunkEnd = 0;
+        uint64_t frame = ~0ull;
+    };
+
+    // The capacity is rounded up to a multiple of the chunk size, which must be a power of two
+    UploadRingAllocator(uint64_t capacity, uint64_t chunkSize);
+
+    // Returns a ring offset aligned to the alignment (a power of two up to the chunk size), or c_UploadRingInvalidOffset
+    uint64_t Allocate(Context& context, uint64_t size, uint64_t alignment);
+
+    uint64_t EndFrame();
+    void Release(uint64_t position);
+
+    [[nodiscard]] uint64_t GetCapacity() const { return m_Capacity; }
+    [[nodiscard]] uint64_t GetChunkSize() const { return m_ChunkSize; }
+    [[nodiscard]] uint64_t GetUsedBytes() const { return m_Head.load(std::memory_order_relaxed) - m_Tail.load(std::memory_order_relaxed); }
+    [[nodiscard]] uint64_t GetFailedAllocations() const { return m_FailedAllocations.load(std::memory_order_relaxed); }
+
+private:
+    uint64_t m_Capacity;
+    uint64_t m_ChunkSize;
+    std::atomic<uint64_t> m_Head{ 0 };
+    std::atomic<uint64_t> m_Tail{ 0 };
+    std::atomic<uint64_t> m_Frame{ 0 };
+    std::atomic<uint64_t> m_FailedAllocations{ 0 };
+
+    bool AcquireSpan(uint64_t size, uint64_t& start);
+};
+
+// Persistently mapped upload buffer on top of UploadRingAllocator. Data is written into the mapping from
+// any thread and copied into device buffers by the command list, replacing writeBuffer for per-frame data.
+//
+// Usage per frame:
+//   ring.Write(context, commandList, buffer, &data, sizeof(data));  // from any recording thread
+//   device->executeCommandList(commandList);
+//   ring.EndFrame();                                                // after every list of the frame was executed
+class UploadRing
+{
+public:
+    using Context = UploadRingAllocator::Context;
+
+    struct Allocation
+    {
+        nvrhi::IBuffer* buffer = nullptr;
+        uint64_t offset = 0;
+        void* cpuAddress = nullptr;
+    };
+
+    struct Stats
+    {
+        uint64_t bytesWritten = 0;
+        uint64_t fallbackWrites = 0; // writes that went through writeBuffer because the ring was full
+        uint64_t usedBytes = 0;
+        uint32_t framesInFlight = 0;
+    };
+
+    UploadRing(nvrhi::IDevice* device, uint64_t capacity = 8 * 1024 * 1024, uint64_t chunkSize = 64 * 1024);
+    ~UploadRing();
+
+    UploadRing(const UploadRing&) = delete;
+    UploadRing& operator=(const UploadRing&) = delete;
+
+    // Returns an allocation without a buffer when the ring is full
+    Allocation Allocate(Context& context, size_t size, size_t alignment = 16);
+
+    // Copies the data into the destination through the ring, or with writeBuffer when the ring is full
+    void Write(Context& context, nvrhi::ICommandList* commandList, nvrhi::IBuffer* destination, const void* data, size_t size, uint64_t destinationOffset = 0);
+
+    void EndFrame();
+
+    [[nodiscard]] Stats GetStats() const;
+
+private:
+    struct PendingFrame
+    {
+        nvrhi::EventQueryHandle query;
+        uint64_t position;
+    };
+
+    nvrhi::DeviceHandle m_Device;
+    nvrhi::BufferHandle m_Buffer;
+    uint8_t* m_MappedData = nullptr;
+    UploadRingAllocator m_Allocator;
+
+    std::deque<PendingFrame> m_PendingFrames;
+    std::vector<nvrhi::EventQueryHandle> m_FreeQueries;
+    std::atomic<uint64_t> m_BytesWritten{ 0 };
+    std::atomic<uint64_t> m_FallbackWrites{ 0 };
+};
+
+// Stresses the allocator from several threads over simulated frames with two frames of GPU latency and
+// checks that no allocation overlaps another live one. Then compares its throughput with a mutex-guarded
+// bump allocator. Runs without a device. Returns the number of violations.
+int RunUploadRingSelfTest(uint32_t threadCount = 0);
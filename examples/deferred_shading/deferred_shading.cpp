@@ -33,6 +33,7 @@
 #include <donut/render/GBuffer.h>
 #include <donut/render/GBufferFillPass.h>
 #include <donut/render/DrawStrategy.h>
+#include <cstring>
 
 using namespace donut;
 using namespace donut::math;
@@ -43,6 +44,7 @@ using namespace donut::render;
 #include <donut/shaders/bindless.h>
 
 #include "CubeGeometry.h"
+#include "TextureTranscoder.h"
 
 static const char* g_WindowTitle = "Donut Example: Deferred Shading";
 
@@ -78,7 +80,7 @@ class SimpleScene
 {
 public:
 
-    bool Init(nvrhi::IDevice* device, nvrhi::ICommandList* commandList, TextureCache* textureCache)
+    bool Init(nvrhi::IDevice* device, nvrhi::ICommandList* commandList, TextureCache* textureCache, bool compressTextures)
     {
         commandList->open();
 
@@ -106,6 +108,14 @@ public:
 
         std::filesystem::path textureFileName = app::GetDirectoryWithExecutable().parent_path() / "media/nvidia-logo.png";
 
+        // Load a BC7 copy with mips from the transcoder cache, transcoding it on first use
+        if (compressTextures)
+        {
+            TranscodedTexture transcoded = TranscodeTexture(textureFileName, TextureUsage::Color, textureFileName.parent_path() / "texture_cache");
+            if (!transcoded.cacheFileName.empty())
+                textureFileName = transcoded.cacheFileName;
+        }
+
         m_Material = std::make_shared<Material>();
         m_Material->name = "CubeMaterial";
         m_Material->useSpecularGlossModel = true;
@@ -257,7 +267,7 @@ public:
         m_View.UpdateCache();
     }
     
-    bool Init()
+    bool Init(bool compressTextures)
     {
         auto nativeFS = std::make_shared<vfs::NativeFileSystem>();
 
@@ -276,7 +286,7 @@ public:
 
         m_CommandList = GetDevice()->createCommandList();
 
-        return m_Scene.Init(GetDevice(), m_CommandList, m_TextureCache.get());
+        return m_Scene.Init(GetDevice(), m_CommandList, m_TextureCache.get(), compressTextures);
     }
 
     void Animate(float seconds) override
@@ -377,6 +387,13 @@ int main(int __argc, const char** __argv)
     deviceParams.enableNvrhiValidationLayer = true;
 #endif
 
+    bool compressTextures = false;
+    for (int i = 1; i < __argc; i++)
+    {
+        if (strcmp(__argv[i], "-compress-textures") == 0)
+            compressTextures = true;
+    }
+
     if (!deviceManager->CreateWindowDeviceAndSwapChain(deviceParams, g_WindowTitle))
     {
         log::fatal("Cannot initialize a graphics device with the requested parameters");
@@ -385,7 +402,7 @@ int main(int __argc, const char** __argv)
 
     {
         DeferredShading example(deviceManager);
-        if (example.Init())
+        if (example.Init(compressTextures))
         {
             deviceManager->AddRenderPassToBack(&example);
             deviceManager->RunMessageLoop();
@@ -21,90 +21,466 @@
 */
 
 #include <donut/app/ApplicationBase.h>
+#include <donut/app/Camera.h>
 #include <donut/engine/ShaderFactory.h>
+#include <donut/engine/CommonRenderPasses.h>
+#include <donut/engine/TextureCache.h>
+#include <donut/engine/Scene.h>
+#include <donut/engine/DescriptorTableManager.h>
+#include <donut/engine/BindingCache.h>
 #include <donut/app/DeviceManager.h>
 #include <donut/core/log.h>
 #include <donut/core/vfs/VFS.h>
+#include <donut/core/math/math.h>
 #include <nvrhi/utils.h>
 
+#include "MeshletBuilder.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <unordered_map>
+
 using namespace donut;
+using namespace donut::math;
+
+#include <donut/shaders/view_cb.h>
+#include "meshlets_cb.h"
 
 static const char* g_WindowTitle = "Donut Example: Meshlets";
 
-class MeshletExample : public app::IRenderPass
+static_assert(MAX_VERTICES_PER_MESHLET == c_MaxMeshletVertices && MAX_PRIMS_PER_MESHLET == c_MaxMeshletTriangles,
+    "The shader output limits must match the meshlet builder");
+
+struct MeshletOptions
+{
+    // Ignore the cache next to the scene file and build every geometry again
+    bool rebuildMeshlets = false;
+
+    // Build and validate the meshlets of the scene, print the statistics and exit
+    bool statsOnly = false;
+
+    bool frustumCulling = true;
+    bool coneCulling = true;
+};
+
+struct MeshletRange
+{
+    uint32_t firstMeshlet = 0;
+    uint32_t meshletCount = 0;
+    bool coneCulling = false; // double-sided geometry is never cone culled
+};
+
+class MeshletExample : public app::ApplicationBase
 {
 private:
+    std::shared_ptr<vfs::RootFileSystem> m_RootFS;
+    std::shared_ptr<engine::ShaderFactory> m_ShaderFactory;
+    std::unique_ptr<engine::Scene> m_Scene;
+    std::shared_ptr<engine::DescriptorTableManager> m_DescriptorTableManager;
+    std::unique_ptr<engine::BindingCache> m_BindingCache;
+
     nvrhi::ShaderHandle m_AmplificationShader;
     nvrhi::ShaderHandle m_MeshShader;
     nvrhi::ShaderHandle m_PixelShader;
+    nvrhi::BindingLayoutHandle m_BindlessLayout;
+    nvrhi::BindingLayoutHandle m_BindingLayout;
+    nvrhi::BindingSetHandle m_BindingSet;
     nvrhi::MeshletPipelineHandle m_Pipeline;
     nvrhi::CommandListHandle m_CommandList;
 
+    nvrhi::BufferHandle m_ViewConstants;
+    nvrhi::BufferHandle m_MeshletBuffer;
+    nvrhi::BufferHandle m_MeshletVertexBuffer;
+    nvrhi::BufferHandle m_MeshletTriangleBuffer;
+
+    nvrhi::TextureHandle m_ColorBuffer;
+    nvrhi::TextureHandle m_DepthBuffer;
+    nvrhi::FramebufferHandle m_Framebuffer;
+
+    app::FirstPersonCamera m_Camera;
+    engine::PlanarView m_View;
+
+    MeshletOptions m_Options;
+    std::unordered_map<const engine::MeshGeometry*, MeshletRange> m_MeshletRanges;
+    MeshletStats m_MeshletStats;
+
 public:
-    using IRenderPass::IRenderPass;
+    using ApplicationBase::ApplicationBase;
 
-    bool Init()
+    bool Init(const MeshletOptions& options)
     {
-        auto nativeFS = std::make_shared<vfs::NativeFileSystem>();
+        m_Options = options;
 
+        std::filesystem::path sceneFileName = app::GetDirectoryWithExecutable().parent_path() / "media/sponza-plus.scene.json";
+        std::filesystem::path frameworkShaderPath = app::GetDirectoryWithExecutable() / "shaders/framework" / app::GetShaderTypeName(GetDevice()->getGraphicsAPI());
         std::filesystem::path appShaderPath = app::GetDirectoryWithExecutable() / "shaders/meshlets" / app::GetShaderTypeName(GetDevice()->getGraphicsAPI());
 
-        engine::ShaderFactory shaderFactory(GetDevice(), nativeFS, appShaderPath);
-        m_AmplificationShader = shaderFactory.CreateShader("shaders.hlsl", "main_as", nullptr, nvrhi::ShaderType::Amplification);
-        m_MeshShader = shaderFactory.CreateShader("shaders.hlsl", "main_ms", nullptr, nvrhi::ShaderType::Mesh);
-        m_PixelShader = shaderFactory.CreateShader("shaders.hlsl", "main_ps", nullptr, nvrhi::ShaderType::Pixel);
+        m_RootFS = std::make_shared<vfs::RootFileSystem>();
+        m_RootFS->mount("/shaders/donut", frameworkShaderPath);
+        m_RootFS->mount("/shaders/app", appShaderPath);
+
+        m_ShaderFactory = std::make_shared<engine::ShaderFactory>(GetDevice(), m_RootFS, "/shaders");
+        m_CommonPasses = std::make_shared<engine::CommonRenderPasses>(GetDevice(), m_ShaderFactory);
+        m_BindingCache = std::make_unique<engine::BindingCache>(GetDevice());
+
+        m_AmplificationShader = m_ShaderFactory->CreateShader("/shaders/app/shaders.hlsl", "main_as", nullptr, nvrhi::ShaderType::Amplification);
+        m_MeshShader = m_ShaderFactory->CreateShader("/shaders/app/shaders.hlsl", "main_ms", nullptr, nvrhi::ShaderType::Mesh);
+        m_PixelShader = m_ShaderFactory->CreateShader("/shaders/app/shaders.hlsl", "main_ps", nullptr, nvrhi::ShaderType::Pixel);
 
         if (!m_AmplificationShader || !m_MeshShader || !m_PixelShader)
         {
             return false;
         }
-        
+
+        nvrhi::BindlessLayoutDesc bindlessLayoutDesc;
+        bindlessLayoutDesc.visibility = nvrhi::ShaderType::All;
+        bindlessLayoutDesc.firstSlot = 0;
+        bindlessLayoutDesc.maxCapacity = 1024;
+        bindlessLayoutDesc.registerSpaces =
+        {
+            nvrhi::BindingLayoutItem::RawBuffer_SRV(1),
+            nvrhi::BindingLayoutItem::Texture_SRV(2)
+        };
+        m_BindlessLayout = GetDevice()->createBindlessLayout(bindlessLayoutDesc);
+
+        m_DescriptorTableManager = std::make_shared<engine::DescriptorTableManager>(GetDevice(), m_BindlessLayout);
+
+        auto nativeFS = std::make_shared<vfs::NativeFileSystem>();
+        m_TextureCache = std::make_shared<engine::TextureCache>(GetDevice(), nativeFS, m_DescriptorTableManager);
+
         m_CommandList = GetDevice()->createCommandList();
 
+        SetAsynchronousLoadingEnabled(false);
+        BeginLoadingScene(nativeFS, sceneFileName);
+
+        m_Scene->FinishedLoading(GetFrameIndex());
+
+        std::filesystem::path cacheFileName = sceneFileName;
+        cacheFileName.replace_extension(".meshlets");
+        if (!buildMeshlets(cacheFileName))
+            return false;
+
+        m_ViewConstants = GetDevice()->createBuffer(nvrhi::utils::CreateVolatileConstantBufferDesc(sizeof(PlanarViewConstants), "ViewConstants", engine::c_MaxRenderPassConstantBufferVersions));
+
+        m_Camera.LookAt(float3(0.f, 1.8f, 0.f), float3(1.f, 1.8f, 0.f));
+        m_Camera.SetMoveSpeed(3.f);
+
+        GetDevice()->waitForIdle();
+
         return true;
     }
-    
+
+    bool LoadScene(std::shared_ptr<vfs::IFileSystem> fs, const std::filesystem::path& sceneFileName) override
+    {
+        engine::Scene* scene = new engine::Scene(GetDevice(), *m_ShaderFactory, fs, m_TextureCache, m_DescriptorTableManager, nullptr);
+        if (scene->Load(sceneFileName))
+        {
+            m_Scene = std::unique_ptr<engine::Scene>(scene);
+            return true;
+        }
+
+        return false;
+    }
+
+    // Builds or loads the meshlets of every geometry in the scene and uploads them into shared buffers
+    bool buildMeshlets(const std::filesystem::path& cacheFileName)
+    {
+        MeshletCache cache;
+        if (!m_Options.rebuildMeshlets && cache.Load(cacheFileName))
+            log::info("Loaded %d cached meshlet geometries from '%s'", int(cache.GetEntryCount()), cacheFileName.generic_string().c_str());
+
+        std::vector<Meshlet> meshlets;
+        std::vector<uint32_t> meshletVertices;
+        std::vector<uint32_t> meshletTriangles;
+        std::vector<float3> normals;
+
+        double buildTimeMs = 0.0;
+        uint64_t builtTriangles = 0;
+        int validationErrors = 0;
+
+        for (const auto& mesh : m_Scene->GetSceneGraph()->GetMeshes())
+        {
+            const auto& buffers = mesh->buffers;
+            // Skinned meshes only have GPU vertex data; they get no meshlet range and are not drawn
+            if (buffers->indexData.empty() || buffers->positionData.empty())
+                continue;
+
+            for (const auto& geometry : mesh->geometries)
+            {
+                const uint32_t* indices = buffers->indexData.data() + mesh->indexOffset + geometry->indexOffsetInMesh;
+                const float3* positions = buffers->positionData.data() + mesh->vertexOffset + geometry->vertexOffsetInMesh;
+
+                // Normals are stored as RGBA8 SNORM; they only orient the face normals of the cones
+                const float3* normalData = nullptr;
+                if (!buffers->normalData.empty())
+                {
+                    const uint32_t* packedNormals = buffers->normalData.data() + mesh->vertexOffset + geometry->vertexOffsetInMesh;
+                    normals.resize(geometry->numVertices);
+                    for (uint32_t i = 0; i < geometry->numVertices; i++)
+                    {
+                        uint32_t packed = packedNormals[i];
+                        normals[i] = float3(float(int8_t(packed & 0xff)), float(int8_t((packed >> 8) & 0xff)), float(int8_t((packed >> 16) & 0xff))) / 127.f;
+                    }
+                    normalData = normals.data();
+                }
+
+                uint64_t hash = HashMeshletInput(indices, geometry->numIndices, positions, geometry->numVertices, normalData);
+                const MeshletGeometry* built = cache.Find(hash);
+                if (!built)
+                {
+                    auto buildStart = std::chrono::high_resolution_clock::now();
+                    MeshletGeometry result = BuildMeshlets(indices, geometry->numIndices, positions, geometry->numVertices, normalData);
+                    buildTimeMs += std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - buildStart).count();
+                    builtTriangles += geometry->numIndices / 3;
+
+                    cache.Insert(hash, std::move(result));
+                    built = cache.Find(hash);
+                }
+
+                if (m_Options.statsOnly)
+                {
+                    std::string error = ValidateMeshlets(*built, indices, geometry->numIndices, positions);
+                    if (!error.empty())
+                    {
+                        log::warning("Mesh '%s': %s", mesh->name.c_str(), error.c_str());
+                        ++validationErrors;
+                    }
+                }
+
+                MeshletRange range;
+                range.firstMeshlet = uint32_t(meshlets.size());
+                range.meshletCount = uint32_t(built->meshlets.size());
+                range.coneCulling = !(geometry->material && geometry->material->doubleSided);
+                m_MeshletRanges[geometry.get()] = range;
+
+                // Rebase the meshlets onto the shared vertex and triangle buffers
+                for (Meshlet meshlet : built->meshlets)
+                {
+                    meshlet.vertexOffset += uint32_t(meshletVertices.size());
+                    meshlet.triangleOffset += uint32_t(meshletTriangles.size());
+                    meshlets.push_back(meshlet);
+                }
+                meshletVertices.insert(meshletVertices.end(), built->vertices.begin(), built->vertices.end());
+                meshletTriangles.insert(meshletTriangles.end(), built->triangles.begin(), built->triangles.end());
+
+                m_MeshletStats.Add(*built, geometry->numVertices);
+            }
+        }
+
+        if (cache.IsDirty() && !cache.Save(cacheFileName))
+            log::warning("Cannot write the meshlet cache '%s'", cacheFileName.generic_string().c_str());
+
+        log::info("%llu meshlets for %llu triangles: %.1f vertices and %.1f triangles per meshlet, %.3f triangles per vertex, %.3fx vertex duplication",
+            (unsigned long long)m_MeshletStats.meshlets, (unsigned long long)m_MeshletStats.triangles,
+            double(m_MeshletStats.meshletVertices) / std::max<uint64_t>(m_MeshletStats.meshlets, 1),
+            double(m_MeshletStats.triangles) / std::max<uint64_t>(m_MeshletStats.meshlets, 1),
+            m_MeshletStats.GetVertexReuse(), m_MeshletStats.GetVertexDuplication());
+
+        if (builtTriangles > 0)
+            log::info("Built %llu triangles in %.1f ms (%.2f Mtriangles/s)", (unsigned long long)builtTriangles, buildTimeMs, double(builtTriangles) / (buildTimeMs * 1000.0));
+
+        if (m_Options.statsOnly)
+        {
+            log::info("Meshlet validation: %d error(s)", validationErrors);
+            return validationErrors == 0;
+        }
+
+        if (meshlets.empty())
+        {
+            log::error("The scene has no geometry to build meshlets from");
+            return false;
+        }
+
+        nvrhi::BufferDesc bufferDesc;
+        bufferDesc.byteSize = meshlets.size() * sizeof(Meshlet);
+        bufferDesc.structStride = sizeof(Meshlet);
+        bufferDesc.initialState = nvrhi::ResourceStates::ShaderResource;
+        bufferDesc.keepInitialState = true;
+        bufferDesc.debugName = "Meshlets";
+        m_MeshletBuffer = GetDevice()->createBuffer(bufferDesc);
+
+        bufferDesc.byteSize = meshletVertices.size() * sizeof(uint32_t);
+        bufferDesc.structStride = sizeof(uint32_t);
+        bufferDesc.debugName = "MeshletVertices";
+        m_MeshletVertexBuffer = GetDevice()->createBuffer(bufferDesc);
+
+        bufferDesc.byteSize = meshletTriangles.size() * sizeof(uint32_t);
+        bufferDesc.debugName = "MeshletTriangles";
+        m_MeshletTriangleBuffer = GetDevice()->createBuffer(bufferDesc);
+
+        m_CommandList->open();
+        m_CommandList->writeBuffer(m_MeshletBuffer, meshlets.data(), meshlets.size() * sizeof(Meshlet));
+        m_CommandList->writeBuffer(m_MeshletVertexBuffer, meshletVertices.data(), meshletVertices.size() * sizeof(uint32_t));
+        m_CommandList->writeBuffer(m_MeshletTriangleBuffer, meshletTriangles.data(), meshletTriangles.size() * sizeof(uint32_t));
+        m_CommandList->close();
+        GetDevice()->executeCommandList(m_CommandList);
+
+        return true;
+    }
+
+    bool KeyboardUpdate(int key, int scancode, int action, int mods) override
+    {
+        m_Camera.KeyboardUpdate(key, scancode, action, mods);
+
+        if (key == GLFW_KEY_F && action == GLFW_PRESS)
+        {
+            m_Options.frustumCulling = !m_Options.frustumCulling;
+            return true;
+        }
+        if (key == GLFW_KEY_C && action == GLFW_PRESS)
+        {
+            m_Options.coneCulling = !m_Options.coneCulling;
+            return true;
+        }
+
+        return true;
+    }
+
+    bool MousePosUpdate(double xpos, double ypos) override
+    {
+        m_Camera.MousePosUpdate(xpos, ypos);
+        return true;
+    }
+
+    bool MouseButtonUpdate(int button, int action, int mods) override
+    {
+        m_Camera.MouseButtonUpdate(button, action, mods);
+        return true;
+    }
+
     void Animate(float fElapsedTimeSeconds) override
     {
-        GetDeviceManager()->SetInformativeWindowTitle(g_WindowTitle);
+        m_Camera.Animate(fElapsedTimeSeconds);
+
+        std::string info = std::to_string(m_MeshletStats.meshlets) + " meshlets, frustum culling " + (m_Options.frustumCulling ? "on" : "off")
+            + " (F), cone culling " + (m_Options.coneCulling ? "on" : "off") + " (C)";
+        GetDeviceManager()->SetInformativeWindowTitle(g_WindowTitle, info.c_str());
     }
 
     void BackBufferResizing() override
-    { 
+    {
+        m_ColorBuffer = nullptr;
+        m_DepthBuffer = nullptr;
+        m_Framebuffer = nullptr;
+        m_BindingSet = nullptr;
         m_Pipeline = nullptr;
+        m_BindingCache->Clear();
+    }
+
+    void createPipeline(uint32_t width, uint32_t height)
+    {
+        nvrhi::TextureDesc textureDesc;
+        textureDesc.width = width;
+        textureDesc.height = height;
+        textureDesc.format = nvrhi::Format::RGBA8_UNORM;
+        textureDesc.isRenderTarget = true;
+        textureDesc.initialState = nvrhi::ResourceStates::RenderTarget;
+        textureDesc.keepInitialState = true;
+        textureDesc.clearValue = nvrhi::Color(0.f);
+        textureDesc.useClearValue = true;
+        textureDesc.debugName = "MeshletColor";
+        m_ColorBuffer = GetDevice()->createTexture(textureDesc);
+
+        textureDesc.format = nvrhi::Format::D32;
+        textureDesc.initialState = nvrhi::ResourceStates::DepthWrite;
+        textureDesc.debugName = "MeshletDepth";
+        m_DepthBuffer = GetDevice()->createTexture(textureDesc);
+
+        m_Framebuffer = GetDevice()->createFramebuffer(nvrhi::FramebufferDesc()
+            .addColorAttachment(m_ColorBuffer)
+            .setDepthAttachment(m_DepthBuffer));
+
+        nvrhi::BindingSetDesc bindingSetDesc;
+        bindingSetDesc.bindings =
+        {
+            nvrhi::BindingSetItem::ConstantBuffer(0, m_ViewConstants),
+            nvrhi::BindingSetItem::PushConstants(1, sizeof(MeshletDrawConstants)),
+            nvrhi::BindingSetItem::StructuredBuffer_SRV(0, m_Scene->GetInstanceBuffer()),
+            nvrhi::BindingSetItem::StructuredBuffer_SRV(1, m_Scene->GetGeometryBuffer()),
+            nvrhi::BindingSetItem::StructuredBuffer_SRV(2, m_MeshletBuffer),
+            nvrhi::BindingSetItem::StructuredBuffer_SRV(3, m_MeshletVertexBuffer),
+            nvrhi::BindingSetItem::StructuredBuffer_SRV(4, m_MeshletTriangleBuffer)
+        };
+        nvrhi::utils::CreateBindingSetAndLayout(GetDevice(), nvrhi::ShaderType::All, 0, bindingSetDesc, m_BindingLayout, m_BindingSet);
+
+        nvrhi::MeshletPipelineDesc psoDesc;
+        psoDesc.AS = m_AmplificationShader;
+        psoDesc.MS = m_MeshShader;
+        psoDesc.PS = m_PixelShader;
+        psoDesc.primType = nvrhi::PrimitiveType::TriangleList;
+        psoDesc.bindingLayouts = { m_BindingLayout, m_BindlessLayout };
+        psoDesc.renderState.depthStencilState.depthTestEnable = true;
+        psoDesc.renderState.depthStencilState.depthFunc = nvrhi::ComparisonFunc::GreaterOrEqual;
+        psoDesc.renderState.rasterState.frontCounterClockwise = true;
+        psoDesc.renderState.rasterState.setCullBack();
+
+        m_Pipeline = GetDevice()->createMeshletPipeline(psoDesc, m_Framebuffer);
     }
 
     void Render(nvrhi::IFramebuffer* framebuffer) override
     {
+        const auto& fbinfo = framebuffer->getFramebufferInfo();
+
         if (!m_Pipeline)
         {
-            nvrhi::MeshletPipelineDesc psoDesc;
-            psoDesc.AS = m_AmplificationShader;
-            psoDesc.MS = m_MeshShader;
-            psoDesc.PS = m_PixelShader;
-            psoDesc.primType = nvrhi::PrimitiveType::TriangleList;
-            psoDesc.renderState.depthStencilState.depthTestEnable = false;
-
-            m_Pipeline = GetDevice()->createMeshletPipeline(psoDesc, framebuffer);
+            createPipeline(fbinfo.width, fbinfo.height);
         }
 
+        nvrhi::Viewport windowViewport(float(fbinfo.width), float(fbinfo.height));
+        m_View.SetViewport(windowViewport);
+        m_View.SetMatrices(m_Camera.GetWorldToViewMatrix(), perspProjD3DStyleReverse(dm::PI_f * 0.25f, windowViewport.width() / windowViewport.height(), 0.1f));
+        m_View.UpdateCache();
+
         m_CommandList->open();
 
-        nvrhi::utils::ClearColorAttachment(m_CommandList, framebuffer, 0, nvrhi::Color(0.f));
+        m_Scene->Refresh(m_CommandList, GetFrameIndex());
+
+        PlanarViewConstants viewConstants;
+        m_View.FillPlanarViewConstants(viewConstants);
+        m_CommandList->writeBuffer(m_ViewConstants, &viewConstants, sizeof(viewConstants));
+
+        m_CommandList->clearTextureFloat(m_ColorBuffer, nvrhi::AllSubresources, nvrhi::Color(0.f));
+        m_CommandList->clearDepthStencilTexture(m_DepthBuffer, nvrhi::AllSubresources, true, 0.f, false, 0);
 
         nvrhi::MeshletState state;
         state.pipeline = m_Pipeline;
-        state.framebuffer = framebuffer;
-        state.viewport.addViewportAndScissorRect(framebuffer->getFramebufferInfo().getViewport());
-
+        state.framebuffer = m_Framebuffer;
+        state.bindings = { m_BindingSet, m_DescriptorTableManager->GetDescriptorTable() };
+        state.viewport = m_View.GetViewportState();
         m_CommandList->setMeshletState(state);
-        
-        m_CommandList->dispatchMesh(1);
+
+        // One amplification dispatch per geometry; each group culls MESHLETS_PER_TASK meshlets
+        for (const auto& instance : m_Scene->GetSceneGraph()->GetMeshInstances())
+        {
+            const auto& mesh = instance->GetMesh();
+
+            for (size_t i = 0; i < mesh->geometries.size(); i++)
+            {
+                auto it = m_MeshletRanges.find(mesh->geometries[i].get());
+                if (it == m_MeshletRanges.end() || it->second.meshletCount == 0)
+                    continue;
+
+                const MeshletRange& range = it->second;
+
+                MeshletDrawConstants constants;
+                constants.instance = uint32_t(instance->GetInstanceIndex());
+                constants.geometryInMesh = uint32_t(i);
+                constants.firstMeshlet = range.firstMeshlet;
+                constants.meshletCount = range.meshletCount;
+                constants.flags = (m_Options.frustumCulling ? MESHLET_CULL_FRUSTUM : 0)
+                    | (m_Options.coneCulling && range.coneCulling ? MESHLET_CULL_CONE : 0);
+                m_CommandList->setPushConstants(&constants, sizeof(constants));
+
+                m_CommandList->dispatchMesh((range.meshletCount + MESHLETS_PER_TASK - 1) / MESHLETS_PER_TASK);
+            }
+        }
+
+        m_CommonPasses->BlitTexture(m_CommandList, framebuffer, m_ColorBuffer, m_BindingCache.get());
 
         m_CommandList->close();
         GetDevice()->executeCommandList(m_CommandList);
     }
-
 };
 
 #ifdef WIN32
@@ -113,12 +489,27 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLine
 int main(int __argc, const char** __argv)
 #endif
 {
+    MeshletOptions options;
+    for (int i = 1; i < __argc; i++)
+    {
+        if (strcmp(__argv[i], "-rebuild-meshlets") == 0)
+        {
+            options.rebuildMeshlets = true;
+        }
+        else if (strcmp(__argv[i], "-meshlet-stats") == 0)
+        {
+            // Always rebuild so that the build throughput is measured
+            options.statsOnly = true;
+            options.rebuildMeshlets = true;
+        }
+    }
+
     nvrhi::GraphicsAPI api = app::GetGraphicsAPIFromCommandLine(__argc, __argv);
     app::DeviceManager* deviceManager = app::DeviceManager::Create(api);
 
     app::DeviceCreationParameters deviceParams;
 #ifdef _DEBUG
-    deviceParams.enableDebugRuntime = true; 
+    deviceParams.enableDebugRuntime = true;
     deviceParams.enableNvrhiValidationLayer = true;
 #endif
 
@@ -128,25 +519,33 @@ int main(int __argc, const char** __argv)
         return 1;
     }
 
-    if (!deviceManager->GetDevice()->queryFeatureSupport(nvrhi::Feature::Meshlets))
+    if (!deviceManager->GetDevice()->queryFeatureSupport(nvrhi::Feature::Meshlets) && !options.statsOnly)
     {
         log::fatal("The graphics device does not support Meshlets");
         return 1;
     }
-    
+
+    int exitCode = 0;
     {
         MeshletExample example(deviceManager);
-        if (example.Init())
+        if (example.Init(options))
+        {
+            if (!options.statsOnly)
+            {
+                deviceManager->AddRenderPassToBack(&example);
+                deviceManager->RunMessageLoop();
+                deviceManager->RemoveRenderPass(&example);
+            }
+        }
+        else
         {
-            deviceManager->AddRenderPassToBack(&example);
-            deviceManager->RunMessageLoop();
-            deviceManager->RemoveRenderPass(&example);
+            exitCode = 1;
         }
     }
-    
+
     deviceManager->Shutdown();
 
     delete deviceManager;
 
-    return 0;
+    return exitCode;
 }
@@ -0,0 +1,46 @@
+/*
+* Copyright (c) 2014-2021, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef MESHLETS_CB_H
+#define MESHLETS_CB_H
+
+// Limits of the meshlet builder, see c_MaxMeshletVertices and c_MaxMeshletTriangles
+#define MAX_VERTICES_PER_MESHLET 64
+#define MAX_PRIMS_PER_MESHLET 124
+
+// Meshlets tested by one amplification shader group
+#define MESHLETS_PER_TASK 32
+
+#define MESHLET_CULL_FRUSTUM 1
+#define MESHLET_CULL_CONE 2
+
+// One per geometry of a mesh instance, dispatched as ceil(meshletCount / MESHLETS_PER_TASK) groups
+struct MeshletDrawConstants
+{
+    uint instance;
+    uint geometryInMesh;
+    uint firstMeshlet;
+    uint meshletCount;
+    uint flags;
+};
+
+#endif // MESHLETS_CB_H
@@ -20,65 +20,178 @@
 * DEALINGS IN THE SOFTWARE.
 */
 
-#define MAX_PRIMS_PER_MESHLET 1
-#define MAX_VERTICES_PER_MESHLET 3
+#pragma pack_matrix(row_major)
 
-static const float2 g_positions[] = {
-	float2(-0.5, -0.5),
-	float2(0, 0.5),
-	float2(0.5, -0.5)
-};
+#include <donut/shaders/bindless.h>
+#include <donut/shaders/view_cb.h>
+#include "meshlets_cb.h"
+
+#ifdef SPIRV
+#define VK_PUSH_CONSTANT [[vk::push_constant]]
+#define VK_BINDING(reg,dset) [[vk::binding(reg,dset)]]
+#else
+#define VK_PUSH_CONSTANT
+#define VK_BINDING(reg,dset)
+#endif
 
-static const float3 g_colors[] = {
-	float3(1, 0, 0),
-	float3(0, 1, 0),
-	float3(0, 0, 1)	
+// Mirrors Meshlet in MeshletBuilder.h
+struct MeshletData
+{
+    uint vertexOffset;
+    uint triangleOffset;
+    uint vertexCount;
+    uint triangleCount;
+    float3 center;
+    float radius;
+    float3 coneAxis;
+    float coneCutoff;
 };
 
 struct Payload
 {
-	int dummy;
+    uint meshletIndices[MESHLETS_PER_TASK];
 };
 
 struct Vertex
 {
-	float4 pos : SV_Position;
-	float3 color : COLOR;
+    float4 pos : SV_Position;
+    float3 worldPos : WORLD_POSITION;
+    nointerpolation uint meshlet : MESHLET;
 };
 
-groupshared Payload s_payload;
+ConstantBuffer<PlanarViewConstants> g_View : register(b0);
+VK_PUSH_CONSTANT ConstantBuffer<MeshletDrawConstants> g_Draw : register(b1);
+
+StructuredBuffer<InstanceData> t_InstanceData : register(t0);
+StructuredBuffer<GeometryData> t_GeometryData : register(t1);
+StructuredBuffer<MeshletData> t_Meshlets : register(t2);
+StructuredBuffer<uint> t_MeshletVertices : register(t3);
+StructuredBuffer<uint> t_MeshletTriangles : register(t4);
+
+VK_BINDING(0, 1) ByteAddressBuffer t_BindlessBuffers[] : register(t0, space1);
+
+groupshared Payload s_Payload;
+groupshared uint s_VisibleCount;
+
+bool IsMeshletVisible(MeshletData meshlet, InstanceData instance)
+{
+    float3x3 linearTransform = (float3x3)instance.transform;
+    float3 axisScales = float3(
+        length(linearTransform._m00_m10_m20),
+        length(linearTransform._m01_m11_m21),
+        length(linearTransform._m02_m12_m22));
+    float maxScale = max(axisScales.x, max(axisScales.y, axisScales.z));
+
+    float3 center = mul(instance.transform, float4(meshlet.center, 1)).xyz;
+    float radius = meshlet.radius * maxScale;
+
+    if (g_Draw.flags & MESHLET_CULL_FRUSTUM)
+    {
+        // Gribb-Hartmann planes of the reverse-Z projection; the far plane is at infinity
+        float4x4 m = g_View.matWorldToClip;
+        float4 c0 = float4(m._m00, m._m10, m._m20, m._m30);
+        float4 c1 = float4(m._m01, m._m11, m._m21, m._m31);
+        float4 c2 = float4(m._m02, m._m12, m._m22, m._m32);
+        float4 c3 = float4(m._m03, m._m13, m._m23, m._m33);
+        float4 planes[5] = { c3 + c0, c3 - c0, c3 + c1, c3 - c1, c3 - c2 };
+
+        [unroll]
+        for (uint i = 0; i < 5; i++)
+        {
+            if (dot(planes[i].xyz, center) + planes[i].w < -radius * length(planes[i].xyz))
+                return false;
+        }
+    }
+
+    // The cone is only valid under rotation and uniform scale without mirroring
+    bool uniformScale = maxScale <= min(axisScales.x, min(axisScales.y, axisScales.z)) * 1.01;
+    if ((g_Draw.flags & MESHLET_CULL_CONE) && meshlet.coneCutoff < 1 && uniformScale && determinant(linearTransform) > 0)
+    {
+        float3 axis = normalize(mul(linearTransform, meshlet.coneAxis));
+        float3 cameraPosition = g_View.matViewToWorld._m30_m31_m32;
+        float3 view = center - cameraPosition;
+
+        if (dot(view, axis) >= meshlet.coneCutoff * length(view) + radius)
+            return false;
+    }
 
-[numthreads(1, 1, 1)]
+    return true;
+}
+
+[numthreads(MESHLETS_PER_TASK, 1, 1)]
 void main_as(
-	uint globalIdx : SV_DispatchThreadID)
+    uint threadId : SV_GroupThreadID,
+    uint groupId : SV_GroupID)
 {
-	s_payload.dummy = 0;
-	DispatchMesh(1, 1, 1, s_payload);
+    if (threadId == 0)
+        s_VisibleCount = 0;
+    GroupMemoryBarrierWithGroupSync();
+
+    uint meshletIndex = groupId * MESHLETS_PER_TASK + threadId;
+    if (meshletIndex < g_Draw.meshletCount)
+    {
+        uint globalIndex = g_Draw.firstMeshlet + meshletIndex;
+        if (IsMeshletVisible(t_Meshlets[globalIndex], t_InstanceData[g_Draw.instance]))
+        {
+            uint slot;
+            InterlockedAdd(s_VisibleCount, 1, slot);
+            s_Payload.meshletIndices[slot] = globalIndex;
+        }
+    }
+    GroupMemoryBarrierWithGroupSync();
+
+    DispatchMesh(s_VisibleCount, 1, 1, s_Payload);
 }
 
-[numthreads(1,1,1)]
+[numthreads(128, 1, 1)]
 [outputtopology("triangle")]
 void main_ms(
     uint threadId : SV_GroupThreadID,
+    uint groupId : SV_GroupID,
     in payload Payload i_payload,
     out indices uint3 o_tris[MAX_PRIMS_PER_MESHLET],
     out vertices Vertex o_verts[MAX_VERTICES_PER_MESHLET])
 {
-    SetMeshOutputCounts(3, 1);
-    o_tris[0] = uint3(0, 1, 2);
+    uint meshletIndex = i_payload.meshletIndices[groupId];
+    MeshletData meshlet = t_Meshlets[meshletIndex];
+
+    SetMeshOutputCounts(meshlet.vertexCount, meshlet.triangleCount);
 
-    for (uint i = 0; i < 3; i++)
+    if (threadId < meshlet.vertexCount)
     {
-    	o_verts[i].pos = float4(g_positions[i], 0, 1);
-    	o_verts[i].color = g_colors[i];
+        InstanceData instance = t_InstanceData[g_Draw.instance];
+        GeometryData geometry = t_GeometryData[instance.firstGeometryIndex + g_Draw.geometryInMesh];
+        ByteAddressBuffer vertexBuffer = t_BindlessBuffers[NonUniformResourceIndex(geometry.vertexBufferIndex)];
+
+        uint index = t_MeshletVertices[meshlet.vertexOffset + threadId];
+        float3 objectSpacePosition = asfloat(vertexBuffer.Load3(geometry.positionOffset + index * 12));
+        float3 worldSpacePosition = mul(instance.transform, float4(objectSpacePosition, 1.0)).xyz;
+
+        o_verts[threadId].pos = mul(float4(worldSpacePosition, 1.0), g_View.matWorldToClip);
+        o_verts[threadId].worldPos = worldSpacePosition;
+        o_verts[threadId].meshlet = meshletIndex;
+    }
+
+    if (threadId < meshlet.triangleCount)
+    {
+        uint packed = t_MeshletTriangles[meshlet.triangleOffset + threadId];
+        o_tris[threadId] = uint3(packed & 0xff, (packed >> 8) & 0xff, (packed >> 16) & 0xff);
     }
 }
 
+float3 MeshletColor(uint meshlet)
+{
+    uint hash = meshlet * 0x9e3779b9u;
+    hash ^= hash >> 16;
+    return float3(hash & 0xff, (hash >> 8) & 0xff, (hash >> 16) & 0xff) / 255.0 * 0.7 + 0.3;
+}
 
 void main_ps(
-	in Vertex i_vertex,
-	out float4 o_color : SV_Target0
-)
+    in Vertex i_vertex,
+    out float4 o_color : SV_Target0)
 {
-	o_color = float4(i_vertex.color, 1);
+    float3 normal = normalize(cross(ddx(i_vertex.worldPos), ddy(i_vertex.worldPos)));
+    float lighting = 0.35 + 0.65 * abs(dot(normal, normalize(float3(0.3, 1.0, 0.2))));
+
+    o_color = float4(MeshletColor(i_vertex.meshlet) * lighting, 1);
 }
@@ -0,0 +1,298 @@
+/*
+* Copyright (c) 2014-2021, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#include "batched_skinning.h"
+
+#include <donut/engine/ShaderFactory.h>
+#include <donut/engine/DescriptorTableManager.h>
+#include <donut/core/log.h>
+
+#include <algorithm>
+
+using namespace donut;
+using namespace donut::math;
+
+static uint32_t GetSkinningGroupCount(uint32_t vertexCount)
+{
+    return (vertexCount + SKINNING_GROUP_SIZE - 1) / SKINNING_GROUP_SIZE;
+}
+
+// A batch that spans more than one row of groups is padded to whole rows
+static uint32_t GetPaddedGroupCount(uint32_t groupCount)
+{
+    if (groupCount <= SKINNING_MAX_GROUPS_X)
+        return groupCount;
+
+    return (groupCount + SKINNING_MAX_GROUPS_X - 1) / SKINNING_MAX_GROUPS_X * SKINNING_MAX_GROUPS_X;
+}
+
+BatchedSkinningPass::BatchedSkinningPass(nvrhi::IDevice* device, nvrhi::IBindingLayout* bindlessLayout)
+    : m_Device(device)
+    , m_BindlessLayout(bindlessLayout)
+{
+}
+
+bool BatchedSkinningPass::Init(engine::ShaderFactory& shaderFactory, const std::vector<std::shared_ptr<engine::SkinnedMeshInstance>>& skinnedInstances)
+{
+    m_Shader = shaderFactory.CreateShader("app/skinning.hlsl", "main", nullptr, nvrhi::ShaderType::Compute);
+    if (!m_Shader)
+        return false;
+
+    nvrhi::BindingLayoutDesc layoutDesc;
+    layoutDesc.visibility = nvrhi::ShaderType::Compute;
+    layoutDesc.bindings = {
+        nvrhi::BindingLayoutItem::StructuredBuffer_SRV(0),
+        nvrhi::BindingLayoutItem::StructuredBuffer_SRV(1),
+        nvrhi::BindingLayoutItem::StructuredBuffer_SRV(2),
+        nvrhi::BindingLayoutItem::RawBuffer_UAV(0)
+    };
+    m_BindingLayout = m_Device->createBindingLayout(layoutDesc);
+
+    auto pipelineDesc = nvrhi::ComputePipelineDesc()
+        .setComputeShader(m_Shader)
+        .addBindingLayout(m_BindingLayout)
+        .addBindingLayout(m_BindlessLayout);
+
+    m_Pipeline = m_Device->createComputePipeline(pipelineDesc);
+    if (!m_Pipeline)
+        return false;
+
+    // Every skinned mesh keeps its range of the output for the lifetime of the scene, so the BLAS
+    // descs never change. The other buffers are sized for all instances being updated in one frame.
+    uint32_t outputVertices = 0;
+    uint32_t groupCount = 0;
+    uint32_t jointCount = 0;
+
+    for (const auto& skinnedInstance : skinnedInstances)
+    {
+        const engine::MeshInfo* mesh = skinnedInstance->GetMesh().get();
+        const uint32_t vertexCount = mesh->skinPrototype->totalVertices;
+
+        if (m_OutputOffsets.emplace(mesh, outputVertices).second)
+            outputVertices += vertexCount;
+
+        groupCount += GetSkinningGroupCount(vertexCount);
+        jointCount += uint32_t(skinnedInstance->joints.size());
+    }
+
+    const uint32_t instanceCount = uint32_t(std::max<size_t>(skinnedInstances.size(), 1));
+    groupCount = std::max(GetPaddedGroupCount(groupCount), 1u);
+    jointCount = std::max(jointCount, 1u);
+    outputVertices = std::max(outputVertices, 1u);
+
+    nvrhi::BufferDesc bufferDesc;
+    bufferDesc.byteSize = sizeof(SkinningInstanceData) * instanceCount;
+    bufferDesc.structStride = sizeof(SkinningInstanceData);
+    bufferDesc.debugName = "SkinningInstances";
+    bufferDesc.initialState = nvrhi::ResourceStates::ShaderResource;
+    bufferDesc.keepInitialState = true;
+    m_InstanceBuffer = m_Device->createBuffer(bufferDesc);
+
+    bufferDesc.byteSize = sizeof(uint32_t) * groupCount;
+    bufferDesc.structStride = sizeof(uint32_t);
+    bufferDesc.debugName = "SkinningGroupInstances";
+    m_GroupInstanceBuffer = m_Device->createBuffer(bufferDesc);
+
+    bufferDesc.byteSize = sizeof(SkinningJointMatrix) * jointCount;
+    bufferDesc.structStride = sizeof(SkinningJointMatrix);
+    bufferDesc.debugName = "SkinningJoints";
+    m_JointBuffer = m_Device->createBuffer(bufferDesc);
+
+    bufferDesc = nvrhi::BufferDesc();
+    bufferDesc.byteSize = sizeof(float3) * uint64_t(outputVertices);
+    bufferDesc.canHaveUAVs = true;
+    bufferDesc.canHaveRawViews = true;
+    bufferDesc.isAccelStructBuildInput = true;
+    bufferDesc.debugName = "SkinnedPositions";
+    bufferDesc.initialState = nvrhi::ResourceStates::AccelStructBuildInput;
+    m_PositionBuffer = m_Device->createBuffer(bufferDesc);
+
+    nvrhi::BindingSetDesc bindingSetDesc;
+    bindingSetDesc.bindings = {
+        nvrhi::BindingSetItem::StructuredBuffer_SRV(0, m_InstanceBuffer),
+        nvrhi::BindingSetItem::StructuredBuffer_SRV(1, m_GroupInstanceBuffer),
+        nvrhi::BindingSetItem::StructuredBuffer_SRV(2, m_JointBuffer),
+        nvrhi::BindingSetItem::RawBuffer_UAV(0, m_PositionBuffer)
+    };
+    m_BindingSet = m_Device->createBindingSet(bindingSetDesc, m_BindingLayout);
+
+    log::info("Batched skinning: %zu skinned meshes, %u output vertices (%.1f MB)",
+        m_OutputOffsets.size(), outputVertices, double(bufferDesc.byteSize) / double(1 << 20));
+
+    return true;
+}
+
+void BatchedSkinningPass::Dispatch(nvrhi::ICommandList* commandList, nvrhi::IDescriptorTable* descriptorTable,
+    const std::vector<const engine::SkinnedMeshInstance*>& instances)
+{
+    m_Instances.clear();
+    m_InstancePrototypes.clear();
+    m_GroupInstances.clear();
+    m_Joints.clear();
+    m_LastVertexCount = 0;
+
+    for (const engine::SkinnedMeshInstance* skinnedInstance : instances)
+    {
+        const engine::MeshInfo* mesh = skinnedInstance->GetMesh().get();
+        const engine::MeshInfo* prototype = mesh->skinPrototype.get();
+
+        uint32_t outputOffset = GetOutputOffset(mesh);
+        if (outputOffset == ~0u)
+            continue;
+
+        // Same joint matrices as Donut's skinning pass: bind pose to joint, then joint to the space of the instance
+        const affine3 worldToMesh = inverse(skinnedInstance->GetNode()->GetLocalToWorldTransformFloat());
+
+        SkinningInstanceData instanceData;
+        instanceData.vertexBufferIndex = uint32_t(prototype->buffers->vertexBufferDescriptor->Get());
+        instanceData.positionOffset = uint32_t(prototype->buffers->getVertexBufferRange(engine::VertexAttribute::Position).byteOffset + prototype->vertexOffset * sizeof(float3));
+        instanceData.jointIndexOffset = uint32_t(prototype->buffers->getVertexBufferRange(engine::VertexAttribute::JointIndices).byteOffset + prototype->vertexOffset * sizeof(uint16_t) * 4);
+        instanceData.jointWeightOffset = uint32_t(prototype->buffers->getVertexBufferRange(engine::VertexAttribute::JointWeights).byteOffset + prototype->vertexOffset * sizeof(float4));
+        instanceData.jointOffset = uint32_t(m_Joints.size());
+        instanceData.vertexCount = prototype->totalVertices;
+        instanceData.outputOffset = outputOffset;
+        instanceData.firstGroup = uint32_t(m_GroupInstances.size());
+
+        for (const auto& joint : skinnedInstance->joints)
+        {
+            affine3 jointMatrix = homogeneousToAffine(joint.inverseBindMatrix) * joint.node->GetLocalToWorldTransformFloat() * worldToMesh;
+            m_Joints.push_back(PackSkinningJointMatrix(jointMatrix));
+        }
+
+        m_GroupInstances.insert(m_GroupInstances.end(), GetSkinningGroupCount(instanceData.vertexCount), uint32_t(m_Instances.size()));
+        m_Instances.push_back(instanceData);
+        m_InstancePrototypes.push_back(prototype);
+        m_LastVertexCount += instanceData.vertexCount;
+    }
+
+    m_LastInstanceCount = uint32_t(m_Instances.size());
+    if (m_Instances.empty())
+        return;
+
+    const uint32_t groupCount = uint32_t(m_GroupInstances.size());
+    m_GroupInstances.resize(GetPaddedGroupCount(groupCount), SKINNING_NO_INSTANCE);
+
+    commandList->beginMarker("Batched Skinning");
+
+    commandList->writeBuffer(m_InstanceBuffer, m_Instances.data(), m_Instances.size() * sizeof(SkinningInstanceData));
+    commandList->writeBuffer(m_GroupInstanceBuffer, m_GroupInstances.data(), m_GroupInstances.size() * sizeof(uint32_t));
+    commandList->writeBuffer(m_JointBuffer, m_Joints.data(), m_Joints.size() * sizeof(SkinningJointMatrix));
+
+    commandList->setBufferState(m_PositionBuffer, nvrhi::ResourceStates::UnorderedAccess);
+
+    nvrhi::ComputeState state;
+    state.pipeline = m_Pipeline;
+    state.bindings = { m_BindingSet, descriptorTable };
+    commandList->setComputeState(state);
+    commandList->dispatch(std::min(groupCount, uint32_t(SKINNING_MAX_GROUPS_X)), (groupCount + SKINNING_MAX_GROUPS_X - 1) / SKINNING_MAX_GROUPS_X);
+
+    // The BLAS builds that follow read the positions, and share the barrier commit with their own transitions
+    commandList->setBufferState(m_PositionBuffer, nvrhi::ResourceStates::AccelStructBuildInput);
+
+    commandList->endMarker();
+}
+
+void BatchedSkinningPass::RecordReadback(nvrhi::ICommandList* commandList)
+{
+    if (!m_ReadbackBuffer)
+    {
+        nvrhi::BufferDesc bufferDesc;
+        bufferDesc.byteSize = m_PositionBuffer->getDesc().byteSize;
+        bufferDesc.cpuAccess = nvrhi::CpuAccessMode::Read;
+        bufferDesc.debugName = "SkinnedPositionsReadback";
+        bufferDesc.initialState = nvrhi::ResourceStates::CopyDest;
+        bufferDesc.keepInitialState = true;
+        m_ReadbackBuffer = m_Device->createBuffer(bufferDesc);
+    }
+
+    commandList->copyBuffer(m_ReadbackBuffer, 0, m_PositionBuffer, 0, m_PositionBuffer->getDesc().byteSize);
+    commandList->setBufferState(m_PositionBuffer, nvrhi::ResourceStates::AccelStructBuildInput);
+}
+
+uint32_t BatchedSkinningPass::ValidateReadback(float tolerance)
+{
+    if (!m_ReadbackBuffer)
+        return 0;
+
+    const float3* gpuPositions = static_cast<const float3*>(m_Device->mapBuffer(m_ReadbackBuffer, nvrhi::CpuAccessMode::Read));
+    if (!gpuPositions)
+    {
+        log::error("Cannot map the skinned position readback buffer");
+        return ~0u;
+    }
+
+    uint32_t mismatches = 0;
+    float maxError = 0.f;
+    std::vector<float3> cpuPositions;
+
+    for (size_t index = 0; index < m_Instances.size(); index++)
+    {
+        const SkinningInstanceData& instance = m_Instances[index];
+        const engine::MeshInfo* prototype = m_InstancePrototypes[index];
+        const engine::BufferGroup& buffers = *prototype->buffers;
+
+        CpuSkinningInput input;
+        input.positions = buffers.positionData.data() + prototype->vertexOffset;
+        input.jointIndices = reinterpret_cast<const uint16_t*>(buffers.jointData.data() + prototype->vertexOffset);
+        input.jointWeights = buffers.weightData.data() + prototype->vertexOffset;
+        input.vertexCount = instance.vertexCount;
+
+        cpuPositions.resize(instance.vertexCount);
+        CpuSkinningOutput output;
+        output.positions = cpuPositions.data();
+
+        SkinVerticesScalar(input, m_Joints.data() + instance.jointOffset, output, 0, instance.vertexCount);
+
+        for (uint32_t vertex = 0; vertex < instance.vertexCount; vertex++)
+        {
+            const float3& gpu = gpuPositions[instance.outputOffset + vertex];
+            const float3& cpu = cpuPositions[vertex];
+            float3 difference = abs(gpu - cpu);
+            float error = std::max(difference.x, std::max(difference.y, difference.z));
+            maxError = std::max(maxError, error);
+
+            // Also catches NaNs written by the shader
+            if (!(error <= tolerance))
+            {
+                if (mismatches < 10)
+                {
+                    log::warning("Batched skinning validation: instance %zu vertex %u is (%f, %f, %f), expected (%f, %f, %f)",
+                        index, vertex, gpu.x, gpu.y, gpu.z, cpu.x, cpu.y, cpu.z);
+                }
+                mismatches++;
+            }
+        }
+    }
+
+    m_Device->unmapBuffer(m_ReadbackBuffer);
+
+    log::info("Batched skinning validation: %u instances, %u vertices, max error %g, %u vertices above %g",
+        uint32_t(m_Instances.size()), m_LastVertexCount, maxError, mismatches, tolerance);
+
+    return mismatches;
+}
+
+uint32_t BatchedSkinningPass::GetOutputOffset(const engine::MeshInfo* mesh) const
+{
+    auto it = m_OutputOffsets.find(mesh);
+    return (it != m_OutputOffsets.end()) ? it->second : ~0u;
+}
@@ -0,0 +1,93 @@
+/*
+* Copyright (c) 2014-2021, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#pragma once
+
+#include <donut/engine/SceneGraph.h>
+#include <nvrhi/nvrhi.h>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include "CpuSkinning.h"
+
+namespace donut::engine
+{
+    class ShaderFactory;
+}
+
+#include "skinning_cb.h"
+
+// Skins the positions of all updated skinned mesh instances with one compute dispatch, as BLAS input.
+//
+// The joint matrices of all instances are packed into one palette, and each instance owns a range of
+// thread groups in a table, so that one dispatch covers instances of any size. The output is a single
+// position buffer with a fixed range per skinned mesh, which the skinned BLASes read their vertices
+// from. Donut's Scene::Refresh still skins the full vertices that are used for shading.
+class BatchedSkinningPass
+{
+public:
+    BatchedSkinningPass(nvrhi::IDevice* device, nvrhi::IBindingLayout* bindlessLayout);
+
+    // Assigns the output ranges and creates the buffers for all skinned instances of the scene
+    bool Init(donut::engine::ShaderFactory& shaderFactory, const std::vector<std::shared_ptr<donut::engine::SkinnedMeshInstance>>& skinnedInstances);
+
+    // Records the uploads and the dispatch for the given instances, and leaves the positions ready for BLAS builds
+    void Dispatch(nvrhi::ICommandList* commandList, nvrhi::IDescriptorTable* descriptorTable, const std::vector<const donut::engine::SkinnedMeshInstance*>& instances);
+
+    // First vertex of the skinned mesh in the position buffer, or ~0u if the mesh is not in the batch
+    [[nodiscard]] uint32_t GetOutputOffset(const donut::engine::MeshInfo* mesh) const;
+    [[nodiscard]] nvrhi::IBuffer* GetPositionBuffer() const { return m_PositionBuffer; }
+
+    [[nodiscard]] uint32_t GetLastInstanceCount() const { return m_LastInstanceCount; }
+    [[nodiscard]] uint32_t GetLastVertexCount() const { return m_LastVertexCount; }
+
+    // Copies the positions written by the last Dispatch into a staging buffer. Record it after Dispatch
+    // in the same command list, and call ValidateReadback once the GPU has finished it.
+    void RecordReadback(nvrhi::ICommandList* commandList);
+
+    // Skins the instances of the last Dispatch with CpuSkinning on the same joint palette and compares the
+    // positions read back from the GPU. Returns the number of vertices off by more than the tolerance.
+    uint32_t ValidateReadback(float tolerance);
+
+private:
+    nvrhi::DeviceHandle m_Device;
+    nvrhi::BindingLayoutHandle m_BindlessLayout;
+    nvrhi::ShaderHandle m_Shader;
+    nvrhi::BindingLayoutHandle m_BindingLayout;
+    nvrhi::BindingSetHandle m_BindingSet;
+    nvrhi::ComputePipelineHandle m_Pipeline;
+
+    nvrhi::BufferHandle m_InstanceBuffer;
+    nvrhi::BufferHandle m_GroupInstanceBuffer;
+    nvrhi::BufferHandle m_JointBuffer;
+    nvrhi::BufferHandle m_PositionBuffer;
+    nvrhi::BufferHandle m_ReadbackBuffer;
+
+    std::unordered_map<const donut::engine::MeshInfo*, uint32_t> m_OutputOffsets;
+    std::vector<SkinningInstanceData> m_Instances;
+    std::vector<const donut::engine::MeshInfo*> m_InstancePrototypes;
+    std::vector<uint32_t> m_GroupInstances;
+    std::vector<SkinningJointMatrix> m_Joints;
+    uint32_t m_LastInstanceCount = 0;
+    uint32_t m_LastVertexCount = 0;
+};
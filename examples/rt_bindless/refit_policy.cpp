@@ -0,0 +1,182 @@
+/*
+* Copyright (c) 2014-2021, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+#include "refit_policy.h"
+#include <algorithm>
+#include <cfloat>
+#include <numeric>
+
+using namespace donut::math;
+
+static constexpr uint32_t c_MaxLeafPrimitives = 4;
+
+// Relative costs of a node traversal and a primitive test in the SAH
+static constexpr float c_TraversalCost = 1.f;
+static constexpr float c_IntersectionCost = 1.f;
+
+static box3 EmptyBox()
+{
+    return box3(float3(FLT_MAX), float3(-FLT_MAX));
+}
+
+static box3 MergeBoxes(const box3& a, const box3& b)
+{
+    return box3(min(a.m_mins, b.m_mins), max(a.m_maxs, b.m_maxs));
+}
+
+static float SurfaceArea(const box3& b)
+{
+    float3 d = max(b.m_maxs - b.m_mins, float3(0.f));
+    return 2.f * (d.x * d.y + d.y * d.z + d.z * d.x);
+}
+
+uint32_t RefitQualityTracker::BuildNode(const std::vector<box3>& bounds, uint32_t first, uint32_t count)
+{
+    uint32_t nodeIndex = uint32_t(m_Nodes.size());
+    m_Nodes.emplace_back();
+
+    box3 nodeBounds = EmptyBox();
+    box3 centroidBounds = EmptyBox();
+    for (uint32_t i = first; i < first + count; i++)
+    {
+        const box3& b = bounds[m_Primitives[i]];
+        float3 centroid = (b.m_mins + b.m_maxs) * 0.5f;
+        nodeBounds = MergeBoxes(nodeBounds, b);
+        centroidBounds = MergeBoxes(centroidBounds, box3(centroid, centroid));
+    }
+    m_Nodes[nodeIndex].bounds = nodeBounds;
+
+    if (count <= c_MaxLeafPrimitives)
+    {
+        m_Nodes[nodeIndex].firstPrimitive = first;
+        m_Nodes[nodeIndex].primitiveCount = count;
+        return nodeIndex;
+    }
+
+    // Median split along the longest axis of the centroids, which is close enough to what drivers build
+    float3 extent = centroidBounds.m_maxs - centroidBounds.m_mins;
+    int axis = (extent.x >= extent.y && extent.x >= extent.z) ? 0 : (extent.y >= extent.z ? 1 : 2);
+
+    uint32_t half = count / 2;
+    std::nth_element(m_Primitives.begin() + first, m_Primitives.begin() + first + half, m_Primitives.begin() + first + count,
+        [&bounds, axis](uint32_t a, uint32_t b)
+        {
+            return bounds[a].m_mins[axis] + bounds[a].m_maxs[axis] < bounds[b].m_mins[axis] + bounds[b].m_maxs[axis];
+        });
+
+    uint32_t left = BuildNode(bounds, first, half);
+    uint32_t right = BuildNode(bounds, first + half, count - half);
+    m_Nodes[nodeIndex].leftChild = left;
+    m_Nodes[nodeIndex].rightChild = right;
+
+    return nodeIndex;
+}
+
+float RefitQualityTracker::ComputeCost() const
+{
+    float rootArea = SurfaceArea(m_Nodes[0].bounds);
+    if (rootArea <= 0.f)
+        return 0.f;
+
+    float cost = 0.f;
+    for (const Node& node : m_Nodes)
+    {
+        float area = SurfaceArea(node.bounds);
+        cost += (node.primitiveCount > 0) ? area * float(node.primitiveCount) * c_IntersectionCost : area * c_TraversalCost;
+    }
+
+    return cost / rootArea;
+}
+
+void RefitQualityTracker::Rebuild(const std::vector<box3>& bounds)
+{
+    m_Nodes.clear();
+    m_Primitives.resize(bounds.size());
+    std::iota(m_Primitives.begin(), m_Primitives.end(), 0u);
+    m_PrimitiveCount = bounds.size();
+
+    if (bounds.empty())
+    {
+        m_BaselineCost = 0.f;
+        return;
+    }
+
+    BuildNode(bounds, 0, uint32_t(bounds.size()));
+    m_BaselineCost = ComputeCost();
+}
+
+float RefitQualityTracker::Refit(const std::vector<box3>& bounds)
+{
+    if (m_Nodes.empty())
+        return 1.f;
+
+    // Children follow their parents, so a reverse walk sees every child before its parent
+    for (size_t index = m_Nodes.size(); index-- > 0; )
+    {
+        Node& node = m_Nodes[index];
+        if (node.primitiveCount > 0)
+        {
+            node.bounds = EmptyBox();
+            for (uint32_t i = node.firstPrimitive; i < node.firstPrimitive + node.primitiveCount; i++)
+                node.bounds = MergeBoxes(node.bounds, bounds[m_Primitives[i]]);
+        }
+        else
+        {
+            node.bounds = MergeBoxes(m_Nodes[node.leftChild].bounds, m_Nodes[node.rightChild].bounds);
+        }
+    }
+
+    return m_BaselineCost > 0.f ? ComputeCost() / m_BaselineCost : 1.f;
+}
+
+bool RefitState::Update(const RefitPolicy& policy, const std::vector<box3>& bounds, bool forceRebuild)
+{
+    if (!policy.enabled)
+    {
+        // Drop the proxy tree, it would be stale by the time refitting is enabled again
+        quality = RefitQualityTracker();
+        return true;
+    }
+
+    bool rebuild = forceRebuild || !quality.IsBuilt(bounds.size());
+
+    if (!rebuild && policy.rebuildInterval > 0 && refitsSinceRebuild >= policy.rebuildInterval)
+        rebuild = true;
+
+    if (!rebuild)
+    {
+        lastQualityRatio = quality.Refit(bounds);
+        rebuild = lastQualityRatio > policy.qualityThreshold;
+    }
+
+    if (rebuild)
+    {
+        quality.Rebuild(bounds);
+        refitsSinceRebuild = 0;
+        lastQualityRatio = 1.f;
+    }
+    else
+    {
+        ++refitsSinceRebuild;
+    }
+
+    return rebuild;
+}
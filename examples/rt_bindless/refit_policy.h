@@ -0,0 +1,86 @@
+/*
+* Copyright (c) 2014-2021, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+#pragma once
+
+#include <donut/core/math/math.h>
+#include <vector>
+
+// Decides when a refitted acceleration structure should be rebuilt instead.
+//
+// Refitting keeps the tree topology of the last rebuild and only grows the node bounds, so its quality
+// degrades as primitives move relative to each other. The driver's tree is opaque, so a small proxy BVH
+// is built on the CPU over the same primitives (instance bounds for the TLAS, joints for a skinned BLAS)
+// whenever the real structure is rebuilt, then refitted along with it. The ratio of its SAH cost to the
+// cost right after the rebuild estimates the degradation.
+
+struct RefitPolicy
+{
+    bool enabled = false;
+
+    // Rebuild after this many consecutive refits; 0 disables the periodic rebuild
+    uint32_t rebuildInterval = 30;
+
+    // Rebuild when the SAH cost of the proxy tree exceeds its post-rebuild cost by this factor
+    float qualityThreshold = 1.3f;
+};
+
+class RefitQualityTracker
+{
+public:
+    // Builds the proxy tree over the primitive bounds and takes its cost as the baseline
+    void Rebuild(const std::vector<dm::box3>& bounds);
+
+    // Refits the proxy tree to new bounds of the same primitives; returns the cost relative to the baseline
+    float Refit(const std::vector<dm::box3>& bounds);
+
+    [[nodiscard]] bool IsBuilt(size_t primitiveCount) const { return !m_Nodes.empty() && m_PrimitiveCount == primitiveCount; }
+
+private:
+    struct Node
+    {
+        dm::box3 bounds;
+        uint32_t leftChild = 0;
+        uint32_t rightChild = 0;
+        uint32_t firstPrimitive = 0;
+        uint32_t primitiveCount = 0; // zero for internal nodes
+    };
+
+    uint32_t BuildNode(const std::vector<dm::box3>& bounds, uint32_t first, uint32_t count);
+    [[nodiscard]] float ComputeCost() const;
+
+    std::vector<Node> m_Nodes; // depth-first, so children always follow their parent
+    std::vector<uint32_t> m_Primitives;
+    size_t m_PrimitiveCount = 0;
+    float m_BaselineCost = 0.f;
+};
+
+// Per acceleration structure state that applies a RefitPolicy
+struct RefitState
+{
+    RefitQualityTracker quality;
+    uint32_t refitsSinceRebuild = 0;
+    float lastQualityRatio = 1.f;
+
+    // Returns true if the structure must be rebuilt this time, and updates the proxy tree either way.
+    // 'forceRebuild' covers changes that a refit cannot handle, such as a new instance count.
+    bool Update(const RefitPolicy& policy, const std::vector<dm::box3>& bounds, bool forceRebuild);
+};
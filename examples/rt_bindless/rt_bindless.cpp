@@ -34,13 +34,101 @@
 #include <donut/core/math/math.h>
 #include <nvrhi/utils.h>
 
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstring>
+#include <deque>
+#include <thread>
+#include <unordered_map>
+
+#ifdef DONUT_WITH_TASKFLOW
+#include <taskflow/taskflow.hpp>
+#endif
+
 using namespace donut;
 using namespace donut::math;
 
 #include "lighting_cb.h"
+#include "refit_policy.h"
+#include "batched_skinning.h"
+#include "AnimationSampler.h"
+#include "CpuRayTracer.h"
+#include "CpuSkinning.h"
+#include "ImageEncoders.h"
 
 static const char* g_WindowTitle = "Donut Example: Bindless Ray Tracing";
 
+// Rough size of a BLAS plus its build scratch per triangle. Only used to split the builds into batches
+// and to account for the memory waiting for compaction, so it errs on the large side.
+static constexpr uint64_t c_EstimatedBlasBytesPerTriangle = 128;
+
+// Estimated memory built by one command list at startup
+static constexpr uint64_t c_BlasBatchBudget = 64ull << 20;
+
+struct BlasBuildBatch
+{
+    std::vector<engine::MeshInfo*> meshes;
+    std::vector<nvrhi::rt::AccelStructDesc> descs;
+    uint64_t estimatedBytes = 0;
+    nvrhi::CommandListHandle commandList;
+};
+
+// A submitted batch whose BLASes can be compacted once the GPU has finished building them
+struct CompactionRequest
+{
+    std::vector<nvrhi::rt::AccelStructHandle> accelStructs;
+    uint32_t compactedCount = 0;
+    uint64_t estimatedBytes = 0;
+};
+
+struct AccelStructStats
+{
+    uint32_t staticBlasCount = 0;
+    uint32_t skinnedBlasCount = 0;
+    uint32_t batchCount = 0;
+    double recordTimeMs = 0.0;
+
+    uint32_t compactedBlasCount = 0;
+    uint64_t pendingCompactionBytes = 0; // estimated size of the BLASes waiting in the compaction queue
+    uint64_t compactedBytes = 0;         // estimated size of the BLASes before they were compacted
+
+    uint32_t patchedInstances = 0;
+    uint32_t batchedSkinnedVertices = 0;
+    bool tlasBuilt = false;
+    float tlasQualityRatio = 1.f;
+};
+
+// Accumulated GPU time of one kind of acceleration structure update
+struct UpdateTiming
+{
+    uint32_t count = 0;
+    double totalMs = 0.0;
+
+    [[nodiscard]] double GetAverageMs() const { return count ? totalMs / double(count) : 0.0; }
+};
+
+struct RefitTimingStats
+{
+    UpdateTiming blasRebuild;
+    UpdateTiming blasRefit;
+    UpdateTiming tlasRebuild;
+    UpdateTiming tlasRefit;
+};
+
+// Timer queries around the acceleration structure updates of one frame, resolved a few frames later
+struct AccelStructTimers
+{
+    nvrhi::TimerQueryHandle blasRebuild;
+    nvrhi::TimerQueryHandle blasRefit;
+    nvrhi::TimerQueryHandle tlas;
+    uint32_t blasRebuilds = 0;
+    uint32_t blasRefits = 0;
+    bool tlasBuilt = false;
+    bool tlasRefit = false;
+    bool pending = false;
+};
+
 class BindlessRayTracing : public app::ApplicationBase
 {
 private:
@@ -57,6 +145,21 @@ private:
     nvrhi::BindingLayoutHandle m_BindlessLayout;
 
     nvrhi::rt::AccelStructHandle m_TopLevelAS;
+    std::vector<nvrhi::rt::InstanceDesc> m_TlasInstances;
+    std::deque<CompactionRequest> m_CompactionQueue;
+    AccelStructStats m_AccelStructStats;
+
+    RefitPolicy m_RefitPolicy;
+    RefitState m_TlasRefitState;
+    std::unordered_map<const engine::SkinnedMeshInstance*, RefitState> m_SkinnedRefitStates;
+    std::vector<box3> m_RefitBounds;
+    std::array<AccelStructTimers, 3> m_AccelStructTimers;
+    uint32_t m_AccelStructTimerIndex = 0;
+    RefitTimingStats m_RefitTimingStats;
+
+    bool m_UseBatchedSkinning = false;
+    std::unique_ptr<BatchedSkinningPass> m_BatchedSkinning;
+    std::vector<const engine::SkinnedMeshInstance*> m_UpdatedSkinnedInstances;
 
     nvrhi::BufferHandle m_ConstantBuffer;
 
@@ -71,12 +174,17 @@ private:
 
     bool m_EnableAnimations = true;
     float m_WallclockTime = 0.f;
+    AnimationSampler m_AnimationSampler;
+    std::vector<float> m_AnimationTimes;
 
 public:
     using ApplicationBase::ApplicationBase;
 
-    bool Init(bool useRayQuery)
+    bool Init(bool useRayQuery, const RefitPolicy& refitPolicy, bool cpuReference, bool batchedSkinning)
     {
+        m_RefitPolicy = refitPolicy;
+        m_UseBatchedSkinning = batchedSkinning;
+
         std::filesystem::path sceneFileName = app::GetDirectoryWithExecutable().parent_path() / "media/sponza-plus.scene.json";
         std::filesystem::path frameworkShaderPath = app::GetDirectoryWithExecutable() / "shaders/framework" / app::GetShaderTypeName(GetDevice()->getGraphicsAPI());
         std::filesystem::path appShaderPath = app::GetDirectoryWithExecutable() / "shaders/rt_bindless" / app::GetShaderTypeName(GetDevice()->getGraphicsAPI());
@@ -99,18 +207,22 @@ public:
         };
         m_BindlessLayout = GetDevice()->createBindlessLayout(bindlessLayoutDesc);
 
-        nvrhi::BindingLayoutDesc globalBindingLayoutDesc;
-        globalBindingLayoutDesc.visibility = nvrhi::ShaderType::All;
-        globalBindingLayoutDesc.bindings = {
-            nvrhi::BindingLayoutItem::VolatileConstantBuffer(0),
-            nvrhi::BindingLayoutItem::RayTracingAccelStruct(0),
-            nvrhi::BindingLayoutItem::StructuredBuffer_SRV(1),
-            nvrhi::BindingLayoutItem::StructuredBuffer_SRV(2),
-            nvrhi::BindingLayoutItem::StructuredBuffer_SRV(3),
-            nvrhi::BindingLayoutItem::Sampler(0),
-            nvrhi::BindingLayoutItem::Texture_UAV(0)
-        };
-        m_BindingLayout = GetDevice()->createBindingLayout(globalBindingLayoutDesc);
+        // The CPU reference runs without ray tracing support, so there is no accel struct binding
+        if (!cpuReference)
+        {
+            nvrhi::BindingLayoutDesc globalBindingLayoutDesc;
+            globalBindingLayoutDesc.visibility = nvrhi::ShaderType::All;
+            globalBindingLayoutDesc.bindings = {
+                nvrhi::BindingLayoutItem::VolatileConstantBuffer(0),
+                nvrhi::BindingLayoutItem::RayTracingAccelStruct(0),
+                nvrhi::BindingLayoutItem::StructuredBuffer_SRV(1),
+                nvrhi::BindingLayoutItem::StructuredBuffer_SRV(2),
+                nvrhi::BindingLayoutItem::StructuredBuffer_SRV(3),
+                nvrhi::BindingLayoutItem::Sampler(0),
+                nvrhi::BindingLayoutItem::Texture_UAV(0)
+            };
+            m_BindingLayout = GetDevice()->createBindingLayout(globalBindingLayoutDesc);
+        }
 
         m_DescriptorTable = std::make_shared<engine::DescriptorTableManager>(GetDevice(), m_BindlessLayout);
 
@@ -135,6 +247,9 @@ public:
         m_ConstantBuffer = GetDevice()->createBuffer(nvrhi::utils::CreateVolatileConstantBufferDesc(
             sizeof(LightingConstants), "LightingConstants", engine::c_MaxRenderPassConstantBufferVersions));
 
+        if (cpuReference)
+            return true;
+
         if (useRayQuery)
         {
             if (!CreateComputePipeline(*m_ShaderFactory))
@@ -148,16 +263,100 @@ public:
 
         m_CommandList = GetDevice()->createCommandList();
 
-        m_CommandList->open();
+        for (AccelStructTimers& timers : m_AccelStructTimers)
+        {
+            timers.blasRebuild = GetDevice()->createTimerQuery();
+            timers.blasRefit = GetDevice()->createTimerQuery();
+            timers.tlas = GetDevice()->createTimerQuery();
+        }
+
+        if (!CreateAccelStructs())
+            return false;
 
-        CreateAccelStructs(m_CommandList);
+        GetDevice()->waitForIdle();
+
+        return true;
+    }
+
+    // Skins every skinned instance with the batched pass in its initial pose, reads the positions back and
+    // compares them with the CPU reference on the same joint palette. Returns false on any mismatch.
+    bool RunSkinningValidation()
+    {
+        if (!m_BatchedSkinning)
+        {
+            log::error("Skinning validation needs -batched-skinning and a scene with skinned meshes");
+            return false;
+        }
+
+        std::vector<const engine::SkinnedMeshInstance*> instances;
+        for (const auto& skinnedInstance : m_Scene->GetSceneGraph()->GetSkinnedMeshInstances())
+            instances.push_back(skinnedInstance.get());
 
+        m_CommandList->open();
+        m_BatchedSkinning->Dispatch(m_CommandList, m_DescriptorTable->GetDescriptorTable(), instances);
+        m_BatchedSkinning->RecordReadback(m_CommandList);
         m_CommandList->close();
         GetDevice()->executeCommandList(m_CommandList);
-
         GetDevice()->waitForIdle();
 
-        return true;
+        // One millimeter, well above the rounding differences between the shader and the reference
+        return m_BatchedSkinning->ValidateReadback(1e-3f) == 0;
+    }
+
+    // Traces the primary rays of the initial view on the CPU, closest hit without culling like the
+    // RayGen shader. Writes the raw hits for comparison with a GPU capture, and an image with one
+    // colour per instance and geometry.
+    bool RunCpuReference(uint32_t width, uint32_t height, const std::filesystem::path& outputFileName)
+    {
+        nvrhi::Viewport viewport(float(width), float(height));
+        m_View.SetViewport(viewport);
+        m_View.SetMatrices(m_Camera.GetWorldToViewMatrix(), perspProjD3DStyleReverse(dm::PI_f * 0.25f, viewport.width() / viewport.height(), 0.1f));
+        m_View.UpdateCache();
+
+        PlanarViewConstants viewConstants;
+        m_View.FillPlanarViewConstants(viewConstants);
+
+        const uint32_t threadCount = std::max(std::thread::hardware_concurrency(), 1u);
+
+        CpuRayTracer tracer;
+        tracer.AddSceneGraph(*m_Scene->GetSceneGraph());
+        tracer.Build(threadCount);
+
+        std::vector<CpuRay> rays;
+        GeneratePrimaryRays(viewConstants.matClipToWorld, viewConstants.cameraDirectionOrPosition.xyz(), width, height, 1000.f, rays);
+        std::vector<CpuRayHit> hits(rays.size());
+        tracer.TraceRays(rays.data(), hits.data(), rays.size(), CpuTraceOptions(), threadCount);
+
+        bool success = WriteCpuRayHits(hits, width, height, outputFileName);
+        if (success)
+            log::info("Wrote the CPU reference hits to '%s'", outputFileName.generic_string().c_str());
+        else
+            log::error("Cannot write '%s'", outputFileName.generic_string().c_str());
+
+        CapturedImage image;
+        image.width = width;
+        image.height = height;
+        image.format = nvrhi::Format::RGBA8_UNORM;
+        image.pixels.resize(size_t(width) * height * 4);
+        for (size_t i = 0; i < hits.size(); i++)
+        {
+            uint32_t hash = 0;
+            if (hits[i].IsHit())
+            {
+                hash = (hits[i].instanceID * 0x9e3779b9u) ^ (hits[i].geometryIndex * 0x85ebca6bu);
+                hash ^= hash >> 16;
+            }
+            memcpy(&image.pixels[i * 4], &hash, 3);
+            image.pixels[i * 4 + 3] = 255;
+        }
+
+        std::filesystem::path imageFileName = outputFileName;
+        imageFileName.replace_extension(".png");
+        success = WriteCapturedImage(image, imageFileName) && success;
+
+        success = ReportCpuRayTracer(tracer, "Primary", rays, CpuTraceOptions()) && success;
+
+        return success;
     }
 
     bool LoadScene(std::shared_ptr<vfs::IFileSystem> fs, const std::filesystem::path& sceneFileName) override 
@@ -167,6 +366,11 @@ public:
         if (scene->Load(sceneFileName))
         {
             m_Scene = std::unique_ptr<engine::Scene>(scene);
+
+            m_AnimationSampler = AnimationSampler();
+            for (const auto& animation : m_Scene->GetSceneGraph()->GetAnimations())
+                m_AnimationSampler.AddAnimation(animation);
+
             return true;
         }
 
@@ -183,6 +387,13 @@ public:
             return true;
         }
 
+        if (key == GLFW_KEY_U && action == GLFW_PRESS)
+        {
+            m_RefitPolicy.enabled = !m_RefitPolicy.enabled;
+            m_RefitTimingStats = RefitTimingStats();
+            return true;
+        }
+
         return true;
     }
 
@@ -213,17 +424,32 @@ public:
             m_WallclockTime += fElapsedTimeSeconds;
             float offset = 0;
 
-            for (const auto& anim : m_Scene->GetSceneGraph()->GetAnimations())
+            const auto& animations = m_Scene->GetSceneGraph()->GetAnimations();
+            m_AnimationTimes.resize(animations.size());
+            for (size_t i = 0; i < animations.size(); i++)
             {
-                float duration = anim->GetDuration();
+                float duration = animations[i]->GetDuration();
                 float integral;
-                float animationTime = std::modf((m_WallclockTime + offset) / duration, &integral) * duration;
-                (void)anim->Apply(animationTime);
+                m_AnimationTimes[i] = std::modf((m_WallclockTime + offset) / duration, &integral) * duration;
                 offset += 1.0f;
             }
+
+            m_AnimationSampler.Evaluate(m_AnimationTimes.data());
+            m_AnimationSampler.Apply();
         }
 
-        const char* extraInfo = (m_RayPipeline != nullptr) ? "- using RayPipeline" : "- using RayQuery";
+        const AccelStructStats& stats = m_AccelStructStats;
+        const RefitTimingStats& timing = m_RefitTimingStats;
+        char extraInfo[512];
+        snprintf(extraInfo, sizeof(extraInfo), "- using %s - BLAS: %u compacted of %u, %.1f MB pending, %u vertices skinned in batch - TLAS: %u instances patched%s"
+            " - refit %s (U): BLAS %.3f ms x%u / rebuild %.3f ms x%u, TLAS %.3f ms x%u / rebuild %.3f ms x%u, SAH %.2fx",
+            (m_RayPipeline != nullptr) ? "RayPipeline" : "RayQuery",
+            stats.compactedBlasCount, stats.staticBlasCount, double(stats.pendingCompactionBytes) / double(1 << 20),
+            stats.batchedSkinnedVertices, stats.patchedInstances, stats.tlasBuilt ? "" : ", not rebuilt",
+            m_RefitPolicy.enabled ? "on" : "off",
+            timing.blasRefit.GetAverageMs(), timing.blasRefit.count, timing.blasRebuild.GetAverageMs(), timing.blasRebuild.count,
+            timing.tlasRefit.GetAverageMs(), timing.tlasRefit.count, timing.tlasRebuild.GetAverageMs(), timing.tlasRebuild.count,
+            stats.tlasQualityRatio);
         GetDeviceManager()->SetInformativeWindowTitle(g_WindowTitle, extraInfo);
     }
 
@@ -296,6 +522,9 @@ public:
         blasDesc.isTopLevel = false;
         blasDesc.debugName = mesh.name;
 
+        // Skinned meshes read their positions from the batched skinning output when it is enabled
+        const uint32_t skinnedOutputOffset = (m_BatchedSkinning && mesh.skinPrototype) ? m_BatchedSkinning->GetOutputOffset(&mesh) : ~0u;
+
         for (const auto& geometry : mesh.geometries)
         {
             nvrhi::rt::GeometryDesc geometryDesc;
@@ -304,8 +533,16 @@ public:
             triangles.indexOffset = (mesh.indexOffset + geometry->indexOffsetInMesh) * sizeof(uint32_t);
             triangles.indexFormat = nvrhi::Format::R32_UINT;
             triangles.indexCount = geometry->numIndices;
-            triangles.vertexBuffer = mesh.buffers->vertexBuffer;
-            triangles.vertexOffset = (mesh.vertexOffset + geometry->vertexOffsetInMesh) * sizeof(float3) + mesh.buffers->getVertexBufferRange(engine::VertexAttribute::Position).byteOffset;
+            if (skinnedOutputOffset != ~0u)
+            {
+                triangles.vertexBuffer = m_BatchedSkinning->GetPositionBuffer();
+                triangles.vertexOffset = (skinnedOutputOffset + geometry->vertexOffsetInMesh) * sizeof(float3);
+            }
+            else
+            {
+                triangles.vertexBuffer = mesh.buffers->vertexBuffer;
+                triangles.vertexOffset = (mesh.vertexOffset + geometry->vertexOffsetInMesh) * sizeof(float3) + mesh.buffers->getVertexBufferRange(engine::VertexAttribute::Position).byteOffset;
+            }
             triangles.vertexFormat = nvrhi::Format::RGB32_FLOAT;
             triangles.vertexStride = sizeof(float3);
             triangles.vertexCount = geometry->numVertices;
@@ -316,10 +553,10 @@ public:
             blasDesc.bottomLevelGeometries.push_back(geometryDesc);
         }
 
-        // don't compact acceleration structures that are built per frame
+        // don't compact acceleration structures that are built per frame, but allow refitting them
         if (mesh.skinPrototype != nullptr)
         {
-            blasDesc.buildFlags = nvrhi::rt::AccelStructBuildFlags::PerferFastTrace;
+            blasDesc.buildFlags = nvrhi::rt::AccelStructBuildFlags::PerferFastTrace | nvrhi::rt::AccelStructBuildFlags::AllowUpdate;
         }
         else
         {
@@ -327,8 +564,30 @@ public:
         }
     }
 
-    void CreateAccelStructs(nvrhi::ICommandList* commandList)
+    static uint64_t EstimateBlasBytes(const nvrhi::rt::AccelStructDesc& blasDesc)
+    {
+        uint64_t triangles = 0;
+        for (const auto& geometryDesc : blasDesc.bottomLevelGeometries)
+            triangles += geometryDesc.geometryData.triangles.indexCount / 3;
+
+        return triangles * c_EstimatedBlasBytesPerTriangle;
+    }
+
+    bool CreateAccelStructs()
     {
+        const auto& skinnedInstances = m_Scene->GetSceneGraph()->GetSkinnedMeshInstances();
+        if (m_UseBatchedSkinning && !skinnedInstances.empty())
+        {
+            m_BatchedSkinning = std::make_unique<BatchedSkinningPass>(GetDevice(), m_BindlessLayout);
+            if (!m_BatchedSkinning->Init(*m_ShaderFactory, skinnedInstances))
+                return false;
+        }
+
+        auto recordStart = std::chrono::high_resolution_clock::now();
+
+        // Group the static BLAS builds into batches that fit the budget, each recorded into its own command list
+        std::vector<BlasBuildBatch> batches;
+
         for (const auto& mesh : m_Scene->GetSceneGraph()->GetMeshes())
         {
             if (mesh->buffers->hasAttribute(engine::VertexAttribute::JointWeights))
@@ -338,72 +597,330 @@ public:
 
             GetMeshBlasDesc(*mesh, blasDesc);
 
-            nvrhi::rt::AccelStructHandle as = GetDevice()->createAccelStruct(blasDesc);
+            mesh->accelStruct = GetDevice()->createAccelStruct(blasDesc);
+
+            if (mesh->skinPrototype)
+            {
+                // built per frame in BuildTLAS
+                m_AccelStructStats.skinnedBlasCount++;
+                continue;
+            }
 
-            if (!mesh->skinPrototype)
-                nvrhi::utils::BuildBottomLevelAccelStruct(commandList, as, blasDesc);
+            uint64_t estimatedBytes = EstimateBlasBytes(blasDesc);
+            if (batches.empty() || (batches.back().estimatedBytes + estimatedBytes > c_BlasBatchBudget && !batches.back().meshes.empty()))
+                batches.emplace_back();
 
-            mesh->accelStruct = as;
+            BlasBuildBatch& batch = batches.back();
+            batch.meshes.push_back(mesh.get());
+            batch.descs.push_back(std::move(blasDesc));
+            batch.estimatedBytes += estimatedBytes;
+
+            m_AccelStructStats.staticBlasCount++;
         }
 
+        for (auto& batch : batches)
+            batch.commandList = GetDevice()->createCommandList();
+
+        auto recordBatch = [](BlasBuildBatch& batch)
+        {
+            batch.commandList->open();
+            for (size_t i = 0; i < batch.meshes.size(); i++)
+                nvrhi::utils::BuildBottomLevelAccelStruct(batch.commandList, batch.meshes[i]->accelStruct, batch.descs[i]);
+            batch.commandList->close();
+        };
+
+#ifdef DONUT_WITH_TASKFLOW
+        tf::Executor executor;
+        tf::Taskflow taskFlow;
+        for (auto& batch : batches)
+            taskFlow.emplace([&batch, &recordBatch]() { recordBatch(batch); });
+        executor.run(taskFlow).wait();
+#else
+        for (auto& batch : batches)
+            recordBatch(batch);
+#endif
+
+        m_AccelStructStats.batchCount = uint32_t(batches.size());
+        m_AccelStructStats.recordTimeMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - recordStart).count();
+
+        // Submit the batches one by one, so that each can be compacted as soon as the GPU has finished it
+        for (auto& batch : batches)
+        {
+            GetDevice()->executeCommandList(batch.commandList);
+
+            CompactionRequest request;
+            for (engine::MeshInfo* mesh : batch.meshes)
+                request.accelStructs.push_back(mesh->accelStruct);
+            request.estimatedBytes = batch.estimatedBytes;
+
+            m_AccelStructStats.pendingCompactionBytes += request.estimatedBytes;
+            m_CompactionQueue.push_back(std::move(request));
+        }
+
+        log::info("Recorded %u static BLAS builds (%.1f MB estimated) in %u batches in %.2f ms; %u skinned BLASes are built per frame",
+            m_AccelStructStats.staticBlasCount, double(m_AccelStructStats.pendingCompactionBytes) / double(1 << 20),
+            m_AccelStructStats.batchCount, m_AccelStructStats.recordTimeMs, m_AccelStructStats.skinnedBlasCount);
 
         nvrhi::rt::AccelStructDesc tlasDesc;
         tlasDesc.isTopLevel = true;
         tlasDesc.topLevelMaxInstances = m_Scene->GetSceneGraph()->GetMeshInstances().size();
+        tlasDesc.buildFlags = nvrhi::rt::AccelStructBuildFlags::AllowUpdate;
         m_TopLevelAS = GetDevice()->createAccelStruct(tlasDesc);
+
+        return true;
     }
 
-    void BuildTLAS(nvrhi::ICommandList* commandList, uint32_t frameIndex) const
+    // Compacts the BLASes of the batches that have finished building. Returns true if any were compacted,
+    // in which case the TLAS must be rebuilt to pick up their new addresses.
+    bool ProcessCompactionQueue(nvrhi::ICommandList* commandList)
     {
-        commandList->beginMarker("Skinned BLAS Updates");
+        if (m_CompactionQueue.empty())
+            return false;
 
-        // Transition all the buffers to their necessary states before building the BLAS'es to allow BLAS batching
-        for (const auto& skinnedInstance : m_Scene->GetSceneGraph()->GetSkinnedMeshInstances())
+        // NVRHI only compacts the tagged acceleration structures whose original build has finished executing,
+        // so keep asking every frame until all of them are done
+        commandList->compactBottomLevelAccelStructs();
+
+        bool anyCompacted = false;
+        for (auto it = m_CompactionQueue.begin(); it != m_CompactionQueue.end(); )
         {
-            if (skinnedInstance->GetLastUpdateFrameIndex() < frameIndex)
+            CompactionRequest& request = *it;
+
+            uint32_t compactedCount = uint32_t(std::count_if(request.accelStructs.begin(), request.accelStructs.end(),
+                [](const nvrhi::rt::AccelStructHandle& accelStruct) { return accelStruct->isCompacted(); }));
+
+            if (compactedCount > request.compactedCount)
+            {
+                m_AccelStructStats.compactedBlasCount += compactedCount - request.compactedCount;
+                request.compactedCount = compactedCount;
+                anyCompacted = true;
+            }
+
+            if (compactedCount == request.accelStructs.size())
+            {
+                m_AccelStructStats.compactedBytes += request.estimatedBytes;
+                m_AccelStructStats.pendingCompactionBytes -= request.estimatedBytes;
+                it = m_CompactionQueue.erase(it);
+            }
+            else
+                ++it;
+        }
+
+        return anyCompacted;
+    }
+
+    // Patches the persistent instance array where the transforms or BLASes have changed. Returns the number of patched instances.
+    uint32_t UpdateTlasInstances()
+    {
+        const auto& meshInstances = m_Scene->GetSceneGraph()->GetMeshInstances();
+
+        bool rebuildAll = false;
+        if (m_TlasInstances.size() != meshInstances.size())
+        {
+            m_TlasInstances.resize(meshInstances.size());
+            rebuildAll = true;
+        }
+
+        uint32_t patchedInstances = 0;
+
+        for (size_t i = 0; i < meshInstances.size(); i++)
+        {
+            const auto& instance = meshInstances[i];
+            nvrhi::rt::IAccelStruct* blas = instance->GetMesh()->accelStruct;
+            assert(blas);
+
+            auto node = instance->GetNode();
+            assert(node);
+            nvrhi::rt::AffineTransform transform;
+            dm::affineToColumnMajor(node->GetLocalToWorldTransformFloat(), transform);
+
+            nvrhi::rt::InstanceDesc& instanceDesc = m_TlasInstances[i];
+            if (!rebuildAll && instanceDesc.bottomLevelAS == blas && memcmp(instanceDesc.transform, transform, sizeof(transform)) == 0)
                 continue;
 
-            commandList->setAccelStructState(skinnedInstance->GetMesh()->accelStruct, nvrhi::ResourceStates::AccelStructWrite);
-            commandList->setBufferState(skinnedInstance->GetMesh()->buffers->vertexBuffer, nvrhi::ResourceStates::AccelStructBuildInput);
+            instanceDesc.bottomLevelAS = blas;
+            instanceDesc.instanceMask = 1;
+            instanceDesc.instanceID = instance->GetInstanceIndex();
+            memcpy(instanceDesc.transform, transform, sizeof(transform));
+            ++patchedInstances;
         }
-        commandList->commitBarriers();
 
-        // Now build the BLAS'es
+        return patchedInstances;
+    }
+
+    // Joint positions in the space of the skinned mesh, a cheap stand-in for its triangles in the refit quality estimate
+    void GetJointBounds(const engine::SkinnedMeshInstance& skinnedInstance, std::vector<box3>& bounds) const
+    {
+        affine3 worldToMesh = inverse(skinnedInstance.GetNode()->GetLocalToWorldTransformFloat());
+
+        bounds.clear();
+        for (const auto& joint : skinnedInstance.joints)
+        {
+            float3 position = worldToMesh.transformPoint(joint.node->GetLocalToWorldTransformFloat().m_translation);
+            bounds.push_back(box3(position, position));
+        }
+    }
+
+    void ResolveAccelStructTimers()
+    {
+        for (AccelStructTimers& timers : m_AccelStructTimers)
+        {
+            if (!timers.pending)
+                continue;
+
+            if ((timers.blasRebuilds && !GetDevice()->pollTimerQuery(timers.blasRebuild)) ||
+                (timers.blasRefits && !GetDevice()->pollTimerQuery(timers.blasRefit)) ||
+                (timers.tlasBuilt && !GetDevice()->pollTimerQuery(timers.tlas)))
+                continue;
+
+            auto collect = [this](nvrhi::ITimerQuery* query, uint32_t count, UpdateTiming& timing)
+            {
+                if (!count)
+                    return;
+
+                timing.count += count;
+                timing.totalMs += double(GetDevice()->getTimerQueryTime(query)) * 1000.0;
+                GetDevice()->resetTimerQuery(query);
+            };
+
+            collect(timers.blasRebuild, timers.blasRebuilds, m_RefitTimingStats.blasRebuild);
+            collect(timers.blasRefit, timers.blasRefits, m_RefitTimingStats.blasRefit);
+            collect(timers.tlas, timers.tlasBuilt ? 1 : 0, timers.tlasRefit ? m_RefitTimingStats.tlasRefit : m_RefitTimingStats.tlasRebuild);
+
+            timers.pending = false;
+        }
+    }
+
+    void BuildTLAS(nvrhi::ICommandList* commandList, uint32_t frameIndex)
+    {
+        ResolveAccelStructTimers();
+
+        // Skip the timing of this frame if the results from this slot have not been collected yet
+        AccelStructTimers* timers = &m_AccelStructTimers[m_AccelStructTimerIndex];
+        if (timers->pending)
+            timers = nullptr;
+
+        std::vector<engine::MeshInfo*> rebuiltMeshes;
+        std::vector<engine::MeshInfo*> refittedMeshes;
+
+        // Queue the skinned BLASes of this frame, refitting those whose skeletons have not moved too far
+        // from their state at the last rebuild
+        m_UpdatedSkinnedInstances.clear();
         for (const auto& skinnedInstance : m_Scene->GetSceneGraph()->GetSkinnedMeshInstances())
         {
             if (skinnedInstance->GetLastUpdateFrameIndex() < frameIndex)
                 continue;
-            
-            nvrhi::rt::AccelStructDesc blasDesc;
-            GetMeshBlasDesc(*skinnedInstance->GetMesh(), blasDesc);
-            
-            nvrhi::utils::BuildBottomLevelAccelStruct(commandList, skinnedInstance->GetMesh()->accelStruct, blasDesc);
-        }
-        commandList->endMarker();
 
-        std::vector<nvrhi::rt::InstanceDesc> instances;
+            m_UpdatedSkinnedInstances.push_back(skinnedInstance.get());
+
+            if (m_RefitPolicy.enabled)
+                GetJointBounds(*skinnedInstance, m_RefitBounds);
 
-        for (const auto& instance : m_Scene->GetSceneGraph()->GetMeshInstances())
+            RefitState& refitState = m_SkinnedRefitStates[skinnedInstance.get()];
+            if (refitState.Update(m_RefitPolicy, m_RefitBounds, false))
+                rebuiltMeshes.push_back(skinnedInstance->GetMesh().get());
+            else
+                refittedMeshes.push_back(skinnedInstance->GetMesh().get());
+        }
+
+        // Skin the positions of all queued instances in one dispatch, which leaves them in the state for BLAS builds
+        m_AccelStructStats.batchedSkinnedVertices = 0;
+        if (m_BatchedSkinning && !m_UpdatedSkinnedInstances.empty())
         {
-            nvrhi::rt::InstanceDesc instanceDesc;
-            instanceDesc.bottomLevelAS = instance->GetMesh()->accelStruct;
-            assert(instanceDesc.bottomLevelAS);
-            instanceDesc.instanceMask = 1;
-            instanceDesc.instanceID = instance->GetInstanceIndex();
+            m_BatchedSkinning->Dispatch(commandList, m_DescriptorTable->GetDescriptorTable(), m_UpdatedSkinnedInstances);
+            m_AccelStructStats.batchedSkinnedVertices = m_BatchedSkinning->GetLastVertexCount();
+        }
 
-            auto node = instance->GetNode();
-            assert(node);
-            dm::affineToColumnMajor(node->GetLocalToWorldTransformFloat(), instanceDesc.transform);
+        commandList->beginMarker("Skinned BLAS Updates");
 
-            instances.push_back(instanceDesc);
+        // Transition all the buffers to their necessary states before building the BLAS'es to allow BLAS batching
+        for (const auto* meshes : { &rebuiltMeshes, &refittedMeshes })
+        {
+            for (engine::MeshInfo* mesh : *meshes)
+            {
+                commandList->setAccelStructState(mesh->accelStruct, nvrhi::ResourceStates::AccelStructWrite);
+                if (!m_BatchedSkinning)
+                    commandList->setBufferState(mesh->buffers->vertexBuffer, nvrhi::ResourceStates::AccelStructBuildInput);
+            }
         }
+        commandList->commitBarriers();
 
-        // Compact acceleration structures that are tagged for compaction and have finished executing the original build
-        commandList->compactBottomLevelAccelStructs();
+        // Now build the BLAS'es, rebuilds and refits timed separately
+        auto buildSkinnedBlases = [this, commandList](const std::vector<engine::MeshInfo*>& meshes, bool refit, nvrhi::ITimerQuery* timer)
+        {
+            if (meshes.empty())
+                return;
 
-        commandList->beginMarker("TLAS Update");
-        commandList->buildTopLevelAccelStruct(m_TopLevelAS, instances.data(), instances.size());
+            if (timer)
+                commandList->beginTimerQuery(timer);
+
+            for (engine::MeshInfo* mesh : meshes)
+            {
+                nvrhi::rt::AccelStructDesc blasDesc;
+                GetMeshBlasDesc(*mesh, blasDesc);
+                if (refit)
+                    blasDesc.buildFlags = blasDesc.buildFlags | nvrhi::rt::AccelStructBuildFlags::PerformUpdate;
+
+                nvrhi::utils::BuildBottomLevelAccelStruct(commandList, mesh->accelStruct, blasDesc);
+            }
+
+            if (timer)
+                commandList->endTimerQuery(timer);
+        };
+
+        buildSkinnedBlases(rebuiltMeshes, false, timers ? timers->blasRebuild.Get() : nullptr);
+        buildSkinnedBlases(refittedMeshes, true, timers ? timers->blasRefit.Get() : nullptr);
         commandList->endMarker();
+
+        bool blasChanged = !rebuiltMeshes.empty() || !refittedMeshes.empty();
+
+        // Compacted BLASes have new addresses, which a TLAS refit would also accept, but rebuild for simplicity
+        bool compacted = ProcessCompactionQueue(commandList);
+        if (compacted)
+            blasChanged = true;
+
+        const auto& meshInstances = m_Scene->GetSceneGraph()->GetMeshInstances();
+        bool instanceCountChanged = m_TlasInstances.size() != meshInstances.size();
+        m_AccelStructStats.patchedInstances = UpdateTlasInstances();
+
+        // The TLAS stays valid while no instance has moved and no BLAS it references has changed
+        m_AccelStructStats.tlasBuilt = blasChanged || m_AccelStructStats.patchedInstances > 0;
+
+        bool tlasRefit = false;
+        if (m_AccelStructStats.tlasBuilt)
+        {
+            if (m_RefitPolicy.enabled)
+            {
+                m_RefitBounds.clear();
+                for (const auto& instance : meshInstances)
+                    m_RefitBounds.push_back(instance->GetNode()->GetGlobalBoundingBox());
+            }
+
+            tlasRefit = !m_TlasRefitState.Update(m_RefitPolicy, m_RefitBounds, instanceCountChanged || compacted);
+            m_AccelStructStats.tlasQualityRatio = m_TlasRefitState.lastQualityRatio;
+
+            nvrhi::rt::AccelStructBuildFlags buildFlags = nvrhi::rt::AccelStructBuildFlags::AllowUpdate;
+            if (tlasRefit)
+                buildFlags = buildFlags | nvrhi::rt::AccelStructBuildFlags::PerformUpdate;
+
+            commandList->beginMarker(tlasRefit ? "TLAS Refit" : "TLAS Update");
+            if (timers)
+                commandList->beginTimerQuery(timers->tlas);
+            commandList->buildTopLevelAccelStruct(m_TopLevelAS, m_TlasInstances.data(), m_TlasInstances.size(), buildFlags);
+            if (timers)
+                commandList->endTimerQuery(timers->tlas);
+            commandList->endMarker();
+        }
+
+        if (timers && (blasChanged || m_AccelStructStats.tlasBuilt))
+        {
+            timers->blasRebuilds = uint32_t(rebuiltMeshes.size());
+            timers->blasRefits = uint32_t(refittedMeshes.size());
+            timers->tlasBuilt = m_AccelStructStats.tlasBuilt;
+            timers->tlasRefit = tlasRefit;
+            timers->pending = true;
+            m_AccelStructTimerIndex = (m_AccelStructTimerIndex + 1) % uint32_t(m_AccelStructTimers.size());
+        }
     }
 
 
@@ -504,12 +1021,45 @@ int main(int __argc, const char** __argv)
     deviceParams.enableRayTracingExtensions = true;
 
     bool useRayQuery = false;
+    bool batchedSkinning = false;
+    bool validateSkinning = false;
+    bool skinningBenchmark = false;
+    RefitPolicy refitPolicy;
+    std::filesystem::path cpuReferenceFileName;
     for (int i = 1; i < __argc; i++)
     {
         if (strcmp(__argv[i], "-rayQuery") == 0)
         {
             useRayQuery = true;
         }
+        else if (strcmp(__argv[i], "-refit") == 0)
+        {
+            refitPolicy.enabled = true;
+        }
+        else if (strcmp(__argv[i], "-rebuild-interval") == 0 && i + 1 < __argc)
+        {
+            refitPolicy.rebuildInterval = uint32_t(std::max(0, atoi(__argv[++i])));
+        }
+        else if (strcmp(__argv[i], "-refit-threshold") == 0 && i + 1 < __argc)
+        {
+            refitPolicy.qualityThreshold = std::max(1.f, float(atof(__argv[++i])));
+        }
+        else if (strcmp(__argv[i], "-batched-skinning") == 0)
+        {
+            batchedSkinning = true;
+        }
+        else if (strcmp(__argv[i], "-validate") == 0)
+        {
+            validateSkinning = true;
+        }
+        else if (strcmp(__argv[i], "-skinning-benchmark") == 0)
+        {
+            skinningBenchmark = true;
+        }
+        else if (strcmp(__argv[i], "-cpu-reference") == 0)
+        {
+            cpuReferenceFileName = (i + 1 < __argc && __argv[i + 1][0] != '-') ? __argv[++i] : "rt_bindless_cpu_hits.bin";
+        }
         else if (strcmp(__argv[i], "-debug") == 0)
         {
             deviceParams.enableDebugRuntime = true;
@@ -517,31 +1067,77 @@ int main(int __argc, const char** __argv)
         }
     }
 
-    if (!deviceManager->CreateWindowDeviceAndSwapChain(deviceParams, g_WindowTitle))
+    // The skinning benchmark only needs the CPU
+    if (skinningBenchmark)
+    {
+        int violations = RunCpuSkinningBenchmark();
+        delete deviceManager;
+        return violations ? 1 : 0;
+    }
+
+    // The CPU reference loads the scene through a headless device that does not need ray tracing support
+    const bool cpuReference = !cpuReferenceFileName.empty();
+    if (cpuReference)
+    {
+        deviceParams.enableRayTracingExtensions = false;
+        if (!deviceManager->CreateHeadlessDevice(deviceParams))
+        {
+            log::fatal("Cannot initialize a graphics device with the requested parameters");
+            return 1;
+        }
+    }
+    else if (validateSkinning)
+    {
+        // The validation dispatches once and reads back, so it does not need a window either
+        if (!deviceManager->CreateHeadlessDevice(deviceParams))
+        {
+            log::fatal("Cannot initialize a graphics device with the requested parameters");
+            return 1;
+        }
+    }
+    else if (!deviceManager->CreateWindowDeviceAndSwapChain(deviceParams, g_WindowTitle))
     {
         log::fatal("Cannot initialize a graphics device with the requested parameters");
         return 1;
     }
 
-    if (!useRayQuery && !deviceManager->GetDevice()->queryFeatureSupport(nvrhi::Feature::RayTracingPipeline))
+    if (!cpuReference && !useRayQuery && !deviceManager->GetDevice()->queryFeatureSupport(nvrhi::Feature::RayTracingPipeline))
     {
         log::fatal("The graphics device does not support Ray Tracing Pipelines");
         return 1;
     }
 
-    if (useRayQuery && !deviceManager->GetDevice()->queryFeatureSupport(nvrhi::Feature::RayQuery))
+    if (!cpuReference && useRayQuery && !deviceManager->GetDevice()->queryFeatureSupport(nvrhi::Feature::RayQuery))
     {
         log::fatal("The graphics device does not support Ray Queries");
         return 1;
     }
 
+    int exitCode = 0;
     {
         BindlessRayTracing example(deviceManager);
-        if (example.Init(useRayQuery))
+        if (example.Init(useRayQuery, refitPolicy, cpuReference, batchedSkinning))
+        {
+            if (cpuReference)
+            {
+                if (!example.RunCpuReference(deviceParams.backBufferWidth, deviceParams.backBufferHeight, cpuReferenceFileName))
+                    exitCode = 1;
+            }
+            else if (validateSkinning)
+            {
+                if (!example.RunSkinningValidation())
+                    exitCode = 1;
+            }
+            else
+            {
+                deviceManager->AddRenderPassToBack(&example);
+                deviceManager->RunMessageLoop();
+                deviceManager->RemoveRenderPass(&example);
+            }
+        }
+        else
         {
-            deviceManager->AddRenderPassToBack(&example);
-            deviceManager->RunMessageLoop();
-            deviceManager->RemoveRenderPass(&example);
+            exitCode = 1;
         }
     }
     
@@ -549,5 +1145,5 @@ int main(int __argc, const char** __argv)
 
     delete deviceManager;
 
-    return 0;
+    return exitCode;
 }
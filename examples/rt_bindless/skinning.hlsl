@@ -0,0 +1,78 @@
+/*
+* Copyright (c) 2014-2021, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#pragma pack_matrix(row_major)
+
+#include <donut/shaders/vulkan.hlsli>
+#include "skinning_cb.h"
+
+// Mirrors SkinningJointMatrix in CpuSkinning.h: transposed rows, one dot product per output coordinate
+struct JointMatrix
+{
+    float4 x;
+    float4 y;
+    float4 z;
+};
+
+StructuredBuffer<SkinningInstanceData> t_Instances : register(t0);
+StructuredBuffer<uint> t_GroupInstances : register(t1);
+StructuredBuffer<JointMatrix> t_Joints : register(t2);
+RWByteAddressBuffer u_Positions : register(u0);
+
+VK_BINDING(0, 1) ByteAddressBuffer t_BindlessBuffers[] : register(t0, space1);
+
+[numthreads(SKINNING_GROUP_SIZE, 1, 1)]
+void main(uint2 groupId : SV_GroupID, uint threadId : SV_GroupThreadID)
+{
+    uint group = groupId.y * SKINNING_MAX_GROUPS_X + groupId.x;
+    uint instanceIndex = t_GroupInstances[group];
+    if (instanceIndex == SKINNING_NO_INSTANCE)
+        return;
+
+    SkinningInstanceData instance = t_Instances[instanceIndex];
+    uint vertex = (group - instance.firstGroup) * SKINNING_GROUP_SIZE + threadId;
+    if (vertex >= instance.vertexCount)
+        return;
+
+    ByteAddressBuffer vertexBuffer = t_BindlessBuffers[NonUniformResourceIndex(instance.vertexBufferIndex)];
+    float3 position = asfloat(vertexBuffer.Load3(instance.positionOffset + vertex * 12));
+    uint2 packedIndices = vertexBuffer.Load2(instance.jointIndexOffset + vertex * 8);
+    float4 weights = asfloat(vertexBuffer.Load4(instance.jointWeightOffset + vertex * 16));
+    uint4 indices = uint4(packedIndices.x & 0xffff, packedIndices.x >> 16, packedIndices.y & 0xffff, packedIndices.y >> 16);
+
+    // Blend the matrices, then transform once, like the CPU reference
+    float4 x = 0;
+    float4 y = 0;
+    float4 z = 0;
+
+    [unroll]
+    for (uint influence = 0; influence < 4; influence++)
+    {
+        JointMatrix joint = t_Joints[instance.jointOffset + indices[influence]];
+        x += joint.x * weights[influence];
+        y += joint.y * weights[influence];
+        z += joint.z * weights[influence];
+    }
+
+    float4 homogeneous = float4(position, 1.0);
+    u_Positions.Store3((instance.outputOffset + vertex) * 12, asuint(float3(dot(homogeneous, x), dot(homogeneous, y), dot(homogeneous, z))));
+}
@@ -0,0 +1,47 @@
+/*
+* Copyright (c) 2014-2021, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef SKINNING_CB_H
+#define SKINNING_CB_H
+
+#define SKINNING_GROUP_SIZE 64
+
+// Rows of thread groups in the batched dispatch, so that large batches stay within the dispatch limits
+#define SKINNING_MAX_GROUPS_X 32768
+
+#define SKINNING_NO_INSTANCE 0xffffffff
+
+// One skinned mesh instance of the batched dispatch, covering groups [firstGroup, firstGroup + ceil(vertexCount / SKINNING_GROUP_SIZE))
+struct SkinningInstanceData
+{
+    uint vertexBufferIndex; // bindless index of the prototype mesh's vertex buffer
+    uint positionOffset;    // byte offsets of the first vertex's attributes in that buffer
+    uint jointIndexOffset;
+    uint jointWeightOffset;
+
+    uint jointOffset;       // first matrix of the instance in the joint palette
+    uint vertexCount;
+    uint outputOffset;      // first vertex of the instance in the output position buffer
+    uint firstGroup;
+};
+
+#endif // SKINNING_CB_H
@@ -37,6 +37,13 @@
 
 #include "donut/engine/BindingCache.h"
 
+#include "CpuRayTracer.h"
+#include "ImageEncoders.h"
+
+#include <algorithm>
+#include <cstring>
+#include <thread>
+
 using namespace donut;
 using namespace donut::math;
 
@@ -164,7 +171,7 @@ private:
 public:
     using ApplicationBase::ApplicationBase;
 
-    bool Init()
+    bool Init(bool cpuReference)
     {
         std::filesystem::path sceneFileName = app::GetDirectoryWithExecutable().parent_path() / "media/glTF-Sample-Models/2.0/Sponza/glTF/Sponza.gltf";
         std::filesystem::path frameworkShaderPath = app::GetDirectoryWithExecutable() / "shaders/framework" / app::GetShaderTypeName(GetDevice()->getGraphicsAPI());
@@ -199,6 +206,10 @@ public:
 
         m_ConstantBuffer = GetDevice()->createBuffer(nvrhi::utils::CreateVolatileConstantBufferDesc(sizeof(LightingConstants), "LightingConstants", engine::c_MaxRenderPassConstantBufferVersions));
 
+        // The CPU reference only needs the scene
+        if (cpuReference)
+            return true;
+
         if (!CreateRayTracingPipeline(*m_ShaderFactory))
             return false;
 
@@ -361,6 +372,65 @@ public:
     }
 
 
+    // Traces the initial view on the CPU and writes the shadow mask that the ray generation shader
+    // multiplies the sun light with: white where the sun is visible, black in shadow, grey for the background.
+    bool RunCpuReference(uint32_t width, uint32_t height, const std::filesystem::path& outputFileName)
+    {
+        nvrhi::Viewport viewport(float(width), float(height));
+        m_View.SetViewport(viewport);
+        m_View.SetMatrices(m_Camera.GetWorldToViewMatrix(), perspProjD3DStyleReverse(dm::PI_f * 0.25f, viewport.width() / viewport.height(), 0.1f));
+        m_View.UpdateCache();
+
+        LightingConstants constants = {};
+        m_View.FillPlanarViewConstants(constants.view);
+        m_SunLight->FillLightConstants(constants.light);
+
+        const uint32_t threadCount = std::max(std::thread::hardware_concurrency(), 1u);
+
+        CpuRayTracer tracer;
+        tracer.AddSceneGraph(*m_Scene->GetSceneGraph());
+        tracer.Build(threadCount);
+
+        // The G-buffer surfaces are found with primary rays instead of rasterization
+        std::vector<CpuRay> primaryRays;
+        GeneratePrimaryRays(constants.view.matClipToWorld, constants.view.cameraDirectionOrPosition.xyz(), width, height, 1000.f, primaryRays);
+        std::vector<CpuRayHit> primaryHits(primaryRays.size());
+        tracer.TraceRays(primaryRays.data(), primaryHits.data(), primaryRays.size(), CpuTraceOptions(), threadCount);
+
+        // Same ray setup and flags as RayGen in rt_shadows.hlsl
+        CpuTraceOptions shadowOptions;
+        shadowOptions.acceptFirstHit = true;
+        shadowOptions.cullBackFaces = true;
+
+        std::vector<CpuRay> shadowRays;
+        GenerateShadowRays(primaryRays, primaryHits, constants.light.direction, 0.01f, 100.f, shadowRays);
+        std::vector<CpuRayHit> shadowHits(shadowRays.size());
+        tracer.TraceRays(shadowRays.data(), shadowHits.data(), shadowRays.size(), shadowOptions, threadCount);
+
+        CapturedImage mask;
+        mask.width = width;
+        mask.height = height;
+        mask.format = nvrhi::Format::RGBA8_UNORM;
+        mask.pixels.resize(size_t(width) * height * 4);
+        for (size_t i = 0; i < shadowHits.size(); i++)
+        {
+            uint8_t value = !primaryHits[i].IsHit() ? 128 : (shadowHits[i].IsHit() ? 0 : 255);
+            memset(&mask.pixels[i * 4], value, 3);
+            mask.pixels[i * 4 + 3] = 255;
+        }
+
+        bool success = WriteCapturedImage(mask, outputFileName);
+        if (success)
+            log::info("Wrote the CPU reference shadow mask to '%s'", outputFileName.generic_string().c_str());
+        else
+            log::error("Cannot write '%s'", outputFileName.generic_string().c_str());
+
+        success = ReportCpuRayTracer(tracer, "Primary", primaryRays, CpuTraceOptions()) && success;
+        success = ReportCpuRayTracer(tracer, "Shadow", shadowRays, shadowOptions) && success;
+
+        return success;
+    }
+
     void BackBufferResizing() override
     { 
         m_RenderTargets = nullptr;
@@ -452,25 +522,58 @@ int main(int __argc, const char** __argv)
     deviceParams.enableNvrhiValidationLayer = true;
 #endif
 
-    if (!deviceManager->CreateWindowDeviceAndSwapChain(deviceParams, g_WindowTitle))
+    // The CPU reference loads the scene through a headless device that does not need ray tracing support
+    std::filesystem::path cpuReferenceFileName;
+    for (int i = 1; i < __argc; i++)
+    {
+        if (strcmp(__argv[i], "-cpu-reference") == 0)
+        {
+            cpuReferenceFileName = (i + 1 < __argc && __argv[i + 1][0] != '-') ? __argv[++i] : "rt_shadows_cpu_shadow_mask.png";
+        }
+    }
+    const bool cpuReference = !cpuReferenceFileName.empty();
+
+    if (cpuReference)
+    {
+        deviceParams.enableRayTracingExtensions = false;
+        if (!deviceManager->CreateHeadlessDevice(deviceParams))
+        {
+            log::fatal("Cannot initialize a graphics device with the requested parameters");
+            return 1;
+        }
+    }
+    else if (!deviceManager->CreateWindowDeviceAndSwapChain(deviceParams, g_WindowTitle))
     {
         log::fatal("Cannot initialize a graphics device with the requested parameters");
         return 1;
     }
 
-    if (!deviceManager->GetDevice()->queryFeatureSupport(nvrhi::Feature::RayTracingPipeline))
+    if (!cpuReference && !deviceManager->GetDevice()->queryFeatureSupport(nvrhi::Feature::RayTracingPipeline))
     {
         log::fatal("The graphics device does not support Ray Tracing Pipelines");
         return 1;
     }
 
+    int exitCode = 0;
     {
         RayTracedShadows example(deviceManager);
-        if (example.Init())
+        if (example.Init(cpuReference))
+        {
+            if (cpuReference)
+            {
+                if (!example.RunCpuReference(deviceParams.backBufferWidth, deviceParams.backBufferHeight, cpuReferenceFileName))
+                    exitCode = 1;
+            }
+            else
+            {
+                deviceManager->AddRenderPassToBack(&example);
+                deviceManager->RunMessageLoop();
+                deviceManager->RemoveRenderPass(&example);
+            }
+        }
+        else
         {
-            deviceManager->AddRenderPassToBack(&example);
-            deviceManager->RunMessageLoop();
-            deviceManager->RemoveRenderPass(&example);
+            exitCode = 1;
         }
     }
     
@@ -478,5 +581,5 @@ int main(int __argc, const char** __argv)
 
     delete deviceManager;
 
-    return 0;
+    return exitCode;
 }
@@ -0,0 +1,380 @@
+/*
+* Copyright (c) 2014-2021, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#include <donut/app/ApplicationBase.h>
+#include <donut/app/DeviceManager.h>
+#include <donut/engine/ShaderFactory.h>
+#include <donut/engine/CommonRenderPasses.h>
+#include <donut/engine/TextureCache.h>
+#include <donut/engine/Scene.h>
+#include <donut/core/log.h>
+#include <donut/core/vfs/VFS.h>
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <unordered_set>
+
+#include "ScenePack.h"
+#include "TextureTranscoder.h"
+
+using namespace donut;
+
+struct CookOptions
+{
+    std::filesystem::path sceneFileName;
+    std::filesystem::path packFileName;
+    bool buildMeshlets = true;
+    bool force = false;
+    bool compressTextures = false;
+    uint32_t textureThreads = 0;
+    int benchmarkRuns = 0;
+};
+
+static double MillisecondsSince(std::chrono::high_resolution_clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+// Cooks scenes into scene packs and compares loading a pack with loading the source scene
+class SceneCook
+{
+public:
+    explicit SceneCook(nvrhi::IDevice* device)
+        : m_Device(device)
+    {
+        std::filesystem::path frameworkShaderPath = app::GetDirectoryWithExecutable() / "shaders/framework" / app::GetShaderTypeName(device->getGraphicsAPI());
+
+        auto rootFS = std::make_shared<vfs::RootFileSystem>();
+        rootFS->mount("/shaders/donut", frameworkShaderPath);
+
+        m_ShaderFactory = std::make_shared<engine::ShaderFactory>(device, rootFS, "/shaders");
+        m_CommonPasses = std::make_shared<engine::CommonRenderPasses>(device, m_ShaderFactory);
+        m_NativeFS = std::make_shared<vfs::NativeFileSystem>();
+        m_CommandList = device->createCommandList();
+    }
+
+    bool Cook(const CookOptions& options)
+    {
+        const uint64_t sourceHash = HashScenePackSource(options.sceneFileName);
+
+        if (!options.force)
+        {
+            ScenePack existing;
+            if (existing.Open(options.packFileName) && existing.GetSourceHash() == sourceHash)
+            {
+                log::info("%s is up to date", options.packFileName.generic_string().c_str());
+                return true;
+            }
+        }
+
+        auto cookStart = std::chrono::high_resolution_clock::now();
+
+        std::unique_ptr<engine::Scene> scene = LoadScene(options.sceneFileName, CreateTextureCache());
+        if (!scene)
+            return false;
+
+        ScenePackBuilder builder(options.buildMeshlets);
+        builder.AddSceneGraph(*scene->GetSceneGraph());
+
+        if (builder.GetSkippedMeshCount() != 0)
+            log::warning("Skipped %d skinned mesh instances; they have no CPU geometry", int(builder.GetSkippedMeshCount()));
+
+        if (!builder.Write(options.packFileName, sourceHash))
+        {
+            log::error("Cannot write %s", options.packFileName.generic_string().c_str());
+            return false;
+        }
+
+        ScenePack pack;
+        if (!pack.Open(options.packFileName))
+            return false;
+
+        log::info("Cooked %s in %.1f ms: %d meshes, %d instances, %d materials, %d vertices, %d meshlets, %.1f MB",
+            options.packFileName.generic_string().c_str(), MillisecondsSince(cookStart),
+            int(pack.GetMeshes().size()), int(pack.GetInstances().size()), int(pack.GetMaterials().size()),
+            int(pack.GetVertices().size()), int(pack.GetMeshlets().size()),
+            double(std::filesystem::file_size(options.packFileName)) / (1024.0 * 1024.0));
+
+        return true;
+    }
+
+    // Transcodes the textures of the pack to BCn with mips, into a cache next to the pack
+    bool CompressTextures(const CookOptions& options)
+    {
+        ScenePack pack;
+        if (!pack.Open(options.packFileName))
+            return false;
+
+        std::filesystem::path cacheDirectory = options.packFileName.parent_path() / "texture_cache";
+        m_Transcoder = std::make_unique<TextureTranscoder>(cacheDirectory, options.textureThreads, options.force);
+
+        auto transcodeStart = std::chrono::high_resolution_clock::now();
+        ForEachPackTexture(pack, options.packFileName.parent_path(), [this](const std::filesystem::path& fileName, TextureUsage usage)
+        {
+            m_Transcoder->Request(fileName, usage);
+        });
+        m_Transcoder->Flush();
+        double transcodeMs = MillisecondsSince(transcodeStart);
+
+        int transcoded = 0, cached = 0, failed = 0;
+        uint64_t uncompressedBytes = 0, compressedBytes = 0;
+        double decodeMs = 0.0, mipsMs = 0.0, encodeMs = 0.0;
+        for (const TranscodedTexture& texture : m_Transcoder->GetResults())
+        {
+            if (texture.cacheFileName.empty())
+            {
+                failed++;
+                continue;
+            }
+
+            (texture.fromCache ? cached : transcoded)++;
+            uncompressedBytes += texture.uncompressedBytes;
+            compressedBytes += texture.compressedBytes;
+            decodeMs += texture.decodeMs;
+            mipsMs += texture.mipsMs;
+            encodeMs += texture.encodeMs;
+        }
+
+        log::info("Textures: %d transcoded, %d cached, %d failed in %.1f ms with %d threads (%.1f textures/s)",
+            transcoded, cached, failed, transcodeMs, int(m_Transcoder->GetThreadCount()),
+            transcodeMs > 0.0 ? double(transcoded + cached) * 1000.0 / transcodeMs : 0.0);
+        if (transcoded != 0)
+            log::info("Thread time: decode %.1f ms, mips %.1f ms, encode %.1f ms", decodeMs, mipsMs, encodeMs);
+        log::info("Texture memory: %.1f MB as RGBA8, %.1f MB as BCn", double(uncompressedBytes) / (1024.0 * 1024.0), double(compressedBytes) / (1024.0 * 1024.0));
+
+        return failed == 0;
+    }
+
+    // Each run loads the scene both ways into a Donut scene, including the buffer and texture uploads and
+    // a wait for the GPU, so that both paths end with the same renderable scene. The first run is reported
+    // as cold; it only measures a cold file cache when the OS cache was flushed before starting.
+    bool Benchmark(const CookOptions& options)
+    {
+        std::vector<double> sourceTimes;
+        std::vector<double> packTimes;
+
+        uint64_t compressedTextureBytes = 0;
+        if (m_Transcoder)
+        {
+            ScenePack pack;
+            if (pack.Open(options.packFileName))
+            {
+                ForEachPackTexture(pack, options.packFileName.parent_path(), [this, &compressedTextureBytes](const std::filesystem::path& fileName, TextureUsage usage)
+                {
+                    std::filesystem::path compressedFileName = m_Transcoder->Find(fileName, usage);
+                    if (!compressedFileName.empty())
+                        compressedTextureBytes += std::filesystem::file_size(compressedFileName);
+                });
+            }
+        }
+
+        for (int run = 0; run < options.benchmarkRuns; run++)
+        {
+            auto sourceStart = std::chrono::high_resolution_clock::now();
+            {
+                auto textureCache = CreateTextureCache();
+                std::unique_ptr<engine::Scene> scene = LoadScene(options.sceneFileName, textureCache);
+                if (!scene)
+                    return false;
+                FinishTextures(*textureCache);
+            }
+            sourceTimes.push_back(MillisecondsSince(sourceStart));
+
+            auto packStart = std::chrono::high_resolution_clock::now();
+            {
+                ScenePack pack;
+                if (!pack.Open(options.packFileName))
+                {
+                    log::error("Cannot open %s", options.packFileName.generic_string().c_str());
+                    return false;
+                }
+
+                auto textureCache = CreateTextureCache();
+                ScenePackScene scene(m_Device, *m_ShaderFactory, m_NativeFS, textureCache, nullptr, nullptr);
+                if (!scene.LoadPack(pack, options.packFileName.parent_path(), m_Transcoder.get()))
+                    return false;
+                scene.FinishedLoading(0);
+
+                FinishTextures(*textureCache);
+            }
+            packTimes.push_back(MillisecondsSince(packStart));
+
+            log::info("Run %d (%s): source %.1f ms, pack %.1f ms", run + 1, run == 0 ? "cold" : "warm", sourceTimes.back(), packTimes.back());
+        }
+
+        if (compressedTextureBytes != 0)
+            log::info("The pack loads used %.1f MB of compressed textures", double(compressedTextureBytes) / (1024.0 * 1024.0));
+
+        if (options.benchmarkRuns > 1)
+        {
+            auto median = [](std::vector<double> times)
+            {
+                std::sort(times.begin(), times.end());
+                return times[times.size() / 2];
+            };
+
+            std::vector<double> warmSource(sourceTimes.begin() + 1, sourceTimes.end());
+            std::vector<double> warmPack(packTimes.begin() + 1, packTimes.end());
+            log::info("Cold: source %.1f ms, pack %.1f ms", sourceTimes[0], packTimes[0]);
+            log::info("Warm median: source %.1f ms, pack %.1f ms (%.1fx)", median(warmSource), median(warmPack), median(warmSource) / std::max(median(warmPack), 1e-3));
+        }
+
+        return true;
+    }
+
+private:
+    nvrhi::IDevice* m_Device;
+    std::shared_ptr<engine::ShaderFactory> m_ShaderFactory;
+    std::shared_ptr<engine::CommonRenderPasses> m_CommonPasses;
+    std::shared_ptr<vfs::NativeFileSystem> m_NativeFS;
+    nvrhi::CommandListHandle m_CommandList;
+    std::unique_ptr<TextureTranscoder> m_Transcoder;
+
+    // A new cache per load, so that textures are not reused from a previous run
+    std::shared_ptr<engine::TextureCache> CreateTextureCache()
+    {
+        return std::make_shared<engine::TextureCache>(m_Device, m_NativeFS, nullptr);
+    }
+
+    std::unique_ptr<engine::Scene> LoadScene(const std::filesystem::path& sceneFileName, std::shared_ptr<engine::TextureCache> textureCache)
+    {
+        auto scene = std::make_unique<engine::Scene>(m_Device, *m_ShaderFactory, m_NativeFS, textureCache, nullptr, nullptr);
+        if (!scene->Load(sceneFileName))
+        {
+            log::error("Cannot load %s", sceneFileName.generic_string().c_str());
+            return nullptr;
+        }
+
+        scene->FinishedLoading(0);
+        return scene;
+    }
+
+    // Calls the function once per distinct texture file and usage of the pack's materials
+    template<typename Function>
+    static void ForEachPackTexture(const ScenePack& pack, const std::filesystem::path& basePath, Function function)
+    {
+        std::unordered_set<uint64_t> visited;
+        for (const auto& material : pack.GetMaterials())
+        {
+            for (uint32_t slot = 0; slot < ScenePackTexture_Count; slot++)
+            {
+                uint32_t path = material.textures[slot];
+                TextureUsage usage = GetScenePackTextureUsage(slot);
+                if (path == c_ScenePackNone || !visited.insert((uint64_t(path) << 32) | uint32_t(usage)).second)
+                    continue;
+
+                std::filesystem::path fileName = pack.GetString(path);
+                function(fileName.is_absolute() ? fileName : basePath / fileName, usage);
+            }
+        }
+    }
+
+    void FinishTextures(engine::TextureCache& textureCache)
+    {
+        m_CommandList->open();
+        textureCache.ProcessRenderingThreadCommands(*m_CommonPasses, 0.f);
+        textureCache.LoadingFinished();
+        m_CommandList->close();
+        m_Device->executeCommandList(m_CommandList);
+        m_Device->waitForIdle();
+        m_Device->runGarbageCollection();
+    }
+};
+
+static void PrintUsage()
+{
+    log::info("Usage: scene_cook [scene.json|model.gltf] [-o output.pack] [-no-meshlets] [-force] [-textures] [-texture-threads N] [-benchmark runs]");
+}
+
+int main(int __argc, const char** __argv)
+{
+    nvrhi::GraphicsAPI api = app::GetGraphicsAPIFromCommandLine(__argc, __argv);
+
+    CookOptions options;
+    for (int i = 1; i < __argc; i++)
+    {
+        if (strcmp(__argv[i], "-o") == 0 && i + 1 < __argc)
+        {
+            options.packFileName = __argv[++i];
+        }
+        else if (strcmp(__argv[i], "-no-meshlets") == 0)
+        {
+            options.buildMeshlets = false;
+        }
+        else if (strcmp(__argv[i], "-force") == 0)
+        {
+            options.force = true;
+        }
+        else if (strcmp(__argv[i], "-textures") == 0)
+        {
+            options.compressTextures = true;
+        }
+        else if (strcmp(__argv[i], "-texture-threads") == 0 && i + 1 < __argc)
+        {
+            options.textureThreads = uint32_t(std::max(1, atoi(__argv[++i])));
+        }
+        else if (strcmp(__argv[i], "-benchmark") == 0)
+        {
+            options.benchmarkRuns = (i + 1 < __argc && __argv[i + 1][0] != '-') ? std::max(1, atoi(__argv[++i])) : 5;
+        }
+        else if (strcmp(__argv[i], "-help") == 0)
+        {
+            PrintUsage();
+            return 0;
+        }
+        else if (__argv[i][0] != '-')
+        {
+            options.sceneFileName = __argv[i];
+        }
+    }
+
+    if (options.sceneFileName.empty())
+        options.sceneFileName = app::GetDirectoryWithExecutable().parent_path() / "media/sponza-plus.scene.json";
+    if (options.packFileName.empty())
+        options.packFileName = GetScenePackFileName(options.sceneFileName);
+
+    app::DeviceManager* deviceManager = app::DeviceManager::Create(api);
+
+    app::DeviceCreationParameters deviceParams;
+    if (!deviceManager->CreateHeadlessDevice(deviceParams))
+    {
+        log::fatal("Cannot initialize a graphics device with the requested parameters");
+        return 1;
+    }
+
+    int exitCode = 0;
+    {
+        SceneCook cook(deviceManager->GetDevice());
+        if (!cook.Cook(options))
+            exitCode = 1;
+        else if (options.compressTextures && !cook.CompressTextures(options))
+            exitCode = 1;
+        else if (options.benchmarkRuns > 0 && !cook.Benchmark(options))
+            exitCode = 1;
+    }
+
+    deviceManager->Shutdown();
+
+    delete deviceManager;
+
+    return exitCode;
+}
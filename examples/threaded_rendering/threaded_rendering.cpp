@@ -36,6 +36,8 @@
 #include <donut/core/math/math.h>
 #include <taskflow/taskflow.hpp>
 
+#include "ScenePack.h"
+
 using namespace donut;
 
 static const char* g_WindowTitle = "Donut Example: Threaded Rendering";
@@ -138,6 +140,19 @@ public:
 
     bool LoadScene(std::shared_ptr<vfs::IFileSystem> fs, const std::filesystem::path& sceneFileName) override 
     {
+        // Unpack the scene from the pack written by scene_cook when it is up to date, instead of parsing the glTF files
+        ScenePack pack;
+        if (OpenUpToDateScenePack(sceneFileName, pack))
+        {
+            auto scene = std::make_unique<ScenePackScene>(GetDevice(), *m_ShaderFactory, fs, m_TextureCache, nullptr, nullptr);
+            if (scene->LoadPack(pack, sceneFileName.parent_path()))
+            {
+                log::info("Loaded the scene from %s", GetScenePackFileName(sceneFileName).generic_string().c_str());
+                m_Scene = std::move(scene);
+                return true;
+            }
+        }
+
         engine::Scene* scene = new engine::Scene(GetDevice(), *m_ShaderFactory, fs, m_TextureCache, nullptr, nullptr);
 
         if (scene->LoadWithExecutor(sceneFileName, m_Executor.get()))
@@ -20,12 +20,17 @@
 * DEALINGS IN THE SOFTWARE.
 */
 
+#include <algorithm>
+#include <array>
 #include <string>
 #include <vector>
 #include <memory>
 #include <chrono>
+#include <deque>
+#include <fstream>
 
 #include <donut/core/vfs/VFS.h>
+#include <donut/core/json.h>
 #include <donut/core/log.h>
 #include <donut/core/string_utils.h>
 #include <donut/engine/CommonRenderPasses.h>
@@ -58,6 +63,12 @@
 #include <nvrhi/utils.h>
 #include <nvrhi/common/misc.h>
 
+#include "AnimationSampler.h"
+#include "AsyncFrameCapture.h"
+#include "FrameGraph.h"
+#include "RenderTargetPool.h"
+#include "TransformHierarchy.h"
+
 #ifdef DONUT_WITH_TASKFLOW
 #include <taskflow/taskflow.hpp>
 #endif
@@ -71,6 +82,236 @@ using namespace donut::render;
 
 static bool g_PrintSceneGraph = false;
 static bool g_PrintFormats = false;
+static bool g_Headless = false;
+static int g_BenchmarkFrames = 300;
+static std::string g_CameraPathFileName;
+static std::string g_BenchmarkOutputFileName = "feature_demo_benchmark.csv";
+static bool g_FrameGraphReport = false;
+static bool g_SceneGraphBenchmark = false;
+static bool g_AnimationBenchmark = false;
+
+// CPU time spent recording each stage of RenderScene, in milliseconds
+struct FrameStageTimings
+{
+    double SceneGraphRefresh = 0.0;
+    double Shadows = 0.0;
+    double GBufferFill = 0.0;
+    double DeferredLighting = 0.0;
+    double TemporalAA = 0.0;
+    double Bloom = 0.0;
+    double ToneMapping = 0.0;
+    double RenderTargetSetup = 0.0; // recreating the render targets and the passes that use them
+    double Total = 0.0;
+};
+
+// Milliseconds from the start of a scene load until each stage was reached
+struct SceneLoadingTimings
+{
+    double SceneLoaded = 0.0;       // scene graph and geometry created by the loader
+    double FirstFrame = 0.0;        // first frame that shows the scene
+    double TexturesFinalized = 0.0; // last texture uploaded
+    uint32_t StreamingFrames = 0;   // frames shown while textures were still arriving
+};
+
+class StageTimer
+{
+public:
+    StageTimer() : m_Start(std::chrono::high_resolution_clock::now()) { }
+
+    // Returns the time since construction or the previous call, in milliseconds
+    double Lap()
+    {
+        auto now = std::chrono::high_resolution_clock::now();
+        double elapsed = std::chrono::duration<double, std::milli>(now - m_Start).count();
+        m_Start = now;
+        return elapsed;
+    }
+
+private:
+    std::chrono::high_resolution_clock::time_point m_Start;
+};
+
+// A deterministic camera path, sampled by frame index rather than by wall clock time
+class CameraPath
+{
+public:
+    struct Keyframe
+    {
+        float time = 0.f;
+        float3 position = 0.f;
+        float3 target = float3(1.f, 0.f, 0.f);
+        float3 up = float3(0.f, 1.f, 0.f);
+    };
+
+    // Expected format:
+    // { "keyframes": [ { "time": 0.0, "position": [x, y, z], "target": [x, y, z], "up": [x, y, z] }, ... ] }
+    bool Load(IFileSystem& fs, const std::filesystem::path& fileName)
+    {
+        Json::Value root;
+        if (!json::LoadFromFile(fs, fileName, root))
+            return false;
+
+        m_Keyframes.clear();
+        for (const auto& node : root["keyframes"])
+        {
+            Keyframe keyframe;
+            keyframe.time = json::Read<float>(node["time"], 0.f);
+            keyframe.position = json::Read<float3>(node["position"], keyframe.position);
+            keyframe.target = json::Read<float3>(node["target"], keyframe.target);
+            keyframe.up = json::Read<float3>(node["up"], keyframe.up);
+            m_Keyframes.push_back(keyframe);
+        }
+
+        if (m_Keyframes.empty())
+        {
+            log::error("Camera path '%s' contains no keyframes", fileName.generic_string().c_str());
+            return false;
+        }
+
+        std::stable_sort(m_Keyframes.begin(), m_Keyframes.end(),
+            [](const Keyframe& a, const Keyframe& b) { return a.time < b.time; });
+
+        return true;
+    }
+
+    [[nodiscard]] Keyframe Evaluate(float time) const
+    {
+        if (time <= m_Keyframes.front().time)
+            return m_Keyframes.front();
+        if (time >= m_Keyframes.back().time)
+            return m_Keyframes.back();
+
+        auto next = std::upper_bound(m_Keyframes.begin(), m_Keyframes.end(), time,
+            [](float t, const Keyframe& keyframe) { return t < keyframe.time; });
+        auto prev = next - 1;
+
+        float t = (time - prev->time) / std::max(next->time - prev->time, 1e-6f);
+
+        Keyframe result;
+        result.time = time;
+        result.position = lerp(prev->position, next->position, t);
+        result.target = lerp(prev->target, next->target, t);
+        result.up = normalize(lerp(prev->up, next->up, t));
+        return result;
+    }
+
+    [[nodiscard]] bool IsEmpty() const { return m_Keyframes.empty(); }
+
+private:
+    std::vector<Keyframe> m_Keyframes;
+};
+
+// Render targets that the frame graph places in the shared heap, in the order they are added to the graph
+enum FrameResource : uint32_t
+{
+    FrameResource_HdrColor,
+    FrameResource_MaterialIDs,
+    FrameResource_ResolvedColor,
+    FrameResource_TemporalFeedback1,
+    FrameResource_TemporalFeedback2,
+    FrameResource_LdrColor,
+    FrameResource_AmbientOcclusion,
+    FrameResource_Count
+};
+
+static void AddFrameResources(FrameGraph& graph)
+{
+    graph.AddResource("HdrColor", true);
+    graph.AddResource("MaterialIDs", true);
+    graph.AddResource("ResolvedColor", true);
+    // The TAA history is read in the next frame
+    graph.AddResource("TemporalFeedback1", false);
+    graph.AddResource("TemporalFeedback2", false);
+    graph.AddResource("LdrColor", true);
+    graph.AddResource("AmbientOcclusion", true);
+}
+
+// The settings that change which passes RenderScene records
+struct FramePassConfig
+{
+    bool deferredShading = true;
+    bool ssao = true;
+    bool proceduralSky = true;
+    bool translucency = true;
+    bool temporalAA = true;
+    bool bloom = true;
+    uint32_t sampleCount = 1;
+};
+
+// Frame graph indices of the passes in RenderScene, c_Invalid for passes that are not recorded
+struct FramePasses
+{
+    uint32_t Clear = FrameGraph::c_Invalid;
+    uint32_t ForwardOpaque = FrameGraph::c_Invalid;
+    uint32_t Ssao = FrameGraph::c_Invalid;
+    uint32_t DeferredLighting = FrameGraph::c_Invalid;
+    uint32_t MaterialID = FrameGraph::c_Invalid;
+    uint32_t Sky = FrameGraph::c_Invalid;
+    uint32_t ForwardTransparent = FrameGraph::c_Invalid;
+    uint32_t TemporalResolve = FrameGraph::c_Invalid;
+    uint32_t MsaaResolve = FrameGraph::c_Invalid;
+    uint32_t Bloom = FrameGraph::c_Invalid;
+    uint32_t ToneMapping = FrameGraph::c_Invalid;
+    uint32_t Blit = FrameGraph::c_Invalid;
+};
+
+// Declares the passes of RenderScene in recording order with the render targets they access.
+// The G-buffer, shadow map and swap chain are not managed by the graph.
+static FramePasses DeclareFramePasses(FrameGraph& graph, const FramePassConfig& config)
+{
+    FramePasses passes;
+    graph.ClearPasses();
+
+    passes.Clear = graph.AddPass("Clear", {}, { FrameResource_HdrColor }, true);
+
+    if (config.deferredShading)
+    {
+        std::vector<uint32_t> lightingInputs;
+        if (config.ssao && config.sampleCount == 1)
+        {
+            passes.Ssao = graph.AddPass("Ssao", {}, { FrameResource_AmbientOcclusion });
+            lightingInputs.push_back(FrameResource_AmbientOcclusion);
+        }
+
+        passes.DeferredLighting = graph.AddPass("DeferredLighting", lightingInputs, { FrameResource_HdrColor });
+    }
+    else
+    {
+        passes.ForwardOpaque = graph.AddPass("ForwardOpaque", {}, { FrameResource_HdrColor });
+    }
+
+    // Declared whether or not a pick is pending, so that picking does not change the placement
+    passes.MaterialID = graph.AddPass("MaterialID", {}, { FrameResource_MaterialIDs }, true);
+
+    if (config.proceduralSky)
+        passes.Sky = graph.AddPass("Sky", {}, { FrameResource_HdrColor });
+
+    if (config.translucency)
+        passes.ForwardTransparent = graph.AddPass("ForwardTransparent", { FrameResource_HdrColor }, { FrameResource_HdrColor });
+
+    uint32_t finalHdrColor = FrameResource_HdrColor;
+    if (config.temporalAA)
+    {
+        passes.TemporalResolve = graph.AddPass("TemporalResolve",
+            { FrameResource_HdrColor, FrameResource_TemporalFeedback1, FrameResource_TemporalFeedback2 },
+            { FrameResource_ResolvedColor, FrameResource_TemporalFeedback1, FrameResource_TemporalFeedback2 });
+        finalHdrColor = FrameResource_ResolvedColor;
+    }
+    else if (config.sampleCount > 1)
+    {
+        passes.MsaaResolve = graph.AddPass("MsaaResolve", { FrameResource_HdrColor }, { FrameResource_ResolvedColor });
+        finalHdrColor = FrameResource_ResolvedColor;
+    }
+
+    if (config.bloom)
+        passes.Bloom = graph.AddPass("Bloom", { finalHdrColor }, { finalHdrColor });
+
+    passes.ToneMapping = graph.AddPass("ToneMapping", { finalHdrColor }, { FrameResource_LdrColor });
+    passes.Blit = graph.AddPass("Blit", { FrameResource_LdrColor }, {});
+
+    graph.ComputeLifetimes();
+    return passes;
+}
 
 class RenderTargets : public GBufferRenderTargets
 {
@@ -90,6 +331,10 @@ public:
     std::shared_ptr<FramebufferFactory> LdrFramebuffer;
     std::shared_ptr<FramebufferFactory> ResolvedFramebuffer;
     std::shared_ptr<FramebufferFactory> MaterialIDFramebuffer;
+
+    explicit RenderTargets(RenderTargetPool* pool)
+        : m_Pool(pool)
+    { }
     
     void Init(
         nvrhi::IDevice* device,
@@ -99,7 +344,54 @@ public:
         bool useReverseProjection) override
     {
         GBufferRenderTargets::Init(device, size, sampleCount, enableMotionVectors, useReverseProjection);
+
+        const auto descs = GetTextureDescs(size, sampleCount, device->queryFeatureSupport(nvrhi::Feature::VirtualResources));
+
+        // Virtual targets own no memory until PlaceInHeap, so only committed targets come from the pool
+        auto createTexture = [this, device](const nvrhi::TextureDesc& desc) {
+            return desc.isVirtual ? device->createTexture(desc) : m_Pool->AcquireTexture(desc);
+        };
+
+        HdrColor = createTexture(descs[FrameResource_HdrColor]);
+        MaterialIDs = createTexture(descs[FrameResource_MaterialIDs]);
+        ResolvedColor = createTexture(descs[FrameResource_ResolvedColor]);
+        TemporalFeedback1 = createTexture(descs[FrameResource_TemporalFeedback1]);
+        TemporalFeedback2 = createTexture(descs[FrameResource_TemporalFeedback2]);
+        LdrColor = createTexture(descs[FrameResource_LdrColor]);
+        AmbientOcclusion = createTexture(descs[FrameResource_AmbientOcclusion]);
+
+        m_FrameResources = {
+            HdrColor,
+            MaterialIDs,
+            ResolvedColor,
+            TemporalFeedback1,
+            TemporalFeedback2,
+            LdrColor,
+            AmbientOcclusion
+        };
         
+        ForwardFramebuffer = std::make_shared<FramebufferFactory>(device);
+        ForwardFramebuffer->RenderTargets = { HdrColor };
+        ForwardFramebuffer->DepthTarget = Depth;
+
+        HdrFramebuffer = std::make_shared<FramebufferFactory>(device);
+        HdrFramebuffer->RenderTargets = { HdrColor };
+
+        LdrFramebuffer = std::make_shared<FramebufferFactory>(device);
+        LdrFramebuffer->RenderTargets = { LdrColor };
+
+        ResolvedFramebuffer = std::make_shared<FramebufferFactory>(device);
+        ResolvedFramebuffer->RenderTargets = { ResolvedColor };
+
+        MaterialIDFramebuffer = std::make_shared<FramebufferFactory>(device);
+        MaterialIDFramebuffer->RenderTargets = { MaterialIDs };
+        MaterialIDFramebuffer->DepthTarget = Depth;
+    }
+
+    static std::array<nvrhi::TextureDesc, FrameResource_Count> GetTextureDescs(dm::uint2 size, dm::uint sampleCount, bool isVirtual)
+    {
+        std::array<nvrhi::TextureDesc, FrameResource_Count> descs;
+
         nvrhi::TextureDesc desc;
         desc.width = size.x;
         desc.height = size.y;
@@ -109,7 +401,7 @@ public:
         desc.sampleCount = sampleCount;
         desc.dimension = sampleCount > 1 ? nvrhi::TextureDimension::Texture2DMS : nvrhi::TextureDimension::Texture2D;
         desc.keepInitialState = true;
-        desc.isVirtual = device->queryFeatureSupport(nvrhi::Feature::VirtualResources);
+        desc.isVirtual = isVirtual;
 
         desc.clearValue = nvrhi::Color(0.f);
         desc.isTypeless = false;
@@ -117,12 +409,12 @@ public:
         desc.format = nvrhi::Format::RGBA16_FLOAT;
         desc.initialState = nvrhi::ResourceStates::RenderTarget;
         desc.debugName = "HdrColor";
-        HdrColor = device->createTexture(desc);
+        descs[FrameResource_HdrColor] = desc;
 
         desc.format = nvrhi::Format::RG16_UINT;
         desc.isUAV = false;
         desc.debugName = "MaterialIDs";
-        MaterialIDs = device->createTexture(desc);
+        descs[FrameResource_MaterialIDs] = desc;
 
         // The render targets below this point are non-MSAA
         desc.sampleCount = 1;
@@ -131,79 +423,78 @@ public:
         desc.format = nvrhi::Format::RGBA16_FLOAT;
         desc.isUAV = true;
         desc.debugName = "ResolvedColor";
-        ResolvedColor = device->createTexture(desc);
+        descs[FrameResource_ResolvedColor] = desc;
 
         desc.format = nvrhi::Format::RGBA16_SNORM;
         desc.debugName = "TemporalFeedback1";
-        TemporalFeedback1 = device->createTexture(desc);
+        descs[FrameResource_TemporalFeedback1] = desc;
         desc.debugName = "TemporalFeedback2";
-        TemporalFeedback2 = device->createTexture(desc);
+        descs[FrameResource_TemporalFeedback2] = desc;
 
         desc.format = nvrhi::Format::SRGBA8_UNORM;
         desc.isUAV = false;
         desc.debugName = "LdrColor";
-        LdrColor = device->createTexture(desc);
+        descs[FrameResource_LdrColor] = desc;
 
         desc.format = nvrhi::Format::R8_UNORM;
         desc.isUAV = true;
         desc.debugName = "AmbientOcclusion";
-        AmbientOcclusion = device->createTexture(desc);
-
-        if (desc.isVirtual)
-        {
-            uint64_t heapSize = 0;
-            nvrhi::ITexture* const textures[] = {
-                HdrColor,
-                MaterialIDs,
-                ResolvedColor,
-                TemporalFeedback1,
-                TemporalFeedback2,
-                LdrColor,
-                AmbientOcclusion
-            };
-
-            for (auto texture : textures)
-            {
-                nvrhi::MemoryRequirements memReq = device->getTextureMemoryRequirements(texture);
-                heapSize = nvrhi::align(heapSize, memReq.alignment);
-                heapSize += memReq.size;
-            }
+        descs[FrameResource_AmbientOcclusion] = desc;
 
-            nvrhi::HeapDesc heapDesc;
-            heapDesc.type = nvrhi::HeapType::DeviceLocal;
-            heapDesc.capacity = heapSize;
-            heapDesc.debugName = "RenderTargetHeap";
+        return descs;
+    }
 
-            Heap = device->createHeap(heapDesc);
+    // Binds the virtual render targets to one heap at the offsets placed by the frame graph,
+    // so that targets whose lifetimes in the frame do not overlap share memory. The heap comes from
+    // the pool, so a resize within the same size bucket reuses the previous allocation.
+    void PlaceInHeap(nvrhi::IDevice* device, FrameGraph& graph)
+    {
+        for (uint32_t resource = 0; resource < FrameResource_Count; resource++)
+        {
+            nvrhi::MemoryRequirements memReq = device->getTextureMemoryRequirements(m_FrameResources[resource]);
+            graph.SetResourceSize(resource, memReq.size, memReq.alignment);
+        }
 
-            uint64_t offset = 0;
-            for (auto texture : textures)
-            {
-                nvrhi::MemoryRequirements memReq = device->getTextureMemoryRequirements(texture);
-                offset = nvrhi::align(offset, memReq.alignment);
+        Heap = m_Pool->AcquireHeap(graph.PlaceResources());
 
-                device->bindTextureMemory(texture, Heap, offset);
+        for (uint32_t resource = 0; resource < FrameResource_Count; resource++)
+            device->bindTextureMemory(m_FrameResources[resource], Heap, graph.GetResource(resource).offset);
 
-                offset += memReq.size;
-            }
-        }
-        
-        ForwardFramebuffer = std::make_shared<FramebufferFactory>(device);
-        ForwardFramebuffer->RenderTargets = { HdrColor };
-        ForwardFramebuffer->DepthTarget = Depth;
+        m_FrameGraph = &graph;
 
-        HdrFramebuffer = std::make_shared<FramebufferFactory>(device);
-        HdrFramebuffer->RenderTargets = { HdrColor };
+        log::info("Render target heap: %.1f MB, %.1f MB without aliasing",
+            double(graph.GetHeapSize()) / (1024.0 * 1024.0), double(graph.GetUnaliasedSize()) / (1024.0 * 1024.0));
+    }
 
-        LdrFramebuffer = std::make_shared<FramebufferFactory>(device);
-        LdrFramebuffer->RenderTargets = { LdrColor };
+    // Clears the aliased render targets that the pass is the first to access, because their memory
+    // holds the data of another target. NVRHI does not expose aliasing barriers, so the other targets
+    // placed in the same memory are moved to the common state instead: the transitions of those previous
+    // occupants make the clear wait until their reads and writes have finished.
+    void BeginPass(nvrhi::ICommandList* commandList, uint32_t pass) const
+    {
+        if (!m_FrameGraph)
+            return;
 
-        ResolvedFramebuffer = std::make_shared<FramebufferFactory>(device);
-        ResolvedFramebuffer->RenderTargets = { ResolvedColor };
+        for (uint32_t resource = 0; resource < FrameResource_Count; resource++)
+        {
+            if (!m_FrameGraph->NeedsInitialization(resource, pass))
+                continue;
 
-        MaterialIDFramebuffer = std::make_shared<FramebufferFactory>(device);
-        MaterialIDFramebuffer->RenderTargets = { MaterialIDs };
-        MaterialIDFramebuffer->DepthTarget = Depth;
+            for (uint32_t other = 0; other < FrameResource_Count; other++)
+            {
+                if (other != resource && m_FrameGraph->IsUsed(other) && m_FrameGraph->MemoryOverlaps(resource, other))
+                    commandList->setTextureState(m_FrameResources[other], nvrhi::AllSubresources, nvrhi::ResourceStates::Common);
+            }
+
+            nvrhi::ITexture* texture = m_FrameResources[resource];
+            commandList->setTextureState(texture, nvrhi::AllSubresources, nvrhi::ResourceStates::Common);
+            commandList->commitBarriers();
+
+            if (nvrhi::getFormatInfo(texture->getDesc().format).kind == nvrhi::FormatKind::Integer)
+                commandList->clearTextureUInt(texture, nvrhi::AllSubresources, 0);
+            else
+                commandList->clearTextureFloat(texture, nvrhi::AllSubresources, texture->getDesc().clearValue);
+        }
     }
 
     [[nodiscard]] bool IsUpdateRequired(uint2 size, uint sampleCount) const
@@ -220,6 +511,11 @@ public:
 
         commandList->clearTextureFloat(HdrColor, nvrhi::AllSubresources, nvrhi::Color(0.f));
     }
+
+private:
+    RenderTargetPool* m_Pool;
+    std::array<nvrhi::ITexture*, FrameResource_Count> m_FrameResources = {};
+    const FrameGraph* m_FrameGraph = nullptr; // set when the render targets are placed in the heap
 };
 
 enum class AntiAliasingMode
@@ -231,6 +527,42 @@ enum class AntiAliasingMode
     MSAA_8X
 };
 
+static uint32_t GetSampleCount(AntiAliasingMode mode)
+{
+    switch (mode)
+    {
+    case AntiAliasingMode::MSAA_2X: return 2;
+    case AntiAliasingMode::MSAA_4X: return 4;
+    case AntiAliasingMode::MSAA_8X: return 8;
+    default: return 1;
+    }
+}
+
+// A light probe bake split into steps that are recorded over several frames
+struct LightProbeBakeJob
+{
+    enum class Step
+    {
+        Shadows,
+        Face,       // one cube face per step
+        Mips,
+        Diffuse,
+        Specular,   // one specular mip per step
+        Finish
+    };
+
+    std::shared_ptr<LightProbe> probe;
+    float3 position = 0.f;
+    Step step = Step::Shadows;
+    uint32_t substep = 0;
+    uint32_t completedSteps = 0;
+    uint32_t totalSteps = 0;
+    uint32_t frames = 0;
+    double recordingMs = 0.0;
+
+    [[nodiscard]] float GetProgress() const { return totalSteps ? float(completedSteps) / float(totalSteps) : 0.f; }
+};
+
 struct UIData
 {
     bool                                ShowUI = true;
@@ -257,6 +589,8 @@ struct UIData
     bool                                EnableLightProbe = true;
     float                               LightProbeDiffuseScale = 1.f;
     float                               LightProbeSpecularScale = 1.f;
+    float                               LightProbeBakeBudgetMs = 2.f;
+    bool                                ContinuousLightProbeBake = false;
     float                               CsmExponent = 4.f;
     bool                                DisplayShadowMap = false;
     bool                                UseThirdPersonCamera = false;
@@ -284,6 +618,9 @@ private:
     std::shared_ptr<InstancedOpaqueDrawStrategy> m_OpaqueDrawStrategy;
     std::shared_ptr<TransparentDrawStrategy> m_TransparentDrawStrategy;
     std::unique_ptr<RenderTargets>      m_RenderTargets;
+    std::unique_ptr<RenderTargetPool>   m_RenderTargetPool;
+    FrameGraph                          m_FrameGraph;
+    FramePasses                         m_FramePasses;
     std::shared_ptr<ForwardShadingPass> m_ForwardPass;
     std::unique_ptr<GBufferFillPass>    m_GBufferPass;
     std::unique_ptr<DeferredLightingPass> m_DeferredLightingPass;
@@ -295,6 +632,7 @@ private:
     std::shared_ptr<LightProbeProcessingPass> m_LightProbePass;
     std::unique_ptr<MaterialIDPass>     m_MaterialIDPass;
     std::unique_ptr<PixelReadbackPass>  m_PixelReadbackPass;
+    std::unique_ptr<AsyncFrameCapture>  m_FrameCapture;
 
     std::shared_ptr<IView>              m_View;
     std::shared_ptr<IView>              m_ViewPrevious;
@@ -315,7 +653,29 @@ private:
     nvrhi::TextureHandle                m_LightProbeDiffuseTexture;
     nvrhi::TextureHandle                m_LightProbeSpecularTexture;
 
+    // Probe baking state, kept between bakes so that only the first one creates targets and passes
+    std::unique_ptr<LightProbeBakeJob>  m_LightProbeBake;
+    std::deque<std::unique_ptr<LightProbeBakeJob>> m_LightProbeBakeQueue;
+    nvrhi::TextureHandle                m_ProbeColorTexture;
+    nvrhi::TextureHandle                m_ProbeDepthTexture;
+    std::shared_ptr<FramebufferFactory> m_ProbeFramebuffer;
+    std::shared_ptr<CascadedShadowMap>  m_ProbeShadowMap;
+    std::shared_ptr<FramebufferFactory> m_ProbeShadowFramebuffer;
+    std::unique_ptr<ForwardShadingPass> m_ProbeForwardPass;
+    std::unique_ptr<SkyPass>            m_ProbeSkyPass;
+
     float                               m_WallclockTime = 0.f;
+    std::unique_ptr<AnimationSampler>   m_AnimationSampler;
+    std::vector<float>                  m_AnimationTimes;
+
+    FrameStageTimings                   m_StageTimings;
+    SceneLoadingTimings                 m_LoadingTimings;
+    std::chrono::high_resolution_clock::time_point m_LoadingStart;
+    bool                                m_FirstSceneFrame = false;
+    bool                                m_TexturesStreaming = false;
+#ifdef DONUT_WITH_TASKFLOW
+    std::unique_ptr<tf::Executor>       m_LoadingExecutor;
+#endif
     
     UIData&                             m_ui;
 
@@ -326,6 +686,8 @@ public:
         , m_ui(ui)
         , m_BindingCache(deviceManager->GetDevice())
     { 
+        AddFrameResources(m_FrameGraph);
+
         std::shared_ptr<NativeFileSystem> nativeFS = std::make_shared<NativeFileSystem>();
 
         std::filesystem::path mediaPath = app::GetDirectoryWithExecutable().parent_path() / "media";
@@ -381,10 +743,14 @@ public:
 
         m_CommandList = GetDevice()->createCommandList();
 
+        m_FrameCapture = std::make_unique<AsyncFrameCapture>(GetDevice());
+        m_RenderTargetPool = std::make_unique<RenderTargetPool>(GetDevice());
+
         m_FirstPersonCamera.SetMoveSpeed(3.0f);
         m_ThirdPersonCamera.SetMoveSpeed(3.0f);
         
-        SetAsynchronousLoadingEnabled(true);
+        // The headless benchmark has no splash screen to show while loading
+        SetAsynchronousLoadingEnabled(!g_Headless);
 
         if (sceneName.empty())
             SetCurrentSceneName(app::FindPreferredScene(m_SceneFilesAvailable, "Sponza.gltf"));
@@ -424,6 +790,18 @@ public:
 		BeginLoadingScene(m_RootFs, m_CurrentSceneName);
     }
 
+    const FrameStageTimings& GetStageTimings() const
+    {
+        return m_StageTimings;
+    }
+
+    void SetScriptedCamera(const CameraPath::Keyframe& keyframe)
+    {
+        m_ui.ActiveSceneCamera = nullptr;
+        m_ui.UseThirdPersonCamera = false;
+        m_FirstPersonCamera.LookAt(keyframe.position, keyframe.target, keyframe.up);
+    }
+
     void CopyActiveCameraToFirstPerson()
     {
         if (m_ui.ActiveSceneCamera)
@@ -515,17 +893,25 @@ public:
         if(m_ToneMappingPass)
             m_ToneMappingPass->AdvanceFrame(fElapsedTimeSeconds);
         
-        if (IsSceneLoaded() && m_ui.EnableAnimations)
+        if (IsSceneLoaded() && m_ui.EnableAnimations && m_AnimationSampler)
         {
             m_WallclockTime += fElapsedTimeSeconds;
 
-            for (const auto& anim : m_Scene->GetSceneGraph()->GetAnimations())
+            const auto& animations = m_Scene->GetSceneGraph()->GetAnimations();
+            m_AnimationTimes.resize(animations.size());
+            for (size_t i = 0; i < animations.size(); i++)
             {
-                float duration = anim->GetDuration();
+                float duration = animations[i]->GetDuration();
                 float integral;
-                float animationTime = std::modf(m_WallclockTime / duration, &integral) * duration;
-                (void)anim->Apply(animationTime);
+                m_AnimationTimes[i] = std::modf(m_WallclockTime / duration, &integral) * duration;
             }
+
+#ifdef DONUT_WITH_TASKFLOW
+            m_AnimationSampler->Evaluate(m_AnimationTimes.data(), m_LoadingExecutor.get());
+#else
+            m_AnimationSampler->Evaluate(m_AnimationTimes.data());
+#endif
+            m_AnimationSampler->Apply();
         }
     }
 
@@ -537,6 +923,7 @@ public:
         if (m_GBufferPass) m_GBufferPass->ResetBindingCache();
         if (m_LightProbePass) m_LightProbePass->ResetCaches();
         if (m_ShadowDepthPass) m_ShadowDepthPass->ResetBindingCache();
+        if (m_ProbeForwardPass) m_ProbeForwardPass->ResetBindingCache();
         m_BindingCache.Clear();
         m_SunLight.reset();
         m_ui.SelectedMaterial = nullptr;
@@ -546,6 +933,10 @@ public:
         {
             probe->enabled = false;
         }
+
+        m_LightProbeBake = nullptr;
+        m_LightProbeBakeQueue.clear();
+        m_AnimationSampler.reset();
     }
 
     virtual bool LoadScene(std::shared_ptr<IFileSystem> fs, const std::filesystem::path& fileName) override
@@ -555,8 +946,19 @@ public:
         Scene* scene = new Scene(GetDevice(), *m_ShaderFactory, fs, m_TextureCache, nullptr, nullptr);
 
         auto startTime = high_resolution_clock::now();
+        m_LoadingStart = startTime;
+        m_LoadingTimings = SceneLoadingTimings();
+
+#ifdef DONUT_WITH_TASKFLOW
+        // Textures are decoded by the executor and finalized by Render as they arrive
+        if (!m_LoadingExecutor)
+            m_LoadingExecutor = std::make_unique<tf::Executor>();
+        bool loaded = scene->LoadWithExecutor(fileName, m_LoadingExecutor.get());
+#else
+        bool loaded = scene->Load(fileName);
+#endif
 
-        if (scene->Load(fileName))
+        if (loaded)
         {
             m_Scene = std::unique_ptr<Scene>(scene);
 
@@ -573,12 +975,30 @@ public:
     virtual void SceneLoaded() override
     {
         Super::SceneLoaded();
+
+        m_LoadingTimings.SceneLoaded = GetLoadingTime();
+        m_FirstSceneFrame = true;
+        m_TexturesStreaming = true;
         
         m_Scene->FinishedLoading(GetFrameIndex());
 
         m_WallclockTime = 0.f;
         m_PreviousViewsValid = false;
 
+        // Animations are flattened once per scene; the sampler keeps pointers to their channels
+        m_AnimationSampler = std::make_unique<AnimationSampler>();
+        for (const auto& animation : m_Scene->GetSceneGraph()->GetAnimations())
+            m_AnimationSampler->AddAnimation(animation);
+
+        if (g_AnimationBenchmark)
+        {
+#ifdef DONUT_WITH_TASKFLOW
+            RunAnimationSamplerBenchmark(m_Scene->GetSceneGraph()->GetAnimations(), m_CurrentSceneName.c_str(), m_LoadingExecutor.get());
+#else
+            RunAnimationSamplerBenchmark(m_Scene->GetSceneGraph()->GetAnimations(), m_CurrentSceneName.c_str(), nullptr);
+#endif
+        }
+
         for (auto light : m_Scene->GetSceneGraph()->GetLights())
         {
             if (light->GetLightType() == LightType_Directional)
@@ -752,10 +1172,12 @@ public:
         return topologyChanged;
     }
 
-    void CreateRenderPasses(bool& exposureResetRequired)
+    static constexpr uint32_t c_MotionVectorStencilMask = 0x01;
+
+    // Passes that do not reference the render targets or the view; they create their pipelines
+    // per framebuffer format on demand and survive resizes and anti-aliasing mode changes
+    void CreateSizeIndependentPasses()
     {
-        uint32_t motionVectorStencilMask = 0x01;
-        
         ForwardShadingPass::CreateParameters ForwardParams;
         ForwardParams.trackLiveness = false;
         m_ForwardPass = std::make_unique<ForwardShadingPass>(GetDevice(), m_CommonPasses);
@@ -763,7 +1185,7 @@ public:
         
         GBufferFillPass::CreateParameters GBufferParams;
         GBufferParams.enableMotionVectors = true;
-        GBufferParams.stencilWriteMask = motionVectorStencilMask;
+        GBufferParams.stencilWriteMask = c_MotionVectorStencilMask;
         m_GBufferPass = std::make_unique<GBufferFillPass>(GetDevice(), m_CommonPasses);
         m_GBufferPass->Init(*m_ShaderFactory, GBufferParams);
 
@@ -771,11 +1193,17 @@ public:
         m_MaterialIDPass = std::make_unique<MaterialIDPass>(GetDevice(), m_CommonPasses);
         m_MaterialIDPass->Init(*m_ShaderFactory, GBufferParams);
 
-        m_PixelReadbackPass = std::make_unique<PixelReadbackPass>(GetDevice(), m_ShaderFactory, m_RenderTargets->MaterialIDs, nvrhi::Format::RGBA32_UINT);
-
         m_DeferredLightingPass = std::make_unique<DeferredLightingPass>(GetDevice(), m_CommonPasses);
         m_DeferredLightingPass->Init(m_ShaderFactory);
 
+        m_LightProbePass = std::make_shared<LightProbeProcessingPass>(GetDevice(), m_ShaderFactory, m_CommonPasses);
+    }
+
+    // Passes that bind the render targets or the view
+    void CreateRenderTargetPasses(bool& exposureResetRequired)
+    {
+        m_PixelReadbackPass = std::make_unique<PixelReadbackPass>(GetDevice(), m_ShaderFactory, m_RenderTargets->MaterialIDs, nvrhi::Format::RGBA32_UINT);
+
         m_SkyPass = std::make_unique<SkyPass>(GetDevice(), m_ShaderFactory, m_CommonPasses, m_RenderTargets->ForwardFramebuffer, *m_View);
         
         {
@@ -786,7 +1214,7 @@ public:
             taaParams.resolvedColor = m_RenderTargets->ResolvedColor;
             taaParams.feedback1 = m_RenderTargets->TemporalFeedback1;
             taaParams.feedback2 = m_RenderTargets->TemporalFeedback2;
-            taaParams.motionVectorStencilMask = motionVectorStencilMask;
+            taaParams.motionVectorStencilMask = c_MotionVectorStencilMask;
             taaParams.useCatmullRomFilter = true;
 
             m_TemporalAntiAliasingPass = std::make_unique<TemporalAntiAliasingPass>(GetDevice(), m_ShaderFactory, m_CommonPasses, *m_View, taaParams);
@@ -797,8 +1225,6 @@ public:
             m_SsaoPass = std::make_unique<SsaoPass>(GetDevice(), m_ShaderFactory, m_CommonPasses, m_RenderTargets->Depth, m_RenderTargets->GBufferNormals, m_RenderTargets->AmbientOcclusion);
         }
 
-        m_LightProbePass = std::make_shared<LightProbeProcessingPass>(GetDevice(), m_ShaderFactory, m_CommonPasses);
-
         nvrhi::BufferHandle exposureBuffer = nullptr;
         if (m_ToneMappingPass)
             exposureBuffer = m_ToneMappingPass->GetExposureBuffer();
@@ -814,6 +1240,76 @@ public:
         m_PreviousViewsValid = false;
     }
 
+    [[nodiscard]] double GetLoadingTime() const
+    {
+        return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - m_LoadingStart).count();
+    }
+
+    const SceneLoadingTimings& GetLoadingTimings() const
+    {
+        return m_LoadingTimings;
+    }
+
+    // Shows the scene as soon as the loader has finished instead of keeping the splash screen up until every
+    // texture is uploaded. Textures that arrive later are finalized within a budget per frame and replace
+    // the fallback textures in the material bindings.
+    virtual void Render(nvrhi::IFramebuffer* framebuffer) override
+    {
+        const float splashTextureBudgetMs = 20.f;
+        const float streamingTextureBudgetMs = 4.f;
+
+        bool texturesProcessed = m_TextureCache->ProcessRenderingThreadCommands(*m_CommonPasses,
+            IsSceneLoaded() ? streamingTextureBudgetMs : splashTextureBudgetMs);
+
+        if (!IsSceneLoaded())
+        {
+            RenderSplashScreen(framebuffer);
+            return;
+        }
+
+        if (m_SceneLoadingThread)
+        {
+            m_SceneLoadingThread->join();
+            m_SceneLoadingThread = nullptr;
+
+            SceneLoaded();
+        }
+
+        if (m_TexturesStreaming && !m_FirstSceneFrame)
+        {
+            if (texturesProcessed)
+            {
+                // Material constants and binding sets were created with the fallback textures
+                for (const auto& material : m_Scene->GetSceneGraph()->GetMaterials())
+                    material->dirty = true;
+
+                if (m_ForwardPass) m_ForwardPass->ResetBindingCache();
+                if (m_GBufferPass) m_GBufferPass->ResetBindingCache();
+                if (m_MaterialIDPass) m_MaterialIDPass->ResetBindingCache();
+                if (m_ProbeForwardPass) m_ProbeForwardPass->ResetBindingCache();
+
+                m_LoadingTimings.StreamingFrames++;
+            }
+            else if (m_TextureCache->GetNumberOfFinalizedTextures() >= m_TextureCache->GetNumberOfRequestedTextures())
+            {
+                // Loaded textures can still be waiting in the finalize queue, only finalized ones are in the bindings
+                m_TexturesStreaming = false;
+                m_LoadingTimings.TexturesFinalized = std::max(GetLoadingTime(), m_LoadingTimings.FirstFrame);
+
+                log::info("Scene loading stages: scene graph and geometry %.0f ms, first frame %.0f ms, all textures %.0f ms (%u frames while streaming)",
+                    m_LoadingTimings.SceneLoaded, m_LoadingTimings.FirstFrame, m_LoadingTimings.TexturesFinalized, m_LoadingTimings.StreamingFrames);
+            }
+        }
+
+        RenderScene(framebuffer);
+
+        if (m_FirstSceneFrame)
+        {
+            m_LoadingTimings.FirstFrame = GetLoadingTime();
+            m_FirstSceneFrame = false;
+        }
+    }
+
     virtual void RenderSplashScreen(nvrhi::IFramebuffer* framebuffer) override
     {
         nvrhi::ITexture* framebufferTexture = framebuffer->getDesc().colorAttachments[0].texture;
@@ -826,12 +1322,20 @@ public:
 
     virtual void RenderScene(nvrhi::IFramebuffer* framebuffer) override
     {
-        int windowWidth, windowHeight;
-        GetDeviceManager()->GetWindowDimensions(windowWidth, windowHeight);
+        StageTimer frameTimer;
+        StageTimer stageTimer;
+        m_StageTimings = FrameStageTimings();
+
+        // Use the framebuffer size rather than the window size so that offscreen targets work too
+        const auto& fbinfo = framebuffer->getFramebufferInfo();
+        int windowWidth = int(fbinfo.width);
+        int windowHeight = int(fbinfo.height);
         nvrhi::Viewport windowViewport = nvrhi::Viewport(float(windowWidth), float(windowHeight));
         nvrhi::Viewport renderViewport = windowViewport;
 
+        // Donut's serial refresh; TransformHierarchy is only exercised by -scenegraph-benchmark
         m_Scene->RefreshSceneGraph(GetFrameIndex());
+        m_StageTimings.SceneGraphRefresh = stageTimer.Lap();
 
         bool exposureResetRequired = false;
         
@@ -839,25 +1343,38 @@ public:
             uint width = windowWidth;
             uint height = windowHeight;
 
-            uint sampleCount = 1;
-            switch (m_ui.AntiAliasingMode)
-            {
-            case AntiAliasingMode::MSAA_2X: sampleCount = 2; break;
-            case AntiAliasingMode::MSAA_4X: sampleCount = 4; break;
-            case AntiAliasingMode::MSAA_8X: sampleCount = 8; break;
-            default:;
-            }
+            uint sampleCount = GetSampleCount(m_ui.AntiAliasingMode);
+
+            FramePassConfig passConfig;
+            passConfig.deferredShading = m_ui.UseDeferredShading;
+            passConfig.ssao = m_ui.EnableSsao;
+            passConfig.proceduralSky = m_ui.EnableProceduralSky;
+            passConfig.translucency = m_ui.EnableTranslucency;
+            passConfig.temporalAA = m_ui.AntiAliasingMode == AntiAliasingMode::TEMPORAL;
+            passConfig.bloom = m_ui.EnableBloom;
+            passConfig.sampleCount = sampleCount;
+            m_FramePasses = DeclareFramePasses(m_FrameGraph, passConfig);
+
+            // Settings that change the lifetimes can make the aliased targets overlap; place them again
+            bool placementValid = !m_FrameGraph.IsPlaced() || m_FrameGraph.ValidatePlacement().empty();
 
             bool needNewPasses = false;
+            bool renderTargetsRecreated = false;
+            StageTimer setupTimer;
 
-            if (!m_RenderTargets || m_RenderTargets->IsUpdateRequired(uint2(width, height), sampleCount))
+            if (!m_RenderTargets || m_RenderTargets->IsUpdateRequired(uint2(width, height), sampleCount) || !placementValid)
             {
+                // Return the previous targets to the pool; the same size and mode get the same textures back
+                m_RenderTargetPool->ReleaseAll();
                 m_RenderTargets = nullptr;
                 m_BindingCache.Clear();
-                m_RenderTargets = std::make_unique<RenderTargets>();
+                m_RenderTargets = std::make_unique<RenderTargets>(m_RenderTargetPool.get());
                 m_RenderTargets->Init(GetDevice(), uint2(width, height), sampleCount, true, true);
+                if (m_RenderTargets->HdrColor->getDesc().isVirtual)
+                    m_RenderTargets->PlaceInHeap(GetDevice(), m_FrameGraph);
                 
                 needNewPasses = true;
+                renderTargetsRecreated = true;
             }
 
             if (SetupView())
@@ -868,12 +1385,32 @@ public:
             if (m_ui.ShaderReoladRequested)
             {
                 m_ShaderFactory->ClearCache();
+                m_ForwardPass = nullptr;
+                m_ProbeForwardPass = nullptr;
+                m_ProbeSkyPass = nullptr;
                 needNewPasses = true;
             }
 
+            if (!m_ForwardPass)
+            {
+                CreateSizeIndependentPasses();
+            }
+
             if(needNewPasses)
             {
-                CreateRenderPasses(exposureResetRequired);
+                CreateRenderTargetPasses(exposureResetRequired);
+            }
+
+            if (renderTargetsRecreated)
+            {
+                m_StageTimings.RenderTargetSetup = setupTimer.Lap();
+
+                const RenderTargetPool::Stats& poolStats = m_RenderTargetPool->GetStats();
+                log::info("Render targets recreated in %.2f ms; pool: %llu textures reused, %llu created, %llu heaps reused, %llu created, %.1f MB",
+                    m_StageTimings.RenderTargetSetup,
+                    (unsigned long long)poolStats.texturesReused, (unsigned long long)poolStats.texturesCreated,
+                    (unsigned long long)poolStats.heapsReused, (unsigned long long)poolStats.heapsCreated,
+                    double(poolStats.pooledBytes) / (1024.0 * 1024.0));
             }
 
             m_ui.ShaderReoladRequested = false;
@@ -885,6 +1422,12 @@ public:
 
         nvrhi::ITexture* framebufferTexture = framebuffer->getDesc().colorAttachments[0].texture;
         m_CommandList->clearTextureFloat(framebufferTexture, nvrhi::AllSubresources, nvrhi::Color(0.f));
+
+        AdvanceLightProbeBake(m_CommandList);
+
+        // The scene graph refresh and render target setup have their own laps above; the buffer refresh
+        // and probe baking are only counted in the total
+        stageTimer.Lap();
         
         m_AmbientTop = m_ui.AmbientIntensity * m_ui.SkyParams.skyColor * m_ui.SkyParams.brightness;
         m_AmbientBottom = m_ui.AmbientIntensity * m_ui.SkyParams.groundColor * m_ui.SkyParams.brightness;
@@ -934,6 +1477,9 @@ public:
             }
         }
 
+        m_StageTimings.Shadows = stageTimer.Lap();
+
+        m_RenderTargets->BeginPass(m_CommandList, m_FramePasses.Clear);
         m_RenderTargets->Clear(m_CommandList);
 
         if (exposureResetRequired)
@@ -960,26 +1506,33 @@ public:
                 "GBufferFill",
                 m_ui.EnableMaterialEvents);
 
+            m_StageTimings.GBufferFill = stageTimer.Lap();
+
             nvrhi::ITexture* ambientOcclusionTarget = nullptr;
             if (m_ui.EnableSsao && m_SsaoPass)
             {
+                m_RenderTargets->BeginPass(m_CommandList, m_FramePasses.Ssao);
                 m_SsaoPass->Render(m_CommandList, m_ui.SsaoParams, *m_View);
                 ambientOcclusionTarget = m_RenderTargets->AmbientOcclusion;
             }
 
             DeferredLightingPass::Inputs deferredInputs;
             deferredInputs.SetGBuffer(*m_RenderTargets);
-            deferredInputs.ambientOcclusion = m_ui.EnableSsao ? m_RenderTargets->AmbientOcclusion : nullptr;
+            deferredInputs.ambientOcclusion = ambientOcclusionTarget;
             deferredInputs.ambientColorTop = m_AmbientTop;
             deferredInputs.ambientColorBottom = m_AmbientBottom;
             deferredInputs.lights = &m_Scene->GetSceneGraph()->GetLights();
             deferredInputs.lightProbes = m_ui.EnableLightProbe ? &m_LightProbes : nullptr;
             deferredInputs.output = m_RenderTargets->HdrColor;
 
+            m_RenderTargets->BeginPass(m_CommandList, m_FramePasses.DeferredLighting);
             m_DeferredLightingPass->Render(m_CommandList, *m_View, deferredInputs);
+
+            m_StageTimings.DeferredLighting = stageTimer.Lap();
         }
         else
         {
+            m_RenderTargets->BeginPass(m_CommandList, m_FramePasses.ForwardOpaque);
             RenderCompositeView(m_CommandList,
                 m_View.get(), m_ViewPrevious.get(),
                 *m_RenderTargets->ForwardFramebuffer,
@@ -989,10 +1542,14 @@ public:
                 forwardContext,
                 "ForwardOpaque",
                 m_ui.EnableMaterialEvents);
+
+            // Forward shading does the lighting in the same pass as the opaque geometry
+            m_StageTimings.DeferredLighting = stageTimer.Lap();
         }
 
         if(m_Pick)
         {
+            m_RenderTargets->BeginPass(m_CommandList, m_FramePasses.MaterialID);
             m_CommandList->clearTextureUInt(m_RenderTargets->MaterialIDs, nvrhi::AllSubresources, 0xffff);
 
             MaterialIDPass::Context materialIdContext;
@@ -1022,10 +1579,14 @@ public:
         }
 
         if (m_ui.EnableProceduralSky)
+        {
+            m_RenderTargets->BeginPass(m_CommandList, m_FramePasses.Sky);
             m_SkyPass->Render(m_CommandList, *m_View, *m_SunLight, m_ui.SkyParams);
+        }
 
         if (m_ui.EnableTranslucency)
         {
+            m_RenderTargets->BeginPass(m_CommandList, m_FramePasses.ForwardTransparent);
             RenderCompositeView(m_CommandList,
                 m_View.get(), m_ViewPrevious.get(),
                 *m_RenderTargets->ForwardFramebuffer,
@@ -1039,6 +1600,9 @@ public:
 
         nvrhi::ITexture* finalHdrColor = m_RenderTargets->HdrColor;
 
+        // Picking, sky and translucency are not broken out separately
+        stageTimer.Lap();
+
         if (m_ui.AntiAliasingMode == AntiAliasingMode::TEMPORAL)
         {
             if (m_PreviousViewsValid)
@@ -1046,14 +1610,20 @@ public:
                 m_TemporalAntiAliasingPass->RenderMotionVectors(m_CommandList, *m_View, *m_ViewPrevious);
             }
 
+            m_RenderTargets->BeginPass(m_CommandList, m_FramePasses.TemporalResolve);
             m_TemporalAntiAliasingPass->TemporalResolve(m_CommandList, m_ui.TemporalAntiAliasingParams, m_PreviousViewsValid, *m_View, *m_View);
 
             finalHdrColor = m_RenderTargets->ResolvedColor;
+
+            m_StageTimings.TemporalAA = stageTimer.Lap();
             
             if (m_ui.EnableBloom)
             {
+                m_RenderTargets->BeginPass(m_CommandList, m_FramePasses.Bloom);
                 m_BloomPass->Render(m_CommandList, m_RenderTargets->ResolvedFramebuffer, *m_View, m_RenderTargets->ResolvedColor, m_ui.BloomSigma, m_ui.BloomAlpha);
             }
+
+            m_StageTimings.Bloom = stageTimer.Lap();
             m_PreviousViewsValid = true;
         }
         else
@@ -1062,16 +1632,21 @@ public:
 
             if (m_RenderTargets->GetSampleCount() > 1)
             {
+                m_RenderTargets->BeginPass(m_CommandList, m_FramePasses.MsaaResolve);
                 m_CommandList->resolveTexture(m_RenderTargets->ResolvedColor, nvrhi::AllSubresources, m_RenderTargets->HdrColor, nvrhi::AllSubresources);
                 finalHdrColor = m_RenderTargets->ResolvedColor;
                 finalHdrFramebuffer = m_RenderTargets->ResolvedFramebuffer;
             }
 
+            m_StageTimings.TemporalAA = stageTimer.Lap();
+
             if (m_ui.EnableBloom)
             {
+                m_RenderTargets->BeginPass(m_CommandList, m_FramePasses.Bloom);
                 m_BloomPass->Render(m_CommandList, finalHdrFramebuffer, *m_View, finalHdrColor, m_ui.BloomSigma, m_ui.BloomAlpha);
             }
 
+            m_StageTimings.Bloom = stageTimer.Lap();
             m_PreviousViewsValid = false;
         }
 
@@ -1081,7 +1656,10 @@ public:
             toneMappingParams.eyeAdaptationSpeedUp = 0.f;
             toneMappingParams.eyeAdaptationSpeedDown = 0.f;
         }
+        m_RenderTargets->BeginPass(m_CommandList, m_FramePasses.ToneMapping);
         m_ToneMappingPass->SimpleRender(m_CommandList, toneMappingParams, *m_View, finalHdrColor);
+
+        m_StageTimings.ToneMapping = stageTimer.Lap();
         
         m_CommonPasses->BlitTexture(m_CommandList, framebuffer, m_RenderTargets->LdrColor, &m_BindingCache);
 
@@ -1105,15 +1683,18 @@ public:
             }
         }
 
-        m_CommandList->close();
-        GetDevice()->executeCommandList(m_CommandList);
-
         if (!m_ui.ScreenshotFileName.empty())
         {
-            SaveTextureToFile(GetDevice(), m_CommonPasses.get(), framebufferTexture, nvrhi::ResourceStates::RenderTarget, m_ui.ScreenshotFileName.c_str());
+            m_FrameCapture->Capture(m_CommandList, framebufferTexture, m_ui.ScreenshotFileName);
             m_ui.ScreenshotFileName = "";
         }
 
+        m_CommandList->close();
+        GetDevice()->executeCommandList(m_CommandList);
+
+        m_FrameCapture->EndFrame();
+        m_RenderTargetPool->EndFrame();
+
         if (m_Pick)
         {
             m_Pick = false;
@@ -1154,7 +1735,10 @@ public:
         m_TemporalAntiAliasingPass->AdvanceFrame();
         std::swap(m_View, m_ViewPrevious);
 
-        GetDeviceManager()->SetVsyncEnabled(m_ui.EnableVsync);
+        if (!g_Headless)
+            GetDeviceManager()->SetVsyncEnabled(m_ui.EnableVsync);
+
+        m_StageTimings.Total = frameTimer.Lap();
     }
 
     std::shared_ptr<ShaderFactory> GetShaderFactory()
@@ -1219,138 +1803,267 @@ public:
         }
     }
 
-    void RenderLightProbe(LightProbe& probe)
+    // Queues a bake of the probe at the current camera position. It is recorded over the next frames by
+    // AdvanceLightProbeBake; the probe is enabled once the bake is complete.
+    void RequestLightProbeBake(const std::shared_ptr<LightProbe>& probe)
+    {
+        float3 probePosition = GetActiveCamera().GetPosition();
+        if (m_ui.ActiveSceneCamera)
+            probePosition = m_ui.ActiveSceneCamera->GetWorldToViewMatrix().m_translation;
+
+        QueueLightProbeBake(probe, probePosition);
+    }
+
+    [[nodiscard]] const LightProbeBakeJob* GetLightProbeBake() const
+    {
+        return m_LightProbeBake.get();
+    }
+
+    void QueueLightProbeBake(const std::shared_ptr<LightProbe>& probe, float3 position)
+    {
+        // A new request for a queued probe replaces the old position
+        for (auto& queued : m_LightProbeBakeQueue)
+        {
+            if (queued->probe == probe)
+            {
+                queued->position = position;
+                return;
+            }
+        }
+
+        auto job = std::make_unique<LightProbeBakeJob>();
+        job->probe = probe;
+        job->position = position;
+        job->totalSteps = 6 + probe->specularMap->getDesc().mipLevels + 4;
+        m_LightProbeBakeQueue.push_back(std::move(job));
+    }
+
+    void CreateLightProbeBakeResources()
     {
         nvrhi::DeviceHandle device = GetDeviceManager()->GetDevice();
 
-        uint32_t environmentMapSize = 1024;
-        uint32_t environmentMapMipLevels = 8;
+        if (!m_ProbeColorTexture)
+        {
+            uint32_t environmentMapSize = 1024;
+            uint32_t environmentMapMipLevels = 8;
+
+            nvrhi::TextureDesc cubemapDesc;
+            cubemapDesc.arraySize = 6;
+            cubemapDesc.width = environmentMapSize;
+            cubemapDesc.height = environmentMapSize;
+            cubemapDesc.mipLevels = environmentMapMipLevels;
+            cubemapDesc.dimension = nvrhi::TextureDimension::TextureCube;
+            cubemapDesc.isRenderTarget = true;
+            cubemapDesc.format = nvrhi::Format::RGBA16_FLOAT;
+            cubemapDesc.initialState = nvrhi::ResourceStates::RenderTarget;
+            cubemapDesc.keepInitialState = true;
+            cubemapDesc.clearValue = nvrhi::Color(0.f);
+            cubemapDesc.useClearValue = true;
+            cubemapDesc.debugName = "LightProbeColor";
+
+            m_ProbeColorTexture = device->createTexture(cubemapDesc);
+
+            const nvrhi::Format depthFormats[] = {
+                nvrhi::Format::D24S8,
+                nvrhi::Format::D32,
+                nvrhi::Format::D16,
+                nvrhi::Format::D32S8 };
+
+            const nvrhi::FormatSupport depthFeatures =
+                nvrhi::FormatSupport::Texture |
+                nvrhi::FormatSupport::DepthStencil |
+                nvrhi::FormatSupport::ShaderLoad;
+
+            cubemapDesc.mipLevels = 1;
+            cubemapDesc.format = nvrhi::utils::ChooseFormat(GetDevice(), depthFeatures, depthFormats, std::size(depthFormats));
+            cubemapDesc.isTypeless = true;
+            cubemapDesc.initialState = nvrhi::ResourceStates::DepthWrite;
+            cubemapDesc.debugName = "LightProbeDepth";
+
+            m_ProbeDepthTexture = device->createTexture(cubemapDesc);
+
+            m_ProbeFramebuffer = std::make_shared<FramebufferFactory>(device);
+            m_ProbeFramebuffer->RenderTargets = { m_ProbeColorTexture };
+            m_ProbeFramebuffer->DepthTarget = m_ProbeDepthTexture;
+
+            // The main shadow map is rendered again every frame, so the bake keeps its own
+            m_ProbeShadowMap = std::make_shared<CascadedShadowMap>(device, 2048, 4, 0, m_ShadowMap->GetTexture()->getDesc().format);
+            m_ProbeShadowFramebuffer = std::make_shared<FramebufferFactory>(device);
+            m_ProbeShadowFramebuffer->DepthTarget = m_ProbeShadowMap->GetTexture();
+        }
 
-        nvrhi::TextureDesc cubemapDesc;
-        cubemapDesc.arraySize = 6;
-        cubemapDesc.width = environmentMapSize;
-        cubemapDesc.height = environmentMapSize;
-        cubemapDesc.mipLevels = environmentMapMipLevels;
-        cubemapDesc.dimension = nvrhi::TextureDimension::TextureCube;
-        cubemapDesc.isRenderTarget = true;
-        cubemapDesc.format = nvrhi::Format::RGBA16_FLOAT;
-        cubemapDesc.initialState = nvrhi::ResourceStates::RenderTarget;
-        cubemapDesc.keepInitialState = true;
-        cubemapDesc.clearValue = nvrhi::Color(0.f);
-        cubemapDesc.useClearValue = true;
+        if (!m_ProbeForwardPass)
+        {
+            // Faces are rendered one per step, so the single-pass cubemap path is not used
+            ForwardShadingPass::CreateParameters ForwardParams;
+            ForwardParams.singlePassCubemap = false;
+            m_ProbeForwardPass = std::make_unique<ForwardShadingPass>(device, m_CommonPasses);
+            m_ProbeForwardPass->Init(*m_ShaderFactory, ForwardParams);
+        }
 
-        nvrhi::TextureHandle colorTexture = device->createTexture(cubemapDesc);
+        if (!m_ProbeSkyPass)
+        {
+            CubemapView view;
+            view.SetArrayViewports(m_ProbeColorTexture->getDesc().width, 0);
+            view.UpdateCache();
+            m_ProbeSkyPass = std::make_unique<SkyPass>(device, m_ShaderFactory, m_CommonPasses, m_ProbeFramebuffer, view);
+        }
+    }
 
-        const nvrhi::Format depthFormats[] = {
-            nvrhi::Format::D24S8,
-            nvrhi::Format::D32,
-            nvrhi::Format::D16,
-            nvrhi::Format::D32S8 };
+    // Records the next steps of the current bake until the time budget is spent, at least one per frame
+    void AdvanceLightProbeBake(nvrhi::ICommandList* commandList)
+    {
+        if (!m_LightProbeBake && !m_LightProbeBakeQueue.empty())
+        {
+            m_LightProbeBake = std::move(m_LightProbeBakeQueue.front());
+            m_LightProbeBakeQueue.pop_front();
+        }
 
-        const nvrhi::FormatSupport depthFeatures =
-            nvrhi::FormatSupport::Texture |
-            nvrhi::FormatSupport::DepthStencil |
-            nvrhi::FormatSupport::ShaderLoad;
+        if (!m_LightProbeBake || !m_SunLight)
+            return;
 
-        cubemapDesc.mipLevels = 1;
-        cubemapDesc.format = nvrhi::utils::ChooseFormat(GetDevice(), depthFeatures, depthFormats, std::size(depthFormats));
-        cubemapDesc.isTypeless = true;
-        cubemapDesc.initialState = nvrhi::ResourceStates::DepthWrite;
+        CreateLightProbeBakeResources();
 
-        nvrhi::TextureHandle depthTexture = device->createTexture(cubemapDesc);
+        LightProbeBakeJob& job = *m_LightProbeBake;
+        job.frames++;
 
-        std::shared_ptr<FramebufferFactory> framebuffer = std::make_shared<FramebufferFactory>(device);
-        framebuffer->RenderTargets = { colorTexture };
-        framebuffer->DepthTarget = depthTexture;
+        StageTimer timer;
+        double elapsed = 0.0;
+        bool finished = false;
+        do
+        {
+            finished = RecordLightProbeBakeStep(commandList, job);
+            elapsed += timer.Lap();
+        } while (!finished && elapsed < double(m_ui.LightProbeBakeBudgetMs));
 
-        CubemapView view;
-        view.SetArrayViewports(environmentMapSize, 0);
+        job.recordingMs += elapsed;
+
+        if (finished)
+        {
+            log::info("Baked light probe %s over %u frames, %.2f ms of recording",
+                job.probe->name.c_str(), job.frames, job.recordingMs);
+
+            // Continuous baking follows changes of the sun and the scene
+            if (m_ui.ContinuousLightProbeBake)
+                QueueLightProbeBake(job.probe, job.position);
+
+            m_LightProbeBake = nullptr;
+        }
+    }
+
+    // Returns true when the bake is complete
+    bool RecordLightProbeBakeStep(nvrhi::ICommandList* commandList, LightProbeBakeJob& job)
+    {
         const float nearPlane = 0.1f;
         const float cullDistance = 100.f;
-        float3 probePosition = GetActiveCamera().GetPosition();
-        if (m_ui.ActiveSceneCamera)
-            probePosition = m_ui.ActiveSceneCamera->GetWorldToViewMatrix().m_translation;
 
-        view.SetTransform(dm::translation(-probePosition), nearPlane, cullDistance);
+        CubemapView view;
+        view.SetArrayViewports(m_ProbeColorTexture->getDesc().width, 0);
+        view.SetTransform(dm::translation(-job.position), nearPlane, cullDistance);
         view.UpdateCache();
-        
-        std::shared_ptr<SkyPass> skyPass = std::make_shared<SkyPass>(device, m_ShaderFactory, m_CommonPasses, framebuffer, view);
 
-        ForwardShadingPass::CreateParameters ForwardParams;
-        ForwardParams.singlePassCubemap = GetDevice()->queryFeatureSupport(nvrhi::Feature::FastGeometryShader);
-        std::shared_ptr<ForwardShadingPass> forwardPass = std::make_shared<ForwardShadingPass>(device, m_CommonPasses);
-        forwardPass->Init(*m_ShaderFactory, ForwardParams);
-        
-        nvrhi::CommandListHandle commandList = device->createCommandList();
-        commandList->open();
-        commandList->clearTextureFloat(colorTexture, nvrhi::AllSubresources, nvrhi::Color(0.f));
+        LightProbe& probe = *job.probe;
+        job.completedSteps++;
 
-        const nvrhi::FormatInfo& depthFormatInfo = nvrhi::getFormatInfo(depthTexture->getDesc().format);
-        commandList->clearDepthStencilTexture(depthTexture, nvrhi::AllSubresources, true, 0.f, depthFormatInfo.hasStencil, 0);
+        switch (job.step)
+        {
+        case LightProbeBakeJob::Step::Shadows: {
+            commandList->clearTextureFloat(m_ProbeColorTexture, nvrhi::AllSubresources, nvrhi::Color(0.f));
 
-        box3 sceneBounds = m_Scene->GetSceneGraph()->GetRootNode()->GetGlobalBoundingBox();
-        float zRange = length(sceneBounds.diagonal()) * 0.5f;
-        m_ShadowMap->SetupForCubemapView(*m_SunLight, view.GetViewOrigin(), cullDistance, zRange, zRange, m_ui.CsmExponent);
-        m_ShadowMap->Clear(commandList);
+            const nvrhi::FormatInfo& depthFormatInfo = nvrhi::getFormatInfo(m_ProbeDepthTexture->getDesc().format);
+            commandList->clearDepthStencilTexture(m_ProbeDepthTexture, nvrhi::AllSubresources, true, 0.f, depthFormatInfo.hasStencil, 0);
 
-        DepthPass::Context shadowContext;
+            box3 sceneBounds = m_Scene->GetSceneGraph()->GetRootNode()->GetGlobalBoundingBox();
+            float zRange = length(sceneBounds.diagonal()) * 0.5f;
+            m_ProbeShadowMap->SetupForCubemapView(*m_SunLight, view.GetViewOrigin(), cullDistance, zRange, zRange, m_ui.CsmExponent);
+            m_ProbeShadowMap->Clear(commandList);
 
-        RenderCompositeView(commandList,
-            &m_ShadowMap->GetView(), nullptr,
-            *m_ShadowFramebuffer,
-            m_Scene->GetSceneGraph()->GetRootNode(),
-            *m_OpaqueDrawStrategy,
-            *m_ShadowDepthPass,
-            shadowContext,
-            "ShadowMap");
+            DepthPass::Context shadowContext;
 
-        ForwardShadingPass::Context forwardContext;
+            RenderCompositeView(commandList,
+                &m_ProbeShadowMap->GetView(), nullptr,
+                *m_ProbeShadowFramebuffer,
+                m_Scene->GetSceneGraph()->GetRootNode(),
+                *m_OpaqueDrawStrategy,
+                *m_ShadowDepthPass,
+                shadowContext,
+                "LightProbeShadowMap");
 
-        std::vector<std::shared_ptr<LightProbe>> lightProbes;
-        forwardPass->PrepareLights(forwardContext, commandList, m_Scene->GetSceneGraph()->GetLights(), m_AmbientTop, m_AmbientBottom, lightProbes);
-
-        RenderCompositeView(commandList,
-            &view, nullptr,
-            *framebuffer,
-            m_Scene->GetSceneGraph()->GetRootNode(),
-            *m_OpaqueDrawStrategy,
-            *forwardPass,
-            forwardContext,
-            "ForwardOpaque");
-        
-        skyPass->Render(commandList, view, *m_SunLight, m_ui.SkyParams);
+            job.step = LightProbeBakeJob::Step::Face;
+            job.substep = 0;
+            return false;
+        }
 
-        RenderCompositeView(commandList,
-            &view, nullptr,
-            *framebuffer,
-            m_Scene->GetSceneGraph()->GetRootNode(),
-            *m_TransparentDrawStrategy,
-            *forwardPass,
-            forwardContext,
-            "ForwardTransparent");
+        case LightProbeBakeJob::Step::Face: {
+            const IView* faceView = view.GetChildView(ViewType::PLANAR, job.substep);
 
-        m_LightProbePass->GenerateCubemapMips(commandList, colorTexture, 0, 0, environmentMapMipLevels - 1);
+            // The lights are prepared against the probe's shadow map, then the sun gets the main one back
+            std::shared_ptr<IShadowMap> mainShadowMap = m_SunLight->shadowMap;
+            m_SunLight->shadowMap = m_ui.EnableShadows ? m_ProbeShadowMap : nullptr;
 
-        m_LightProbePass->RenderDiffuseMap(commandList, colorTexture, nvrhi::AllSubresources, probe.diffuseMap, probe.diffuseArrayIndex * 6, 0);
-        
-        uint32_t specularMapMipLevels = probe.specularMap->getDesc().mipLevels;
-        for (uint32_t mipLevel = 0; mipLevel < specularMapMipLevels; mipLevel++)
-        {
-            float roughness = powf(float(mipLevel) / float(specularMapMipLevels - 1), 2.0f);
-            m_LightProbePass->RenderSpecularMap(commandList, roughness, colorTexture, nvrhi::AllSubresources, probe.specularMap, probe.specularArrayIndex * 6, mipLevel);
+            ForwardShadingPass::Context forwardContext;
+            std::vector<std::shared_ptr<LightProbe>> lightProbes;
+            m_ProbeForwardPass->PrepareLights(forwardContext, commandList, m_Scene->GetSceneGraph()->GetLights(), m_AmbientTop, m_AmbientBottom, lightProbes);
+
+            m_SunLight->shadowMap = mainShadowMap;
+
+            RenderCompositeView(commandList,
+                faceView, nullptr,
+                *m_ProbeFramebuffer,
+                m_Scene->GetSceneGraph()->GetRootNode(),
+                *m_OpaqueDrawStrategy,
+                *m_ProbeForwardPass,
+                forwardContext,
+                "LightProbeForwardOpaque");
+
+            m_ProbeSkyPass->Render(commandList, *faceView, *m_SunLight, m_ui.SkyParams);
+
+            RenderCompositeView(commandList,
+                faceView, nullptr,
+                *m_ProbeFramebuffer,
+                m_Scene->GetSceneGraph()->GetRootNode(),
+                *m_TransparentDrawStrategy,
+                *m_ProbeForwardPass,
+                forwardContext,
+                "LightProbeForwardTransparent");
+
+            if (++job.substep == 6)
+                job.step = LightProbeBakeJob::Step::Mips;
+            return false;
         }
-        
-        m_LightProbePass->RenderEnvironmentBrdfTexture(commandList);
 
-        commandList->close();
-        device->executeCommandList(commandList);
-        device->waitForIdle();
-        device->runGarbageCollection();
+        case LightProbeBakeJob::Step::Mips:
+            m_LightProbePass->GenerateCubemapMips(commandList, m_ProbeColorTexture, 0, 0, m_ProbeColorTexture->getDesc().mipLevels - 1);
+            job.step = LightProbeBakeJob::Step::Diffuse;
+            return false;
+
+        case LightProbeBakeJob::Step::Diffuse:
+            m_LightProbePass->RenderDiffuseMap(commandList, m_ProbeColorTexture, nvrhi::AllSubresources, probe.diffuseMap, probe.diffuseArrayIndex * 6, 0);
+            job.step = LightProbeBakeJob::Step::Specular;
+            job.substep = 0;
+            return false;
+
+        case LightProbeBakeJob::Step::Specular: {
+            uint32_t specularMapMipLevels = probe.specularMap->getDesc().mipLevels;
+            float roughness = powf(float(job.substep) / float(specularMapMipLevels - 1), 2.0f);
+            m_LightProbePass->RenderSpecularMap(commandList, roughness, m_ProbeColorTexture, nvrhi::AllSubresources, probe.specularMap, probe.specularArrayIndex * 6, job.substep);
+
+            if (++job.substep == specularMapMipLevels)
+                job.step = LightProbeBakeJob::Step::Finish;
+            return false;
+        }
+
+        case LightProbeBakeJob::Step::Finish:
+        default: {
+            m_LightProbePass->RenderEnvironmentBrdfTexture(commandList);
 
-        probe.environmentBrdf = m_LightProbePass->GetEnvironmentBrdfTexture();
-        box3 bounds = box3(probePosition, probePosition).grow(10.f);
-        probe.bounds = frustum::fromBox(bounds);
-        probe.enabled = true;
+            probe.environmentBrdf = m_LightProbePass->GetEnvironmentBrdfTexture();
+            box3 bounds = box3(job.position, job.position).grow(10.f);
+            probe.bounds = frustum::fromBox(bounds);
+            probe.enabled = true;
+            return true;
+        }
+        }
     }
 };
 
@@ -1426,6 +2139,13 @@ protected:
         if (frameTime > 0.0)
             ImGui::Text("%.3f ms/frame (%.1f FPS)", frameTime * 1e3, 1.0 / frameTime);
 
+        const SceneLoadingTimings& loadingTimings = m_app->GetLoadingTimings();
+        if (loadingTimings.TexturesFinalized > 0.0)
+            ImGui::Text("Loaded in %.0f ms, interactive after %.0f ms, textures after %.0f ms",
+                loadingTimings.SceneLoaded, loadingTimings.FirstFrame, loadingTimings.TexturesFinalized);
+        else
+            ImGui::Text("Streaming textures: %d/%d", m_app->GetTextureCache()->GetNumberOfFinalizedTextures(), m_app->GetTextureCache()->GetNumberOfRequestedTextures());
+
         const std::string currentScene = m_app->GetCurrentSceneName();
         if (ImGui::BeginCombo("Scene", currentScene.c_str()))
         {
@@ -1535,20 +2255,26 @@ protected:
         }
 
         ImGui::TextUnformatted("Render Light Probe: ");
-        uint32_t probeIndex = 1;
         for (auto probe : m_app->GetLightProbes())
         {
             ImGui::SameLine();
             if (ImGui::Button(probe->name.c_str()))
             {
-                m_app->RenderLightProbe(*probe);
+                m_app->RequestLightProbeBake(probe);
             }
         }
+        ImGui::Checkbox("Continuous Probe Baking", &m_ui.ContinuousLightProbeBake);
+        ImGui::SliderFloat("Probe Bake Budget (ms)", &m_ui.LightProbeBakeBudgetMs, 0.f, 16.f);
+        if (const LightProbeBakeJob* bake = m_app->GetLightProbeBake())
+        {
+            std::string label = "Baking probe " + bake->probe->name;
+            ImGui::ProgressBar(bake->GetProgress(), ImVec2(-1.f, 0.f), label.c_str());
+        }
 
         if (ImGui::Button("Screenshot"))
         {
             std::string fileName;
-            if (FileDialog(false, "BMP files\0*.bmp\0All files\0*.*\0\0", fileName))
+            if (FileDialog(false, "PNG files\0*.png\0BMP files\0*.bmp\0EXR files\0*.exr\0All files\0*.*\0\0", fileName))
             {
                 m_ui.ScreenshotFileName = fileName;
             }
@@ -1613,6 +2339,34 @@ bool ProcessCommandLine(int argc, const char* const* argv, DeviceCreationParamet
         {
             g_PrintFormats = true;
         }
+        else if (!strcmp(argv[i], "-headless"))
+        {
+            g_Headless = true;
+        }
+        else if (!strcmp(argv[i], "-frames"))
+        {
+            g_BenchmarkFrames = std::stoi(argv[++i]);
+        }
+        else if (!strcmp(argv[i], "-camera-path"))
+        {
+            g_CameraPathFileName = argv[++i];
+        }
+        else if (!strcmp(argv[i], "-benchmark-output"))
+        {
+            g_BenchmarkOutputFileName = argv[++i];
+        }
+        else if (!strcmp(argv[i], "-frame-graph-report"))
+        {
+            g_FrameGraphReport = true;
+        }
+        else if (!strcmp(argv[i], "-scenegraph-benchmark"))
+        {
+            g_SceneGraphBenchmark = true;
+        }
+        else if (!strcmp(argv[i], "-animation-benchmark"))
+        {
+            g_AnimationBenchmark = true;
+        }
         else if (argv[i][0] != '-')
         {
             sceneName = argv[i];
@@ -1622,6 +2376,161 @@ bool ProcessCommandLine(int argc, const char* const* argv, DeviceCreationParamet
     return true;
 }
 
+// Renders a fixed number of frames into an offscreen framebuffer, without a window or UI,
+// and writes the CPU time of every RenderScene stage into a CSV file.
+bool RunHeadlessBenchmark(DeviceManager* deviceManager, FeatureDemo& demo, const DeviceCreationParameters& deviceParams)
+{
+    nvrhi::IDevice* device = deviceManager->GetDevice();
+
+    if (!demo.IsSceneLoaded())
+    {
+        log::error("The scene failed to load, cannot run the benchmark.");
+        return false;
+    }
+
+    CameraPath cameraPath;
+    if (!g_CameraPathFileName.empty())
+    {
+        NativeFileSystem fs;
+        if (!cameraPath.Load(fs, g_CameraPathFileName))
+        {
+            log::error("Cannot load the camera path from '%s'", g_CameraPathFileName.c_str());
+            return false;
+        }
+    }
+
+    auto colorDesc = nvrhi::TextureDesc()
+        .setWidth(deviceParams.backBufferWidth)
+        .setHeight(deviceParams.backBufferHeight)
+        .setFormat(deviceParams.swapChainFormat)
+        .setIsRenderTarget(true)
+        .setInitialState(nvrhi::ResourceStates::RenderTarget)
+        .setKeepInitialState(true)
+        .setClearValue(nvrhi::Color(0.f))
+        .setDebugName("OffscreenBackBuffer");
+    nvrhi::TextureHandle colorTexture = device->createTexture(colorDesc);
+
+    nvrhi::FramebufferHandle framebuffer = device->createFramebuffer(nvrhi::FramebufferDesc().addColorAttachment(colorTexture));
+
+    std::ofstream csv(g_BenchmarkOutputFileName);
+    if (!csv.is_open())
+    {
+        log::error("Cannot open '%s' for writing", g_BenchmarkOutputFileName.c_str());
+        return false;
+    }
+
+    csv << "frame,scene_graph_refresh_ms,shadows_ms,gbuffer_fill_ms,deferred_lighting_ms,temporal_aa_ms,bloom_ms,tone_mapping_ms,render_target_setup_ms,render_scene_ms,frame_ms\n";
+
+    // Use a fixed time step so that animations and the camera path are reproducible across runs
+    const float frameTime = 1.f / 60.f;
+
+    for (int frame = 0; frame < g_BenchmarkFrames; frame++)
+    {
+        StageTimer frameTimer;
+
+        if (!cameraPath.IsEmpty())
+            demo.SetScriptedCamera(cameraPath.Evaluate(float(frame) * frameTime));
+
+        demo.Animate(frameTime);
+        demo.Render(framebuffer);
+
+        // There is no swap chain to throttle the CPU, so wait for the GPU to keep frames independent
+        device->waitForIdle();
+        device->runGarbageCollection();
+
+        double frameMs = frameTimer.Lap();
+
+        const FrameStageTimings& timings = demo.GetStageTimings();
+        csv << frame << ','
+            << timings.SceneGraphRefresh << ','
+            << timings.Shadows << ','
+            << timings.GBufferFill << ','
+            << timings.DeferredLighting << ','
+            << timings.TemporalAA << ','
+            << timings.Bloom << ','
+            << timings.ToneMapping << ','
+            << timings.RenderTargetSetup << ','
+            << timings.Total << ','
+            << frameMs << '\n';
+    }
+
+    log::info("Wrote timings for %d frames into '%s'", g_BenchmarkFrames, g_BenchmarkOutputFileName.c_str());
+
+    return true;
+}
+
+// Placed size of a render target under the D3D12 rules: 64 KB pages, 4 MB for multisampled textures.
+// Drivers may pad further, so the report is an estimate.
+static uint64_t EstimateRenderTargetSize(const nvrhi::TextureDesc& desc)
+{
+    const uint64_t alignment = desc.sampleCount > 1 ? 4 * 1024 * 1024 : 64 * 1024;
+    const uint64_t size = uint64_t(desc.width) * desc.height * desc.sampleCount * nvrhi::getFormatInfo(desc.format).bytesPerBlock;
+    return (size + alignment - 1) / alignment * alignment;
+}
+
+// Checks the placement solver, then prints the render target memory with and without aliasing
+// for the default settings at 1080p and 4K in every anti-aliasing mode
+bool RunFrameGraphReport()
+{
+    std::string error = TestFrameGraphPlacement(10000, 1);
+    if (!error.empty())
+    {
+        log::error("Frame graph placement test failed: %s", error.c_str());
+        return false;
+    }
+    log::info("Frame graph placement test passed");
+
+    const uint2 resolutions[] = { uint2(1920, 1080), uint2(3840, 2160) };
+    const std::pair<AntiAliasingMode, const char*> modes[] = {
+        { AntiAliasingMode::NONE, "None" },
+        { AntiAliasingMode::TEMPORAL, "TAA" },
+        { AntiAliasingMode::MSAA_2X, "MSAA 2x" },
+        { AntiAliasingMode::MSAA_4X, "MSAA 4x" },
+        { AntiAliasingMode::MSAA_8X, "MSAA 8x" }
+    };
+
+    log::info("Resolution  Mode      Unaliased MB  Aliased MB  Saved");
+
+    for (const uint2& resolution : resolutions)
+    {
+        for (const auto& [mode, modeName] : modes)
+        {
+            // Same settings as the UI defaults; MSAA forces forward shading without SSAO
+            FramePassConfig config;
+            config.sampleCount = GetSampleCount(mode);
+            config.temporalAA = mode == AntiAliasingMode::TEMPORAL;
+            config.deferredShading = config.sampleCount == 1;
+            config.ssao = config.deferredShading;
+
+            FrameGraph graph;
+            AddFrameResources(graph);
+            DeclareFramePasses(graph, config);
+
+            const auto descs = RenderTargets::GetTextureDescs(resolution, config.sampleCount, true);
+            for (uint32_t resource = 0; resource < FrameResource_Count; resource++)
+            {
+                const nvrhi::TextureDesc& desc = descs[resource];
+                graph.SetResourceSize(resource, EstimateRenderTargetSize(desc), desc.sampleCount > 1 ? 4 * 1024 * 1024 : 64 * 1024);
+            }
+            graph.PlaceResources();
+
+            error = graph.ValidatePlacement();
+            if (!error.empty())
+            {
+                log::error("Invalid placement for %s at %ux%u: %s", modeName, resolution.x, resolution.y, error.c_str());
+                return false;
+            }
+
+            const double unaliased = double(graph.GetUnaliasedSize()) / (1024.0 * 1024.0);
+            const double aliased = double(graph.GetHeapSize()) / (1024.0 * 1024.0);
+            log::info("%4ux%-4u   %-8s  %12.1f  %10.1f  %4.1f%%",
+                resolution.x, resolution.y, modeName, unaliased, aliased, 100.0 * (1.0 - aliased / unaliased));
+        }
+    }
+
+    return true;
+}
+
 #ifdef _WIN32
 int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLine, int nCmdShow)
 {
@@ -1648,13 +2557,43 @@ int main(int __argc, const char* const* __argv)
         log::error("Failed to process the command line.");
         return 1;
     }
+
+    if (g_FrameGraphReport)
+        return RunFrameGraphReport() ? 0 : 1;
+
+    if (g_SceneGraphBenchmark)
+    {
+#ifdef DONUT_WITH_TASKFLOW
+        tf::Executor executor;
+        return RunTransformHierarchyBenchmark(&executor) == 0 ? 0 : 1;
+#else
+        return RunTransformHierarchyBenchmark(nullptr) == 0 ? 0 : 1;
+#endif
+    }
+
+    // The synthetic rigs run up front; with a scene file, its animations are benchmarked once it has loaded
+    if (g_AnimationBenchmark)
+    {
+#ifdef DONUT_WITH_TASKFLOW
+        tf::Executor executor;
+        int violations = RunSyntheticAnimationBenchmark(&executor);
+#else
+        int violations = RunSyntheticAnimationBenchmark(nullptr);
+#endif
+        if (violations != 0 || sceneName.empty())
+            return violations == 0 ? 0 : 1;
+    }
     
     DeviceManager* deviceManager = DeviceManager::Create(api);
     const char* apiString = nvrhi::utils::GraphicsAPIToString(deviceManager->GetGraphicsAPI());
 
     std::string windowTitle = "Donut Feature Demo (" + std::string(apiString) + ")";
 
-    if (!deviceManager->CreateWindowDeviceAndSwapChain(deviceParams, windowTitle.c_str()))
+    bool deviceCreated = g_Headless
+        ? deviceManager->CreateHeadlessDevice(deviceParams)
+        : deviceManager->CreateWindowDeviceAndSwapChain(deviceParams, windowTitle.c_str());
+
+    if (!deviceCreated)
 	{
         log::error("Cannot initialize a %s graphics device with the requested parameters", apiString);
 		return 1;
@@ -1686,18 +2625,31 @@ int main(int __argc, const char* const* __argv)
         }
     }
 
+    int exitCode = 0;
+
     {
         UIData uiData;
 
         std::shared_ptr<FeatureDemo> demo = std::make_shared<FeatureDemo>(deviceManager, uiData, sceneName);
-        std::shared_ptr<UIRenderer> gui = std::make_shared<UIRenderer>(deviceManager, demo, uiData);
 
-        gui->Init(demo->GetShaderFactory());
+        if (g_Headless)
+        {
+            uiData.ShowUI = false;
 
-        deviceManager->AddRenderPassToBack(demo.get());
-        deviceManager->AddRenderPassToBack(gui.get());
+            if (!RunHeadlessBenchmark(deviceManager, *demo, deviceParams))
+                exitCode = 1;
+        }
+        else
+        {
+            std::shared_ptr<UIRenderer> gui = std::make_shared<UIRenderer>(deviceManager, demo, uiData);
 
-        deviceManager->RunMessageLoop();
+            gui->Init(demo->GetShaderFactory());
+
+            deviceManager->AddRenderPassToBack(demo.get());
+            deviceManager->AddRenderPassToBack(gui.get());
+
+            deviceManager->RunMessageLoop();
+        }
     }
 
     deviceManager->Shutdown();
@@ -1706,5 +2658,5 @@ int main(int __argc, const char* const* __argv)
 #endif
     delete deviceManager;
 	
-	return 0;
+	return exitCode;
 }